@@ -17,6 +17,8 @@ typedef unsigned int u_long128 __attribute__((mode(TI)));
 
 typedef float f32;
 
+// Host tools (tools/libxff) are built with XFF_HOST and take varargs from the host libc.
+#ifndef XFF_HOST
 #define va_start(v, l) __builtin_stdarg_start((v), l)
 #define va_end __builtin_va_end
 #define va_arg __builtin_va_arg
@@ -24,6 +26,9 @@ typedef float f32;
 
 typedef __builtin_va_list __gnuc_va_list;
 typedef __gnuc_va_list va_list;
+#else
+#include <stdarg.h>
+#endif
 
 #define UNK_TYPE s32
 #define UNK_PTR void *
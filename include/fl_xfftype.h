@@ -1,3 +1,6 @@
+#ifndef FL_XFFTYPE_H
+#define FL_XFFTYPE_H
+
 #include "common.h"
 
 /*
@@ -12,6 +15,15 @@ The old one in xffType.h is mostly deprecated, but should be kept for reference,
 
 */
 
+// Pointer fields are 32-bit EE addresses. On the EE they are declared as real pointers,
+// host tools (tools/libxff, built with XFF_HOST) see them as u32 guest addresses so the
+// structs keep their on-disc layout on 64-bit hosts.
+#ifdef XFF_HOST
+#define XFF_PTR(type) u32
+#else
+#define XFF_PTR(type) type *
+#endif
+
 // Single entries are also called "Tab" so that the naming is more consistent, otherwise things like struct t_xffSymTab would be called struct t_xffSymEnt.
 
 // For resource files
@@ -35,7 +47,7 @@ enum
 struct t_xffSymEnt
 {
     s32 nameOffs;    // 00  Name string offset in Symbol Strings Table - symTabStr.
-    void *addr;      // 04  Symbol address - initially relative(never read by parser) and overwritten to absolute
+    XFF_PTR(void) addr; // 04  Symbol address - initially relative(never read by parser) and overwritten to absolute
     u32 size;        // 08  Symbol size in bytes
     u8 type : 4;     // 0C 3:0  info = Type & Binding attributes
     u8 bindAttr : 4; // 0C 7:4	 Binding attributes
@@ -209,10 +221,10 @@ struct t_xffSymStrEnt {
 struct t_xffSectEnt
 {
     // 00 set by SectionDecoder
-    void *memPt; // 00 This is the actual pointer to the section that should be used when accessing it in RAM. If the section was set to be moved, or it is a "nobits" (.bss) section and does not exist in the XFF file, then this is set to its allocated location in RAM, while filPt below is NULL (AFAIK). memAddr_Abs;       //00 points to start of section  or =0 if sect. has no data - NOT ENTIRELY CORRECT - CHECK CONDITION
+    XFF_PTR(void) memPt; // 00 This is the actual pointer to the section that should be used when accessing it in RAM. If the section was set to be moved, or it is a "nobits" (.bss) section and does not exist in the XFF file, then this is set to its allocated location in RAM, while filPt below is NULL (AFAIK). memAddr_Abs;       //00 points to start of section  or =0 if sect. has no data - NOT ENTIRELY CORRECT - CHECK CONDITION
     // 04 absolute Start = startOfFile + (1C)RelativeSectStart
     // Set by relocator
-    void *filePt; // 04	This is an absolute pointer to the section *in the file* as it is in RAM.  This seems to be the actual absolute section start addr, while the above is unknown.  u32 fileAddr_Abs;    //04 poins to start of section if real or start of file if sect. has no data - absolute in RAM
+    XFF_PTR(void) filePt; // 04	This is an absolute pointer to the section *in the file* as it is in RAM.  This seems to be the actual absolute section start addr, while the above is unknown.  u32 fileAddr_Abs;    //04 poins to start of section if real or start of file if sect. has no data - absolute in RAM
     int size;     // 08 size in bytes
     int align;    // 0C alignment in bytes  This alignment is always fulfilled on loading (by allocating new memory for the section if the dile alignment is i,nsufficient) but if flags(u14) is set, then the maximum alignment of 0x100 is used.
     // 10 Type:
@@ -295,8 +307,8 @@ struct t_xffRelocEnt
     u32 type;                       // 00 usualy 9  or 4 (only 9, 4 are supported) - 9=rel<section>  4=rela<section> - contains addEnd - the instr/data table for them is different
     u32 nrEnt;                      // 04 Number of entries in this table.
     u32 sect;                       // 08 section to which this table of reloc. belongs to
-    struct t_xffRelocAddrEnt *addr; // 0C
-    struct t_xffRelocInstEnt *inst; // 10
+    XFF_PTR(struct t_xffRelocAddrEnt) addr; // 0C
+    XFF_PTR(struct t_xffRelocInstEnt) inst; // 10
     u32 addr_Rel;                   // 14 relative of 0C
     u32 inst_Rel;                   // 18 relative of 10
 }; // = 0x1C
@@ -589,25 +601,25 @@ struct t_xffEntPntHdr
     u32 nextXffHdr;  // 08   0   offset? ->? Pointer to another XFF header with Tab7 within file XXXNOT:version?
     s32 specSectNrE; // 0C   6=exe; 9=script/text? 0xF (iosKernel = ?) //type;  read as u8 - 001B44D0
     // 10 writen by DecodeSection_sub_100278
-    void *entryPnt; // 10   entry point function addr. Written on load, before that is =0
+    XFF_PTR(void) entryPnt; // 10   entry point function addr. Written on load, before that is =0
     //(about the following:) +0x00010000 ??
     u32 stack_Rel;                    // 14 Stack relative to start of file addr. (points right after the end of file) - it shows its size, but maybe if there are multiple XFF headers, it will only show the offset to the next header.
-    void *stack;                      // 18   MAY ALSO BE "NEXT FILE START" Stack absolute addr. (=0 before load)
+    XFF_PTR(void) stack;                      // 18   MAY ALSO BE "NEXT FILE START" Stack absolute addr. (=0 before load)
     int impSymIxsNrE;                 // 1C   size of the following table [words] = [entries]
-    struct t_xffImpSymIxs *impSymIxs; // 20	Indices of imported symbols.
+    XFF_PTR(struct t_xffImpSymIxs) impSymIxs; // 20	Indices of imported symbols.
 
     int symTabNrE; // 24   size of the Symbol table [entries] (1 entry = 4 words = 16 bytes)
     // The symTabNrE contains both expSymTabNrE and SpecSectNr(with processing: if ( == 0) =2; else +=1) and "normal" symbols, so to get the normal symbols, the above two have to be subtracted from symTabNrE.
     // handled (also) by RelocateSelfSymbol_sub_1018b8
-    struct t_xffSymEnt *symTab;        // 28  NOT?: Symbol table offset (before loading = from start of file), after load = absolute
-    char *symTabStr;                   // 2C   Strings used by the entries in the Symbol Table
-    struct t_xffSectEnt *sectTab;      // 30   Section header table? - "xff2-table" - see below
-    struct t_xffSymRelEnt *symRelTab;  // 34   Relative addr. of each entry in symTab based on (offset from the start) its section. Same indexing as SymTab. some table of strange values - mostly middle numbers
+    XFF_PTR(struct t_xffSymEnt) symTab;        // 28  NOT?: Symbol table offset (before loading = from start of file), after load = absolute
+    XFF_PTR(char) symTabStr;                   // 2C   Strings used by the entries in the Symbol Table
+    XFF_PTR(struct t_xffSectEnt) sectTab;      // 30   Section header table? - "xff2-table" - see below
+    XFF_PTR(struct t_xffSymRelEnt) symRelTab;  // 34   Relative addr. of each entry in symTab based on (offset from the start) its section. Same indexing as SymTab. some table of strange values - mostly middle numbers
     int relocTabNrE;                   // 38   Size in entries of the Relocation Table (contains 7-word structs, each of which points to two tables - for addr and instr.
-    struct t_xffRelocEnt *relocTab;    // 3C   Array of per-section Relocation tables.  some table headers ... see "7-entry table"   "Tab7"
+    XFF_PTR(struct t_xffRelocEnt) relocTab;    // 3C   Array of per-section Relocation tables.  some table headers ... see "7-entry table"   "Tab7"
     int sectNrE;                       // 40   Number of Sections (entries)  //ssNameSz;  Special Sections Names Table Size [entries] - The zero section included.
-    struct t_xffSsNmOffs *ssNamesOffs; // 44   Special Sections Names offsets table (from the following word)   //AKA xSectStrPnt_t
-    char *ssNamesBase;                 // 48   Base addr. for the special sections' strings (names). The offset from this of each one is set by the values in array ssNamesOffs.
+    XFF_PTR(struct t_xffSsNmOffs) ssNamesOffs; // 44   Special Sections Names offsets table (from the following word)   //AKA xSectStrPnt_t
+    XFF_PTR(char) ssNamesBase;                 // 48   Base addr. for the special sections' strings (names). The offset from this of each one is set by the values in array ssNamesOffs.
     // From here the relative, to the start of file, offsets start:
     u32 entryPnt_Rel;    // 4C  Relative offset from the start of a section. In Executable files, the entry point is in the .text section, while in data files, it depends on the fileType (usually .rodada or .data).
     u32 impSymIxs_Rel;   // 50
@@ -627,3 +639,5 @@ struct t_xffEntPntHdr
 in DBGMGR there where absolute addresses apper on loading,
 the values from the start of the file are +0x40010000 and some are +0x00010000
 */
+
+#endif /* FL_XFFTYPE_H */
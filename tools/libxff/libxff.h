@@ -0,0 +1,744 @@
+#ifndef LIBXFF_H
+#define LIBXFF_H
+
+/*
+Host-native port of the XFF loading path in src/os/loaderSys.c.
+
+Loaded images live in an XffArena, a host mapping that stands in for EE memory.
+All pointer fields of the fl_xfftype.h structs hold 32-bit guest addresses inside the
+arena (XFF_HOST makes them u32), so an image relocated here is byte-identical to what
+the EE loader produces at the same heap base.
+*/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "common.h"
+#include "fl_xfftype.h"
+
+// Relocation types, see the notes above t_xffRelocEnt in fl_xfftype.h
+enum
+{
+    XFF_R_NONE = 0,
+    XFF_R_32 = 2,   // instr + addr
+    XFF_R_26 = 4,   // ((addr / 4) & 0x03FFFFFF) + instr
+    XFF_R_HI16 = 5, // paired with the following XFF_R_LO16
+    XFF_R_LO16 = 6, // ((instr + addr) & 0xFFFF) | (instr & 0xFFFF0000)
+};
+
+// t_xffRelocEnt.type of an extern table XffPackRelocations() rewrote, see xffRelocPack.c
+#define XFF_RELOC_TYPE_PACKED (0x70)
+
+// Section types handled by DecodeSection()
+#define XFF_SECT_PROGBITS (1)
+#define XFF_SECT_OVERLAYDATA (0x7FFFF420)
+#define XFF_SECT_NOBITS (8)
+
+// t_xffSymEnt.sect of absolute symbols, their address is taken from symRelTab as is
+#define XFF_SECT_ABS (0xFFF1)
+#define XFF_STB_GLOBAL (1)
+
+// Alignment used by mallocAlign0x100Mempool for sections with flags != 0
+#define XFF_MAX_ALIGN (0x100)
+
+// File images are placed at this alignment unless XffLoader.fileAlign says otherwise
+#define XFF_FILE_ALIGN_DEFAULT (0x10)
+
+// Default guest layout, roughly where the EE loader heap starts (D_0013A110)
+#define XFF_ARENA_DEFAULT_BASE (0x00200000)
+#define XFF_ARENA_DEFAULT_SIZE (0x01E00000)
+
+enum
+{
+    XFF_OK = 0,
+    XFF_ERR_IO = -1,
+    XFF_ERR_FORMAT = -2,
+    XFF_ERR_NOMEM = -3,
+    XFF_ERR_FULL = -4,
+    XFF_ERR_NOENT = -5,
+};
+
+// Optional extension blocks appended after an XFF image:
+//   [image] [XffExtHdr + data, 4-aligned]... [XffExtTrailer]
+// The trailer sits at the very end of the file and gives the size of everything after
+// the image, itself included. Loaders that don't know about it never look past the image.
+#define XFF_EXT_MAGIC (0x78666678) // "xffx"
+
+struct XffExtHdr
+{
+    u32 tag;
+    u32 size; // data bytes following this header
+};
+
+struct XffExtTrailer
+{
+    u32 magic;
+    u32 size;
+};
+
+#define XFF_EXT_PRELINK (0x4B4C5058) // "XPLK"
+
+// XFF_EXT_PRELINK: the image was relocated for this layout by xffprelink. Section
+// contents are already patched and imported symbols carry their resolved address in
+// symTab[].addr, so a load that reproduces the layout can skip relocation.
+struct XffPrelinkInfo
+{
+    u32 base;    // file address the image was prelinked at
+    u32 sectNrE;
+    u32 memPt[]; // memPt of every section after DecodeSection()
+};
+
+#define XFF_EXT_HASH (0x48534858) // "XHSH"
+
+// XFF_EXT_HASH: hashes of the imports and a bloom filtered hash table of the exports, so
+// imports resolve without hashing or scanning names. Layout in xffHash.c.
+struct XffHashHdr
+{
+    u32 symTabNrE; // of the image it was built for
+    u32 impNrE;
+    u32 exportNrE;
+    u32 bucketNrE; // power of two
+    u32 bloomNrE;  // 32-bit words, power of two
+    u32 bloomShift;
+};
+
+struct XffHashEnt
+{
+    u32 hash; // XffStrHash() of the name
+    u32 symIx;
+};
+
+#define XFF_EXT_RELPLAN (0x4C505258) // "XRPL"
+#define XFF_RELPLAN_GROUP_SPAN (0x1000) // section bytes a plan group patches, at most
+#define XFF_RELPLAN_GROUP_SLOTS (128)   // distinct symbols of a plan group, at most
+
+// XFF_EXT_RELPLAN: the relocation tables compiled into per-table plans, cut into groups
+// of sites small enough for the EE data cache, entries grouped by type and sorted by
+// site within a group. Layout in xffRelPlan.c.
+struct XffRelPlanHdr
+{
+    u32 relocTabNrE; // of the image it was built for
+    u32 symTabNrE;
+    u32 groupNrE;
+    u32 slotNrE;
+    u32 entNrE;
+};
+
+struct XffRelPlanTab
+{
+    u32 nrEnt;      // of the relocation table
+    u32 fileOrder;  // applied from the table as is, the plan has nothing for it
+    u32 firstGroup;
+    u32 groupNrE;
+};
+
+struct XffRelPlanGroup
+{
+    u32 firstSlot;
+    u32 slotNrE;
+    u32 firstEnt;
+    u32 kindNrE[4]; // R_32, R_26, HI16, LO16 entries in that order
+};
+
+struct XffRelPlanEnt
+{
+    u32 offs;   // site in the section
+    u16 slot;   // symbol, index into the dense array of the group
+    u16 op;     // HI16: upper half of the instruction
+    u32 addend; // HI16: (inst << 16) + low half of its LO16, else the instruction
+};
+
+// Lazy binding, see xffLazy.c. An import that points at its stub and wasn't called yet
+// has t_xffSymEnt.unk0D set to this; 1 = bound, 0 = nobody exports it.
+#define XFF_SYM_LAZY (2)
+#define XFF_LAZY_STUB_SIZE (16) // move $t7, $ra / jal resolver / ori $at, $zero, impIx / nop
+
+struct XffArena
+{
+    u8 *host;   // host mapping of guest address 'base'
+    u32 base;   // guest address of host[0]
+    u32 size;   // size of the mapping in bytes
+    u32 heapPt; // bump heap pointer, see XffSetHeapStartPoint()
+    u32 zeroPt; // zero watermark: memory from here up has never been handed out
+};
+
+struct XffLoadStats
+{
+    u32 files;
+    u32 sections;
+    u32 relocs;      // relocation entries applied
+    u32 imports;     // imported symbols looked up
+    u32 unresolved;  // imported symbols that no loaded module exports
+    u64 bytesRead;   // file bytes brought into the arena
+    u64 bytesCopied; // section bytes copied by DecodeSection()
+    u64 bytesZeroed; // nobits bytes cleared by DecodeSection()
+    u64 bytesInflated; // bytes decompressed out of packed containers
+    u64 bytesZeroSkipped; // nobits bytes known to be zero already, see XffLoader.lazyZero
+    u32 prelinked;     // prelinked images loaded without relocation
+    u32 prelinkMisses; // prelinked images whose layout didn't match
+    u32 relocBytesRaw;    // extern relocation table bytes replaced by packed ones
+    u32 relocBytesPacked; // bytes of the packed tables
+    u32 strBytesFreed;    // symTabStr bytes given back to the region heap, the names being in the string pool
+    u32 hashTabs;         // images loaded with their XFF_EXT_HASH block
+    u32 hashMisses;       // XFF_EXT_HASH blocks that didn't match their image
+    u32 relPlans;         // images relocated from their XFF_EXT_RELPLAN block
+    u32 relPlanMisses;    // XFF_EXT_RELPLAN blocks that didn't match their image
+    u32 lazyStubs;        // imports given a stub instead of being bound at load time
+    u32 lazyBound;        // of them, bound by their first call
+    u32 lazyMisses;       // first calls to an import nobody exports
+};
+
+struct XffModule
+{
+    struct XffModule *next;
+    char *name;
+    u32 seq; // load order, newer modules shadow exports of older ones
+    u32 fileAddr; // guest address of the file image
+    u32 fileSize;
+    struct t_xffEntPntHdr *xffEp;
+    s32 hasLocalRelocs; // DisposeRelocationElement() wasn't run, the module can be moved
+    u32 sectCopied;     // sections DecodeSection() copied out of the file image
+    u32 bytesCopied;
+    struct XffRegion *region; // memory of the module when the loader uses a region heap
+    u32 hashTab; // guest address of its XFF_EXT_HASH block, 0 = none
+    u32 lazyStubs; // guest address of its lazy binding stubs, 0 = none
+    u32 lazyNrE;
+};
+
+// Global export index: open addressing with linear probing, keyed on the name and its
+// precomputed hash. Modules register on load and are removed by XffFreeDecodedSection().
+struct XffSymIndexEnt
+{
+    u32 hash; // 0 = empty slot, 1 = deleted
+    u32 shadowed; // a newer module exports the same name
+    const char *name;
+    struct t_xffSymEnt *sym;
+    struct XffModule *mod;
+};
+
+struct XffSymIndex
+{
+    struct XffStrPool *pool;  // names are interned there and compared by pointer, NULL = strcmp
+    struct XffSymIndexEnt *ent;
+    u32 cap;  // power of two
+    u32 live; // entries in use
+    u32 used; // entries in use or deleted
+};
+
+// Symbol name pool, see xffStrPool.c
+#define XFF_STRPOOL_CHUNK (0x10000)
+#define XFF_STRPOOL_NONE (0xFFFFFFFF) // no handle
+
+struct XffStrPoolEnt
+{
+    u32 hash;
+    u32 handle; // 0 = empty slot
+};
+
+struct XffStrPool
+{
+    u8 **chunk;
+    u32 chunkNrE;
+    u32 used;  // bytes used in the last chunk
+    u32 bytes; // bytes of the names, hash words included
+    struct XffStrPoolEnt *ent;
+    u32 cap;   // power of two
+    u32 live;  // names interned
+    u32 lookups; // XffStrPoolIntern() calls
+    u32 added;   // of them, names that were new
+};
+
+static inline const char *XffStrPoolName(const struct XffStrPool *pool, u32 handle)
+{
+    return (const char *)pool->chunk[handle / XFF_STRPOOL_CHUNK] + handle % XFF_STRPOOL_CHUNK;
+}
+
+// XffStrHash() of the name, stored in front of it
+static inline u32 XffStrPoolHash(const struct XffStrPool *pool, u32 handle)
+{
+    u32 hash;
+
+    memcpy(&hash, XffStrPoolName(pool, handle) - 4, 4);
+    return hash;
+}
+
+// Region heap, see xffRegion.c
+#define XFF_REGION_CHUNK_DEFAULT (0x10000)
+
+struct XffRegionChunk
+{
+    struct XffRegionChunk *next;
+    u32 addr;
+    u32 size;
+    u32 used;  // bump offset inside the chunk
+    u32 align; // strictest alignment handed out from it
+};
+
+struct XffRegion
+{
+    struct XffRegion *next;
+    struct XffRegionChunk *chunks; // newest first
+    char name[28];
+    u32 allocs;
+    u32 used;     // bytes handed out
+    u32 peak;     // most bytes handed out at once
+    u32 reserved; // bytes of the chunks, used plus alignment and chunk tails
+};
+
+struct XffRegionHeap
+{
+    struct XffArena *ar;
+    struct XffFreeExtent *free; // address order
+    struct XffRegion *regions;
+    u32 start;
+    u32 end;
+    u32 chunkSize;
+    u32 highPt; // highest address ever handed out
+};
+
+struct XffRegionHeapStats
+{
+    u32 heapSize;
+    u32 highWater;   // bytes from the heap start to the highest address ever handed out
+    u32 freeBytes;
+    u32 freeExtents;
+    u32 largestFree;
+    u32 regions;
+    u32 reserved;
+    u32 used;
+};
+
+// Loader phases recorded by the profiler, see xffProf.c
+enum
+{
+    XFF_PHASE_READ,     // file brought into the heap
+    XFF_PHASE_HEADER,   // RelocateElfInfoHeader()
+    XFF_PHASE_DECODE,   // DecodeSection()
+    XFF_PHASE_SELFSYM,  // RelocateSelfSymbol()
+    XFF_PHASE_IMPORTS,  // import binding
+    XFF_PHASE_RELOC,    // RelocateCode(), ResolveRelocation() for every entry
+    XFF_PHASE_DISPOSE,  // DisposeRelocationElement()
+    XFF_PHASE_ENTRY,    // jump to the entry point, recorded by whoever makes it
+    XFF_PHASE_NRE,
+};
+
+struct XffProfEvent
+{
+    u64 begin; // ns, XffProfNow()
+    u32 dur;   // ns
+    u16 phase;
+    u16 boot;  // XffLoaderReset() calls since the profiler was attached
+    u32 seq;   // load sequence number of the module
+    u32 count; // sections, symbols or entries handled
+    u32 bytes; // bytes read, copied or cleared
+    char module[28];
+};
+
+struct XffProfile
+{
+    struct XffProfEvent *ev;
+    u32 cap;  // power of two
+    u64 head; // events ever recorded, the ring holds the last 'cap' of them
+    u16 boot;
+    u32 seq;
+    char module[28];
+};
+
+struct XffProfTotal
+{
+    u32 events;
+    u64 ns;
+    u32 minNs;
+    u32 maxNs;
+    u64 count;
+    u64 bytes;
+};
+
+struct XffLoader
+{
+    struct XffArena arena;
+    struct XffModule *modules; // most recently loaded first
+    u32 loadSeq;
+    struct XffLoadStats stats;
+    struct XffSymIndex *symIndex; // NULL = linear export search
+    s32 noPrelink;                // ignore XFF_EXT_PRELINK, always relocate
+    struct XffRelocPool *relocPool; // NULL = serial RelocateCode()
+    u32 relocChunk;                 // entries per parallel relocation job
+    s32 keepLocalRelocs;            // keep the local relocation tables for XffMoveSections()
+    u32 fileAlign;                  // alignment of file images in the heap
+    s32 lazyZero;                   // only clear nobits memory below the arena zero watermark
+    struct XffProfile *prof;        // NULL = no phase profiling
+    struct XffRegionHeap *regions;  // NULL = bump heap, see XffLoaderUseRegions()
+    struct XffRegion *region;       // region the default allocators hand out from
+    u32 trimmed;                    // file image bytes given back after DisposeRelocationElement()
+    s32 packRelocs;                 // keep the extern relocation tables packed, see xffRelocPack.c
+    struct XffStrPool *strPool;     // NULL = names stay in symTabStr, see XffLoaderUseStrPool()
+    u32 strTabSize;                 // symTabStr bytes of the image being loaded whose names went to the pool
+    s32 noHash;                     // ignore XFF_EXT_HASH, hash and compare the names
+    u32 hashTab;                    // XFF_EXT_HASH block of the image being loaded, see XffAddModule()
+    s32 noRelPlan;                  // ignore XFF_EXT_RELPLAN, relocate from the tables
+    const struct XffRelPlanHdr *relPlan; // XFF_EXT_RELPLAN block of the image being loaded, see XffLinkImage()
+    u32 *relPlanVals;               // XffApplyRelPlan() scratch, grown to the largest plan group
+    u32 relPlanValNrE;
+    u32 lazyResolver;               // guest address the stubs call, 0 = bind every import at load
+    u32 lazyStubs;                  // stubs of the image being loaded, see XffAddModule()
+    u32 lazyNrE;
+
+    // Section allocators handed to XffDecodeSection(), mallocAlignMempool and
+    // mallocAlign0x100Mempool on the EE. Both return a guest address or 0.
+    u32 (*mallocAlign)(struct XffLoader *ldr, s32 sz, s32 align);
+    u32 (*mallocMaxAlign)(struct XffLoader *ldr, s32 sz);
+    void (*ldrDbgPrintf)(char *fmt, ...);
+};
+
+// Guest address <-> host pointer
+static inline void *XffPtr(const struct XffArena *ar, u32 addr)
+{
+    return ar->host + (addr - ar->base);
+}
+
+static inline u32 XffAddr(const struct XffArena *ar, const void *pt)
+{
+    return ar->base + (u32)((const u8 *)pt - ar->host);
+}
+
+// Name of a symbol of a loaded image
+static inline const char *XffSymName(const struct XffLoader *ldr, const struct t_xffEntPntHdr *xffEp, const struct t_xffSymEnt *sym)
+{
+    if (ldr->strPool != NULL)
+        return XffStrPoolName(ldr->strPool, sym->nameOffs);
+    return (const char *)XffPtr(&ldr->arena, xffEp->symTabStr) + sym->nameOffs;
+}
+
+// xffArena.c
+s32 XffArenaCreate(struct XffArena *ar, u32 base, u32 size);
+void XffArenaDestroy(struct XffArena *ar);
+void XffSetHeapStartPoint(struct XffArena *ar, u32 startAddress);
+u32 XffGetHeapCurrentPoint(const struct XffArena *ar);
+u32 XffArenaAlloc(struct XffArena *ar, u32 sz, u32 align);
+void XffBulkZero(void *dst, u32 n);
+
+// xffLoad.c
+s32 XffLoaderInit(struct XffLoader *ldr, u32 base, u32 size);
+void XffLoaderTerm(struct XffLoader *ldr);
+void XffLoaderReset(struct XffLoader *ldr);
+
+s32 XffCheckHeader(const struct t_xffEntPntHdr *xffEp, u32 size);
+s32 XffCheckSymbols(const struct t_xffEntPntHdr *xffEp, u32 strEnd);
+s32 XffCheckRelocTab(const struct t_xffEntPntHdr *xffEp, s32 ix);
+s32 XffCheckImage(const struct t_xffEntPntHdr *xffEp, u32 size);
+s32 XffRelocateElfInfoHeader(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp, u32 fileAddr);
+s32 XffPlaceSection(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp, s32 ix);
+void XffFillSection(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp, s32 ix);
+void XffSetEntryPoint(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp);
+s32 XffDecodeSection(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp);
+void XffRelocateSelfSymbol(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp);
+u32 XffFindExport(const struct XffLoader *ldr, const char *name, struct t_xffSymEnt **symOut);
+u32 XffFindImport(const struct XffLoader *ldr, const struct t_xffEntPntHdr *xffEp, const struct t_xffSymEnt *sym, u32 hash,
+                  struct t_xffSymEnt **symOut);
+void XffResolveImports(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp);
+s32 XffResolveRelocation(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp, struct t_xffRelocEnt *rt, u32 ix);
+u32 XffRelocateCode(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp, s32 firstTab, s32 tabNrE);
+u32 XffDisposeRelocationElement(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp);
+void XffFreeDecodedSection(struct XffLoader *ldr, struct XffModule *mod);
+void XffUnloadModule(struct XffLoader *ldr, struct XffModule *mod);
+s32 XffLoaderUseSymIndex(struct XffLoader *ldr, s32 enable);
+s32 XffLoaderUseStrPool(struct XffLoader *ldr, s32 enable);
+
+s32 XffLoaderUseRegions(struct XffLoader *ldr, u32 chunkSize);
+u32 XffAllocImage(struct XffLoader *ldr, const char *name, u32 size);
+void XffFreeImage(struct XffLoader *ldr, u32 fileAddr);
+void XffTrimImage(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp, u32 fileAddr, u32 fileSize, u32 freeStart);
+void XffLinkImage(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp);
+s32 XffAddModule(struct XffLoader *ldr, const char *name, u32 fileAddr, u32 fileSize, struct XffModule **modOut);
+s32 XffLoadImage(struct XffLoader *ldr, const char *name, const void *data, u32 size, struct XffModule **modOut);
+s32 XffLoadFile(struct XffLoader *ldr, const char *path, struct XffModule **modOut);
+
+// xffSymIndex.c
+u32 XffStrHash(const char *name);
+void XffSymIndexInit(struct XffSymIndex *ix);
+void XffSymIndexFree(struct XffSymIndex *ix);
+struct XffSymIndexEnt *XffSymIndexFind(const struct XffSymIndex *ix, const char *name, u32 hash);
+s32 XffSymIndexAdd(struct XffSymIndex *ix, const char *name, u32 hash, struct t_xffSymEnt *sym, struct XffModule *mod);
+s32 XffSymIndexAddModule(struct XffSymIndex *ix, const struct XffArena *ar, struct XffModule *mod);
+void XffSymIndexRemoveModule(struct XffSymIndex *ix, const struct XffArena *ar, const struct XffModule *mod);
+void XffSymIndexRebaseModule(struct XffSymIndex *ix, const struct XffModule *mod, s32 shift);
+
+// xffStrPool.c
+s32 XffStrPoolInit(struct XffStrPool *pool);
+void XffStrPoolTerm(struct XffStrPool *pool);
+void XffStrPoolClear(struct XffStrPool *pool);
+u32 XffStrPoolFind(const struct XffStrPool *pool, const char *name);
+u32 XffStrPoolIntern(struct XffStrPool *pool, const char *name);
+s32 XffInternModule(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp);
+
+// xffRelocPar.c
+#define XFF_RELOC_CHUNK_DEFAULT (0x2000)
+
+struct XffRelocPool;
+u32 XffRelocateRange(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp, struct t_xffRelocEnt *rt, u32 begin, u32 end);
+struct XffRelocPool *XffRelocPoolCreate(s32 threadNrE);
+void XffRelocPoolDestroy(struct XffRelocPool *pool);
+u32 XffRelocateCodeParallel(struct XffRelocPool *pool, const struct XffArena *ar, struct t_xffEntPntHdr *xffEp,
+                            s32 firstTab, s32 tabNrE, u32 chunkEnt);
+
+// xffRelocPack.c
+u32 XffApplyPackedRelocs(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp, const struct t_xffRelocEnt *rt, const u8 *changed);
+u32 XffPackRelocations(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp, u32 freeStart);
+
+// xffLz.c
+u32 XffLzBound(u32 size);
+u32 XffLzCompress(const u8 *src, u32 size, u8 *dst);
+s32 XffLzDecompress(const u8 *src, u32 size, u8 *dst, u32 rawSize);
+
+// xffPack.c
+#define XFF_PACK_MAGIC (0x7A666678) // "xffz"
+
+// Packed container header, followed by the block index and the compressed data
+struct XffPackHdr
+{
+    u32 magic;
+    u32 rawSize;  // size of the original file
+    u32 blockNrE;
+    u32 dataOffs; // start of the compressed data
+};
+
+struct XffPackBlock
+{
+    u32 rawOffs;  // position in the original file
+    u32 rawSize;
+    u32 packOffs; // from XffPackHdr.dataOffs
+    u32 packSize; // == rawSize when stored uncompressed
+    u32 sect;     // progbits section the bytes belong to, 0 for anything else
+};
+
+s32 XffPackIsPacked(const void *data, u32 size);
+s32 XffPack(const u8 *data, u32 size, u8 **out, u32 *outSize);
+s32 XffUnpack(const u8 *data, u32 size, u8 **out, u32 *outSize);
+s32 XffLoadPacked(struct XffLoader *ldr, const char *name, const void *data, u32 size, struct XffModule **modOut);
+
+// xffLayout.c
+struct XffLayoutStats
+{
+    u32 sections;   // progbits sections
+    u32 forced;     // with flags != 0, always copied
+    u32 realigned;  // were misaligned in the file
+    u32 aligned;    // sit at an offset meeting their alignment now
+    u32 maxAlign;   // largest alignment asked for, the file image must be placed at least as aligned
+    u32 padBytes;
+    s32 extDropped; // extension blocks were dropped
+};
+
+s32 XffRelayout(const u8 *data, u32 size, struct XffLayoutStats *st, u8 **out, u32 *outSize);
+
+// xffStream.c
+typedef s32 (*XffReadFunc)(void *ctx, void *buf, s32 count);
+
+s32 XffLoadStream(struct XffLoader *ldr, const char *name, XffReadFunc read, void *ctx, u32 size, u32 chunk, struct XffModule **modOut);
+
+// xffMove.c
+struct XffMoveStats
+{
+    u32 sections;   // sections moved
+    u32 symbols;    // symbols of the moved module whose address changed
+    u32 bytesMoved;
+    u32 modules;    // modules with at least one site patched
+    u32 sites;      // relocation sites patched
+    u32 fullSites;  // sites a full re-relocation patches
+};
+
+s32 XffRelocateOnline(struct XffLoader *ldr, struct XffModule *mod, const s32 *delta, s32 incremental, struct XffMoveStats *st);
+s32 XffMoveSections(struct XffLoader *ldr, struct XffModule *mod, const u32 *newMemPt, s32 incremental, struct XffMoveStats *st);
+s32 XffMoveModule(struct XffLoader *ldr, struct XffModule *mod, s32 incremental, struct XffMoveStats *st);
+u32 XffPatchChanged(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp, struct t_xffRelocEnt *rt, const u8 *changed);
+
+// xffLazy.c
+void XffLoaderUseLazyBind(struct XffLoader *ldr, u32 resolver);
+void XffLazyImports(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp);
+u32 XffLazyCall(struct XffLoader *ldr, u32 target);
+s32 XffLazyRebase(struct XffLoader *ldr, struct XffModule *mod, u32 from, u32 size, s32 shift);
+
+// xffRegion.c
+s32 XffRegionHeapInit(struct XffRegionHeap *heap, struct XffArena *ar, u32 start, u32 end, u32 chunkSize);
+void XffRegionHeapTerm(struct XffRegionHeap *heap);
+void XffRegionHeapReset(struct XffRegionHeap *heap);
+struct XffRegion *XffRegionCreate(struct XffRegionHeap *heap, const char *name);
+u32 XffRegionAlloc(struct XffRegionHeap *heap, struct XffRegion *rgn, u32 size, u32 align);
+u32 XffRegionAllocBlock(struct XffRegionHeap *heap, struct XffRegion *rgn, u32 size, u32 align);
+u32 XffRegionTrim(struct XffRegionHeap *heap, struct XffRegion *rgn, u32 addr);
+u32 XffRegionRelocateChunk(struct XffRegionHeap *heap, struct XffRegionChunk *chunk);
+u32 XffRegionLowestFree(const struct XffRegionHeap *heap);
+void XffRegionRelease(struct XffRegionHeap *heap, struct XffRegion *rgn);
+void XffRegionHeapStats(const struct XffRegionHeap *heap, struct XffRegionHeapStats *st);
+
+// xffCompact.c
+#define XFF_COMPACT_SITE_COST (16) // cost of reapplying a relocation site, in bytes copied
+
+struct XffCompactStats
+{
+    u32 chunks;     // chunks moved
+    u32 bytesMoved;
+    u32 sites;      // relocation sites reapplied
+    u32 fullSites;  // sites a full re-relocation would have reapplied
+    u32 estimate;   // cost estimated before the moves
+    u32 cost;       // bytes moved + sites * XFF_COMPACT_SITE_COST
+    s32 done;       // nothing left to move
+};
+
+u32 XffCompactEstimate(const struct XffLoader *ldr, const struct XffModule *mod, const struct XffRegionChunk *chunk);
+s32 XffCompact(struct XffLoader *ldr, u32 budget, struct XffCompactStats *st);
+
+// xffHandle.c
+// Sizes of the LoaderSys external resource lists
+#define XFF_HANDLE_THREADS (256)    // THREAD_LIST, MAX_THREADS
+#define XFF_HANDLE_SEMAS (256)      // SEMAPHORE_LIST, MAX_SEMAPHORES
+#define XFF_HANDLE_INTC (256)       // INTC_HANDLER_LIST
+#define XFF_HANDLE_IOP_MEMORY (256) // IOP_MEMORY_LIST
+
+struct XffHandleTable
+{
+    s32 *key;     // id per slot
+    s32 *value;   // second word, the INTC cause of INTC_HANDLER_LIST
+    u32 *bitmap;  // occupied slots
+    u32 *rev;     // id -> slot + 1, 0 = empty
+    u32 cap;
+    u32 revCap;   // power of two, at least 2 * cap
+    u32 used;
+    u32 overflows; // XffHandleEntry() calls refused because the table was full
+};
+
+typedef void (*XffHandleFunc)(s32 id, s32 value, void *ctx);
+
+s32 XffHandleInit(struct XffHandleTable *tab, u32 cap);
+void XffHandleTerm(struct XffHandleTable *tab);
+void XffHandleClear(struct XffHandleTable *tab);
+s32 XffHandleEntry(struct XffHandleTable *tab, s32 id, s32 value);
+s32 XffHandleFind(const struct XffHandleTable *tab, s32 id);
+s32 XffHandleDelete(struct XffHandleTable *tab, s32 id);
+void XffHandleForEach(const struct XffHandleTable *tab, XffHandleFunc func, void *ctx);
+u32 XffHandleDeleteAll(struct XffHandleTable *tab, s32 except, XffHandleFunc func, void *ctx);
+
+// xffSnapshot.c
+struct XffSnapshot
+{
+    void *data; // the block, see xffSnapshot.c
+    u32 size;   // bytes reserved for it
+    u32 used;   // bytes of it the last snapshot took
+    s32 valid;  // a snapshot was taken and hasn't been rejected since
+    u32 taken;
+    u32 restored;
+    u32 rejected; // restores refused, no snapshot or a checksum mismatch
+};
+
+s32 XffSnapshotInit(struct XffSnapshot *snap, u32 size);
+void XffSnapshotTerm(struct XffSnapshot *snap);
+s32 XffSnapshotTake(const struct XffLoader *ldr, struct XffSnapshot *snap);
+s32 XffSnapshotRestore(struct XffLoader *ldr, struct XffSnapshot *snap, u32 *entryOut);
+
+// xffTlsf.c
+struct XffTlsf;
+
+struct XffTlsfStats
+{
+    u32 poolSize;   // bytes in blocks, headers included
+    u32 used;
+    u32 free;
+    u32 largestFree;
+    u32 usedBlocks;
+    u32 freeBlocks;
+    u32 peak;       // most bytes in use at once
+    u32 allocs;
+    u32 frees;
+    u32 failed;     // requests that found no block
+};
+
+typedef void (*XffTlsfWalkFunc)(void *ptr, u32 size, s32 used, void *ctx);
+
+struct XffTlsf *XffTlsfCreate(void *mem, u32 size);
+void *XffTlsfMalloc(struct XffTlsf *t, u32 size);
+void *XffTlsfMemalign(struct XffTlsf *t, u32 align, u32 size);
+void *XffTlsfRealloc(struct XffTlsf *t, void *ptr, u32 size);
+void XffTlsfFree(struct XffTlsf *t, void *ptr);
+u32 XffTlsfBlockSize(const void *ptr);
+void XffTlsfWalk(const struct XffTlsf *t, XffTlsfWalkFunc func, void *ctx);
+void XffTlsfStats(const struct XffTlsf *t, struct XffTlsfStats *st);
+s32 XffTlsfCheck(const struct XffTlsf *t);
+
+// xffProf.c
+#define XFF_PROF_CAP_DEFAULT (0x10000)
+
+const char *XffProfPhaseName(u32 phase);
+u64 XffProfNow(void);
+struct XffProfile *XffProfCreate(u32 cap);
+void XffProfDestroy(struct XffProfile *prof);
+void XffProfSetModule(struct XffProfile *prof, const char *name, u32 seq);
+void XffProfRecord(struct XffProfile *prof, u32 phase, u64 begin, u32 count, u32 bytes);
+void XffProfTotals(const struct XffProfile *prof, struct XffProfTotal *tot);
+s32 XffProfWriteTrace(const struct XffProfile *prof, const char *path);
+
+// xffHash.c
+s32 XffHashBuild(const u8 *data, u32 size, u8 **out, u32 *outSize);
+u8 *XffHashAttach(u8 *data, u32 *size);
+s32 XffHashCheck(const struct XffHashHdr *hdr, u32 size, const struct t_xffEntPntHdr *xffEp);
+const u32 *XffHashImports(const struct XffLoader *ldr, const struct t_xffEntPntHdr *xffEp);
+struct t_xffSymEnt *XffHashLookup(const struct XffLoader *ldr, const struct XffModule *mod, const char *name, u32 hash);
+
+// xffRelPlan.c
+s32 XffRelPlanBuild(const u8 *data, u32 size, u8 **out, u32 *outSize);
+u8 *XffRelPlanAttach(u8 *data, u32 *size);
+s32 XffRelPlanCheck(const struct XffArena *ar, const struct XffRelPlanHdr *hdr, u32 size, const struct t_xffEntPntHdr *xffEp);
+u32 XffRelPlanSlots(const struct XffRelPlanHdr *hdr);
+u32 XffApplyRelPlan(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp, const struct XffRelPlanHdr *hdr, u32 *vals);
+
+// xffPrefetch.c
+#define XFF_PREFETCH_NAME_MAX (256)
+
+struct XffPrefetch;
+
+// Reads the whole file 'name' into buf[0..cap) and sets *sizeOut to its size. Returns
+// XFF_ERR_FULL, with *sizeOut set, when it doesn't fit, XFF_ERR_NOENT when there is none.
+typedef s32 (*XffFetchFunc)(void *ctx, const char *name, void *buf, u32 cap, u32 *sizeOut);
+
+struct XffPrefetchStats
+{
+    u32 hints;
+    u32 staged;      // images the thread finished staging
+    u32 hits;        // loads handed a staged image
+    u32 lateHits;    // of them, loads that waited for the thread to finish it
+    u32 misses;      // loads that read the file themselves
+    u32 dropped;     // staged images replaced before any load took them
+    u32 failed;      // hinted files the thread couldn't fetch or that didn't fit
+    u64 bytesStaged;
+    u64 stageNs;     // thread time that went into the images of the hits
+    u64 waitNs;      // time loads waited for the thread
+};
+
+s32 XffFetchFile(void *ctx, const char *name, void *buf, u32 cap, u32 *sizeOut);
+struct XffPrefetch *XffPrefetchCreate(struct XffLoader *ldr, u32 stageSize, s32 decode, XffFetchFunc fetch, void *ctx);
+void XffPrefetchDestroy(struct XffPrefetch *pf);
+void XffPrefetchHint(struct XffPrefetch *pf, const char *name);
+s32 XffPrefetchLoad(struct XffPrefetch *pf, const char *name, struct XffModule **modOut);
+void XffPrefetchGetStats(struct XffPrefetch *pf, struct XffPrefetchStats *st);
+
+// Phase timing in the loader, free when no profiler is attached
+static inline u64 XffProfBegin(const struct XffLoader *ldr)
+{
+    return ldr->prof != NULL ? XffProfNow() : 0;
+}
+
+static inline void XffProfEnd(const struct XffLoader *ldr, u32 phase, u64 begin, u32 count, u32 bytes)
+{
+    if (ldr->prof != NULL)
+        XffProfRecord(ldr->prof, phase, begin, count, bytes);
+}
+
+// xffExt.c
+u32 XffExtImageSize(const void *data, u32 size);
+const void *XffExtFind(const void *data, u32 size, u32 tag, u32 *sizeOut);
+u8 *XffExtSet(u8 *data, u32 *size, u32 tag, const void *blkData, u32 blkSize);
+
+// Maps a whole file read-only, for tools and benchmarks that want the raw bytes
+void *XffMapFile(const char *path, u32 *sizeOut);
+void XffUnmapFile(void *data, u32 size);
+
+#endif /* LIBXFF_H */
@@ -0,0 +1,110 @@
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "libxff.h"
+
+// 128-bit vector, a quadword store like sq on the EE
+typedef u32 XffQword __attribute__((vector_size(16)));
+
+s32 XffArenaCreate(struct XffArena *ar, u32 base, u32 size)
+{
+    void *host;
+
+    host = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (host == MAP_FAILED)
+    {
+        return XFF_ERR_NOMEM;
+    }
+
+    ar->host = host;
+    ar->base = base;
+    ar->size = size;
+    ar->zeroPt = base; // fresh anonymous memory reads as zero
+    XffSetHeapStartPoint(ar, base);
+    return XFF_OK;
+}
+
+void XffArenaDestroy(struct XffArena *ar)
+{
+    if (ar->host != NULL)
+    {
+        munmap(ar->host, ar->size);
+    }
+    ar->host = NULL;
+}
+
+// Same rounding as SetHeapStartPoint() on the EE
+void XffSetHeapStartPoint(struct XffArena *ar, u32 startAddress)
+{
+    ar->heapPt = (startAddress + 0xF) & ~0xF;
+}
+
+u32 XffGetHeapCurrentPoint(const struct XffArena *ar)
+{
+    return ar->heapPt;
+}
+
+// Bump allocation from the heap point, returns a guest address or 0 when the arena is full.
+u32 XffArenaAlloc(struct XffArena *ar, u32 sz, u32 align)
+{
+    u32 addr;
+    u32 end = ar->base + ar->size;
+
+    if (align < 0x10)
+    {
+        align = 0x10;
+    }
+
+    addr = (ar->heapPt + align - 1) & ~(align - 1);
+    if (addr < ar->heapPt || addr > end || sz > end - addr)
+    {
+        return 0;
+    }
+
+    // Alignment padding is cleared like the rest of the heap, nobody else writes it and
+    // a reload must give the same bytes whatever ran before
+    if (ar->heapPt < ar->zeroPt && addr > ar->heapPt)
+        memset(ar->host + (ar->heapPt - ar->base), 0, (addr < ar->zeroPt ? addr : ar->zeroPt) - ar->heapPt);
+
+    ar->heapPt = addr + sz;
+    if (ar->heapPt > ar->zeroPt)
+        ar->zeroPt = ar->heapPt;
+    return addr;
+}
+
+// Clears 'n' bytes with aligned quadword stores, four per iteration. The unaligned
+// head and tail are cleared with memset.
+void XffBulkZero(void *dst, u32 n)
+{
+    u8 *p = dst;
+    u32 head = (0x10 - ((uintptr_t)p & 0xF)) & 0xF;
+    XffQword *q;
+    XffQword *qend;
+    XffQword zero = {0, 0, 0, 0};
+
+    if (n < 0x40 + head)
+    {
+        memset(p, 0, n);
+        return;
+    }
+
+    memset(p, 0, head);
+    p += head;
+    n -= head;
+
+    q = (XffQword *)p;
+    qend = q + (n >> 6) * 4;
+    for (; q < qend; q += 4)
+    {
+        q[0] = zero;
+        q[1] = zero;
+        q[2] = zero;
+        q[3] = zero;
+    }
+
+    for (n &= 0x3F; n >= 0x10; n -= 0x10)
+        *q++ = zero;
+
+    memset(q, 0, n);
+}
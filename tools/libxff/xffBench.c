@@ -0,0 +1,179 @@
+/*
+xffbench: load cost of XFF modules on the host.
+
+Usage: xffbench [-n iterations] [-b heapBase] [-j relocThreads] [-r] [-z] [-t trace.json] file.xff...
+
+Each iteration loads the given files in order into a freshly reset heap, the way
+loaderLoop() reloads the STARTUP.XFF chain after a reset. Files are mapped once up
+front so the numbers cover the loader itself and not the host page cache. With -j,
+relocation runs on a pool of that many threads. -r lists the bytes DecodeSection()
+copied for each module. -z clears nobits sections lazily, see XffLoader.lazyZero. -t
+attaches the phase profiler, prints the time spent in each phase and writes the last
+XFF_PROF_CAP_DEFAULT events as a Chrome trace.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libxff.h"
+
+struct BenchFile
+{
+    const char *path;
+    void *data;
+    u32 size;
+};
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    struct XffLoader ldr;
+    struct BenchFile *files;
+    struct XffModule *mod;
+    u32 heapBase = XFF_ARENA_DEFAULT_BASE;
+    s32 iterations = 100;
+    s32 relocThreads = 1;
+    s32 report = 0;
+    s32 lazyZero = 0;
+    const char *tracePath = NULL;
+    struct XffProfTotal tot[XFF_PHASE_NRE];
+    s32 fileNrE;
+    s32 opt;
+    s32 i;
+    s32 it;
+    s32 ret;
+    double t0;
+    double sec;
+
+    while ((opt = getopt(argc, argv, "n:b:j:rzt:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            iterations = strtol(optarg, NULL, 0);
+            break;
+        case 'b':
+            heapBase = strtoul(optarg, NULL, 0);
+            break;
+        case 'j':
+            relocThreads = strtol(optarg, NULL, 0);
+            break;
+        case 'r':
+            report = 1;
+            break;
+        case 'z':
+            lazyZero = 1;
+            break;
+        case 't':
+            tracePath = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-b heapBase] [-j relocThreads] [-r] [-z] [-t trace.json] file.xff...\n", argv[0]);
+            return 1;
+        }
+    }
+
+    fileNrE = argc - optind;
+    if (fileNrE <= 0 || iterations <= 0)
+    {
+        fprintf(stderr, "usage: %s [-n iterations] [-b heapBase] [-j relocThreads] [-r] [-z] [-t trace.json] file.xff...\n", argv[0]);
+        return 1;
+    }
+
+    files = calloc(fileNrE, sizeof(*files));
+    for (i = 0; i < fileNrE; i++)
+    {
+        files[i].path = argv[optind + i];
+        files[i].data = XffMapFile(files[i].path, &files[i].size);
+        if (files[i].data == NULL)
+        {
+            fprintf(stderr, "xffbench: can't map %s\n", files[i].path);
+            return 1;
+        }
+    }
+
+    if (XffLoaderInit(&ldr, heapBase, XFF_ARENA_DEFAULT_SIZE) != XFF_OK)
+    {
+        fprintf(stderr, "xffbench: can't create arena\n");
+        return 1;
+    }
+    if (relocThreads > 1)
+        ldr.relocPool = XffRelocPoolCreate(relocThreads);
+    ldr.lazyZero = lazyZero;
+    if (tracePath != NULL)
+        ldr.prof = XffProfCreate(XFF_PROF_CAP_DEFAULT);
+
+    t0 = NowSec();
+    for (it = 0; it < iterations; it++)
+    {
+        XffLoaderReset(&ldr);
+        for (i = 0; i < fileNrE; i++)
+        {
+            ret = XffLoadImage(&ldr, files[i].path, files[i].data, files[i].size, NULL);
+            if (ret != XFF_OK)
+            {
+                fprintf(stderr, "xffbench: %s: load failed (%d)\n", files[i].path, ret);
+                return 1;
+            }
+        }
+    }
+    sec = NowSec() - t0;
+
+    printf("iterations      : %d\n", iterations);
+    printf("files           : %u (%.1f files/sec)\n", ldr.stats.files, ldr.stats.files / sec);
+    printf("relocations     : %u (%.3f M relocs/sec)\n", ldr.stats.relocs, ldr.stats.relocs / sec * 1e-6);
+    printf("imports         : %u (%u unresolved)\n", ldr.stats.imports, ldr.stats.unresolved);
+    printf("prelinked       : %u (%u layout misses)\n", ldr.stats.prelinked, ldr.stats.prelinkMisses);
+    printf("hash blocks     : %u (%u mismatched)\n", ldr.stats.hashTabs, ldr.stats.hashMisses);
+    printf("bytes read      : %llu\n", (unsigned long long)ldr.stats.bytesRead);
+    printf("bytes copied    : %llu (%llu per iteration)\n", (unsigned long long)ldr.stats.bytesCopied,
+           (unsigned long long)(ldr.stats.bytesCopied / iterations));
+    printf("bytes zeroed    : %llu (%llu already zero)\n", (unsigned long long)ldr.stats.bytesZeroed,
+           (unsigned long long)ldr.stats.bytesZeroSkipped);
+    printf("time            : %.3f ms (%.3f us per iteration)\n", sec * 1e3, sec * 1e6 / iterations);
+
+    if (report)
+    {
+        printf("copied by DecodeSection():\n");
+        for (i = 0; i < fileNrE; i++)
+        {
+            for (mod = ldr.modules; mod != NULL && mod->seq != ldr.loadSeq - fileNrE + i; mod = mod->next)
+                ;
+            printf("  %-30s %3u sections, %8u bytes\n", files[i].path, mod->sectCopied, mod->bytesCopied);
+        }
+    }
+
+    if (ldr.prof != NULL)
+    {
+        XffProfTotals(ldr.prof, tot);
+        printf("phase                       events     total ms    min us    max us        count        bytes\n");
+        for (i = 0; i < XFF_PHASE_NRE; i++)
+        {
+            if (tot[i].events == 0)
+                continue;
+            printf("  %-24s %8u %12.3f %9.3f %9.3f %12llu %12llu\n", XffProfPhaseName(i), tot[i].events, tot[i].ns * 1e-6,
+                   tot[i].minNs * 1e-3, tot[i].maxNs * 1e-3, (unsigned long long)tot[i].count, (unsigned long long)tot[i].bytes);
+        }
+        if (XffProfWriteTrace(ldr.prof, tracePath) != XFF_OK)
+            fprintf(stderr, "xffbench: can't write %s\n", tracePath);
+        XffProfDestroy(ldr.prof);
+    }
+
+    XffRelocPoolDestroy(ldr.relocPool);
+    XffLoaderTerm(&ldr);
+    for (i = 0; i < fileNrE; i++)
+    {
+        XffUnmapFile(files[i].data, files[i].size);
+    }
+    free(files);
+    return 0;
+}
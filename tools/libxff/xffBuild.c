@@ -0,0 +1,426 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "xffBuild.h"
+
+struct OutBuf
+{
+    u8 *data;
+    u32 size;
+    u32 cap;
+    s32 noMem; // an allocation failed, nothing is written from then on
+};
+
+// Returns 'arr' grown to at least 'need' entries, the new ones cleared, or NULL without
+// memory; 'arr' and 'cap' are left as they were then.
+static void *GrowArray(void *arr, u32 *cap, u32 need, u32 entSz)
+{
+    void *grown;
+    u32 newCap;
+
+    if (need <= *cap)
+        return arr;
+
+    newCap = *cap ? *cap * 2 : 16;
+    while (newCap < need)
+        newCap *= 2;
+
+    grown = realloc(arr, (size_t)newCap * entSz);
+    if (grown == NULL)
+        return NULL;
+    memset((u8 *)grown + (size_t)*cap * entSz, 0, (size_t)(newCap - *cap) * entSz);
+    *cap = newCap;
+    return grown;
+}
+
+static s32 OutReserve(struct OutBuf *o, u32 need)
+{
+    u8 *data;
+
+    if (o->noMem)
+        return 0;
+    if (need <= o->cap)
+        return 1;
+
+    data = GrowArray(o->data, &o->cap, need, 1);
+    if (data == NULL)
+    {
+        o->noMem = 1;
+        return 0;
+    }
+    o->data = data;
+    return 1;
+}
+
+static u32 OutAlign(struct OutBuf *o, u32 align)
+{
+    u32 pos = (o->size + align - 1) & ~(align - 1);
+
+    if (!OutReserve(o, pos))
+        return pos;
+    if (pos > o->size)
+        memset(o->data + o->size, 0, pos - o->size);
+    o->size = pos;
+    return pos;
+}
+
+static u32 OutPut(struct OutBuf *o, const void *data, u32 size, u32 align)
+{
+    u32 pos = OutAlign(o, align);
+
+    if (!OutReserve(o, pos + size))
+        return pos;
+    if (data != NULL)
+        memcpy(o->data + pos, data, size);
+    else
+        memset(o->data + pos, 0, size);
+    o->size = pos + size;
+    return pos;
+}
+
+void XffBuilderInit(struct XffBuilder *b)
+{
+    memset(b, 0, sizeof(*b));
+    b->specSectNrE = 6;
+    XffBuilderAddSection(b, "", 0, 1, 0, NULL, 0);
+    XffBuilderAddSymbol(b, "", 0, 0, 0, XFF_STT_NOTYPE, 0);
+}
+
+void XffBuilderFree(struct XffBuilder *b)
+{
+    u32 i;
+
+    for (i = 0; i < b->sectNrE; i++)
+    {
+        free(b->sect[i].name);
+        free(b->sect[i].data);
+        free(b->sect[i].ext.ent);
+        free(b->sect[i].loc.ent);
+    }
+    for (i = 0; i < b->symNrE; i++)
+    {
+        free(b->sym[i].name);
+    }
+    free(b->sect);
+    free(b->sym);
+    memset(b, 0, sizeof(*b));
+}
+
+// Adds a section and its STT_SECTION symbol, returns the section index. Without memory
+// nothing is added, 0 is returned and XffBuilderWrite() fails.
+u32 XffBuilderAddSection(struct XffBuilder *b, const char *name, u32 type, u32 align, s32 flags, const void *data, u32 size)
+{
+    struct XffBuildSect *sect;
+    u32 ix = b->sectNrE;
+    char *nm;
+    u8 *copy = NULL;
+
+    sect = GrowArray(b->sect, &b->sectCap, ix + 1, sizeof(*b->sect));
+    if (sect != NULL)
+        b->sect = sect;
+    nm = sect != NULL ? strdup(name) : NULL;
+    if (nm != NULL && type != XFF_SECT_NOBITS && size != 0)
+    {
+        copy = malloc(size);
+        if (copy == NULL)
+        {
+            free(nm);
+            nm = NULL;
+        }
+    }
+    if (nm == NULL)
+    {
+        b->noMem = 1;
+        return 0;
+    }
+
+    sect = &b->sect[ix];
+    sect->name = nm;
+    sect->type = type;
+    sect->align = align ? align : 1;
+    sect->flags = flags;
+    sect->size = size;
+    sect->data = copy;
+    if (copy != NULL)
+    {
+        if (data != NULL)
+            memcpy(copy, data, size);
+        else
+            memset(copy, 0, size);
+    }
+    b->sectNrE++;
+
+    if (ix != 0)
+        sect->symIx = XffBuilderAddSymbol(b, "", ix, 0, 0, XFF_STT_SECTION, 0);
+    return ix;
+}
+
+u32 XffBuilderAddSymbol(struct XffBuilder *b, const char *name, u16 sect, u32 offs, u32 size, u8 type, u8 bindAttr)
+{
+    struct XffBuildSym *sym;
+    u32 ix = b->symNrE;
+    char *nm;
+
+    sym = GrowArray(b->sym, &b->symCap, ix + 1, sizeof(*b->sym));
+    if (sym != NULL)
+        b->sym = sym;
+    nm = sym != NULL ? strdup(name) : NULL;
+    if (nm == NULL)
+    {
+        b->noMem = 1;
+        return 0;
+    }
+
+    sym = &b->sym[ix];
+    sym->name = nm;
+    sym->sect = sect;
+    sym->offs = offs;
+    sym->size = size;
+    sym->type = type;
+    sym->bindAttr = bindAttr;
+    b->symNrE++;
+    return ix;
+}
+
+// Relocations against imported symbols go to the extern table of the section,
+// everything else to the local one.
+void XffBuilderAddReloc(struct XffBuilder *b, u32 sect, u32 addr, u32 relType, u32 symIx, u32 inst)
+{
+    struct XffBuildRelTab *tab;
+    struct XffBuildReloc *ent;
+
+    if (b->noMem)
+        return;
+
+    tab = (symIx != 0 && b->sym[symIx].sect == 0) ? &b->sect[sect].ext : &b->sect[sect].loc;
+    ent = GrowArray(tab->ent, &tab->cap, tab->nrEnt + 1, sizeof(*tab->ent));
+    if (ent == NULL)
+    {
+        b->noMem = 1;
+        return;
+    }
+    tab->ent = ent;
+    ent = &tab->ent[tab->nrEnt++];
+    ent->addr = addr;
+    ent->relType = relType;
+    ent->symIx = symIx;
+    ent->inst = inst;
+}
+
+static u32 PutRelocAddr(struct OutBuf *o, const struct XffBuildRelTab *tab)
+{
+    struct t_xffRelocAddrEnt ent;
+    u32 pos = OutAlign(o, 4);
+    u32 i;
+
+    for (i = 0; i < tab->nrEnt; i++)
+    {
+        ent.addr = tab->ent[i].addr;
+        ent.relType = tab->ent[i].relType;
+        ent.tgSymIx = tab->ent[i].symIx;
+        OutPut(o, &ent, sizeof(ent), 4);
+    }
+    return pos;
+}
+
+static u32 PutRelocInst(struct OutBuf *o, const struct XffBuildRelTab *tab)
+{
+    struct t_xffRelocInstEnt ent;
+    u32 pos = OutAlign(o, 4);
+    u32 i;
+
+    for (i = 0; i < tab->nrEnt; i++)
+    {
+        ent.inst = tab->ent[i].inst;
+        ent.tyIx = tab->ent[i].relType | (tab->ent[i].symIx << 8);
+        OutPut(o, &ent, sizeof(ent), 4);
+    }
+    return pos;
+}
+
+// Returns XFF_ERR_NOMEM when this or an earlier XffBuilderAdd*() ran out of memory.
+s32 XffBuilderWrite(const struct XffBuilder *b, u8 **out, u32 *sizeOut)
+{
+    struct OutBuf o = {NULL, 0, 0, 0};
+    struct t_xffEntPntHdr hdr;
+    struct t_xffSectEnt *sectTab;
+    struct t_xffSymEnt *symTab;
+    struct t_xffSymRelEnt *symRel;
+    struct t_xffRelocEnt *rt;
+    s32 *nmOffs;
+    u32 *relSect;
+    u32 relSectNrE = 0;
+    u32 strSize;
+    u32 impNrE = 0;
+    u32 align;
+    u32 i;
+    char *str;
+
+    *out = NULL;
+    *sizeOut = 0;
+    if (b->noMem)
+        return XFF_ERR_NOMEM;
+
+    memset(&hdr, 0, sizeof(hdr));
+    OutPut(&o, NULL, sizeof(hdr), 1);
+
+    // Sections that carry relocations get one extern and one local table each
+    relSect = calloc(b->sectNrE + 1, sizeof(*relSect));
+    if (relSect == NULL)
+    {
+        free(o.data);
+        return XFF_ERR_NOMEM;
+    }
+    for (i = 1; i < b->sectNrE; i++)
+    {
+        if (b->sect[i].ext.nrEnt != 0 || b->sect[i].loc.nrEnt != 0)
+            relSect[relSectNrE++] = i;
+    }
+
+    sectTab = calloc(b->sectNrE, sizeof(*sectTab));
+    nmOffs = calloc(b->sectNrE, sizeof(*nmOffs));
+    symTab = calloc(b->symNrE, sizeof(*symTab));
+    symRel = calloc(b->symNrE, sizeof(*symRel));
+    rt = calloc(relSectNrE * 2 + 1, sizeof(*rt));
+    if (sectTab == NULL || nmOffs == NULL || symTab == NULL || symRel == NULL || rt == NULL)
+    {
+        free(relSect);
+        free(sectTab);
+        free(nmOffs);
+        free(symTab);
+        free(symRel);
+        free(rt);
+        free(o.data);
+        return XFF_ERR_NOMEM;
+    }
+
+    hdr.sectTab_Rel = OutPut(&o, NULL, b->sectNrE * sizeof(*sectTab), 4);
+
+    // Section names
+    strSize = 1;
+    for (i = 0; i < b->sectNrE; i++)
+    {
+        nmOffs[i] = strSize;
+        strSize += strlen(b->sect[i].name) + 1;
+    }
+    str = calloc(strSize, 1);
+    for (i = 0; str != NULL && i < b->sectNrE; i++)
+    {
+        strcpy(&str[nmOffs[i]], b->sect[i].name);
+    }
+    o.noMem |= str == NULL;
+    hdr.ssNamesOffs_Rel = OutPut(&o, nmOffs, b->sectNrE * sizeof(*nmOffs), 4);
+    hdr.ssNamesBase_Rel = OutPut(&o, str, strSize, 1);
+    free(str);
+
+    // Symbols and their names
+    strSize = 1;
+    for (i = 0; i < b->symNrE; i++)
+    {
+        symTab[i].nameOffs = b->sym[i].name[0] != '\0' ? strSize : 0;
+        strSize += b->sym[i].name[0] != '\0' ? strlen(b->sym[i].name) + 1 : 0;
+        symTab[i].size = b->sym[i].size;
+        symTab[i].type = b->sym[i].type;
+        symTab[i].bindAttr = b->sym[i].bindAttr;
+        symTab[i].sect = b->sym[i].sect;
+        symRel[i].offs = b->sym[i].offs;
+        if (i != 0 && b->sym[i].sect == 0)
+            impNrE++;
+    }
+    str = calloc(strSize, 1);
+    o.noMem |= str == NULL;
+    for (i = 0; str != NULL && i < b->symNrE; i++)
+    {
+        if (symTab[i].nameOffs != 0)
+            strcpy(&str[symTab[i].nameOffs], b->sym[i].name);
+    }
+    hdr.symTab_Rel = OutPut(&o, symTab, b->symNrE * sizeof(*symTab), 4);
+    hdr.symRelTab_Rel = OutPut(&o, symRel, b->symNrE * sizeof(*symRel), 4);
+
+    hdr.impSymIxs_Rel = OutAlign(&o, 4);
+    for (i = 1; i < b->symNrE; i++)
+    {
+        if (b->sym[i].sect == 0)
+            OutPut(&o, &i, sizeof(i), 4);
+    }
+
+    hdr.relocTab_Rel = OutPut(&o, NULL, relSectNrE * 2 * sizeof(*rt), 4);
+
+    // Section data
+    for (i = 1; i < b->sectNrE; i++)
+    {
+        sectTab[i].size = b->sect[i].size;
+        sectTab[i].align = b->sect[i].align;
+        sectTab[i].type = b->sect[i].type;
+        sectTab[i].flags = b->sect[i].flags;
+        if (b->sect[i].data != NULL)
+        {
+            align = b->fileAlign > b->sect[i].align ? b->fileAlign : b->sect[i].align;
+            sectTab[i].offs_Rel = OutPut(&o, b->sect[i].data, b->sect[i].size, align);
+        }
+    }
+    sectTab[0].align = 1;
+    sectTab[0].type = XFF_SECT_NOBITS;
+
+    // TI DI RI, TA DA RA, symTabStr, TAS DAS RAS, TIS DIS RIS
+    for (i = 0; i < relSectNrE; i++)
+    {
+        rt[i].type = 9;
+        rt[i].sect = relSect[i];
+        rt[i].nrEnt = b->sect[relSect[i]].ext.nrEnt;
+        rt[i].inst_Rel = PutRelocInst(&o, &b->sect[relSect[i]].ext);
+        rt[relSectNrE + i].type = 9;
+        rt[relSectNrE + i].sect = relSect[i];
+        rt[relSectNrE + i].nrEnt = b->sect[relSect[i]].loc.nrEnt;
+    }
+    for (i = 0; i < relSectNrE; i++)
+        rt[i].addr_Rel = PutRelocAddr(&o, &b->sect[relSect[i]].ext);
+
+    // Where DisposeRelocationElement() cuts, so a loader with a string pool gives the names
+    // back with the local half
+    hdr.symTabStr_Rel = OutPut(&o, str, strSize, 1);
+    free(str);
+
+    for (i = 0; i < relSectNrE; i++)
+        rt[relSectNrE + i].addr_Rel = PutRelocAddr(&o, &b->sect[relSect[i]].loc);
+    for (i = 0; i < relSectNrE; i++)
+        rt[relSectNrE + i].inst_Rel = PutRelocInst(&o, &b->sect[relSect[i]].loc);
+
+    hdr.ident = XFF_SHTEXE_MAGIC_XFF2;
+    hdr.specSectNrE = b->specSectNrE;
+    hdr.stack_Rel = OutAlign(&o, 4);
+    hdr.impSymIxsNrE = impNrE;
+    hdr.symTabNrE = b->symNrE;
+    hdr.relocTabNrE = relSectNrE * 2;
+    hdr.sectNrE = b->sectNrE;
+    hdr.entryPnt_Rel = b->entryOffs;
+
+    if (!o.noMem)
+    {
+        memcpy(o.data, &hdr, sizeof(hdr));
+        memcpy(o.data + hdr.sectTab_Rel, sectTab, b->sectNrE * sizeof(*sectTab));
+        memcpy(o.data + hdr.relocTab_Rel, rt, relSectNrE * 2 * sizeof(*rt));
+    }
+
+    free(relSect);
+    free(sectTab);
+    free(nmOffs);
+    free(symTab);
+    free(symRel);
+    free(rt);
+
+    if (o.noMem)
+    {
+        free(o.data);
+        return XFF_ERR_NOMEM;
+    }
+
+    if (b->hashSection)
+        o.data = XffHashAttach(o.data, &o.size);
+    if (b->relPlanSection)
+        o.data = XffRelPlanAttach(o.data, &o.size);
+
+    *out = o.data;
+    *sizeOut = o.size;
+    return XFF_OK;
+}
@@ -0,0 +1,175 @@
+#ifndef XFFBUILD_H
+#define XFFBUILD_H
+
+/*
+In-memory XFF2 writer shared by the host tools.
+
+Sections, symbols and relocations are collected first and laid out by XffBuilderWrite()
+in the order the loader expects: header, sectTab, section names, symTab, symRelTab,
+impSymIxs, relocTab, section data, then the relocation tables as
+TI DI RI, TA DA RA, symTabStr, TAS DAS RAS, TIS DIS RIS so that
+DisposeRelocationElement() can cut the local half off the end of the file, and the
+string table with it once the names are in a string pool (xffStrPool.c).
+*/
+
+#include "libxff.h"
+
+struct XffBuildReloc
+{
+    u32 addr; // offset in the section
+    u32 relType;
+    u32 symIx;
+    u32 inst;
+};
+
+struct XffBuildRelTab
+{
+    u32 nrEnt;
+    u32 cap;
+    struct XffBuildReloc *ent;
+};
+
+struct XffBuildSect
+{
+    char *name;
+    u32 type;
+    u32 align;
+    s32 flags;
+    u32 size;
+    u8 *data; // NULL for nobits
+    u32 symIx; // STT_SECTION symbol of this section
+    struct XffBuildRelTab ext; // relocations against imported symbols
+    struct XffBuildRelTab loc; // relocations against symbols of this module
+};
+
+struct XffBuildSym
+{
+    char *name;
+    u32 offs; // offset in 'sect', or the value of XFF_SECT_ABS symbols
+    u32 size;
+    u8 type;
+    u8 bindAttr;
+    u16 sect; // 0 = imported
+};
+
+struct XffBuilder
+{
+    struct XffBuildSect *sect; // sect[0] is the zero section
+    u32 sectNrE;
+    u32 sectCap;
+    struct XffBuildSym *sym; // sym[0] is the undefined symbol
+    u32 symNrE;
+    u32 symCap;
+    u32 entryOffs; // relative to the first section placed in memory
+    s32 specSectNrE;
+    u32 fileAlign; // minimum file alignment of section data, 0 = section align
+    s32 hashSection; // append an XFF_EXT_HASH block, see xffHash.c
+    s32 relPlanSection; // append an XFF_EXT_RELPLAN block, see xffRelPlan.c
+    s32 noMem; // an XffBuilderAdd*() ran out of memory, XffBuilderWrite() fails
+};
+
+enum
+{
+    XFF_STT_NOTYPE = 0,
+    XFF_STT_OBJECT = 1,
+    XFF_STT_FUNC = 2,
+    XFF_STT_SECTION = 3,
+};
+
+void XffBuilderInit(struct XffBuilder *b);
+void XffBuilderFree(struct XffBuilder *b);
+u32 XffBuilderAddSection(struct XffBuilder *b, const char *name, u32 type, u32 align, s32 flags, const void *data, u32 size);
+u32 XffBuilderAddSymbol(struct XffBuilder *b, const char *name, u16 sect, u32 offs, u32 size, u8 type, u8 bindAttr);
+void XffBuilderAddReloc(struct XffBuilder *b, u32 sect, u32 addr, u32 relType, u32 symIx, u32 inst);
+s32 XffBuilderWrite(const struct XffBuilder *b, u8 **out, u32 *sizeOut);
+
+// MIPS ELF input, see xffElf.c
+struct XffElfOptions
+{
+    const char *entry; // entry point symbol, NULL = e_entry of executables, _start of relocatables
+    s32 sectFlags;     // t_xffSectEnt.flags of every section, != 0 moves them at 0x100 alignment
+};
+
+struct XffElfInfo
+{
+    u32 sections;
+    u32 symbols;
+    u32 exports;
+    u32 imports;
+    u32 relocs;
+    u32 relocsDropped; // R_MIPS_NONE, R_MIPS_JALR and PC16 branches inside a section
+    u32 checked;       // section bytes XffElfCheck() compared with the link
+    char err[160];     // why the conversion failed
+};
+
+s32 XffElfConvert(struct XffBuilder *b, const u8 *elf, u32 size, const struct XffElfOptions *opt, struct XffElfInfo *info);
+s32 XffElfCheck(const u8 *elf, u32 size, const u8 *xff, u32 xffSize, const struct XffElfOptions *opt, struct XffElfInfo *info);
+
+// Synthetic modules, see xffGen.c
+struct XffGenParams
+{
+    u32 seed;
+    u32 sectNrE;  // progbits sections, they hold the relocation sites
+    u32 bssNrE;   // nobits sections
+    u32 alignMin; // every section gets a power of two alignment in [alignMin, alignMax]
+    u32 alignMax;
+    s32 sectFlags; // t_xffSectEnt.flags of every section
+    u32 padBytes;  // added to each progbits section, the size of each nobits one
+    u32 exportNrE; // global symbols, exportPrefix0...
+    u32 localNrE;  // local symbols
+    u32 importNrE; // importPrefix0...
+    const char *exportPrefix;
+    const char *importPrefix;
+    u32 relocNrE;    // relocation entries, spread evenly over the progbits sections
+    u32 weight[3];   // relative share of R_32, R_26 and HI16/LO16 sites
+    u32 hiRunMax;    // up to this many HI16 entries share one LO16
+    u32 extPercent;  // share of the sites that refer to an import
+    s32 hashSection; // see XffBuilder.hashSection
+};
+
+void XffGenDefaults(struct XffGenParams *p);
+s32 XffGenerate(const struct XffGenParams *p, u8 **out, u32 *sizeOut);
+
+// Several modules merged into one, see xffMerge.c
+struct XffMergeInfo
+{
+    u32 modules;
+    u32 sectionsIn;
+    u32 sections;
+    u32 symbolsIn;
+    u32 symbols;
+    u32 importsIn;    // imports of all inputs
+    u32 imports;      // left in the merged module, one per name
+    u32 importsBound; // bound to the export of another input at merge time
+    u32 relocs;
+    u32 extRelocsIn;  // entries of the extern tables of all inputs
+    u32 extRelocs;    // of the merged module, the others are local now
+    u32 checked;      // section bytes XffMergeCheck() compared
+    char err[160];    // why the merge failed
+};
+
+s32 XffMerge(struct XffBuilder *b, const u8 *const *img, const u32 *size, const char *const *names, u32 nrE,
+             struct XffMergeInfo *info);
+s32 XffMergeCheck(const u8 *const *img, const u32 *size, const char *const *names, u32 nrE, const u8 *xff, u32 xffSize,
+                  struct XffMergeInfo *info);
+
+// Dead symbol stripping of a whole set of modules, see xffStrip.c
+struct XffStripInfo
+{
+    u32 symbolsIn;
+    u32 symbols;
+    u32 exportsIn;
+    u32 exports;
+    u32 importsIn;
+    u32 imports;
+    u32 demoted;    // exports nobody imports that relocations still refer to, now locals
+    u32 strBytesIn; // symTabStr
+    u32 strBytes;
+};
+
+s32 XffStripSet(struct XffBuilder *b, u32 nrE, const char *const *keep, u32 keepNrE, s32 keepLocalNames,
+                struct XffStripInfo *info);
+s32 XffStripCheck(const u8 *const *img, const u32 *size, const u8 *const *out, const u32 *outSize, const char *const *names,
+                  u32 nrE, u32 *checked, char *err, u32 errSize);
+
+#endif /* XFFBUILD_H */
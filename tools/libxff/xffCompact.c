@@ -0,0 +1,185 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libxff.h"
+
+/*
+Heap compaction for the region heap.
+
+Loading and unloading modules leaves holes between regions until a large module no
+longer fits in one piece, even with enough memory free in total. XffCompact() slides
+the chunks of movable modules (loaded with XffLoader.keepLocalRelocs) down into the
+holes, lowest chunk first, each to the lowest address it fits. A chunk is moved the way
+MoveElf() moves a module: memmove() the contents, rebase the file image header if the
+chunk holds it (RelocateElfInfoHeader() at the new address), then fix every reference
+with XffRelocateOnline(), in incremental mode.
+
+Cost model: a move costs the bytes copied plus XFF_COMPACT_SITE_COST per relocation
+site reapplied. Before a chunk is moved its cost is estimated from its used bytes and
+the entries in the module's own tables; what it actually cost is known afterwards.
+With a budget the call stops before a move whose estimate would take it over, so
+compaction can run in small steps between frames. The first move of a call is always
+made, a chunk larger than the budget still moves.
+*/
+
+struct CompactChunk
+{
+    struct XffRegionChunk *chunk;
+    struct XffModule *mod;
+};
+
+static int CompareChunk(const void *a, const void *b)
+{
+    const struct CompactChunk *ca = a;
+    const struct CompactChunk *cb = b;
+
+    return ca->chunk->addr < cb->chunk->addr ? -1 : ca->chunk->addr > cb->chunk->addr;
+}
+
+static u32 ModuleEntries(const struct XffArena *ar, const struct t_xffEntPntHdr *xffEp)
+{
+    const struct t_xffRelocEnt *rt = XffPtr(ar, xffEp->relocTab);
+    u32 n = 0;
+    s32 i;
+
+    for (i = 0; i < xffEp->relocTabNrE; i++)
+        n += rt[i].nrEnt;
+
+    return n;
+}
+
+u32 XffCompactEstimate(const struct XffLoader *ldr, const struct XffModule *mod, const struct XffRegionChunk *chunk)
+{
+    return chunk->used + ModuleEntries(&ldr->arena, mod->xffEp) * XFF_COMPACT_SITE_COST;
+}
+
+// Moves the contents of a chunk that was relocated from 'from' to chunk->addr and fixes
+// up the module.
+static s32 MoveChunk(struct XffLoader *ldr, struct XffModule *mod, const struct XffRegionChunk *chunk, u32 from,
+                     struct XffMoveStats *st)
+{
+    struct XffArena *ar = &ldr->arena;
+    struct t_xffSectEnt *sect;
+    s32 shift = chunk->addr - from;
+    s32 *delta;
+    s32 ret;
+    s32 i;
+
+    memmove(XffPtr(ar, chunk->addr), XffPtr(ar, from), chunk->used);
+    st->bytesMoved += chunk->used;
+
+    if (mod->fileAddr >= from && mod->fileAddr < from + chunk->size)
+    {
+        if (ldr->symIndex != NULL)
+            XffSymIndexRebaseModule(ldr->symIndex, mod, shift);
+        mod->fileAddr += shift;
+        mod->xffEp = XffPtr(ar, mod->fileAddr);
+        XffRelocateElfInfoHeader(ar, mod->xffEp, mod->fileAddr);
+    }
+    if (mod->hashTab >= from && mod->hashTab < from + chunk->size)
+        mod->hashTab += shift;
+
+    delta = calloc(mod->xffEp->sectNrE, sizeof(*delta));
+    if (delta == NULL)
+        return XFF_ERR_NOMEM;
+
+    // Sections used in place in the file image move with it
+    sect = XffPtr(ar, mod->xffEp->sectTab);
+    for (i = 1; i < mod->xffEp->sectNrE; i++)
+    {
+        if (sect[i].memPt != 0 && sect[i].memPt >= from && sect[i].memPt < from + chunk->size)
+        {
+            sect[i].memPt += shift;
+            delta[i] = shift;
+            st->sections++;
+        }
+    }
+
+    // Call sites of stub imports, once the sections are where they are now
+    ret = XffLazyRebase(ldr, mod, from, chunk->size, shift);
+    if (ret == XFF_OK)
+        ret = XffRelocateOnline(ldr, mod, delta, 1, st);
+    free(delta);
+    return ret;
+}
+
+s32 XffCompact(struct XffLoader *ldr, u32 budget, struct XffCompactStats *st)
+{
+    struct XffRegionHeap *heap = ldr->regions;
+    struct CompactChunk *list;
+    struct XffRegionChunk *chunk;
+    struct XffModule *mod;
+    struct XffMoveStats mst;
+    u32 nrE = 0;
+    u32 from;
+    u32 est;
+    u32 i;
+    s32 ret = XFF_OK;
+
+    memset(st, 0, sizeof(*st));
+    st->done = 1;
+    if (heap == NULL)
+        return XFF_ERR_FORMAT;
+
+    for (mod = ldr->modules; mod != NULL; mod = mod->next)
+    {
+        if (mod->region != NULL && mod->hasLocalRelocs)
+        {
+            for (chunk = mod->region->chunks; chunk != NULL; chunk = chunk->next)
+                nrE++;
+        }
+    }
+
+    list = malloc((nrE ? nrE : 1) * sizeof(*list));
+    if (list == NULL)
+        return XFF_ERR_NOMEM;
+
+    nrE = 0;
+    for (mod = ldr->modules; mod != NULL; mod = mod->next)
+    {
+        if (mod->region == NULL || !mod->hasLocalRelocs)
+            continue;
+
+        for (chunk = mod->region->chunks; chunk != NULL; chunk = chunk->next)
+        {
+            list[nrE].chunk = chunk;
+            list[nrE].mod = mod;
+            nrE++;
+        }
+    }
+    qsort(list, nrE, sizeof(*list), CompareChunk);
+
+    for (i = 0; i < nrE; i++)
+    {
+        chunk = list[i].chunk;
+
+        // Nothing free below it, nowhere to go
+        if (XffRegionLowestFree(heap) == 0 || XffRegionLowestFree(heap) >= chunk->addr)
+            continue;
+
+        est = XffCompactEstimate(ldr, list[i].mod, chunk);
+        if (budget != 0 && st->chunks != 0 && st->cost + est > budget)
+        {
+            st->done = 0;
+            break;
+        }
+
+        from = chunk->addr;
+        if (XffRegionRelocateChunk(heap, chunk) == from)
+            continue;
+
+        memset(&mst, 0, sizeof(mst));
+        ret = MoveChunk(ldr, list[i].mod, chunk, from, &mst);
+        st->chunks++;
+        st->bytesMoved += mst.bytesMoved;
+        st->sites += mst.sites;
+        st->fullSites += mst.fullSites;
+        st->estimate += est;
+        st->cost += mst.bytesMoved + mst.sites * XFF_COMPACT_SITE_COST;
+        if (ret != XFF_OK)
+            break;
+    }
+
+    free(list);
+    return ret;
+}
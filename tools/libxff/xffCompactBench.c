@@ -0,0 +1,382 @@
+/*
+xffcompactbench: heap compaction over a load/unload trace.
+
+Usage: xffcompactbench [-s heapSize] [-c chunkSize] [-b budget] [-n steps] [-r seed]
+                       [-t trace] [-o out.csv] file.xff...
+
+Replays the same trace on three region heaps of 'heapSize' bytes (default 1 MiB):
+without compaction, with one XffCompact() step of 'budget' cost units after every trace
+step (default 0x8000, the work that fits between two frames), and with full compaction
+after every step. Modules are loaded with their local relocation tables so they can be
+moved. The trace format is the one of xffregionbench; without -t a random trace of
+'steps' loads and unloads of the given files is generated. A load that doesn't fit is
+counted as failed and skipped.
+
+The largest free block of each heap after every step goes to 'out.csv'; the summary
+gives its minimum and mean, the failed loads and the compaction cost.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libxff.h"
+
+enum
+{
+    MODE_NONE,
+    MODE_STEP,
+    MODE_FULL,
+    MODE_NRE,
+};
+
+static const char *sModeNames[MODE_NRE] = {"none", "budgeted", "full"};
+
+struct TraceStep
+{
+    s32 load;
+    s32 file;
+};
+
+struct BenchFile
+{
+    const char *path;
+    void *data;
+    u32 size;
+};
+
+struct Heap
+{
+    struct XffLoader ldr;
+    u32 failed;
+    u32 minLargest;
+    double sumLargest;
+    u64 bytesMoved;
+    u64 sites;
+    u64 fullSites;
+    u64 estimate;
+    u64 cost;
+    u32 chunks;
+    double sec;
+};
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static s32 FindFile(struct BenchFile *files, s32 fileNrE, const char *path)
+{
+    s32 i;
+
+    for (i = 0; i < fileNrE; i++)
+    {
+        if (strcmp(files[i].path, path) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static struct TraceStep *ReadTrace(const char *path, struct BenchFile **files, s32 *fileNrE, s32 *stepNrE)
+{
+    struct TraceStep *step = NULL;
+    char line[1024];
+    FILE *f;
+    s32 cap = 0;
+    s32 ix;
+
+    f = fopen(path, "r");
+    if (f == NULL)
+        return NULL;
+
+    *stepNrE = 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if ((line[0] != '+' && line[0] != '-') || line[1] != ' ')
+            continue;
+
+        ix = FindFile(*files, *fileNrE, line + 2);
+        if (ix < 0)
+        {
+            *files = realloc(*files, (*fileNrE + 1) * sizeof(**files));
+            memset(&(*files)[*fileNrE], 0, sizeof(**files));
+            (*files)[*fileNrE].path = strdup(line + 2);
+            ix = (*fileNrE)++;
+        }
+
+        if (*stepNrE == cap)
+        {
+            cap = cap ? cap * 2 : 64;
+            step = realloc(step, cap * sizeof(*step));
+        }
+        step[*stepNrE].load = line[0] == '+';
+        step[*stepNrE].file = ix;
+        (*stepNrE)++;
+    }
+
+    fclose(f);
+    return step;
+}
+
+// Random churn: load while few modules are live, unload a random live one otherwise.
+static struct TraceStep *RandomTrace(s32 fileNrE, s32 stepNrE, u32 seed)
+{
+    struct TraceStep *step = calloc(stepNrE, sizeof(*step));
+    s32 *live = calloc(stepNrE, sizeof(*live));
+    s32 liveNrE = 0;
+    s32 target = fileNrE + 2;
+    s32 i;
+    s32 k;
+
+    for (i = 0; i < stepNrE; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        if (liveNrE == 0 || (liveNrE < target && ((seed >> 16) & 3) != 0))
+        {
+            seed = seed * 1103515245 + 12345;
+            step[i].load = 1;
+            step[i].file = (seed >> 16) % fileNrE;
+            live[liveNrE++] = step[i].file;
+        }
+        else
+        {
+            seed = seed * 1103515245 + 12345;
+            k = (seed >> 16) % liveNrE;
+            step[i].file = live[k];
+            live[k] = live[--liveNrE];
+        }
+    }
+
+    free(live);
+    return step;
+}
+
+static struct XffModule *FindModule(struct XffLoader *ldr, const char *path)
+{
+    struct XffModule *mod;
+
+    for (mod = ldr->modules; mod != NULL; mod = mod->next)
+    {
+        if (strcmp(mod->name, path) == 0)
+            return mod;
+    }
+    return NULL;
+}
+
+// Relocation is idempotent: if the moves fixed every reference, applying every table
+// again with the symbol values the modules hold now changes nothing. Imports are not
+// bound again, a module keeps the exporter it was bound to when it was loaded.
+static s32 Verify(struct XffLoader *ldr)
+{
+    struct XffModule *mod;
+    u8 *copy;
+    s32 same;
+
+    copy = malloc(ldr->arena.size);
+    memcpy(copy, ldr->arena.host, ldr->arena.size);
+    for (mod = ldr->modules; mod != NULL; mod = mod->next)
+        XffRelocateCode(&ldr->arena, mod->xffEp, 0, mod->xffEp->relocTabNrE);
+    same = memcmp(copy, ldr->arena.host, ldr->arena.size) == 0;
+    free(copy);
+    return same;
+}
+
+static void Step(struct Heap *h, s32 mode, u32 budget, const struct BenchFile *file, s32 load)
+{
+    struct XffRegionHeapStats rst;
+    struct XffCompactStats cst;
+    struct XffModule *mod;
+    double t0;
+
+    if (load)
+    {
+        if (XffLoadImage(&h->ldr, file->path, file->data, file->size, &mod) != XFF_OK)
+            h->failed++;
+    }
+    else if ((mod = FindModule(&h->ldr, file->path)) != NULL)
+    {
+        XffUnloadModule(&h->ldr, mod);
+    }
+
+    if (mode != MODE_NONE)
+    {
+        t0 = NowSec();
+        do
+        {
+            XffCompact(&h->ldr, mode == MODE_STEP ? budget : 0, &cst);
+            h->chunks += cst.chunks;
+            h->bytesMoved += cst.bytesMoved;
+            h->sites += cst.sites;
+            h->fullSites += cst.fullSites;
+            h->estimate += cst.estimate;
+            h->cost += cst.cost;
+        } while (mode == MODE_FULL && cst.chunks != 0);
+        h->sec += NowSec() - t0;
+    }
+
+    XffRegionHeapStats(h->ldr.regions, &rst);
+    if (rst.largestFree < h->minLargest)
+        h->minLargest = rst.largestFree;
+    h->sumLargest += rst.largestFree;
+}
+
+int main(int argc, char **argv)
+{
+    struct Heap heap[MODE_NRE];
+    struct BenchFile *files = NULL;
+    struct TraceStep *step = NULL;
+    struct XffRegionHeapStats rst[MODE_NRE];
+    const char *tracePath = NULL;
+    const char *csvPath = NULL;
+    FILE *csv = NULL;
+    u32 heapSize = 0x100000;
+    u32 chunkSize = 0x4000;
+    u32 budget = 0x8000;
+    u32 seed = 1;
+    s32 stepNrE = 500;
+    s32 fileNrE = 0;
+    s32 ret = 0;
+    s32 opt;
+    s32 m;
+    s32 i;
+
+    while ((opt = getopt(argc, argv, "s:c:b:n:r:t:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            heapSize = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            chunkSize = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            budget = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            stepNrE = strtol(optarg, NULL, 0);
+            break;
+        case 'r':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            tracePath = optarg;
+            break;
+        case 'o':
+            csvPath = optarg;
+            break;
+        default:
+            optind = argc;
+            stepNrE = 0;
+            break;
+        }
+    }
+
+    if (tracePath != NULL)
+    {
+        step = ReadTrace(tracePath, &files, &fileNrE, &stepNrE);
+        if (step == NULL)
+        {
+            fprintf(stderr, "xffcompactbench: can't read %s\n", tracePath);
+            return 1;
+        }
+    }
+    else if (optind < argc && stepNrE > 0)
+    {
+        fileNrE = argc - optind;
+        files = calloc(fileNrE, sizeof(*files));
+        for (i = 0; i < fileNrE; i++)
+            files[i].path = argv[optind + i];
+        step = RandomTrace(fileNrE, stepNrE, seed);
+    }
+
+    if (step == NULL || fileNrE == 0 || budget == 0)
+    {
+        fprintf(stderr, "usage: %s [-s heapSize] [-c chunkSize] [-b budget] [-n steps] [-r seed] [-t trace] [-o out.csv] file.xff...\n",
+                argv[0]);
+        return 1;
+    }
+
+    for (i = 0; i < fileNrE; i++)
+    {
+        files[i].data = XffMapFile(files[i].path, &files[i].size);
+        if (files[i].data == NULL)
+        {
+            fprintf(stderr, "xffcompactbench: can't map %s\n", files[i].path);
+            return 1;
+        }
+    }
+
+    memset(heap, 0, sizeof(heap));
+    for (m = 0; m < MODE_NRE; m++)
+    {
+        if (XffLoaderInit(&heap[m].ldr, XFF_ARENA_DEFAULT_BASE, heapSize) != XFF_OK || XffLoaderUseRegions(&heap[m].ldr, chunkSize) != XFF_OK)
+        {
+            fprintf(stderr, "xffcompactbench: can't create arena\n");
+            return 1;
+        }
+        XffLoaderUseSymIndex(&heap[m].ldr, 1);
+        heap[m].ldr.keepLocalRelocs = 1;
+        heap[m].ldr.noPrelink = 1;
+        heap[m].minLargest = 0xFFFFFFFF;
+    }
+
+    if (csvPath != NULL)
+    {
+        csv = fopen(csvPath, "w");
+        if (csv == NULL)
+        {
+            fprintf(stderr, "xffcompactbench: can't write %s\n", csvPath);
+            return 1;
+        }
+        fprintf(csv, "step,op,largest_none,largest_budgeted,largest_full\n");
+    }
+
+    for (i = 0; i < stepNrE; i++)
+    {
+        for (m = 0; m < MODE_NRE; m++)
+            Step(&heap[m], m, budget, &files[step[i].file], step[i].load);
+
+        if (csv != NULL)
+        {
+            for (m = 0; m < MODE_NRE; m++)
+                XffRegionHeapStats(heap[m].ldr.regions, &rst[m]);
+            fprintf(csv, "%d,%c,%u,%u,%u\n", i, step[i].load ? '+' : '-', rst[MODE_NONE].largestFree, rst[MODE_STEP].largestFree,
+                    rst[MODE_FULL].largestFree);
+        }
+    }
+    if (csv != NULL)
+        fclose(csv);
+
+    printf("steps           : %d (%d files), heap 0x%x, chunks 0x%x, budget %u\n", stepNrE, fileNrE, heapSize, chunkSize, budget);
+    printf("                      failed   min largest  mean largest     moved        sites  est/actual       ms\n");
+    for (m = 0; m < MODE_NRE; m++)
+    {
+        printf("  %-12s %10u %13u %13.0f %9llu %12llu %11.2f %8.3f\n", sModeNames[m], heap[m].failed, heap[m].minLargest,
+               heap[m].sumLargest / stepNrE, (unsigned long long)heap[m].bytesMoved, (unsigned long long)heap[m].sites,
+               heap[m].cost != 0 ? (double)heap[m].estimate / heap[m].cost : 0.0, heap[m].sec * 1e3);
+    }
+    printf("incremental sites are %.1f%% of a full re-relocation per move\n",
+           heap[MODE_FULL].fullSites != 0 ? heap[MODE_FULL].sites * 100.0 / heap[MODE_FULL].fullSites : 0.0);
+
+    for (m = 0; m < MODE_NRE; m++)
+    {
+        if (!Verify(&heap[m].ldr))
+        {
+            fprintf(stderr, "xffcompactbench: %s: relinking changed the heap\n", sModeNames[m]);
+            ret = 1;
+        }
+        XffLoaderTerm(&heap[m].ldr);
+    }
+    for (i = 0; i < fileNrE; i++)
+        XffUnmapFile(files[i].data, files[i].size);
+    free(files);
+    free(step);
+    return ret;
+}
@@ -0,0 +1,666 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xffBuild.h"
+
+/*
+MIPS ELF to XFF2 conversion.
+
+Takes a little endian 32-bit MIPS relocatable (ET_REL) or an executable linked with
+--emit-relocs (ET_EXEC) and fills an XffBuilder, which lays the file out the way the
+loader expects. Every allocated progbits and nobits section becomes an XFF section, the
+section holding the entry point first (the entry point is relative to the first section
+placed in memory). Undefined symbols become imports, defined global and weak symbols
+exports, and common symbols get a nobits section of their own.
+
+XFF applies REL style relocations, the addend is the original instruction:
+  R_MIPS_32, R_MIPS_26      inst is the word at the site
+  R_MIPS_HI16, R_MIPS_LO16  a run of HI16 takes the low half of its addend from the LO16
+                            that follows it in the same table
+ELF pairs a HI16 with the next LO16 against the same symbol instead, so HI16 entries are
+held back and written right in front of their LO16. In an executable the sites already
+hold the final values; the addends are taken back out by subtracting the link time value
+of the symbol. Relocations XFF has no use for are dropped: R_MIPS_NONE, the R_MIPS_JALR
+hints and, in executables, R_MIPS_PC16 branches that stay inside their section. Anything
+else (gp relative or PIC code, RELA) is refused.
+*/
+
+struct ElfHdr
+{
+    u8 ident[16];
+    u16 type;
+    u16 machine;
+    u32 version;
+    u32 entry;
+    u32 phoff;
+    u32 shoff;
+    u32 flags;
+    u16 ehsize;
+    u16 phentsize;
+    u16 phnum;
+    u16 shentsize;
+    u16 shnum;
+    u16 shstrndx;
+};
+
+struct ElfShdr
+{
+    u32 name;
+    u32 type;
+    u32 flags;
+    u32 addr;
+    u32 offset;
+    u32 size;
+    u32 link;
+    u32 info;
+    u32 addralign;
+    u32 entsize;
+};
+
+struct ElfSym
+{
+    u32 name;
+    u32 value;
+    u32 size;
+    u8 info;
+    u8 other;
+    u16 shndx;
+};
+
+struct ElfRel
+{
+    u32 offset;
+    u32 info;
+};
+
+#define ELF_ET_REL (1)
+#define ELF_ET_EXEC (2)
+#define ELF_EM_MIPS (8)
+
+#define ELF_SHT_PROGBITS (1)
+#define ELF_SHT_SYMTAB (2)
+#define ELF_SHT_RELA (4)
+#define ELF_SHT_NOBITS (8)
+#define ELF_SHT_REL (9)
+#define ELF_SHF_ALLOC (2)
+
+#define ELF_SHN_UNDEF (0)
+#define ELF_SHN_LORESERVE (0xFF00)
+#define ELF_SHN_ABS (0xFFF1)
+#define ELF_SHN_COMMON (0xFFF2)
+
+#define ELF_STB_LOCAL (0)
+#define ELF_STT_SECTION (3)
+#define ELF_STT_FILE (4)
+#define ELF_STT_COMMON (5)
+
+#define ELF_R_MIPS_NONE (0)
+#define ELF_R_MIPS_32 (2)
+#define ELF_R_MIPS_26 (4)
+#define ELF_R_MIPS_HI16 (5)
+#define ELF_R_MIPS_LO16 (6)
+#define ELF_R_MIPS_PC16 (10)
+#define ELF_R_MIPS_JALR (37)
+
+#define NO_SYM (0xFFFFFFFF)
+
+struct Conv
+{
+    const u8 *elf;
+    u32 size;
+    const struct ElfHdr *eh;
+    const struct ElfShdr *sh;
+    const char *shStr;
+    u32 shStrSize;
+    const struct ElfSym *sym;
+    u32 symNrE;
+    const char *str;
+    u32 strSize;
+    s32 exec;
+    u32 *order;   // converted ELF sections, in XFF order
+    u32 orderNrE;
+    u32 *sectIx;  // ELF section -> XFF section, 0 = not converted
+    struct XffElfInfo *info;
+};
+
+// Pending R_MIPS_HI16 of one relocation section, chained per symbol
+struct PendHi
+{
+    u32 offs;
+    u32 word;
+    u32 next;
+};
+
+static s32 Fail(struct Conv *c, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(c->info->err, sizeof(c->info->err), fmt, ap);
+    va_end(ap);
+    return XFF_ERR_FORMAT;
+}
+
+static inline s32 IsConverted(const struct ElfShdr *sh)
+{
+    return (sh->flags & ELF_SHF_ALLOC) != 0 && (sh->type == ELF_SHT_PROGBITS || sh->type == ELF_SHT_NOBITS);
+}
+
+static inline s32 InFile(const struct Conv *c, u32 offs, u32 size)
+{
+    return offs <= c->size && size <= c->size - offs;
+}
+
+static const char *SymName(const struct Conv *c, u32 i)
+{
+    return c->sym[i].name < c->strSize ? c->str + c->sym[i].name : "";
+}
+
+static const char *SectName(const struct Conv *c, u32 i)
+{
+    return c->sh[i].name < c->shStrSize ? c->shStr + c->sh[i].name : "";
+}
+
+// Checks the headers and finds the section and symbol tables
+static s32 Open(struct Conv *c, const u8 *elf, u32 size, struct XffElfInfo *info)
+{
+    const struct ElfShdr *symSh = NULL;
+    u32 i;
+
+    memset(c, 0, sizeof(*c));
+    memset(info, 0, sizeof(*info));
+    c->elf = elf;
+    c->size = size;
+    c->info = info;
+    c->eh = (const struct ElfHdr *)elf;
+
+    if (size < sizeof(*c->eh) || memcmp(elf, "\177ELF", 4) != 0)
+        return Fail(c, "not an ELF file");
+    if (elf[4] != 1 || elf[5] != 1 || c->eh->machine != ELF_EM_MIPS)
+        return Fail(c, "not a 32-bit little endian MIPS ELF");
+    if (c->eh->type != ELF_ET_REL && c->eh->type != ELF_ET_EXEC)
+        return Fail(c, "only relocatables and executables can be converted");
+    if (c->eh->shentsize != sizeof(*c->sh) || (c->eh->shoff & 3) != 0 || !InFile(c, c->eh->shoff, c->eh->shnum * sizeof(*c->sh)) ||
+        c->eh->shstrndx >= c->eh->shnum)
+        return Fail(c, "bad section header table");
+
+    c->exec = c->eh->type == ELF_ET_EXEC;
+    c->sh = (const struct ElfShdr *)(elf + c->eh->shoff);
+    if (c->sh[c->eh->shstrndx].type != ELF_SHT_NOBITS && InFile(c, c->sh[c->eh->shstrndx].offset, c->sh[c->eh->shstrndx].size))
+    {
+        c->shStr = (const char *)elf + c->sh[c->eh->shstrndx].offset;
+        c->shStrSize = c->sh[c->eh->shstrndx].size;
+    }
+
+    for (i = 1; i < c->eh->shnum; i++)
+    {
+        if (c->sh[i].type != ELF_SHT_NOBITS && !InFile(c, c->sh[i].offset, c->sh[i].size))
+            return Fail(c, "section %u lies outside the file", i);
+        if (c->sh[i].type == ELF_SHT_SYMTAB)
+            symSh = &c->sh[i];
+    }
+    if (c->shStr == NULL || c->shStrSize == 0 || c->shStr[c->shStrSize - 1] != '\0')
+        return Fail(c, "bad section name table");
+
+    if (symSh == NULL)
+        return Fail(c, "no symbol table");
+    if ((symSh->offset & 3) != 0 || symSh->link >= c->eh->shnum || c->sh[symSh->link].size == 0 ||
+        c->sh[symSh->link].type == ELF_SHT_NOBITS)
+        return Fail(c, "bad symbol table");
+
+    c->sym = (const struct ElfSym *)(elf + symSh->offset);
+    c->symNrE = symSh->size / sizeof(*c->sym);
+    c->str = (const char *)elf + c->sh[symSh->link].offset;
+    c->strSize = c->sh[symSh->link].size;
+    if (c->str[c->strSize - 1] != '\0')
+        return Fail(c, "bad symbol name table");
+    return XFF_OK;
+}
+
+static void Close(struct Conv *c)
+{
+    free(c->order);
+    free(c->sectIx);
+}
+
+// Picks the sections to convert and their order, the entry point's section first.
+// 'entry' is the offset of the entry point in it.
+static s32 Order(struct Conv *c, const struct XffElfOptions *opt, u32 *entry)
+{
+    const struct ElfShdr *sh = c->sh;
+    u32 entSect = 0;
+    u32 i;
+
+    *entry = 0;
+    if (opt != NULL && opt->entry != NULL)
+    {
+        for (i = 1; i < c->symNrE; i++)
+        {
+            if (c->sym[i].shndx != ELF_SHN_UNDEF && c->sym[i].shndx < c->eh->shnum && strcmp(SymName(c, i), opt->entry) == 0)
+                break;
+        }
+        if (i == c->symNrE || !IsConverted(&sh[c->sym[i].shndx]))
+            return Fail(c, "entry symbol %s is not defined in a converted section", opt->entry);
+        entSect = c->sym[i].shndx;
+        *entry = c->sym[i].value - (c->exec ? sh[entSect].addr : 0);
+    }
+    else if (c->exec)
+    {
+        for (i = 1; i < c->eh->shnum && entSect == 0; i++)
+        {
+            if (IsConverted(&sh[i]) && c->eh->entry >= sh[i].addr && c->eh->entry - sh[i].addr < sh[i].size)
+                entSect = i;
+        }
+        if (entSect != 0)
+            *entry = c->eh->entry - sh[entSect].addr;
+    }
+    else
+    {
+        for (i = 1; i < c->symNrE; i++)
+        {
+            if (c->sym[i].shndx < c->eh->shnum && IsConverted(&sh[c->sym[i].shndx]) && strcmp(SymName(c, i), "_start") == 0)
+            {
+                entSect = c->sym[i].shndx;
+                *entry = c->sym[i].value;
+                break;
+            }
+        }
+    }
+
+    c->order = malloc((c->eh->shnum + 1) * sizeof(*c->order));
+    c->sectIx = calloc(c->eh->shnum + 1, sizeof(*c->sectIx));
+    if (c->order == NULL || c->sectIx == NULL)
+        return XFF_ERR_NOMEM;
+
+    if (entSect != 0)
+        c->order[c->orderNrE++] = entSect;
+    for (i = 1; i < c->eh->shnum; i++)
+    {
+        if (IsConverted(&sh[i]) && i != entSect)
+            c->order[c->orderNrE++] = i;
+    }
+    for (i = 0; i < c->orderNrE; i++)
+        c->sectIx[c->order[i]] = i + 1;
+    return XFF_OK;
+}
+
+// Link time value of symbol 'i', what the sites of an executable were relocated with
+static u32 SymValue(const struct Conv *c, u32 i)
+{
+    if ((c->sym[i].info & 0xF) == ELF_STT_SECTION && c->sym[i].shndx < c->eh->shnum)
+        return c->sh[c->sym[i].shndx].addr;
+    return c->sym[i].value;
+}
+
+static s32 AddSymbols(struct Conv *c, struct XffBuilder *b, u32 *symIx, s32 flags)
+{
+    const struct ElfSym *sym;
+    u32 commonSect = 0;
+    u32 commonSize = 0;
+    u32 commonAlign = 1;
+    u32 offs;
+    u32 i;
+    u8 type;
+    u8 bind;
+
+    // Common symbols get a nobits section after the converted ones
+    for (i = 1; i < c->symNrE; i++)
+    {
+        sym = &c->sym[i];
+        if (sym->shndx != ELF_SHN_COMMON)
+            continue;
+        if (sym->value == 0 || (sym->value & (sym->value - 1)) != 0)
+            return Fail(c, "common symbol %s has a bad alignment", SymName(c, i));
+        commonSize = ((commonSize + sym->value - 1) & ~(sym->value - 1)) + sym->size;
+        commonAlign = sym->value > commonAlign ? sym->value : commonAlign;
+    }
+    if (commonSize != 0)
+        commonSect = XffBuilderAddSection(b, "COMMON", XFF_SECT_NOBITS, commonAlign, flags, NULL, commonSize);
+    commonSize = 0;
+
+    symIx[0] = 0;
+    for (i = 1; i < c->symNrE; i++)
+    {
+        sym = &c->sym[i];
+        type = sym->info & 0xF;
+        bind = sym->info >> 4;
+        symIx[i] = NO_SYM;
+
+        if (type == ELF_STT_FILE)
+            continue;
+        if (type == ELF_STT_SECTION)
+        {
+            if (sym->shndx < c->eh->shnum && c->sectIx[sym->shndx] != 0)
+                symIx[i] = b->sect[c->sectIx[sym->shndx]].symIx;
+            continue;
+        }
+        if (type == ELF_STT_COMMON)
+            type = XFF_STT_OBJECT;
+        if (type > XFF_STT_FUNC)
+            return Fail(c, "symbol %s has unsupported type %u", SymName(c, i), type);
+
+        // Weak definitions are exported like global ones, the loader only looks for those
+        bind = bind == ELF_STB_LOCAL ? 0 : XFF_STB_GLOBAL;
+
+        if (sym->shndx == ELF_SHN_UNDEF)
+        {
+            if (sym->name == 0)
+                symIx[i] = 0;
+            else
+                symIx[i] = XffBuilderAddSymbol(b, SymName(c, i), 0, 0, sym->size, type, XFF_STB_GLOBAL);
+        }
+        else if (sym->shndx == ELF_SHN_ABS)
+        {
+            symIx[i] = XffBuilderAddSymbol(b, SymName(c, i), XFF_SECT_ABS, sym->value, sym->size, type, bind);
+        }
+        else if (sym->shndx == ELF_SHN_COMMON)
+        {
+            offs = (commonSize + sym->value - 1) & ~(sym->value - 1);
+            commonSize = offs + sym->size;
+            symIx[i] = XffBuilderAddSymbol(b, SymName(c, i), commonSect, offs, sym->size, type, bind);
+        }
+        else if (sym->shndx < c->eh->shnum && c->sectIx[sym->shndx] != 0)
+        {
+            offs = sym->value - (c->exec ? c->sh[sym->shndx].addr : 0);
+            symIx[i] = XffBuilderAddSymbol(b, SymName(c, i), c->sectIx[sym->shndx], offs, sym->size, type, bind);
+        }
+        else if (sym->shndx >= ELF_SHN_LORESERVE)
+        {
+            return Fail(c, "symbol %s is in unsupported section 0x%x", SymName(c, i), sym->shndx);
+        }
+
+        if (symIx[i] != NO_SYM && bind != 0 && sym->shndx != ELF_SHN_UNDEF)
+            c->info->exports++;
+        if (symIx[i] != NO_SYM && symIx[i] != 0 && sym->shndx == ELF_SHN_UNDEF)
+            c->info->imports++;
+    }
+
+    c->info->symbols = b->symNrE;
+    return XFF_OK;
+}
+
+// Writes the HI16 entries waiting for symbol 'es', paired with the LO16 whose site holds
+// 'loWord' (NO_SYM: none, they go at the end of the table and see a low half of 0).
+static void FlushHi(struct Conv *c, struct XffBuilder *b, u32 sect, u32 symIx, u32 s, struct PendHi *hi, u32 *head, u32 loWord)
+{
+    u32 inst;
+    u32 ahl;
+    u32 j;
+
+    for (j = *head; j != NO_SYM; j = hi[j].next)
+    {
+        inst = hi[j].word;
+        if (c->exec)
+        {
+            ahl = (hi[j].word << 16) + (loWord != NO_SYM ? (s16)loWord : 0) - s;
+            if (loWord != NO_SYM)
+                ahl -= (s16)(ahl & 0xFFFF);
+            else
+                ahl += 0x8000;
+            inst = (hi[j].word & 0xFFFF0000) | ((ahl >> 16) & 0xFFFF);
+        }
+        XffBuilderAddReloc(b, sect, hi[j].offs, XFF_R_HI16, symIx, inst);
+        c->info->relocs++;
+    }
+    *head = NO_SYM;
+}
+
+static s32 AddRelocs(struct Conv *c, struct XffBuilder *b, const u32 *symIx, u32 relSh, u32 *head)
+{
+    const struct ElfShdr *rs = &c->sh[relSh];
+    const struct ElfShdr *target = &c->sh[rs->info];
+    const struct ElfRel *rel = (const struct ElfRel *)(c->elf + rs->offset);
+    const u8 *data = c->elf + target->offset;
+    u32 relNrE = rs->size / sizeof(*rel);
+    u32 sect = c->sectIx[rs->info];
+    struct PendHi *hi;
+    u32 *pendSym;
+    u32 pendNrE = 0;
+    u32 hiNrE = 0;
+    u32 offs;
+    u32 type;
+    u32 es;
+    u32 word;
+    u32 inst;
+    u32 s;
+    u32 a;
+    u32 j;
+
+    if ((rs->offset & 3) != 0 || target->type == ELF_SHT_NOBITS)
+        return Fail(c, "bad relocation section %s", SectName(c, relSh));
+
+    hi = malloc((relNrE + 1) * sizeof(*hi));
+    pendSym = malloc((relNrE + 1) * sizeof(*pendSym));
+    if (hi == NULL || pendSym == NULL)
+    {
+        free(hi);
+        free(pendSym);
+        return XFF_ERR_NOMEM;
+    }
+
+    for (j = 0; j < relNrE; j++)
+    {
+        type = rel[j].info & 0xFF;
+        es = rel[j].info >> 8;
+        offs = rel[j].offset - (c->exec ? target->addr : 0);
+
+        switch (type)
+        {
+        case ELF_R_MIPS_NONE:
+        case ELF_R_MIPS_JALR:
+            c->info->relocsDropped++;
+            continue;
+        case ELF_R_MIPS_32:
+        case ELF_R_MIPS_26:
+        case ELF_R_MIPS_HI16:
+        case ELF_R_MIPS_LO16:
+            break;
+        default:
+            if (type == ELF_R_MIPS_PC16 && c->exec && es < c->symNrE && c->sym[es].shndx == rs->info)
+            {
+                c->info->relocsDropped++;
+                continue;
+            }
+            free(hi);
+            free(pendSym);
+            return Fail(c, "%s+0x%x: relocation type %u is not supported (build with -G0 -mno-abicalls)", SectName(c, rs->info),
+                        offs, type);
+        }
+        if (es >= c->symNrE || offs > target->size || target->size - offs < 4)
+        {
+            free(hi);
+            free(pendSym);
+            return Fail(c, "%s+0x%x: bad relocation", SectName(c, rs->info), offs);
+        }
+        if (symIx[es] == NO_SYM)
+        {
+            free(hi);
+            free(pendSym);
+            return Fail(c, "%s+0x%x: relocation against %s, which is not in a converted section", SectName(c, rs->info), offs,
+                        SymName(c, es));
+        }
+
+        memcpy(&word, data + offs, 4);
+        s = c->exec ? SymValue(c, es) : 0;
+        inst = word;
+        switch (type)
+        {
+        case ELF_R_MIPS_32:
+            inst = word - s;
+            break;
+        case ELF_R_MIPS_26:
+            if (c->exec)
+            {
+                a = (((word & 0x03FFFFFF) << 2) | ((target->addr + offs) & 0xF0000000)) - s;
+                inst = (word & 0xFC000000) | ((a >> 2) & 0x03FFFFFF);
+            }
+            break;
+        case ELF_R_MIPS_HI16:
+            // Held back until the LO16 of the same symbol
+            if (head[es] == NO_SYM)
+                pendSym[pendNrE++] = es;
+            hi[hiNrE].offs = offs;
+            hi[hiNrE].word = word;
+            hi[hiNrE].next = head[es];
+            head[es] = hiNrE++;
+            continue;
+        case ELF_R_MIPS_LO16:
+            FlushHi(c, b, sect, symIx[es], s, hi, &head[es], word);
+            if (c->exec)
+                inst = (word & 0xFFFF0000) | ((word - s) & 0xFFFF);
+            break;
+        }
+        XffBuilderAddReloc(b, sect, offs, type, symIx[es], inst);
+        c->info->relocs++;
+    }
+
+    // HI16 without a LO16
+    for (j = 0; j < pendNrE; j++)
+        FlushHi(c, b, sect, symIx[pendSym[j]], c->exec ? SymValue(c, pendSym[j]) : 0, hi, &head[pendSym[j]], NO_SYM);
+
+    free(hi);
+    free(pendSym);
+    return XFF_OK;
+}
+
+// Converts 'elf' into 'b', a freshly initialised builder. On failure info->err says why.
+s32 XffElfConvert(struct XffBuilder *b, const u8 *elf, u32 size, const struct XffElfOptions *opt, struct XffElfInfo *info)
+{
+    struct Conv c;
+    const struct ElfShdr *sh;
+    u32 *symIx = NULL;
+    u32 *head = NULL;
+    u32 entry;
+    u32 i;
+    s32 ret;
+
+    ret = Open(&c, elf, size, info);
+    if (ret == XFF_OK)
+        ret = Order(&c, opt, &entry);
+    if (ret != XFF_OK)
+    {
+        Close(&c);
+        return ret;
+    }
+
+    for (i = 0; i < c.orderNrE; i++)
+    {
+        sh = &c.sh[c.order[i]];
+        XffBuilderAddSection(b, SectName(&c, c.order[i]), sh->type == ELF_SHT_NOBITS ? XFF_SECT_NOBITS : XFF_SECT_PROGBITS,
+                             sh->addralign, opt != NULL ? opt->sectFlags : 0, sh->type == ELF_SHT_NOBITS ? NULL : elf + sh->offset,
+                             sh->size);
+    }
+    b->entryOffs = entry;
+    info->sections = c.orderNrE;
+
+    symIx = malloc(c.symNrE * sizeof(*symIx) + 1);
+    head = malloc(c.symNrE * sizeof(*head) + 1);
+    if (symIx == NULL || head == NULL)
+        ret = XFF_ERR_NOMEM;
+    else
+        ret = AddSymbols(&c, b, symIx, opt != NULL ? opt->sectFlags : 0);
+    for (i = 0; i < c.symNrE && head != NULL; i++)
+        head[i] = NO_SYM;
+
+    for (i = 1; i < c.eh->shnum && ret == XFF_OK; i++)
+    {
+        if ((c.sh[i].type != ELF_SHT_REL && c.sh[i].type != ELF_SHT_RELA) || c.sh[i].info >= c.eh->shnum ||
+            c.sectIx[c.sh[i].info] == 0)
+            continue;
+        if (c.sh[i].type == ELF_SHT_RELA)
+            ret = Fail(&c, "%s: RELA relocations are not supported", SectName(&c, i));
+        else
+            ret = AddRelocs(&c, b, symIx, i, head);
+    }
+
+    free(symIx);
+    free(head);
+    Close(&c);
+    return ret;
+}
+
+// Loads a converted executable and moves its sections to their link addresses; the
+// relocated sections must come out as the linker wrote them. Relocatables are only
+// loaded. Returns XFF_ERR_FORMAT with info->err set on a mismatch.
+s32 XffElfCheck(const u8 *elf, u32 size, const u8 *xff, u32 xffSize, const struct XffElfOptions *opt, struct XffElfInfo *info)
+{
+    struct XffLoader ldr;
+    struct XffModule *mod;
+    struct XffMoveStats st;
+    struct Conv c;
+    const struct ElfShdr *sh;
+    const struct t_xffSectEnt *sect;
+    u32 *newMemPt = NULL;
+    u32 lo = 0xFFFFFFFF;
+    u32 hi = 0;
+    u32 base = XFF_ARENA_DEFAULT_BASE;
+    u32 heap;
+    u32 entry;
+    u32 i;
+    s32 ret;
+
+    ret = Open(&c, elf, size, info);
+    if (ret == XFF_OK)
+        ret = Order(&c, opt, &entry);
+    if (ret != XFF_OK)
+    {
+        Close(&c);
+        return ret;
+    }
+
+    // Executables: the heap starts above the link addresses, the sections move down there
+    for (i = 0; i < c.orderNrE && c.exec; i++)
+    {
+        sh = &c.sh[c.order[i]];
+        if (sh->size == 0)
+            continue;
+        lo = sh->addr < lo ? sh->addr : lo;
+        hi = sh->addr + sh->size > hi ? sh->addr + sh->size : hi;
+    }
+    if (hi != 0)
+        base = lo & ~0xFFFF;
+    heap = ((hi > base ? hi : base) + 0xFFFF) & ~0xFFFF;
+
+    if (XffLoaderInit(&ldr, base, heap - base + xffSize * 2 + 0x100000) != XFF_OK)
+    {
+        Close(&c);
+        return XFF_ERR_NOMEM;
+    }
+    XffSetHeapStartPoint(&ldr.arena, heap);
+    ldr.keepLocalRelocs = 1;
+
+    ret = XffLoadImage(&ldr, "check", xff, xffSize, &mod);
+    if (ret != XFF_OK)
+        ret = Fail(&c, "the converted file doesn't load (%d)", ret);
+    else if (mod->xffEp->sectNrE < (s32)c.orderNrE + 1)
+        ret = Fail(&c, "the converted file has %d sections, expected %u", mod->xffEp->sectNrE - 1, c.orderNrE);
+
+    if (ret == XFF_OK && hi != 0)
+    {
+        newMemPt = calloc(mod->xffEp->sectNrE, sizeof(*newMemPt));
+        if (newMemPt == NULL)
+            ret = XFF_ERR_NOMEM;
+        for (i = 0; i < c.orderNrE && ret == XFF_OK; i++)
+            newMemPt[i + 1] = c.sh[c.order[i]].addr;
+        if (ret == XFF_OK)
+            ret = XffMoveSections(&ldr, mod, newMemPt, 0, &st);
+
+        sect = XffPtr(&ldr.arena, mod->xffEp->sectTab);
+        for (i = 0; i < c.orderNrE && ret == XFF_OK; i++)
+        {
+            sh = &c.sh[c.order[i]];
+            if (sh->type == ELF_SHT_NOBITS || sh->size == 0)
+                continue;
+            if (sect[i + 1].memPt != sh->addr || memcmp(XffPtr(&ldr.arena, sh->addr), elf + sh->offset, sh->size) != 0)
+                ret = Fail(&c, "%s differs from the linked section after relocation", SectName(&c, c.order[i]));
+            info->checked += sh->size;
+        }
+    }
+
+    free(newMemPt);
+    XffLoaderTerm(&ldr);
+    Close(&c);
+    return ret;
+}
@@ -0,0 +1,139 @@
+/*
+xffelf: converts MIPS ELF relocatables and executables to XFF2.
+
+Usage: xffelf [-e entry] [-m] [-H] [-c] -o out.xff in.elf
+
+Executables must be linked with --emit-relocs (-q) so the relocations are still there.
+-e names the entry point symbol, -m makes the loader move every section at 0x100
+alignment instead of using it in place, -H adds an XFF_EXT_HASH block. -c loads the
+result with libxff; an executable is then moved to its link addresses and must come out
+byte for byte as the linker wrote it.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xffBuild.h"
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static s32 WriteFile(const char *path, const void *data, u32 size)
+{
+    FILE *f = fopen(path, "wb");
+
+    if (f == NULL)
+        return XFF_ERR_IO;
+
+    if (fwrite(data, 1, size, f) != size)
+    {
+        fclose(f);
+        return XFF_ERR_IO;
+    }
+
+    return fclose(f) == 0 ? XFF_OK : XFF_ERR_IO;
+}
+
+int main(int argc, char **argv)
+{
+    struct XffElfOptions elfOpt = {NULL, 0};
+    struct XffElfInfo info;
+    struct XffBuilder b;
+    const char *outPath = NULL;
+    s32 hash = 0;
+    s32 check = 0;
+    void *data;
+    u8 *out;
+    u32 size;
+    u32 outSize;
+    s32 opt;
+    s32 ret;
+    double t0;
+    double t1;
+
+    while ((opt = getopt(argc, argv, "e:mHco:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'e':
+            elfOpt.entry = optarg;
+            break;
+        case 'm':
+            elfOpt.sectFlags = 1;
+            break;
+        case 'H':
+            hash = 1;
+            break;
+        case 'c':
+            check = 1;
+            break;
+        case 'o':
+            outPath = optarg;
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+
+    if (outPath == NULL || optind != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [-e entry] [-m] [-H] [-c] -o out.xff in.elf\n", argv[0]);
+        return 1;
+    }
+
+    data = XffMapFile(argv[optind], &size);
+    if (data == NULL)
+    {
+        fprintf(stderr, "xffelf: can't map %s\n", argv[optind]);
+        return 1;
+    }
+
+    t0 = NowSec();
+    XffBuilderInit(&b);
+    b.hashSection = hash;
+    ret = XffElfConvert(&b, data, size, &elfOpt, &info);
+    if (ret == XFF_OK)
+        ret = XffBuilderWrite(&b, &out, &outSize);
+    t1 = NowSec();
+    XffBuilderFree(&b);
+    if (ret != XFF_OK)
+    {
+        fprintf(stderr, "xffelf: %s: %s\n", argv[optind], ret == XFF_ERR_FORMAT ? info.err : "out of memory");
+        return 1;
+    }
+
+    printf("%s: %u sections, %u symbols (%u exports, %u imports), %u relocations (%u dropped)\n", argv[optind], info.sections,
+           info.symbols, info.exports, info.imports, info.relocs, info.relocsDropped);
+    printf("%u bytes in, %u bytes out, %.3f ms (%.1f MB/s)\n", size, outSize, (t1 - t0) * 1e3, size / (t1 - t0) * 1e-6);
+
+    if (check)
+    {
+        ret = XffElfCheck(data, size, out, outSize, &elfOpt, &info);
+        if (ret != XFF_OK)
+        {
+            fprintf(stderr, "xffelf: %s: check failed: %s\n", argv[optind], ret == XFF_ERR_FORMAT ? info.err : "out of memory");
+            return 1;
+        }
+        if (info.checked != 0)
+            printf("check: loads, %u section bytes match the link\n", info.checked);
+        else
+            printf("check: loads\n");
+    }
+    XffUnmapFile(data, size);
+
+    if (WriteFile(outPath, out, outSize) != XFF_OK)
+    {
+        fprintf(stderr, "xffelf: can't write %s\n", outPath);
+        return 1;
+    }
+    free(out);
+    return 0;
+}
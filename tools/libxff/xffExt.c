@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libxff.h"
+
+// Returns the trailer of an image with extension blocks, or NULL for a plain image.
+static const struct XffExtTrailer *GetTrailer(const u8 *data, u32 size)
+{
+    const struct XffExtTrailer *tr;
+
+    if (size < sizeof(struct t_xffEntPntHdr) + sizeof(*tr))
+        return NULL;
+
+    tr = (const struct XffExtTrailer *)(data + size - sizeof(*tr));
+    if (tr->magic != XFF_EXT_MAGIC || tr->size < sizeof(*tr) || tr->size > size - sizeof(struct t_xffEntPntHdr))
+        return NULL;
+
+    return tr;
+}
+
+// Size of the XFF image proper, without the extension blocks.
+u32 XffExtImageSize(const void *data, u32 size)
+{
+    const struct XffExtTrailer *tr = GetTrailer(data, size);
+
+    return tr != NULL ? size - tr->size : size;
+}
+
+// Finds extension block 'tag' and returns its data, or NULL if the image doesn't carry it.
+const void *XffExtFind(const void *data, u32 size, u32 tag, u32 *sizeOut)
+{
+    const struct XffExtTrailer *tr = GetTrailer(data, size);
+    const struct XffExtHdr *blk;
+    const u8 *end;
+
+    if (tr == NULL)
+        return NULL;
+
+    blk = (const struct XffExtHdr *)((const u8 *)data + ((size - tr->size + 3) & ~3));
+    end = (const u8 *)tr;
+
+    while ((const u8 *)(blk + 1) <= end && blk->size <= (u32)(end - (const u8 *)(blk + 1)))
+    {
+        if (blk->tag == tag)
+        {
+            if (sizeOut != NULL)
+                *sizeOut = blk->size;
+            return blk + 1;
+        }
+        blk = (const struct XffExtHdr *)((const u8 *)(blk + 1) + ((blk->size + 3) & ~3));
+    }
+
+    return NULL;
+}
+
+// Adds or replaces block 'tag' of a malloc'd image. Returns the (reallocated) image, NULL
+// without memory with 'data' left as it was.
+u8 *XffExtSet(u8 *data, u32 *size, u32 tag, const void *blkData, u32 blkSize)
+{
+    const struct XffExtTrailer *tr = GetTrailer(data, *size);
+    const struct XffExtHdr *blk;
+    struct XffExtHdr *newBlk;
+    struct XffExtTrailer newTr;
+    u8 *out;
+    u32 imgSize = XffExtImageSize(data, *size);
+    u32 pos;
+    u32 len;
+
+    // Keep every other block, dropping an older copy of 'tag'
+    out = malloc(*size + 3 + sizeof(*newBlk) + blkSize + 3 + sizeof(newTr));
+    if (out == NULL)
+        return NULL;
+    memcpy(out, data, imgSize);
+    for (pos = imgSize; (pos & 3) != 0; pos++)
+        out[pos] = 0;
+
+    if (tr != NULL)
+    {
+        blk = (const struct XffExtHdr *)(data + ((imgSize + 3) & ~3));
+        while ((const u8 *)blk < (const u8 *)tr)
+        {
+            len = sizeof(*blk) + ((blk->size + 3) & ~3);
+            if (blk->tag != tag)
+            {
+                memcpy(out + pos, blk, len);
+                pos += len;
+            }
+            blk = (const struct XffExtHdr *)((const u8 *)blk + len);
+        }
+    }
+
+    newBlk = (struct XffExtHdr *)(out + pos);
+    newBlk->tag = tag;
+    newBlk->size = blkSize;
+    memcpy(newBlk + 1, blkData, blkSize);
+    len = sizeof(*newBlk) + ((blkSize + 3) & ~3);
+    memset(out + pos + sizeof(*newBlk) + blkSize, 0, len - sizeof(*newBlk) - blkSize);
+    pos += len;
+
+    // The trailer size covers the padding after the image too
+    newTr.magic = XFF_EXT_MAGIC;
+    newTr.size = pos + sizeof(newTr) - imgSize;
+    memcpy(out + pos, &newTr, sizeof(newTr));
+    pos += sizeof(newTr);
+
+    free(data);
+    *size = pos;
+    return out;
+}
@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xffBuild.h"
+
+/*
+Synthetic XFF2 modules of a chosen shape, for tuning the loader.
+
+Every count the loader's cost depends on is a parameter: sections and their alignment,
+defined and imported symbols, relocation entries, the mix of relocation types and how
+many HI16 entries share one LO16. The same parameters and seed always give the same
+file. Relocation sites are consecutive words at the start of each progbits section, so
+the relocation tables come out sorted by address like the ones the toolchain writes.
+
+Exports are named exportPrefix0, exportPrefix1, ... and imports importPrefix0, ...; a
+module generated with exportPrefix equal to another one's importPrefix and at least as
+many exports satisfies all of its imports.
+*/
+
+#define SECT_NRE_MAX (0xFF00)
+
+static inline u32 NextRand(u32 *state)
+{
+    u32 x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static inline s32 IsPow2(u32 n)
+{
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+void XffGenDefaults(struct XffGenParams *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->seed = 1;
+    p->sectNrE = 3;
+    p->bssNrE = 1;
+    p->alignMin = 16;
+    p->alignMax = 16;
+    p->exportNrE = 256;
+    p->localNrE = 256;
+    p->importNrE = 64;
+    p->exportPrefix = "gen_";
+    p->importPrefix = "gen_";
+    p->relocNrE = 10000;
+    p->weight[0] = 1;
+    p->weight[1] = 1;
+    p->weight[2] = 2;
+    p->hiRunMax = 2;
+    p->extPercent = 25;
+}
+
+// A power of two between alignMin and alignMax
+static u32 PickAlign(const struct XffGenParams *p, u32 *rnd)
+{
+    u32 steps = 0;
+    u32 a;
+
+    for (a = p->alignMin; a < p->alignMax; a <<= 1)
+        steps++;
+    return p->alignMin << (NextRand(rnd) % (steps + 1));
+}
+
+// Relocation entries of one section, 'nrE' of them on consecutive words
+static void AddSectRelocs(struct XffBuilder *b, const struct XffGenParams *p, u32 sect, u32 nrE, const u32 *target,
+                          u32 targetNrE, const u32 *imports, u32 *rnd)
+{
+    u32 weightSum = p->weight[0] + p->weight[1] + p->weight[2];
+    u32 addr = 0;
+    u32 symIx;
+    u32 runNrE;
+    u32 r;
+    u32 w;
+
+    while (nrE != 0)
+    {
+        r = NextRand(rnd);
+        if (p->importNrE != 0 && r % 100 < p->extPercent)
+            symIx = imports[(r >> 7) % p->importNrE];
+        else
+            symIx = target[(r >> 7) % targetNrE];
+
+        r = NextRand(rnd);
+        w = r % weightSum;
+        if (w >= p->weight[0] + p->weight[1] && nrE >= 2)
+        {
+            // lui ... addiu, runNrE lui sharing the addiu
+            runNrE = 1 + (r >> 8) % p->hiRunMax;
+            if (runNrE > nrE - 1)
+                runNrE = nrE - 1;
+            for (nrE -= runNrE + 1; runNrE-- != 0; addr += 4)
+                XffBuilderAddReloc(b, sect, addr, XFF_R_HI16, symIx, 0x3C020000 | ((r >> 20) & 0xF));
+            XffBuilderAddReloc(b, sect, addr, XFF_R_LO16, symIx, 0x24420000 | ((r >> 4) & 0x7FFC));
+        }
+        else if (w >= p->weight[0])
+        {
+            XffBuilderAddReloc(b, sect, addr, XFF_R_26, symIx, 0x0C000000);
+            nrE--;
+        }
+        else
+        {
+            XffBuilderAddReloc(b, sect, addr, XFF_R_32, symIx, (r >> 8) & 0xFFC);
+            nrE--;
+        }
+        addr += 4;
+    }
+}
+
+// Builds the module described by 'p'. The result is malloc()ed, XFF_ERR_FORMAT means
+// the parameters don't describe a valid module.
+s32 XffGenerate(const struct XffGenParams *p, u8 **out, u32 *sizeOut)
+{
+    struct XffBuilder b;
+    u32 allNrE = p->sectNrE + p->bssNrE;
+    u32 rnd = p->seed != 0 ? p->seed : 1;
+    u32 *imports = NULL;
+    u32 *target;
+    u32 targetNrE = 0;
+    u32 sectSize;
+    u32 relocNrE;
+    u32 sect;
+    u32 i;
+    char name[64];
+    s32 ret;
+
+    if (allNrE == 0 || allNrE > SECT_NRE_MAX || !IsPow2(p->alignMin) || !IsPow2(p->alignMax) || p->alignMin > p->alignMax ||
+        p->weight[0] + p->weight[1] + p->weight[2] == 0 || p->hiRunMax == 0 || p->extPercent > 100 ||
+        (p->relocNrE != 0 && p->sectNrE == 0))
+    {
+        return XFF_ERR_FORMAT;
+    }
+
+    target = malloc((allNrE + p->exportNrE + p->localNrE) * sizeof(*target));
+    if (p->importNrE != 0)
+        imports = malloc(p->importNrE * sizeof(*imports));
+    if (target == NULL || (p->importNrE != 0 && imports == NULL))
+    {
+        free(target);
+        free(imports);
+        return XFF_ERR_NOMEM;
+    }
+
+    XffBuilderInit(&b);
+    b.hashSection = p->hashSection;
+
+    // Progbits sections hold one word per relocation site of theirs, the entry point is
+    // the start of the first one
+    for (i = 0; i < allNrE; i++)
+    {
+        if (i < p->sectNrE)
+        {
+            relocNrE = p->relocNrE / p->sectNrE + (i < p->relocNrE % p->sectNrE);
+            sectSize = relocNrE * 4 + p->padBytes;
+            snprintf(name, sizeof(name), ".text.%u", i);
+            sect = XffBuilderAddSection(&b, name, XFF_SECT_PROGBITS, PickAlign(p, &rnd), p->sectFlags, NULL, sectSize);
+        }
+        else
+        {
+            sectSize = p->padBytes != 0 ? p->padBytes : 64;
+            snprintf(name, sizeof(name), ".bss.%u", i - p->sectNrE);
+            sect = XffBuilderAddSection(&b, name, XFF_SECT_NOBITS, PickAlign(p, &rnd), p->sectFlags, NULL, sectSize);
+        }
+        target[targetNrE++] = b.sect[sect].symIx;
+    }
+
+    // Defined symbols land on a random word of a random section
+    for (i = 0; i < p->exportNrE + p->localNrE; i++)
+    {
+        sect = 1 + NextRand(&rnd) % allNrE;
+        sectSize = b.sect[sect].size & ~3;
+        if (i < p->exportNrE)
+            snprintf(name, sizeof(name), "%s%u", p->exportPrefix, i);
+        else
+            snprintf(name, sizeof(name), "local%u", i - p->exportNrE);
+        target[targetNrE++] = XffBuilderAddSymbol(&b, name, sect, sectSize != 0 ? (NextRand(&rnd) % sectSize) & ~3 : 0, 4,
+                                                  XFF_STT_FUNC, i < p->exportNrE ? XFF_STB_GLOBAL : 0);
+    }
+
+    for (i = 0; i < p->importNrE; i++)
+    {
+        snprintf(name, sizeof(name), "%s%u", p->importPrefix, i);
+        imports[i] = XffBuilderAddSymbol(&b, name, 0, 0, 0, XFF_STT_FUNC, XFF_STB_GLOBAL);
+    }
+
+    for (i = 0; i < p->sectNrE; i++)
+    {
+        relocNrE = p->relocNrE / p->sectNrE + (i < p->relocNrE % p->sectNrE);
+        AddSectRelocs(&b, p, 1 + i, relocNrE, target, targetNrE, imports, &rnd);
+    }
+
+    ret = XffBuilderWrite(&b, out, sizeOut);
+    XffBuilderFree(&b);
+    free(target);
+    free(imports);
+    return ret;
+}
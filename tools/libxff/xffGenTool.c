@@ -0,0 +1,141 @@
+/*
+xffgen: writes a synthetic XFF2 module of a chosen shape, see xffGen.c.
+
+Usage: xffgen [-S seed] [-s sections] [-b bssSections] [-a alignMin] [-A alignMax] [-m]
+              [-p padBytes] [-e exports] [-l locals] [-i imports] [-E exportPrefix]
+              [-I importPrefix] [-r relocs] [-w w32,w26,wHiLo] [-h hiRunMax] [-x extPercent]
+              [-H] -o out.xff
+
+-m sets t_xffSectEnt.flags so the loader moves every section, -w weighs the relocation
+types against each other, -H adds an XFF_EXT_HASH block. The defaults are those of
+XffGenDefaults(). A module that satisfies the imports of another one is written with
+-E set to that one's -I prefix and -e at least its -i count.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "xffBuild.h"
+
+static s32 WriteFile(const char *path, const void *data, u32 size)
+{
+    FILE *f = fopen(path, "wb");
+
+    if (f == NULL)
+        return XFF_ERR_IO;
+
+    if (fwrite(data, 1, size, f) != size)
+    {
+        fclose(f);
+        return XFF_ERR_IO;
+    }
+
+    return fclose(f) == 0 ? XFF_OK : XFF_ERR_IO;
+}
+
+int main(int argc, char **argv)
+{
+    struct XffGenParams p;
+    const char *outPath = NULL;
+    u8 *out;
+    u32 outSize;
+    s32 bad = 0;
+    s32 opt;
+    s32 ret;
+
+    XffGenDefaults(&p);
+    while ((opt = getopt(argc, argv, "S:s:b:a:A:mp:e:l:i:E:I:r:w:h:x:Ho:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'S':
+            p.seed = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            p.sectNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            p.bssNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'a':
+            p.alignMin = strtoul(optarg, NULL, 0);
+            if (p.alignMax < p.alignMin)
+                p.alignMax = p.alignMin;
+            break;
+        case 'A':
+            p.alignMax = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            p.sectFlags = 1;
+            break;
+        case 'p':
+            p.padBytes = strtoul(optarg, NULL, 0);
+            break;
+        case 'e':
+            p.exportNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            p.localNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            p.importNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'E':
+            p.exportPrefix = optarg;
+            break;
+        case 'I':
+            p.importPrefix = optarg;
+            break;
+        case 'r':
+            p.relocNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            if (sscanf(optarg, "%u,%u,%u", &p.weight[0], &p.weight[1], &p.weight[2]) != 3)
+                bad = 1;
+            break;
+        case 'h':
+            p.hiRunMax = strtoul(optarg, NULL, 0);
+            break;
+        case 'x':
+            p.extPercent = strtoul(optarg, NULL, 0);
+            break;
+        case 'H':
+            p.hashSection = 1;
+            break;
+        case 'o':
+            outPath = optarg;
+            break;
+        default:
+            bad = 1;
+            break;
+        }
+    }
+
+    if (bad || outPath == NULL || optind != argc)
+    {
+        fprintf(stderr,
+                "usage: %s [-S seed] [-s sections] [-b bssSections] [-a alignMin] [-A alignMax] [-m] [-p padBytes]\n"
+                "       [-e exports] [-l locals] [-i imports] [-E exportPrefix] [-I importPrefix] [-r relocs]\n"
+                "       [-w w32,w26,wHiLo] [-h hiRunMax] [-x extPercent] [-H] -o out.xff\n",
+                argv[0]);
+        return 1;
+    }
+
+    ret = XffGenerate(&p, &out, &outSize);
+    if (ret != XFF_OK)
+    {
+        fprintf(stderr, "xffgen: %s\n", ret == XFF_ERR_FORMAT ? "invalid parameters" : "out of memory");
+        return 1;
+    }
+
+    if (WriteFile(outPath, out, outSize) != XFF_OK)
+    {
+        fprintf(stderr, "xffgen: can't write %s\n", outPath);
+        return 1;
+    }
+    printf("%s: %u sections, %u exports, %u locals, %u imports, %u relocations, %u bytes\n", outPath, p.sectNrE + p.bssNrE,
+           p.exportNrE, p.localNrE, p.importNrE, p.relocNrE, outSize);
+    free(out);
+    return 0;
+}
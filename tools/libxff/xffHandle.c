@@ -0,0 +1,240 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libxff.h"
+
+/*
+Slot tables for the LoaderSys external resource lists.
+
+THREAD_LIST, SEMAPHORE_LIST, INTC_HANDLER_LIST and IOP_MEMORY_LIST on the EE are plain
+arrays with a sentinel for free slots: LoaderSysEntryExternal*List() scans for the first
+free one (and writes index -1 when there is none), LoaderSysDeleteExternal*List() scans
+for the id, and the LoaderSysDeleteAll*() walk every slot. Here a slot table keeps:
+ - a bitmap of occupied slots; the free slot is the first zero bit (ctz), bulk
+   operations jump from one set bit to the next,
+ - a reverse map from id to slot, open addressed with linear probing and deletion by
+   backward shift, so it never fills up with tombstones.
+Slots are handed out lowest first like the EE scan does, so a table walks its entries in
+the same order as the array it replaces. A full table is reported as XFF_ERR_FULL.
+*/
+
+#define REV_EMPTY (0) // reverse map entries hold slot + 1
+
+static u32 HashId(s32 id)
+{
+    u32 h = (u32)id * 0x9E3779B1;
+
+    return h ^ (h >> 16);
+}
+
+static u32 *RevFind(const struct XffHandleTable *tab, s32 id)
+{
+    u32 mask = tab->revCap - 1;
+    u32 j;
+
+    for (j = HashId(id) & mask; tab->rev[j] != REV_EMPTY; j = (j + 1) & mask)
+    {
+        if (tab->key[tab->rev[j] - 1] == id)
+            return &tab->rev[j];
+    }
+    return NULL;
+}
+
+static void RevInsert(struct XffHandleTable *tab, s32 id, u32 slot)
+{
+    u32 mask = tab->revCap - 1;
+    u32 j;
+
+    for (j = HashId(id) & mask; tab->rev[j] != REV_EMPTY; j = (j + 1) & mask)
+        ;
+    tab->rev[j] = slot + 1;
+}
+
+// Removes reverse map entry 'j' and moves later entries of the probe run back into the
+// gap when their home slot allows it.
+static void RevRemove(struct XffHandleTable *tab, u32 j)
+{
+    u32 mask = tab->revCap - 1;
+    u32 home;
+    u32 k;
+
+    for (k = (j + 1) & mask; tab->rev[k] != REV_EMPTY; k = (k + 1) & mask)
+    {
+        home = HashId(tab->key[tab->rev[k] - 1]) & mask;
+
+        // Entry k may fill the gap at j unless its home lies cyclically in (j, k]
+        if (((k - home) & mask) >= ((k - j) & mask))
+        {
+            tab->rev[j] = tab->rev[k];
+            j = k;
+        }
+    }
+    tab->rev[j] = REV_EMPTY;
+}
+
+s32 XffHandleInit(struct XffHandleTable *tab, u32 cap)
+{
+    memset(tab, 0, sizeof(*tab));
+    if (cap == 0)
+        return XFF_ERR_FORMAT;
+
+    // At most half full, so probe runs stay short
+    tab->revCap = 4;
+    while (tab->revCap < cap * 2)
+        tab->revCap <<= 1;
+
+    tab->cap = cap;
+    tab->key = calloc(cap, sizeof(*tab->key));
+    tab->value = calloc(cap, sizeof(*tab->value));
+    tab->bitmap = calloc((cap + 31) / 32, sizeof(*tab->bitmap));
+    tab->rev = calloc(tab->revCap, sizeof(*tab->rev));
+    if (tab->key == NULL || tab->value == NULL || tab->bitmap == NULL || tab->rev == NULL)
+    {
+        XffHandleTerm(tab);
+        return XFF_ERR_NOMEM;
+    }
+    return XFF_OK;
+}
+
+void XffHandleTerm(struct XffHandleTable *tab)
+{
+    free(tab->key);
+    free(tab->value);
+    free(tab->bitmap);
+    free(tab->rev);
+    memset(tab, 0, sizeof(*tab));
+}
+
+// LoaderSysInitExternal*List()
+void XffHandleClear(struct XffHandleTable *tab)
+{
+    memset(tab->bitmap, 0, (tab->cap + 31) / 32 * sizeof(*tab->bitmap));
+    memset(tab->rev, 0, tab->revCap * sizeof(*tab->rev));
+    tab->used = 0;
+}
+
+// Lowest free slot, or -1
+static s32 FreeSlot(const struct XffHandleTable *tab)
+{
+    u32 wordNrE = (tab->cap + 31) / 32;
+    u32 slot;
+    u32 w;
+
+    for (w = 0; w < wordNrE; w++)
+    {
+        if (tab->bitmap[w] == 0xFFFFFFFF)
+            continue;
+
+        slot = w * 32 + __builtin_ctz(~tab->bitmap[w]);
+        return slot < tab->cap ? (s32)slot : -1;
+    }
+    return -1;
+}
+
+// LoaderSysEntryExternal*List(): records 'id' with 'value' and returns its slot. An id
+// that is already in the table keeps its slot and gets the new value.
+s32 XffHandleEntry(struct XffHandleTable *tab, s32 id, s32 value)
+{
+    u32 *rev = RevFind(tab, id);
+    s32 slot;
+
+    if (rev != NULL)
+    {
+        tab->value[*rev - 1] = value;
+        return *rev - 1;
+    }
+
+    slot = FreeSlot(tab);
+    if (slot < 0)
+    {
+        tab->overflows++;
+        return XFF_ERR_FULL;
+    }
+
+    tab->key[slot] = id;
+    tab->value[slot] = value;
+    tab->bitmap[slot / 32] |= 1u << (slot % 32);
+    RevInsert(tab, id, slot);
+    tab->used++;
+    return slot;
+}
+
+// Slot of 'id', or XFF_ERR_NOENT
+s32 XffHandleFind(const struct XffHandleTable *tab, s32 id)
+{
+    u32 *rev = RevFind(tab, id);
+
+    return rev != NULL ? (s32)(*rev - 1) : XFF_ERR_NOENT;
+}
+
+// LoaderSysDeleteExternal*List()
+s32 XffHandleDelete(struct XffHandleTable *tab, s32 id)
+{
+    u32 *rev = RevFind(tab, id);
+    u32 slot;
+
+    if (rev == NULL)
+        return XFF_ERR_NOENT;
+
+    slot = *rev - 1;
+    tab->bitmap[slot / 32] &= ~(1u << (slot % 32));
+    RevRemove(tab, rev - tab->rev);
+    tab->used--;
+    return XFF_OK;
+}
+
+// Calls 'func' for every entry, in slot order.
+void XffHandleForEach(const struct XffHandleTable *tab, XffHandleFunc func, void *ctx)
+{
+    u32 wordNrE = (tab->cap + 31) / 32;
+    u32 bits;
+    u32 slot;
+    u32 w;
+
+    for (w = 0; w < wordNrE; w++)
+    {
+        for (bits = tab->bitmap[w]; bits != 0; bits &= bits - 1)
+        {
+            slot = w * 32 + __builtin_ctz(bits);
+            func(tab->key[slot], tab->value[slot], ctx);
+        }
+    }
+}
+
+// LoaderSysDeleteAll*(): calls 'func' (may be NULL) for every entry but 'except' and
+// removes it. Returns the number of entries deleted.
+u32 XffHandleDeleteAll(struct XffHandleTable *tab, s32 except, XffHandleFunc func, void *ctx)
+{
+    u32 wordNrE = (tab->cap + 31) / 32;
+    u32 deleted = 0;
+    u32 bits;
+    u32 slot;
+    u32 w;
+    s32 keep = -1;
+
+    for (w = 0; w < wordNrE; w++)
+    {
+        for (bits = tab->bitmap[w]; bits != 0; bits &= bits - 1)
+        {
+            slot = w * 32 + __builtin_ctz(bits);
+            if (tab->key[slot] == except)
+            {
+                keep = slot;
+                continue;
+            }
+
+            if (func != NULL)
+                func(tab->key[slot], tab->value[slot], ctx);
+            deleted++;
+        }
+    }
+
+    XffHandleClear(tab);
+    if (keep >= 0)
+    {
+        tab->bitmap[keep / 32] |= 1u << (keep % 32);
+        RevInsert(tab, except, keep);
+        tab->used = 1;
+    }
+    return deleted;
+}
@@ -0,0 +1,273 @@
+/*
+xffhandlebench: LoaderSys external resource lists, linear arrays against slot tables.
+
+Usage: xffhandlebench [-c capacity] [-l live] [-n ops] [-r seed]
+
+The linear model is the EE code: an array with -1 for a free slot, scanned on every
+entry and delete. Both structures get the same churn: 'live' entries (default 3/4 of
+'capacity', 256 like THREAD_LIST) are registered, then every op deletes a random one
+by id and registers a new id. Every entry must land in the same slot in both, so a
+table walks its entries in the order the array does. Then the delete-all operation is
+timed at several fill levels, and the list is overfilled by one entry, where the EE
+code indexes the array with -1.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libxff.h"
+
+struct Linear
+{
+    s32 *list;
+    u32 cap;
+};
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// getStA(), FindSemaIndex()
+static s32 LinearEntry(struct Linear *lin, s32 id)
+{
+    u32 i;
+
+    for (i = 0; i < lin->cap; i++)
+    {
+        if (lin->list[i] < 0)
+        {
+            lin->list[i] = id;
+            return i;
+        }
+    }
+    return -1;
+}
+
+// LoaderSysDeleteExternalThreadList()
+static s32 LinearDelete(struct Linear *lin, s32 id)
+{
+    u32 i;
+
+    for (i = 0; i < lin->cap; i++)
+    {
+        if (lin->list[i] == id)
+        {
+            lin->list[i] = -1;
+            return id;
+        }
+    }
+    return -1;
+}
+
+static void CountEntry(s32 id, s32 value, void *ctx)
+{
+    (void)id;
+    (void)value;
+    (*(u32 *)ctx)++;
+}
+
+// LoaderSysDeleteAllExternalThread()
+static u32 LinearDeleteAll(struct Linear *lin)
+{
+    u32 deleted = 0;
+    u32 i;
+
+    for (i = 0; i < lin->cap; i++)
+    {
+        if (lin->list[i] >= 0)
+        {
+            CountEntry(lin->list[i], 0, &deleted);
+            lin->list[i] = -1;
+        }
+    }
+    return deleted;
+}
+
+static u32 Next(u32 *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+static void Fill(struct Linear *lin, struct XffHandleTable *tab, u32 n)
+{
+    u32 i;
+
+    for (i = 0; i < lin->cap; i++)
+        lin->list[i] = -1;
+    XffHandleClear(tab);
+
+    for (i = 0; i < n; i++)
+    {
+        LinearEntry(lin, 1000 + i * 7);
+        XffHandleEntry(tab, 1000 + i * 7, 0);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct XffHandleTable tab;
+    struct Linear lin;
+    s32 *live;
+    s32 *order;
+    u32 cap = XFF_HANDLE_THREADS;
+    u32 liveNrE = 0;
+    u32 opNrE = 1000000;
+    u32 seed = 1;
+    u32 s;
+    u32 id;
+    u32 nextId = 1;
+    u32 mismatch = 0;
+    u32 deleted;
+    u32 level;
+    u32 reps;
+    u32 i;
+    u32 k;
+    s32 slotLin;
+    s32 slotTab;
+    s32 opt;
+    double tLin;
+    double tTab;
+    double t0;
+
+    while ((opt = getopt(argc, argv, "c:l:n:r:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            cap = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            liveNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            opNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-c capacity] [-l live] [-n ops] [-r seed]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (liveNrE == 0)
+        liveNrE = cap * 3 / 4;
+    if (cap == 0 || liveNrE == 0 || liveNrE > cap)
+    {
+        fprintf(stderr, "xffhandlebench: need 0 < live <= capacity\n");
+        return 1;
+    }
+
+    lin.cap = cap;
+    lin.list = malloc(cap * sizeof(*lin.list));
+    live = malloc(cap * sizeof(*live));
+    order = malloc(cap * sizeof(*order));
+    if (lin.list == NULL || live == NULL || order == NULL || XffHandleInit(&tab, cap) != XFF_OK)
+    {
+        fprintf(stderr, "xffhandlebench: out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < cap; i++)
+        lin.list[i] = -1;
+
+    for (i = 0; i < liveNrE; i++)
+    {
+        live[i] = nextId++;
+        slotLin = LinearEntry(&lin, live[i]);
+        slotTab = XffHandleEntry(&tab, live[i], 0);
+        mismatch += slotLin != slotTab;
+    }
+
+    // The same churn on both, one after the other
+    memcpy(order, live, liveNrE * sizeof(*order));
+    s = seed;
+    id = nextId;
+    t0 = NowSec();
+    for (i = 0; i < opNrE; i++)
+    {
+        k = Next(&s) % liveNrE;
+        LinearDelete(&lin, order[k]);
+        order[k] = id++;
+        LinearEntry(&lin, order[k]);
+    }
+    tLin = NowSec() - t0;
+
+    s = seed;
+    id = nextId;
+    t0 = NowSec();
+    for (i = 0; i < opNrE; i++)
+    {
+        k = Next(&s) % liveNrE;
+        XffHandleDelete(&tab, live[k]);
+        live[k] = id++;
+        XffHandleEntry(&tab, live[k], 0);
+    }
+    tTab = NowSec() - t0;
+
+    // Same slots on both sides
+    for (i = 0, k = 0; i < cap; i++)
+    {
+        if (lin.list[i] >= 0)
+        {
+            mismatch += XffHandleFind(&tab, lin.list[i]) != (s32)i;
+            k++;
+        }
+    }
+    mismatch += k != liveNrE || tab.used != liveNrE;
+
+    printf("capacity %u, %u live, %u delete+entry ops\n", cap, liveNrE, opNrE);
+    printf("                      linear    slot table\n");
+    printf("delete + entry   %10.1f ns %10.1f ns\n", tLin * 1e9 / opNrE, tTab * 1e9 / opNrE);
+
+    for (level = 1; level <= cap; level *= 4)
+    {
+        reps = opNrE / cap > 1 ? opNrE / cap : 1;
+        tLin = tTab = 0;
+        for (i = 0; i < reps; i++)
+        {
+            Fill(&lin, &tab, level);
+            // Spread the entries: delete every other one
+            for (k = 0; k + 1 < level; k += 2)
+            {
+                LinearDelete(&lin, 1000 + k * 7);
+                XffHandleDelete(&tab, 1000 + k * 7);
+            }
+
+            t0 = NowSec();
+            deleted = LinearDeleteAll(&lin);
+            tLin += NowSec() - t0;
+
+            t0 = NowSec();
+            k = 0;
+            mismatch += XffHandleDeleteAll(&tab, -1, CountEntry, &k) != deleted || k != deleted;
+            tTab += NowSec() - t0;
+        }
+        printf("delete all, %3u  %10.1f ns %10.1f ns\n", level - level / 2, tLin * 1e9 / reps, tTab * 1e9 / reps);
+    }
+
+    Fill(&lin, &tab, cap);
+    slotLin = LinearEntry(&lin, 1);
+    slotTab = XffHandleEntry(&tab, 1, 0);
+    printf("entry %u of %u   index %d (out of bounds) %s\n", cap + 1, cap, slotLin, slotTab == XFF_ERR_FULL ? "XFF_ERR_FULL" : "?");
+    mismatch += slotTab != XFF_ERR_FULL || tab.overflows != 1;
+
+    XffHandleTerm(&tab);
+    free(lin.list);
+    free(live);
+    free(order);
+
+    if (mismatch != 0)
+    {
+        fprintf(stderr, "xffhandlebench: %u mismatches between the array and the table\n", mismatch);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libxff.h"
+
+/*
+Precomputed symbol hashes, the XFF_EXT_HASH extension block.
+
+Resolving an import hashes its name, then the linear search compares it against every
+exported name of every module. The block carries what a loader would compute: the
+XffStrHash() of each import, and a table of the exports in the style of ELF .gnu.hash.
+A bloom filter turns most modules down after one word is read; a module that may have
+the name walks one bucket, comparing hashes, and only a hash match compares the name.
+
+Block layout, all u32:
+  XffHashHdr
+  bloom[bloomNrE]          two bits per export: hash % 32 and (hash >> bloomShift) % 32
+                           of word (hash / 32) % bloomNrE
+  bucket[bucketNrE + 1]    first entry of each bucket, the last one is exportNrE
+  XffHashEnt[exportNrE]    by bucket (hash % bucketNrE), symTab order within a bucket
+  impHash[impNrE]          in impSymIxs order
+
+The loader copies the block into the heap with the module, see XffLoadImage(). Files
+without it, or with one that doesn't match the image, load as before.
+*/
+
+#define BLOOM_SHIFT (6)
+
+static u32 RoundPow2(u32 n)
+{
+    u32 p = 1;
+
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+static inline s32 IsExport(const struct t_xffSymEnt *sym)
+{
+    return sym->sect != 0 && sym->bindAttr == XFF_STB_GLOBAL && sym->nameOffs != 0;
+}
+
+// Builds the block for an XFF file as it is on disc. Returns XFF_ERR_FORMAT when the
+// tables don't lie inside the file.
+s32 XffHashBuild(const u8 *data, u32 size, u8 **out, u32 *outSize)
+{
+    const struct t_xffEntPntHdr *xffEp = (const struct t_xffEntPntHdr *)data;
+    const struct t_xffSymEnt *sym;
+    const struct t_xffImpSymIxs *imp;
+    const char *str;
+    struct XffHashHdr *hdr;
+    struct XffHashEnt *ent;
+    u32 *bloom;
+    u32 *bucket;
+    u32 *impHash;
+    u32 *hash;
+    u32 exportNrE = 0;
+    u32 blkSize;
+    u32 b;
+    u32 h;
+    s32 i;
+
+    size = XffExtImageSize(data, size);
+    if (size < sizeof(*xffEp) || xffEp->ident != XFF_SHTEXE_MAGIC_XFF2 || xffEp->symTabNrE < 0 || xffEp->impSymIxsNrE < 0 ||
+        xffEp->symTab_Rel > size || (u32)xffEp->symTabNrE > (size - xffEp->symTab_Rel) / sizeof(*sym) ||
+        xffEp->impSymIxs_Rel > size || (u32)xffEp->impSymIxsNrE > (size - xffEp->impSymIxs_Rel) / sizeof(*imp) ||
+        xffEp->symTabStr_Rel >= size)
+        return XFF_ERR_FORMAT;
+
+    sym = (const struct t_xffSymEnt *)(data + xffEp->symTab_Rel);
+    imp = (const struct t_xffImpSymIxs *)(data + xffEp->impSymIxs_Rel);
+    str = (const char *)data + xffEp->symTabStr_Rel;
+
+    // Names must end inside the file
+    hash = malloc((xffEp->symTabNrE + 1) * sizeof(*hash));
+    if (hash == NULL)
+        return XFF_ERR_NOMEM;
+    for (i = 0; i < xffEp->symTabNrE; i++)
+    {
+        hash[i] = 0;
+        if (sym[i].nameOffs < 0 || (u32)sym[i].nameOffs >= size - xffEp->symTabStr_Rel ||
+            memchr(&str[sym[i].nameOffs], '\0', size - xffEp->symTabStr_Rel - sym[i].nameOffs) == NULL)
+        {
+            free(hash);
+            return XFF_ERR_FORMAT;
+        }
+        if (sym[i].nameOffs != 0)
+            hash[i] = XffStrHash(&str[sym[i].nameOffs]);
+        exportNrE += IsExport(&sym[i]);
+    }
+    for (i = 0; i < xffEp->impSymIxsNrE; i++)
+    {
+        if (imp[i].stIx < 0 || imp[i].stIx >= xffEp->symTabNrE)
+        {
+            free(hash);
+            return XFF_ERR_FORMAT;
+        }
+    }
+
+    blkSize = sizeof(*hdr);
+    hdr = calloc(1, blkSize + (RoundPow2(exportNrE / 4) + RoundPow2(exportNrE) + 1) * 4 + exportNrE * sizeof(*ent) +
+                        xffEp->impSymIxsNrE * 4);
+    if (hdr == NULL)
+    {
+        free(hash);
+        return XFF_ERR_NOMEM;
+    }
+    hdr->symTabNrE = xffEp->symTabNrE;
+    hdr->impNrE = xffEp->impSymIxsNrE;
+    hdr->exportNrE = exportNrE;
+    hdr->bucketNrE = RoundPow2(exportNrE);
+    hdr->bloomNrE = RoundPow2(exportNrE / 4);
+    hdr->bloomShift = BLOOM_SHIFT;
+
+    bloom = (u32 *)(hdr + 1);
+    bucket = bloom + hdr->bloomNrE;
+    ent = (struct XffHashEnt *)(bucket + hdr->bucketNrE + 1);
+    impHash = (u32 *)(ent + exportNrE);
+
+    // Counting sort by bucket, stable so symTab order holds within one
+    for (i = 0; i < xffEp->symTabNrE; i++)
+    {
+        if (!IsExport(&sym[i]))
+            continue;
+        h = hash[i];
+        bloom[(h / 32) & (hdr->bloomNrE - 1)] |= (1u << (h % 32)) | (1u << ((h >> BLOOM_SHIFT) % 32));
+        bucket[(h & (hdr->bucketNrE - 1)) + 1]++;
+    }
+    for (b = 0; b < hdr->bucketNrE; b++)
+        bucket[b + 1] += bucket[b];
+    for (i = 0; i < xffEp->symTabNrE; i++)
+    {
+        if (!IsExport(&sym[i]))
+            continue;
+        b = hash[i] & (hdr->bucketNrE - 1);
+        ent[bucket[b]].hash = hash[i];
+        ent[bucket[b]].symIx = i;
+        bucket[b]++;
+    }
+    // The fill moved every start to the next bucket's
+    for (b = hdr->bucketNrE; b > 0; b--)
+        bucket[b] = bucket[b - 1];
+    bucket[0] = 0;
+
+    for (i = 0; i < xffEp->impSymIxsNrE; i++)
+        impHash[i] = hash[imp[i].stIx];
+
+    free(hash);
+    *out = (u8 *)hdr;
+    *outSize = (u8 *)(impHash + hdr->impNrE) - (u8 *)hdr;
+    return XFF_OK;
+}
+
+// Returns the image with an XFF_EXT_HASH block added or replaced, see XffExtSet().
+u8 *XffHashAttach(u8 *data, u32 *size)
+{
+    u8 *blk;
+    u8 *out;
+    u32 blkSize;
+
+    if (XffHashBuild(data, *size, &blk, &blkSize) != XFF_OK)
+        return data;
+
+    out = XffExtSet(data, size, XFF_EXT_HASH, blk, blkSize);
+    free(blk);
+    return out != NULL ? out : data;
+}
+
+// Whether a block of 'size' bytes is well formed and was built for 'xffEp'
+s32 XffHashCheck(const struct XffHashHdr *hdr, u32 size, const struct t_xffEntPntHdr *xffEp)
+{
+    const u32 *bucket;
+    const struct XffHashEnt *ent;
+    u32 words;
+    u32 b;
+
+    if (size < sizeof(*hdr) || (s32)hdr->symTabNrE != xffEp->symTabNrE || (s32)hdr->impNrE != xffEp->impSymIxsNrE ||
+        hdr->exportNrE > hdr->symTabNrE || hdr->bucketNrE == 0 || (hdr->bucketNrE & (hdr->bucketNrE - 1)) != 0 ||
+        hdr->bloomNrE == 0 || (hdr->bloomNrE & (hdr->bloomNrE - 1)) != 0 || hdr->bloomShift >= 32 ||
+        hdr->bucketNrE > 0x01000000 || hdr->bloomNrE > 0x01000000)
+        return 0;
+
+    words = hdr->bloomNrE + hdr->bucketNrE + 1 + hdr->exportNrE * 2 + hdr->impNrE;
+    if ((size - sizeof(*hdr)) / 4 != words)
+        return 0;
+
+    bucket = (const u32 *)(hdr + 1) + hdr->bloomNrE;
+    ent = (const struct XffHashEnt *)(bucket + hdr->bucketNrE + 1);
+    if (bucket[0] != 0 || bucket[hdr->bucketNrE] != hdr->exportNrE)
+        return 0;
+    for (b = 0; b < hdr->bucketNrE; b++)
+    {
+        if (bucket[b] > bucket[b + 1])
+            return 0;
+    }
+    for (b = 0; b < hdr->exportNrE; b++)
+    {
+        if (ent[b].symIx >= hdr->symTabNrE)
+            return 0;
+    }
+    return 1;
+}
+
+// Hashes of the imports of a loaded image or of the one being loaded, NULL without a block
+const u32 *XffHashImports(const struct XffLoader *ldr, const struct t_xffEntPntHdr *xffEp)
+{
+    const struct XffHashHdr *hdr;
+    const struct XffModule *mod;
+    u32 addr = ldr->hashTab;
+
+    for (mod = ldr->modules; mod != NULL; mod = mod->next)
+    {
+        if (mod->xffEp == xffEp)
+        {
+            addr = mod->hashTab;
+            break;
+        }
+    }
+    if (addr == 0)
+        return NULL;
+
+    hdr = XffPtr(&ldr->arena, addr);
+    return (const u32 *)(hdr + 1) + hdr->bloomNrE + hdr->bucketNrE + 1 + hdr->exportNrE * 2;
+}
+
+// Looks an export of 'mod' up by name and XffStrHash(). Names from the string pool match
+// on the pointer.
+struct t_xffSymEnt *XffHashLookup(const struct XffLoader *ldr, const struct XffModule *mod, const char *name, u32 hash)
+{
+    const struct XffHashHdr *hdr = XffPtr(&ldr->arena, mod->hashTab);
+    const u32 *bloom = (const u32 *)(hdr + 1);
+    const u32 *bucket = bloom + hdr->bloomNrE;
+    const struct XffHashEnt *ent = (const struct XffHashEnt *)(bucket + hdr->bucketNrE + 1);
+    struct t_xffSymEnt *symTab;
+    const char *symName;
+    u32 word = bloom[(hash / 32) & (hdr->bloomNrE - 1)];
+    u32 b;
+    u32 i;
+
+    if (((word >> (hash % 32)) & (word >> ((hash >> hdr->bloomShift) % 32)) & 1) == 0)
+        return NULL;
+
+    symTab = XffPtr(&ldr->arena, mod->xffEp->symTab);
+    b = hash & (hdr->bucketNrE - 1);
+    for (i = bucket[b]; i < bucket[b + 1]; i++)
+    {
+        if (ent[i].hash != hash)
+            continue;
+        symName = XffSymName(ldr, mod->xffEp, &symTab[ent[i].symIx]);
+        if (symName == name || strcmp(symName, name) == 0)
+            return &symTab[ent[i].symIx];
+    }
+    return NULL;
+}
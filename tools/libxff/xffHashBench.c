@@ -0,0 +1,237 @@
+/*
+xffhashbench: import resolution with and without XFF_EXT_HASH blocks.
+
+Usage: xffhashbench [-n reps] [-o outDir] STARTUP.XFF [file.xff...]
+
+Every file gets a hash block built for it (XffHashAttach()), with -o the results are
+written to outDir. The boot sequence is loaded once from the files as they are and once
+with the blocks, and XffResolveImports() is timed 'reps' times for every module, with the
+linear export search and with the export index. Both loaders must bind every import to
+the same symbol of the same module.
+*/
+
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libxff.h"
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static s32 WriteFile(const char *path, const void *data, u32 size)
+{
+    FILE *f = fopen(path, "wb");
+
+    if (f == NULL)
+        return XFF_ERR_IO;
+
+    if (fwrite(data, 1, size, f) != size)
+    {
+        fclose(f);
+        return XFF_ERR_IO;
+    }
+
+    return fclose(f) == 0 ? XFF_OK : XFF_ERR_IO;
+}
+
+// Modules come newest first
+static struct XffModule *NthModule(const struct XffLoader *ldr, s32 n)
+{
+    struct XffModule *mod = ldr->modules;
+
+    while (mod != NULL && n-- > 0)
+        mod = mod->next;
+    return mod;
+}
+
+// Load order and symTab index of an exported symbol, the same in both loaders
+static u32 SymId(const struct XffLoader *ldr, const struct t_xffSymEnt *sym)
+{
+    const struct XffModule *mod;
+    const struct t_xffSymEnt *symTab;
+
+    if (sym == NULL)
+        return 0xFFFFFFFF;
+
+    for (mod = ldr->modules; mod != NULL; mod = mod->next)
+    {
+        symTab = XffPtr(&ldr->arena, mod->xffEp->symTab);
+        if (sym >= symTab && sym < symTab + mod->xffEp->symTabNrE)
+            return (mod->seq << 20) | (u32)(sym - symTab);
+    }
+    return 0xFFFFFFFE;
+}
+
+static s32 SameImports(const struct XffLoader *a, const struct XffModule *ma, const struct XffLoader *b, const struct XffModule *mb)
+{
+    const struct t_xffImpSymIxs *imp = XffPtr(&a->arena, ma->xffEp->impSymIxs);
+    const struct t_xffSymEnt *sa = XffPtr(&a->arena, ma->xffEp->symTab);
+    const struct t_xffSymEnt *sb = XffPtr(&b->arena, mb->xffEp->symTab);
+    const u32 *hash = XffHashImports(b, mb->xffEp);
+    struct t_xffSymEnt *fa;
+    struct t_xffSymEnt *fb;
+    s32 i;
+
+    for (i = 0; i < ma->xffEp->impSymIxsNrE; i++)
+    {
+        XffFindImport(a, ma->xffEp, &sa[imp[i].stIx], 0, &fa);
+        XffFindImport(b, mb->xffEp, &sb[imp[i].stIx], hash != NULL ? hash[i] : 0, &fb);
+        if (SymId(a, fa) != SymId(b, fb) || sa[imp[i].stIx].unk0D != sb[imp[i].stIx].unk0D)
+            return 0;
+    }
+    return 1;
+}
+
+static double TimeResolve(struct XffLoader *ldr, s32 pathNrE, u32 reps)
+{
+    double t0 = NowSec();
+    u32 r;
+    s32 i;
+
+    for (r = 0; r < reps; r++)
+    {
+        for (i = 0; i < pathNrE; i++)
+            XffResolveImports(ldr, NthModule(ldr, i)->xffEp);
+    }
+    return (NowSec() - t0) / reps;
+}
+
+int main(int argc, char **argv)
+{
+    struct XffLoader plain;
+    struct XffLoader hashed;
+    struct XffModule *modPlain;
+    struct XffModule *modHashed;
+    const char *outDir = NULL;
+    char name[1024];
+    char path[1024];
+    char **paths;
+    void *data;
+    u8 *img;
+    u32 size;
+    u32 imgSize;
+    u32 reps = 200;
+    u32 imports = 0;
+    u32 blkBytes = 0;
+    u32 bad = 0;
+    s32 pathNrE;
+    s32 opt;
+    s32 i;
+    s32 indexed;
+    double tPlain;
+    double tHashed;
+
+    while ((opt = getopt(argc, argv, "n:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            reps = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            outDir = optarg;
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+
+    if (optind >= argc || reps == 0)
+    {
+        fprintf(stderr, "usage: %s [-n reps] [-o outDir] STARTUP.XFF [file.xff...]\n", argv[0]);
+        return 1;
+    }
+    paths = argv + optind;
+    pathNrE = argc - optind;
+
+    if (XffLoaderInit(&plain, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK ||
+        XffLoaderInit(&hashed, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK)
+    {
+        fprintf(stderr, "xffhashbench: out of memory\n");
+        return 1;
+    }
+
+    printf("%-24s %8s %8s %8s %10s\n", "module", "symbols", "exports", "imports", "block");
+    for (i = 0; i < pathNrE; i++)
+    {
+        data = XffMapFile(paths[i], &size);
+        if (data == NULL)
+        {
+            fprintf(stderr, "xffhashbench: can't map %s\n", paths[i]);
+            return 1;
+        }
+
+        imgSize = size;
+        img = malloc(imgSize);
+        memcpy(img, data, imgSize);
+        img = XffHashAttach(img, &imgSize);
+
+        if (XffLoadImage(&plain, paths[i], data, size, &modPlain) != XFF_OK ||
+            XffLoadImage(&hashed, paths[i], img, imgSize, &modHashed) != XFF_OK)
+        {
+            fprintf(stderr, "xffhashbench: %s: load failed\n", paths[i]);
+            return 1;
+        }
+        XffUnmapFile(data, size);
+
+        if (modHashed->hashTab == 0)
+        {
+            fprintf(stderr, "xffhashbench: %s: no hash block\n", paths[i]);
+            return 1;
+        }
+
+        if (outDir != NULL)
+        {
+            snprintf(name, sizeof(name), "%s", paths[i]);
+            snprintf(path, sizeof(path), "%s/%s", outDir, basename(name));
+            if (WriteFile(path, img, imgSize) != XFF_OK)
+            {
+                fprintf(stderr, "xffhashbench: can't write %s\n", path);
+                return 1;
+            }
+        }
+
+        imports += modPlain->xffEp->impSymIxsNrE;
+        blkBytes += imgSize - size;
+        bad += !SameImports(&plain, modPlain, &hashed, modHashed);
+
+        printf("%-24.24s %8d %8u %8d %10u\n", modPlain->name, modPlain->xffEp->symTabNrE,
+               ((const struct XffHashHdr *)XffPtr(&hashed.arena, modHashed->hashTab))->exportNrE,
+               modPlain->xffEp->impSymIxsNrE, imgSize - size);
+        free(img);
+    }
+    printf("%-24s %8s %8s %8u %10u\n", "total", "", "", imports, blkBytes);
+
+    for (indexed = 0; indexed <= 1; indexed++)
+    {
+        XffLoaderUseSymIndex(&plain, indexed);
+        XffLoaderUseSymIndex(&hashed, indexed);
+        tPlain = TimeResolve(&plain, pathNrE, reps);
+        tHashed = TimeResolve(&hashed, pathNrE, reps);
+        printf("resolve, %-7s : %8.2f M lookups/s without, %8.2f M lookups/s with the section (%.2fx)\n",
+               indexed ? "index" : "linear", imports / tPlain * 1e-6, imports / tHashed * 1e-6, tPlain / tHashed);
+
+        for (i = 0; i < pathNrE; i++)
+            bad += !SameImports(&plain, NthModule(&plain, i), &hashed, NthModule(&hashed, i));
+    }
+
+    XffLoaderTerm(&plain);
+    XffLoaderTerm(&hashed);
+
+    if (bad != 0)
+    {
+        fprintf(stderr, "xffhashbench: %u modules resolved differently\n", bad);
+        return 1;
+    }
+    return 0;
+}
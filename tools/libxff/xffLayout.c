@@ -0,0 +1,184 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libxff.h"
+
+/*
+Section layout optimizer.
+
+DecodeSection() uses a progbits section in place only when its file address meets the
+section alignment. XffRelayout() inserts padding in front of every progbits section so
+that its file offset is aligned; with the file image itself placed at 'baseAlign' or
+better, every such section up to that alignment then loads without a copy.
+
+Padding moves everything behind it, so all file offsets are rewritten: the _Rel fields
+of the header, sectTab[].offs_Rel and the addr_Rel/inst_Rel of every relocation table.
+Symbol values, relocation sites and the entry point are relative to their section and
+don't change. Sections with flags != 0 are always copied to a max aligned block by
+DecodeSection() and are left alone.
+*/
+
+struct Pad
+{
+    u32 offs; // original offset the padding goes in front of
+    u32 size;
+};
+
+static int ComparePad(const void *a, const void *b)
+{
+    const struct Pad *pa = a;
+    const struct Pad *pb = b;
+
+    return pa->offs < pb->offs ? -1 : pa->offs > pb->offs;
+}
+
+// New offset of original offset 'offs'. Padding in front of a section moves the section.
+static u32 MapOffs(const struct Pad *pad, u32 padNrE, u32 offs)
+{
+    u32 shift = 0;
+    u32 i;
+
+    for (i = 0; i < padNrE && pad[i].offs <= offs; i++)
+        shift += pad[i].size;
+
+    return offs + shift;
+}
+
+static s32 Aligned(u32 offs, u32 align)
+{
+    return align <= 1 || (offs & (align - 1)) == 0;
+}
+
+// Rewrites an XFF image so that its progbits sections sit at aligned file offsets.
+// Extension blocks are dropped: XFF_EXT_PRELINK describes the old layout.
+s32 XffRelayout(const u8 *data, u32 size, struct XffLayoutStats *st, u8 **out, u32 *outSize)
+{
+    const struct t_xffEntPntHdr *xffEp = (const struct t_xffEntPntHdr *)data;
+    const struct t_xffSectEnt *sect;
+    struct t_xffEntPntHdr *hdr;
+    struct t_xffSectEnt *newSect;
+    struct t_xffRelocEnt *newRt;
+    struct Pad *pad;
+    u32 padNrE = 0;
+    u32 imgSize;
+    u32 newSize;
+    u32 newOffs;
+    u32 shift;
+    u32 align;
+    u32 prev;
+    u32 pos;
+    u32 i;
+    u8 *img;
+
+    memset(st, 0, sizeof(*st));
+    imgSize = XffExtImageSize(data, size);
+    if (imgSize < sizeof(*xffEp) || xffEp->ident != XFF_SHTEXE_MAGIC_XFF2 || xffEp->sectTab_Rel > imgSize ||
+        (u32)xffEp->sectNrE > (imgSize - xffEp->sectTab_Rel) / sizeof(*sect) || xffEp->relocTab_Rel > imgSize ||
+        (u32)xffEp->relocTabNrE > (imgSize - xffEp->relocTab_Rel) / sizeof(struct t_xffRelocEnt))
+        return XFF_ERR_FORMAT;
+
+    sect = (const struct t_xffSectEnt *)(data + xffEp->sectTab_Rel);
+    pad = calloc(xffEp->sectNrE + 1, sizeof(*pad));
+    if (pad == NULL)
+        return XFF_ERR_NOMEM;
+
+    for (i = 1; i < (u32)xffEp->sectNrE; i++)
+    {
+        if ((sect[i].type != XFF_SECT_PROGBITS && sect[i].type != XFF_SECT_OVERLAYDATA) || sect[i].size == 0)
+            continue;
+
+        st->sections++;
+        if (sect[i].flags != 0)
+        {
+            st->forced++;
+            continue;
+        }
+        if (sect[i].align > 1 && (sect[i].align & (sect[i].align - 1)) == 0 && sect[i].offs_Rel < imgSize)
+        {
+            pad[padNrE].offs = sect[i].offs_Rel;
+            pad[padNrE].size = sect[i].align; // alignment for now, turned into a size below
+            padNrE++;
+        }
+    }
+    qsort(pad, padNrE, sizeof(*pad), ComparePad);
+
+    // Sections sharing a start offset get the strictest alignment once
+    for (i = 0, prev = 0; i < padNrE; i++)
+    {
+        if (prev != 0 && pad[prev - 1].offs == pad[i].offs)
+        {
+            if (pad[i].size > pad[prev - 1].size)
+                pad[prev - 1].size = pad[i].size;
+            continue;
+        }
+        pad[prev++] = pad[i];
+    }
+    padNrE = prev;
+
+    for (i = 0, shift = 0; i < padNrE; i++)
+    {
+        align = pad[i].size;
+        newOffs = pad[i].offs + shift;
+        pad[i].size = (align - (newOffs & (align - 1))) & (align - 1);
+        shift += pad[i].size;
+    }
+
+    newSize = imgSize + shift;
+    img = calloc(1, newSize);
+    if (img == NULL)
+    {
+        free(pad);
+        return XFF_ERR_NOMEM;
+    }
+
+    // Copy the original bytes with the padding spliced in
+    for (i = 0, pos = 0, newOffs = 0; i < padNrE; i++)
+    {
+        memcpy(img + newOffs, data + pos, pad[i].offs - pos);
+        newOffs += pad[i].offs - pos + pad[i].size;
+        pos = pad[i].offs;
+    }
+    memcpy(img + newOffs, data + pos, imgSize - pos);
+
+    hdr = (struct t_xffEntPntHdr *)img;
+    hdr->stack_Rel = MapOffs(pad, padNrE, hdr->stack_Rel);
+    hdr->impSymIxs_Rel = MapOffs(pad, padNrE, hdr->impSymIxs_Rel);
+    hdr->symTab_Rel = MapOffs(pad, padNrE, hdr->symTab_Rel);
+    hdr->symTabStr_Rel = MapOffs(pad, padNrE, hdr->symTabStr_Rel);
+    hdr->sectTab_Rel = MapOffs(pad, padNrE, hdr->sectTab_Rel);
+    hdr->symRelTab_Rel = MapOffs(pad, padNrE, hdr->symRelTab_Rel);
+    hdr->relocTab_Rel = MapOffs(pad, padNrE, hdr->relocTab_Rel);
+    hdr->ssNamesOffs_Rel = MapOffs(pad, padNrE, hdr->ssNamesOffs_Rel);
+    hdr->ssNamesBase_Rel = MapOffs(pad, padNrE, hdr->ssNamesBase_Rel);
+
+    newSect = (struct t_xffSectEnt *)(img + hdr->sectTab_Rel);
+    for (i = 0; i < (u32)hdr->sectNrE; i++)
+    {
+        newSect[i].offs_Rel = MapOffs(pad, padNrE, newSect[i].offs_Rel);
+        if ((newSect[i].type == XFF_SECT_PROGBITS || newSect[i].type == XFF_SECT_OVERLAYDATA) && newSect[i].size != 0 &&
+            newSect[i].flags == 0)
+        {
+            if (!Aligned(sect[i].offs_Rel, sect[i].align))
+                st->realigned++;
+            if (Aligned(newSect[i].offs_Rel, newSect[i].align))
+                st->aligned++;
+            if (newSect[i].align > st->maxAlign)
+                st->maxAlign = newSect[i].align;
+        }
+    }
+
+    newRt = (struct t_xffRelocEnt *)(img + hdr->relocTab_Rel);
+    for (i = 0; i < (u32)hdr->relocTabNrE; i++)
+    {
+        newRt[i].addr_Rel = MapOffs(pad, padNrE, newRt[i].addr_Rel);
+        newRt[i].inst_Rel = MapOffs(pad, padNrE, newRt[i].inst_Rel);
+    }
+
+    st->padBytes = shift;
+    st->extDropped = imgSize != size;
+    free(pad);
+
+    *out = img;
+    *outSize = newSize;
+    return XFF_OK;
+}
@@ -0,0 +1,186 @@
+/*
+xfflayout: rewrites XFF files so that DecodeSection() never has to copy a section.
+
+Usage: xfflayout [-a fileAlign] -o outDir file.xff...
+
+Every progbits section is moved to a file offset that meets its alignment, see
+XffRelayout(). The rewritten file must hold the same sections, symbols and relocations.
+Each file is then loaded, in order, from the original and from the rewritten copy and
+the bytes DecodeSection() copied are reported for both. 'fileAlign' is the alignment
+the loader places file images at (default 0x10, as XffLoadImage() and the EE heap do);
+sections asking for more than that can still be copied.
+*/
+
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libxff.h"
+
+static s32 WriteFile(const char *path, const void *data, u32 size)
+{
+    FILE *f = fopen(path, "wb");
+
+    if (f == NULL)
+        return XFF_ERR_IO;
+
+    if (fwrite(data, 1, size, f) != size)
+    {
+        fclose(f);
+        return XFF_ERR_IO;
+    }
+
+    return fclose(f) == 0 ? XFF_OK : XFF_ERR_IO;
+}
+
+// The rewrite must only move things around: same section bytes, symbols and relocations.
+static s32 SameContents(const u8 *a, const u8 *b)
+{
+    const struct t_xffEntPntHdr *ha = (const struct t_xffEntPntHdr *)a;
+    const struct t_xffEntPntHdr *hb = (const struct t_xffEntPntHdr *)b;
+    const struct t_xffSectEnt *sa = (const struct t_xffSectEnt *)(a + ha->sectTab_Rel);
+    const struct t_xffSectEnt *sb = (const struct t_xffSectEnt *)(b + hb->sectTab_Rel);
+    const struct t_xffRelocEnt *ra = (const struct t_xffRelocEnt *)(a + ha->relocTab_Rel);
+    const struct t_xffRelocEnt *rb = (const struct t_xffRelocEnt *)(b + hb->relocTab_Rel);
+    const struct t_xffSymEnt *ya = (const struct t_xffSymEnt *)(a + ha->symTab_Rel);
+    s32 i;
+
+    if (ha->sectNrE != hb->sectNrE || ha->relocTabNrE != hb->relocTabNrE || ha->symTabNrE != hb->symTabNrE ||
+        ha->impSymIxsNrE != hb->impSymIxsNrE || ha->entryPnt_Rel != hb->entryPnt_Rel)
+        return 0;
+
+    for (i = 1; i < ha->sectNrE; i++)
+    {
+        if (sa[i].size != sb[i].size || sa[i].align != sb[i].align || sa[i].type != sb[i].type || sa[i].flags != sb[i].flags)
+            return 0;
+        if (sa[i].type != XFF_SECT_NOBITS && memcmp(a + sa[i].offs_Rel, b + sb[i].offs_Rel, sa[i].size) != 0)
+            return 0;
+    }
+
+    for (i = 0; i < ha->relocTabNrE; i++)
+    {
+        if (ra[i].nrEnt != rb[i].nrEnt || ra[i].sect != rb[i].sect ||
+            memcmp(a + ra[i].addr_Rel, b + rb[i].addr_Rel, ra[i].nrEnt * sizeof(struct t_xffRelocAddrEnt)) != 0 ||
+            memcmp(a + ra[i].inst_Rel, b + rb[i].inst_Rel, ra[i].nrEnt * sizeof(struct t_xffRelocInstEnt)) != 0)
+            return 0;
+    }
+
+    if (memcmp(ya, b + hb->symTab_Rel, ha->symTabNrE * sizeof(*ya)) != 0 ||
+        memcmp(a + ha->symRelTab_Rel, b + hb->symRelTab_Rel, ha->symTabNrE * sizeof(struct t_xffSymRelEnt)) != 0 ||
+        memcmp(a + ha->impSymIxs_Rel, b + hb->impSymIxs_Rel, ha->impSymIxsNrE * sizeof(struct t_xffImpSymIxs)) != 0)
+        return 0;
+
+    for (i = 0; i < ha->symTabNrE; i++)
+    {
+        if (strcmp((const char *)a + ha->symTabStr_Rel + ya[i].nameOffs, (const char *)b + hb->symTabStr_Rel + ya[i].nameOffs) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    struct XffLoader before;
+    struct XffLoader after;
+    struct XffLayoutStats st;
+    struct XffModule *ma;
+    struct XffModule *mb;
+    const char *outDir = NULL;
+    u32 fileAlign = XFF_FILE_ALIGN_DEFAULT;
+    char name[1024];
+    char path[1024];
+    void *data;
+    u8 *out;
+    u32 size;
+    u32 outSize;
+    s32 opt;
+    s32 ret = 0;
+    s32 i;
+
+    while ((opt = getopt(argc, argv, "a:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a':
+            fileAlign = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            outDir = optarg;
+            break;
+        default:
+            outDir = NULL;
+            optind = argc;
+            break;
+        }
+    }
+
+    if (outDir == NULL || optind >= argc || fileAlign == 0 || (fileAlign & (fileAlign - 1)) != 0)
+    {
+        fprintf(stderr, "usage: %s [-a fileAlign] -o outDir file.xff...\n", argv[0]);
+        return 1;
+    }
+
+    if (XffLoaderInit(&before, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK ||
+        XffLoaderInit(&after, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK)
+        return 1;
+    before.noPrelink = 1;
+    before.fileAlign = fileAlign;
+    after.fileAlign = fileAlign;
+
+    for (i = optind; i < argc; i++)
+    {
+        data = XffMapFile(argv[i], &size);
+        if (data == NULL)
+        {
+            fprintf(stderr, "xfflayout: can't map %s\n", argv[i]);
+            return 1;
+        }
+
+        if (XffRelayout(data, size, &st, &out, &outSize) != XFF_OK)
+        {
+            fprintf(stderr, "xfflayout: %s: not an XFF2 executable\n", argv[i]);
+            XffUnmapFile(data, size);
+            return 1;
+        }
+
+        snprintf(name, sizeof(name), "%s", argv[i]);
+        snprintf(path, sizeof(path), "%s/%s", outDir, basename(name));
+        if (WriteFile(path, out, outSize) != XFF_OK)
+        {
+            fprintf(stderr, "xfflayout: can't write %s\n", path);
+            XffUnmapFile(data, size);
+            free(out);
+            return 1;
+        }
+
+        if (XffLoadImage(&before, argv[i], data, size, &ma) != XFF_OK || XffLoadImage(&after, path, out, outSize, &mb) != XFF_OK)
+        {
+            fprintf(stderr, "xfflayout: %s: load failed\n", argv[i]);
+            XffUnmapFile(data, size);
+            free(out);
+            return 1;
+        }
+
+        printf("%s: %u sections realigned, %u pad bytes, copied %u -> %u bytes (%u -> %u sections)%s\n", path, st.realigned, st.padBytes,
+               ma->bytesCopied, mb->bytesCopied, ma->sectCopied, mb->sectCopied, st.extDropped ? ", extension blocks dropped" : "");
+        if (st.forced != 0)
+            printf("\t%u sections with flags != 0 are always copied\n", st.forced);
+        if (st.maxAlign > fileAlign)
+            printf("\tsections ask for 0x%x alignment, file images are placed at 0x%x\n", st.maxAlign, fileAlign);
+
+        if (!SameContents(data, out))
+        {
+            fprintf(stderr, "xfflayout: %s: contents differ from the original\n", path);
+            ret = 1;
+        }
+
+        XffUnmapFile(data, size);
+        free(out);
+    }
+
+    XffLoaderTerm(&before);
+    XffLoaderTerm(&after);
+    return ret;
+}
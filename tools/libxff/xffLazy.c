@@ -0,0 +1,237 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libxff.h"
+
+/*
+Lazy binding of imported functions.
+
+ResolveImports() looks every import up at load time, although most of the functions a
+module calls in other modules, error and debug paths among them, never run in a session.
+With a resolver set (XffLoaderUseLazyBind()), an import the module only reaches through
+XFF_R_26 sites, a jal or j, isn't looked up. It points at a stub of its own instead:
+
+    move  $t7, $ra
+    jal   resolver
+    ori   $at, $zero, impIx     (delay slot)
+    nop
+
+The jal leaves $ra at stub + 12, so the EE side resolver knows the stub and, through the
+stub ranges of the loaded modules, its module; $at holds the import index and $t7 the
+caller's return address, both free to clobber across a call. XffLazyCall() stands in for
+the resolver on the host: the import is looked up through the exports of every loaded
+module, the stub is rewritten to a plain j to the function and execution continues there. The call sites keep going
+through the stub, a jump slot, until something re-relocates the extern tables; the import
+carries the real address from then on, so that puts them on the function directly.
+Imports that are also referenced as data (R_32, HI16/LO16) are bound at load time, their
+address must be the one the exporter sees.
+
+The stubs are allocated with the module and handed to it by XffAddModule(). An import
+waiting at its stub has unk0D == XFF_SYM_LAZY, which XffResolveImports() and the move
+code leave alone. The ori with the index stays when the stub is bound, so the stubs tell
+which imports they belong to after compaction moved them.
+*/
+
+#define MIPS_J (0x08000000)
+#define MIPS_JAL (0x0C000000)
+#define MIPS_MOVE_T7_RA (0x03E07825) // or $t7, $ra, $zero
+#define MIPS_ORI_AT (0x34010000)     // ori $at, $zero, imm
+#define MIPS_NOP (0x00000000)
+
+static inline u32 JumpTo(u32 addr)
+{
+    return MIPS_J | ((addr >> 2) & 0x03FFFFFF);
+}
+
+static inline u32 CallTo(u32 addr)
+{
+    return MIPS_JAL | ((addr >> 2) & 0x03FFFFFF);
+}
+
+static inline u32 JumpTarget(u32 word, u32 pc)
+{
+    return ((word & 0x03FFFFFF) << 2) | ((pc + 4) & 0xF0000000);
+}
+
+// Stubs call guest address 'resolver', 0 turns lazy binding off. Only modules loaded
+// from then on get stubs.
+void XffLoaderUseLazyBind(struct XffLoader *ldr, u32 resolver)
+{
+    ldr->lazyResolver = resolver;
+}
+
+// Flags the imports every extern relocation entry of which is an XFF_R_26 one: 1 = jump
+// target only, 2 = referenced some other way.
+static u8 *JumpOnlyImports(const struct XffArena *ar, const struct t_xffEntPntHdr *xffEp)
+{
+    const struct t_xffRelocEnt *rt = XffPtr(ar, xffEp->relocTab);
+    const struct t_xffRelocAddrEnt *addrTab;
+    u8 *use;
+    u32 j;
+    s32 i;
+
+    use = calloc(xffEp->symTabNrE, 1);
+    if (use == NULL)
+        return NULL;
+
+    for (i = 0; i < xffEp->relocTabNrE / 2; i++)
+    {
+        // Packed tables only appear after the load, XffPackRelocations()
+        if (rt[i].type == XFF_RELOC_TYPE_PACKED)
+        {
+            free(use);
+            return NULL;
+        }
+
+        addrTab = XffPtr(ar, rt[i].addr);
+        for (j = 0; j < rt[i].nrEnt; j++)
+            use[addrTab[j].tgSymIx] |= addrTab[j].relType == XFF_R_26 ? 1 : 2;
+    }
+    return use;
+}
+
+// XffResolveImports() for a loader with lazy binding on: imports only used as jump
+// targets get a stub, the others are bound now. Falls back to binding everything when
+// there is no memory for the stubs.
+void XffLazyImports(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp)
+{
+    const struct XffArena *ar = &ldr->arena;
+    struct t_xffImpSymIxs *imp = XffPtr(ar, xffEp->impSymIxs);
+    struct t_xffSymEnt *symTab = XffPtr(ar, xffEp->symTab);
+    struct t_xffSymEnt *sym;
+    u32 *stub;
+    u32 stubAddr = 0;
+    u32 stubNrE = 0;
+    u8 *use;
+    s32 i;
+
+    use = xffEp->impSymIxsNrE <= 0x10000 ? JumpOnlyImports(ar, xffEp) : NULL;
+    for (i = 0; use != NULL && i < xffEp->impSymIxsNrE; i++)
+        stubNrE += use[imp[i].stIx] == 1;
+
+    if (stubNrE != 0)
+        stubAddr = ldr->mallocAlign(ldr, stubNrE * XFF_LAZY_STUB_SIZE, XFF_LAZY_STUB_SIZE);
+
+    stub = stubAddr != 0 ? XffPtr(ar, stubAddr) : NULL;
+    for (i = 0; i < xffEp->impSymIxsNrE; i++)
+    {
+        sym = &symTab[imp[i].stIx];
+        if (stubAddr == 0 || use[imp[i].stIx] != 1)
+        {
+            sym->unk0D = 0;
+            continue;
+        }
+
+        stub[0] = MIPS_MOVE_T7_RA;
+        stub[1] = CallTo(ldr->lazyResolver);
+        stub[2] = MIPS_ORI_AT | i;
+        stub[3] = MIPS_NOP;
+        sym->addr = XffAddr(ar, stub);
+        sym->unk0D = XFF_SYM_LAZY;
+        stub += XFF_LAZY_STUB_SIZE / 4;
+    }
+    free(use);
+
+    if (stubAddr != 0)
+    {
+        ldr->lazyStubs = stubAddr;
+        ldr->lazyNrE = stubNrE;
+        ldr->stats.lazyStubs += stubNrE;
+    }
+
+    XffResolveImports(ldr, xffEp);
+}
+
+// Binds the import behind stub 'n' of 'mod'. Returns the address it now jumps to, 0 when
+// nobody exports the import; the stub stays then and the next call tries again.
+static u32 BindStub(struct XffLoader *ldr, struct XffModule *mod, u32 n)
+{
+    const struct XffArena *ar = &ldr->arena;
+    struct t_xffEntPntHdr *xffEp = mod->xffEp;
+    struct t_xffImpSymIxs *imp = XffPtr(ar, xffEp->impSymIxs);
+    struct t_xffSymEnt *symTab = XffPtr(ar, xffEp->symTab);
+    const u32 *impHash = XffHashImports(ldr, xffEp);
+    u32 stubAddr = mod->lazyStubs + n * XFF_LAZY_STUB_SIZE;
+    u32 *stub = XffPtr(ar, stubAddr);
+    struct t_xffSymEnt *sym;
+    struct t_xffSymEnt *found;
+    u32 addr;
+    u32 i;
+
+    // Bound by an earlier call
+    if (stub[1] != CallTo(ldr->lazyResolver))
+        return JumpTarget(stub[0], stubAddr);
+
+    i = stub[2] & 0xFFFF;
+    sym = &symTab[imp[i].stIx];
+    addr = XffFindImport(ldr, xffEp, sym, impHash != NULL ? impHash[i] : 0, &found);
+    if (found == NULL)
+    {
+        ldr->stats.lazyMisses++;
+        return 0;
+    }
+
+    sym->addr = addr;
+    sym->unk0D = 1;
+    stub[0] = JumpTo(addr);
+    stub[1] = MIPS_NOP;
+    ldr->stats.lazyBound++;
+    return addr;
+}
+
+// What the resolver does when a call lands on guest address 'target': a stub binds its
+// import and the address execution continues at is returned. Any other address is
+// returned as it is, 0 means the import of the stub is exported by nobody.
+u32 XffLazyCall(struct XffLoader *ldr, u32 target)
+{
+    struct XffModule *mod;
+    u32 offs;
+
+    for (mod = ldr->modules; mod != NULL; mod = mod->next)
+    {
+        offs = target - mod->lazyStubs;
+        if (mod->lazyNrE != 0 && offs < mod->lazyNrE * XFF_LAZY_STUB_SIZE)
+            return offs % XFF_LAZY_STUB_SIZE == 0 ? BindStub(ldr, mod, offs / XFF_LAZY_STUB_SIZE) : target;
+    }
+    return target;
+}
+
+// The stubs of 'mod' were moved by 'shift' together with [from, from + size). Points the
+// imports still waiting at their stub there and patches every call site of a stub import
+// again, the bound ones go to the function directly from now on.
+s32 XffLazyRebase(struct XffLoader *ldr, struct XffModule *mod, u32 from, u32 size, s32 shift)
+{
+    const struct XffArena *ar = &ldr->arena;
+    struct t_xffEntPntHdr *xffEp = mod->xffEp;
+    struct t_xffImpSymIxs *imp = XffPtr(ar, xffEp->impSymIxs);
+    struct t_xffSymEnt *symTab = XffPtr(ar, xffEp->symTab);
+    struct t_xffRelocEnt *rt = XffPtr(ar, xffEp->relocTab);
+    struct t_xffSymEnt *sym;
+    const u32 *stub;
+    u8 *changed;
+    u32 n;
+    s32 i;
+
+    if (mod->lazyNrE == 0 || mod->lazyStubs < from || mod->lazyStubs >= from + size)
+        return XFF_OK;
+
+    changed = calloc(xffEp->symTabNrE, 1);
+    if (changed == NULL)
+        return XFF_ERR_NOMEM;
+
+    mod->lazyStubs += shift;
+    stub = XffPtr(ar, mod->lazyStubs);
+    for (n = 0; n < mod->lazyNrE; n++, stub += XFF_LAZY_STUB_SIZE / 4)
+    {
+        sym = &symTab[imp[stub[2] & 0xFFFF].stIx];
+        if (sym->unk0D == XFF_SYM_LAZY)
+            sym->addr += shift;
+        changed[imp[stub[2] & 0xFFFF].stIx] = 1;
+    }
+
+    for (i = 0; i < xffEp->relocTabNrE / 2; i++)
+        XffPatchChanged(ar, xffEp, &rt[i], changed);
+
+    free(changed);
+    return XFF_OK;
+}
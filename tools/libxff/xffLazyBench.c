@@ -0,0 +1,232 @@
+/*
+xfflazybench: load time with lazy import binding against binding everything up front.
+
+Usage: xfflazybench [-n reps] [-i imports] [-r relocs] [-c callPercent] [-R resolver]
+
+A provider module exporting 'imports' functions is loaded, then a synthetic consumer
+(xffGen.c) importing all of them with 'relocs' relocation entries, mostly jal sites. The
+consumer load is timed 'reps' times on an eager loader and on one with lazy binding,
+its stubs calling guest address 'resolver'. Then a session is played on the lazy
+loader: callPercent of the imports are called once through one of their sites
+(XffLazyCall()), and the first calls are timed. At the end every extern site is followed
+through its stub, binding the rest, and must reach what the eager loader put there.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xffBuild.h"
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline u32 JumpTarget(u32 word, u32 pc)
+{
+    return ((word & 0x03FFFFFF) << 2) | ((pc + 4) & 0xF0000000);
+}
+
+// Loads provider and consumer into a reset loader, returns the seconds the consumer took
+static double LoadPair(struct XffLoader *ldr, const u8 *prov, u32 provSize, const u8 *img, u32 size, struct XffModule **modOut)
+{
+    struct XffModule *mod;
+    double t0;
+
+    XffLoaderReset(ldr);
+    if (XffLoadImage(ldr, "provider", prov, provSize, &mod) != XFF_OK)
+        return -1;
+
+    t0 = NowSec();
+    if (XffLoadImage(ldr, "consumer", img, size, modOut) != XFF_OK)
+        return -1;
+    return NowSec() - t0;
+}
+
+// Guest address of extern entry 'j' of table 't'
+static u32 SiteAddr(const struct XffArena *ar, const struct t_xffEntPntHdr *xffEp, s32 t, u32 j)
+{
+    const struct t_xffRelocEnt *rt = (const struct t_xffRelocEnt *)XffPtr(ar, xffEp->relocTab) + t;
+    const struct t_xffSectEnt *sect = (const struct t_xffSectEnt *)XffPtr(ar, xffEp->sectTab) + rt->sect;
+    const struct t_xffRelocAddrEnt *addrTab = XffPtr(ar, rt->addr);
+
+    return sect->memPt + addrTab[j].addr;
+}
+
+int main(int argc, char **argv)
+{
+    struct XffLoader eager;
+    struct XffLoader lazy;
+    struct XffModule *modEager;
+    struct XffModule *modLazy;
+    struct XffGenParams cons;
+    struct XffGenParams prov;
+    const struct t_xffRelocEnt *rt;
+    const struct t_xffRelocAddrEnt *addrTab;
+    u32 resolver = 0x00100000;
+    u32 callPercent = 10;
+    u32 importNrE = 4096;
+    u32 relocNrE = 0;
+    s32 reps = 20;
+    s32 opt;
+    s32 r;
+    s32 t;
+    u32 j;
+    u32 site;
+    u32 want;
+    u32 got;
+    u32 calls = 0;
+    u32 checked = 0;
+    u32 bad = 0;
+    u8 *called;
+    u8 *img;
+    u8 *provImg;
+    u32 size;
+    u32 provSize;
+    double sec;
+    double tEager = 1e30;
+    double tLazy = 1e30;
+    double tCalls;
+
+    while ((opt = getopt(argc, argv, "n:i:r:c:R:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            reps = strtol(optarg, NULL, 0);
+            break;
+        case 'i':
+            importNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            relocNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            callPercent = strtoul(optarg, NULL, 0);
+            break;
+        case 'R':
+            resolver = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            reps = 0;
+            break;
+        }
+    }
+
+    if (reps < 1 || optind != argc || importNrE == 0 || importNrE > 0x10000 || callPercent > 100 || resolver == 0)
+    {
+        fprintf(stderr, "usage: %s [-n reps] [-i imports] [-r relocs] [-c callPercent] [-R resolver]\n", argv[0]);
+        return 1;
+    }
+
+    // Mostly jal, some imports end up referenced as data too and are bound eagerly
+    XffGenDefaults(&cons);
+    cons.importNrE = importNrE;
+    cons.relocNrE = relocNrE != 0 ? relocNrE : importNrE * 16;
+    cons.weight[0] = 1;
+    cons.weight[1] = 30;
+    cons.weight[2] = 1;
+    cons.extPercent = 50;
+    cons.exportPrefix = "mod_";
+    cons.importPrefix = "lib_";
+
+    XffGenDefaults(&prov);
+    prov.seed = 2;
+    prov.exportNrE = importNrE;
+    prov.importNrE = 0;
+    prov.relocNrE = 0;
+    prov.padBytes = 0x1000;
+    prov.exportPrefix = "lib_";
+
+    if (XffGenerate(&cons, &img, &size) != XFF_OK || XffGenerate(&prov, &provImg, &provSize) != XFF_OK ||
+        XffLoaderInit(&eager, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK ||
+        XffLoaderInit(&lazy, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK)
+    {
+        fprintf(stderr, "xfflazybench: out of memory\n");
+        return 1;
+    }
+    XffLoaderUseLazyBind(&lazy, resolver);
+
+    for (r = 0; r < reps; r++)
+    {
+        memset(&eager.stats, 0, sizeof(eager.stats));
+        memset(&lazy.stats, 0, sizeof(lazy.stats));
+        sec = LoadPair(&eager, provImg, provSize, img, size, &modEager);
+        if (sec >= 0 && sec < tEager)
+            tEager = sec;
+        sec = LoadPair(&lazy, provImg, provSize, img, size, &modLazy);
+        if (sec >= 0 && sec < tLazy)
+            tLazy = sec;
+        if (sec < 0)
+            break;
+    }
+    if (r != reps)
+    {
+        fprintf(stderr, "xfflazybench: load failed\n");
+        return 1;
+    }
+
+    printf("consumer        : %u imports, %u relocations, %u bytes\n", importNrE, cons.relocNrE, size);
+    printf("stubs           : %u imports only reached by jal, %u bound at load\n", lazy.stats.lazyStubs,
+           lazy.stats.imports - lazy.stats.unresolved);
+    printf("load, eager     : %8.3f ms\n", tEager * 1e3);
+    printf("load, lazy      : %8.3f ms (%.2fx)\n", tLazy * 1e3, tEager / tLazy);
+
+    // The session: the first site of every called import
+    called = calloc(modLazy->xffEp->symTabNrE, 1);
+    rt = XffPtr(&lazy.arena, modLazy->xffEp->relocTab);
+    tCalls = NowSec();
+    for (t = 0; t < modLazy->xffEp->relocTabNrE / 2; t++)
+    {
+        addrTab = XffPtr(&lazy.arena, rt[t].addr);
+        for (j = 0; j < rt[t].nrEnt; j++)
+        {
+            if (addrTab[j].relType != XFF_R_26 || called[addrTab[j].tgSymIx] ||
+                (addrTab[j].tgSymIx * 2654435761u >> 8) % 100 >= callPercent)
+                continue;
+
+            called[addrTab[j].tgSymIx] = 1;
+            site = SiteAddr(&lazy.arena, modLazy->xffEp, t, j);
+            XffLazyCall(&lazy, JumpTarget(*(u32 *)XffPtr(&lazy.arena, site), site));
+            calls++;
+        }
+    }
+    tCalls = NowSec() - tCalls;
+    free(called);
+
+    printf("session         : %u imports called, %u bound on their first call, %.2f us per first call\n", calls,
+           lazy.stats.lazyBound, calls != 0 ? tCalls / calls * 1e6 : 0.0);
+    printf("imports bound   : %u of %u\n", lazy.stats.imports - lazy.stats.unresolved + lazy.stats.lazyBound, importNrE);
+
+    // Every extern site must end up where the eager loader sent it
+    for (t = 0; t < modLazy->xffEp->relocTabNrE / 2; t++)
+    {
+        addrTab = XffPtr(&lazy.arena, rt[t].addr);
+        for (j = 0; j < rt[t].nrEnt; j++, checked++)
+        {
+            site = SiteAddr(&lazy.arena, modLazy->xffEp, t, j);
+            want = *(u32 *)XffPtr(&eager.arena, SiteAddr(&eager.arena, modEager->xffEp, t, j));
+            got = *(u32 *)XffPtr(&lazy.arena, site);
+            if (addrTab[j].relType == XFF_R_26)
+            {
+                want = JumpTarget(want, site);
+                got = XffLazyCall(&lazy, JumpTarget(got, site));
+            }
+            bad += got != want;
+        }
+    }
+    printf("check           : %u extern sites, %u differ, %u of %u stubs bound in the end\n", checked, bad,
+           lazy.stats.lazyBound, lazy.stats.lazyStubs);
+
+    free(img);
+    free(provImg);
+    XffLoaderTerm(&eager);
+    XffLoaderTerm(&lazy);
+    return bad != 0;
+}
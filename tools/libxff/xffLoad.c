@@ -0,0 +1,1334 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libxff.h"
+
+static char *sMovedNames[] = {"normal use", "\x1B[36mout of align(alloc)\x1B[m", "alloc flag(alloc)"};
+
+static u32 DefaultMallocAlign(struct XffLoader *ldr, s32 sz, s32 align)
+{
+    if (ldr->regions != NULL)
+        return ldr->region != NULL ? XffRegionAlloc(ldr->regions, ldr->region, sz, align) : 0;
+    return XffArenaAlloc(&ldr->arena, sz, align);
+}
+
+static u32 DefaultMallocMaxAlign(struct XffLoader *ldr, s32 sz)
+{
+    return DefaultMallocAlign(ldr, sz, XFF_MAX_ALIGN);
+}
+
+s32 XffLoaderInit(struct XffLoader *ldr, u32 base, u32 size)
+{
+    memset(ldr, 0, sizeof(*ldr));
+    ldr->mallocAlign = DefaultMallocAlign;
+    ldr->mallocMaxAlign = DefaultMallocMaxAlign;
+    ldr->relocChunk = XFF_RELOC_CHUNK_DEFAULT;
+    ldr->fileAlign = XFF_FILE_ALIGN_DEFAULT;
+    return XffArenaCreate(&ldr->arena, base, size);
+}
+
+static void FreeModuleList(struct XffLoader *ldr)
+{
+    struct XffModule *mod;
+
+    while ((mod = ldr->modules) != NULL)
+    {
+        ldr->modules = mod->next;
+        free(mod->name);
+        free(mod);
+    }
+
+    if (ldr->symIndex != NULL)
+    {
+        XffSymIndexFree(ldr->symIndex);
+        ldr->symIndex->pool = ldr->strPool;
+    }
+
+    // No module refers to the names anymore
+    if (ldr->strPool != NULL)
+        XffStrPoolClear(ldr->strPool);
+}
+
+void XffLoaderTerm(struct XffLoader *ldr)
+{
+    XffLoaderUseSymIndex(ldr, 0);
+    FreeModuleList(ldr);
+    XffLoaderUseStrPool(ldr, 0);
+    if (ldr->regions != NULL)
+    {
+        XffRegionHeapTerm(ldr->regions);
+        free(ldr->regions);
+        ldr->regions = NULL;
+    }
+    free(ldr->relPlanVals);
+    ldr->relPlanVals = NULL;
+    ldr->relPlanValNrE = 0;
+    XffArenaDestroy(&ldr->arena);
+}
+
+// Switches export lookups between the hashed index and the linear search. Without
+// memory for the index it returns XFF_ERR_NOMEM and keeps the linear search.
+s32 XffLoaderUseSymIndex(struct XffLoader *ldr, s32 enable)
+{
+    struct XffModule *mod;
+    struct XffModule *prev;
+
+    if (!enable)
+    {
+        if (ldr->symIndex != NULL)
+        {
+            XffSymIndexFree(ldr->symIndex);
+            free(ldr->symIndex);
+            ldr->symIndex = NULL;
+        }
+        return XFF_OK;
+    }
+
+    if (ldr->symIndex != NULL)
+        return XFF_OK;
+
+    ldr->symIndex = malloc(sizeof(*ldr->symIndex));
+    if (ldr->symIndex == NULL)
+        return XFF_ERR_NOMEM;
+    XffSymIndexInit(ldr->symIndex);
+    ldr->symIndex->pool = ldr->strPool;
+
+    // Register oldest first so that newer exports shadow older ones
+    for (prev = NULL; prev != ldr->modules; prev = mod)
+    {
+        for (mod = ldr->modules; mod->next != prev; mod = mod->next)
+            ;
+        if (XffSymIndexAddModule(ldr->symIndex, &ldr->arena, mod) != XFF_OK)
+        {
+            XffLoaderUseSymIndex(ldr, 0);
+            return XFF_ERR_NOMEM;
+        }
+    }
+    return XFF_OK;
+}
+
+// Interns the symbol names of every module loaded from now on, see xffStrPool.c. Only
+// allowed while no module is loaded, all of them must agree on what nameOffs is.
+s32 XffLoaderUseStrPool(struct XffLoader *ldr, s32 enable)
+{
+    struct XffStrPool *pool;
+    s32 ret;
+
+    if (ldr->modules != NULL)
+        return XFF_ERR_FORMAT;
+
+    if (!enable)
+    {
+        if (ldr->strPool != NULL)
+        {
+            XffStrPoolTerm(ldr->strPool);
+            free(ldr->strPool);
+            ldr->strPool = NULL;
+        }
+    }
+    else if (ldr->strPool == NULL)
+    {
+        pool = malloc(sizeof(*pool));
+        if (pool == NULL)
+            return XFF_ERR_NOMEM;
+
+        ret = XffStrPoolInit(pool);
+        if (ret != XFF_OK)
+        {
+            free(pool);
+            return ret;
+        }
+        ldr->strPool = pool;
+    }
+
+    if (ldr->symIndex != NULL)
+        ldr->symIndex->pool = ldr->strPool;
+    return XFF_OK;
+}
+
+// Gives each module loaded from now on a region of its own, carved out of the arena
+// above the current heap point. Only allowed while no module is loaded.
+s32 XffLoaderUseRegions(struct XffLoader *ldr, u32 chunkSize)
+{
+    struct XffRegionHeap *heap;
+    s32 ret;
+
+    if (ldr->modules != NULL || ldr->regions != NULL)
+        return XFF_ERR_FORMAT;
+
+    heap = malloc(sizeof(*heap));
+    if (heap == NULL)
+        return XFF_ERR_NOMEM;
+
+    ret = XffRegionHeapInit(heap, &ldr->arena, ldr->arena.heapPt, ldr->arena.base + ldr->arena.size, chunkSize);
+    if (ret != XFF_OK)
+    {
+        free(heap);
+        return ret;
+    }
+
+    ldr->regions = heap;
+    return XFF_OK;
+}
+
+// Drops every module and rewinds the heap, as loaderLoop() does on each reset.
+void XffLoaderReset(struct XffLoader *ldr)
+{
+    FreeModuleList(ldr);
+    XffSetHeapStartPoint(&ldr->arena, ldr->arena.base);
+    if (ldr->regions != NULL)
+        XffRegionHeapReset(ldr->regions);
+    ldr->region = NULL;
+    if (ldr->prof != NULL)
+        ldr->prof->boot++;
+}
+
+// Whether 'nrE' entries of 'entSize' bytes at file offset 'offs' lie inside 'size' bytes
+static s32 InFile(u32 offs, u32 nrE, u32 entSize, u32 size)
+{
+    return offs <= size && nrE <= (size - offs) / entSize;
+}
+
+// End of the last NUL terminated string in [offs, end), 'offs' when there is none
+static u32 StrEnd(const u8 *img, u32 offs, u32 end)
+{
+    while (end > offs && img[end - 1] != 0)
+        end--;
+    return end;
+}
+
+// Whether [a, a + aSize) and [b, b + bSize) share a byte
+static s32 Overlaps(u32 a, u32 aSize, u32 b, u32 bSize)
+{
+    return aSize != 0 && bSize != 0 && a < b + bSize && b < a + aSize;
+}
+
+// Sections of these types get memory, a relocation table can only be for them. A section in
+// place in the file must be word aligned for the relocation stores.
+static s32 RelocSect(const struct t_xffSectEnt *sect)
+{
+    if (sect->type == XFF_SECT_NOBITS)
+        return 1;
+    return (sect->type == XFF_SECT_PROGBITS || sect->type == XFF_SECT_OVERLAYDATA) && (sect->offs_Rel & 3) == 0;
+}
+
+// Whether a section in the file covers one of the tables the loader works from, which
+// relocating the section would then rewrite under it
+static s32 CoversTable(const struct t_xffEntPntHdr *xffEp, const struct t_xffRelocEnt *rt, u32 offs, u32 size)
+{
+    s32 i;
+
+    if (Overlaps(offs, size, 0, sizeof(*xffEp)) ||
+        Overlaps(offs, size, xffEp->impSymIxs_Rel, xffEp->impSymIxsNrE * sizeof(struct t_xffImpSymIxs)) ||
+        Overlaps(offs, size, xffEp->symTab_Rel, xffEp->symTabNrE * sizeof(struct t_xffSymEnt)) ||
+        Overlaps(offs, size, xffEp->symRelTab_Rel, xffEp->symTabNrE * sizeof(struct t_xffSymRelEnt)) ||
+        Overlaps(offs, size, xffEp->sectTab_Rel, xffEp->sectNrE * sizeof(struct t_xffSectEnt)) ||
+        Overlaps(offs, size, xffEp->relocTab_Rel, xffEp->relocTabNrE * sizeof(struct t_xffRelocEnt)))
+        return 1;
+
+    for (i = 0; i < xffEp->relocTabNrE; i++)
+    {
+        if (Overlaps(offs, size, rt[i].addr_Rel, rt[i].nrEnt * sizeof(struct t_xffRelocAddrEnt)) ||
+            Overlaps(offs, size, rt[i].inst_Rel, rt[i].nrEnt * sizeof(struct t_xffRelocInstEnt)))
+            return 1;
+    }
+    return 0;
+}
+
+// Range checks of the header, the section, relocation and section name tables of a 'size'
+// byte image against its size and counts. Only reads the file offsets, so the image may be
+// relocated already. A hostile or truncated file gives XFF_ERR_FORMAT here instead of
+// reads and writes outside of it later.
+s32 XffCheckHeader(const struct t_xffEntPntHdr *xffEp, u32 size)
+{
+    const u8 *img = (const u8 *)xffEp;
+    const struct t_xffSectEnt *sect;
+    const struct t_xffRelocEnt *rt;
+    const struct t_xffSsNmOffs *nmOffs;
+    u32 strEnd;
+    s32 i;
+
+    if (size < sizeof(*xffEp) || xffEp->ident != XFF_SHTEXE_MAGIC_XFF2 || xffEp->sectNrE < 1 || xffEp->impSymIxsNrE < 0 ||
+        xffEp->symTabNrE < 0 || xffEp->symTabNrE > 0x01000000 || xffEp->relocTabNrE < 0)
+        return XFF_ERR_FORMAT;
+
+    if (((xffEp->impSymIxs_Rel | xffEp->symTab_Rel | xffEp->sectTab_Rel | xffEp->symRelTab_Rel | xffEp->relocTab_Rel |
+          xffEp->ssNamesOffs_Rel) & 3) != 0 ||
+        !InFile(xffEp->impSymIxs_Rel, xffEp->impSymIxsNrE, sizeof(struct t_xffImpSymIxs), size) ||
+        !InFile(xffEp->symTab_Rel, xffEp->symTabNrE, sizeof(struct t_xffSymEnt), size) ||
+        !InFile(xffEp->symRelTab_Rel, xffEp->symTabNrE, sizeof(struct t_xffSymRelEnt), size) ||
+        !InFile(xffEp->sectTab_Rel, xffEp->sectNrE, sizeof(struct t_xffSectEnt), size) ||
+        !InFile(xffEp->relocTab_Rel, xffEp->relocTabNrE, sizeof(struct t_xffRelocEnt), size) ||
+        !InFile(xffEp->ssNamesOffs_Rel, xffEp->sectNrE - 1, sizeof(struct t_xffSsNmOffs), size) || xffEp->symTabStr_Rel > size ||
+        xffEp->ssNamesBase_Rel > size)
+        return XFF_ERR_FORMAT;
+
+    sect = (const struct t_xffSectEnt *)(img + xffEp->sectTab_Rel);
+    for (i = 1; i < xffEp->sectNrE; i++)
+    {
+        if (sect[i].size < 0 || sect[i].align < 0 || (sect[i].align & (sect[i].align - 1)) != 0)
+            return XFF_ERR_FORMAT;
+        if (sect[i].type != XFF_SECT_NOBITS && !InFile(sect[i].offs_Rel, sect[i].size, 1, size))
+            return XFF_ERR_FORMAT;
+    }
+
+    rt = (const struct t_xffRelocEnt *)(img + xffEp->relocTab_Rel);
+    for (i = 0; i < xffEp->relocTabNrE; i++)
+    {
+        if (rt[i].nrEnt == 0)
+            continue;
+        if (rt[i].type == XFF_RELOC_TYPE_PACKED || rt[i].sect == 0 || rt[i].sect >= (u32)xffEp->sectNrE ||
+            !RelocSect(&sect[rt[i].sect]) || ((rt[i].addr_Rel | rt[i].inst_Rel) & 3) != 0 ||
+            !InFile(rt[i].addr_Rel, rt[i].nrEnt, sizeof(struct t_xffRelocAddrEnt), size) ||
+            !InFile(rt[i].inst_Rel, rt[i].nrEnt, sizeof(struct t_xffRelocInstEnt), size))
+            return XFF_ERR_FORMAT;
+    }
+
+    for (i = 1; i < xffEp->sectNrE; i++)
+    {
+        if (sect[i].type != XFF_SECT_NOBITS && CoversTable(xffEp, rt, sect[i].offs_Rel, sect[i].size))
+            return XFF_ERR_FORMAT;
+    }
+
+    nmOffs = (const struct t_xffSsNmOffs *)(img + xffEp->ssNamesOffs_Rel);
+    strEnd = StrEnd(img, xffEp->ssNamesBase_Rel, size);
+    for (i = 0; i < xffEp->sectNrE - 1; i++)
+    {
+        if (nmOffs[i].nmOffs < 0 || (u32)nmOffs[i].nmOffs >= strEnd - xffEp->ssNamesBase_Rel)
+            return XFF_ERR_FORMAT;
+    }
+
+    return XFF_OK;
+}
+
+// Range checks of the import indices and the symbol names, which end before file offset
+// 'strEnd'. Needs XffCheckHeader().
+s32 XffCheckSymbols(const struct t_xffEntPntHdr *xffEp, u32 strEnd)
+{
+    const u8 *img = (const u8 *)xffEp;
+    const struct t_xffImpSymIxs *imp = (const struct t_xffImpSymIxs *)(img + xffEp->impSymIxs_Rel);
+    const struct t_xffSymEnt *sym = (const struct t_xffSymEnt *)(img + xffEp->symTab_Rel);
+    u32 nameEnd;
+    s32 i;
+
+    for (i = 0; i < xffEp->impSymIxsNrE; i++)
+    {
+        if (imp[i].stIx < 0 || imp[i].stIx >= xffEp->symTabNrE)
+            return XFF_ERR_FORMAT;
+    }
+
+    nameEnd = strEnd > xffEp->symTabStr_Rel ? StrEnd(img, xffEp->symTabStr_Rel, strEnd) : xffEp->symTabStr_Rel;
+    for (i = 0; i < xffEp->symTabNrE; i++)
+    {
+        if (sym[i].nameOffs < 0 || (u32)sym[i].nameOffs >= nameEnd - xffEp->symTabStr_Rel)
+            return XFF_ERR_FORMAT;
+    }
+
+    return XFF_OK;
+}
+
+// Range checks of the entries of relocation table 'ix': symbol index and a word aligned
+// site inside the section. Needs XffCheckHeader().
+s32 XffCheckRelocTab(const struct t_xffEntPntHdr *xffEp, s32 ix)
+{
+    const u8 *img = (const u8 *)xffEp;
+    const struct t_xffRelocEnt *rt = (const struct t_xffRelocEnt *)(img + xffEp->relocTab_Rel) + ix;
+    const struct t_xffRelocAddrEnt *addrTab = (const struct t_xffRelocAddrEnt *)(img + rt->addr_Rel);
+    u32 sectSize;
+    u32 j;
+
+    if (rt->nrEnt == 0)
+        return XFF_OK;
+
+    sectSize = ((const struct t_xffSectEnt *)(img + xffEp->sectTab_Rel))[rt->sect].size;
+    for (j = 0; j < rt->nrEnt; j++)
+    {
+        if (addrTab[j].tgSymIx >= (u32)xffEp->symTabNrE || (addrTab[j].addr & 3) != 0 || sectSize < 4 ||
+            addrTab[j].addr > sectSize - 4)
+            return XFF_ERR_FORMAT;
+    }
+
+    return XFF_OK;
+}
+
+// All of the above for a whole 'size' byte image
+s32 XffCheckImage(const struct t_xffEntPntHdr *xffEp, u32 size)
+{
+    s32 ret;
+    s32 i;
+
+    ret = XffCheckHeader(xffEp, size);
+    if (ret == XFF_OK)
+        ret = XffCheckSymbols(xffEp, size);
+    for (i = 0; ret == XFF_OK && i < xffEp->relocTabNrE; i++)
+        ret = XffCheckRelocTab(xffEp, i);
+    return ret;
+}
+
+// Turns the file offsets of the header, section and relocation tables into guest addresses.
+// The loaders pass the image through XffCheckHeader() first.
+s32 XffRelocateElfInfoHeader(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp, u32 fileAddr)
+{
+    s32 i;
+    struct t_xffSectEnt *sect;
+    struct t_xffRelocEnt *rt;
+
+    if (xffEp->ident != XFF_SHTEXE_MAGIC_XFF2)
+    {
+        return XFF_ERR_FORMAT;
+    }
+
+    xffEp->stack = fileAddr + xffEp->stack_Rel;
+    xffEp->impSymIxs = fileAddr + xffEp->impSymIxs_Rel;
+    xffEp->symTab = fileAddr + xffEp->symTab_Rel;
+    xffEp->symTabStr = fileAddr + xffEp->symTabStr_Rel;
+    xffEp->sectTab = fileAddr + xffEp->sectTab_Rel;
+    xffEp->symRelTab = fileAddr + xffEp->symRelTab_Rel;
+    xffEp->relocTab = fileAddr + xffEp->relocTab_Rel;
+    xffEp->ssNamesOffs = fileAddr + xffEp->ssNamesOffs_Rel;
+    xffEp->ssNamesBase = fileAddr + xffEp->ssNamesBase_Rel;
+
+    sect = XffPtr(ar, xffEp->sectTab);
+    for (i = 0; i < xffEp->sectNrE; i++)
+    {
+        sect[i].filePt = fileAddr + sect[i].offs_Rel;
+    }
+
+    rt = XffPtr(ar, xffEp->relocTab);
+    for (i = 0; i < xffEp->relocTabNrE; i++)
+    {
+        rt[i].addr = fileAddr + rt[i].addr_Rel;
+        rt[i].inst = fileAddr + rt[i].inst_Rel;
+    }
+
+    return XFF_OK;
+}
+
+// Clears a freshly allocated nobits section. In lazy mode, the part above the zero
+// watermark the arena had before the allocation has never been handed out and is left
+// alone.
+static void ClearNobits(struct XffLoader *ldr, u32 addr, u32 size, u32 zeroPt)
+{
+    u32 n = size;
+
+    if (ldr->lazyZero)
+        n = addr >= zeroPt ? 0 : (zeroPt - addr < size ? zeroPt - addr : size);
+
+    XffBulkZero(XffPtr(&ldr->arena, addr), n);
+    ldr->stats.bytesZeroed += n;
+    ldr->stats.bytesZeroSkipped += size - n;
+}
+
+// Picks the memory of section 'ix': in place in the file, or allocated when the file
+// alignment is insufficient, the section asks for max alignment or it is nobits.
+// Returns XFF_ERR_NOMEM when the section had to be allocated and got no memory.
+s32 XffPlaceSection(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp, s32 ix)
+{
+    const struct XffArena *ar = &ldr->arena;
+    struct t_xffSectEnt *sect = (struct t_xffSectEnt *)XffPtr(ar, xffEp->sectTab) + ix;
+    struct t_xffSsNmOffs *nmOffs = (struct t_xffSsNmOffs *)XffPtr(ar, xffEp->ssNamesOffs) + ix - 1;
+    char *ssNamesBase = XffPtr(ar, xffEp->ssNamesBase);
+    u32 zeroPt;
+
+    sect->moved = 0;
+    if (sect->size == 0)
+    {
+        sect->memPt = 0;
+        return XFF_OK;
+    }
+
+    switch (sect->type)
+    {
+    case XFF_SECT_PROGBITS:
+    case XFF_SECT_OVERLAYDATA:
+        if (sect->flags != 0)
+        {
+            // Forced max alignment
+            sect->memPt = ldr->mallocMaxAlign(ldr, sect->size);
+            sect->moved = 2;
+        }
+        else if ((sect->filePt & (sect->align - 1)) != 0)
+        {
+            // Insufficient alignment in the file, so allocate
+            sect->memPt = ldr->mallocAlign(ldr, sect->size, sect->align);
+            sect->moved = 1;
+        }
+        else
+        {
+            // Use the section as is in the file
+            sect->memPt = sect->filePt;
+        }
+
+        if (ldr->ldrDbgPrintf != NULL)
+        {
+            ldr->ldrDbgPrintf(sect->type == XFF_SECT_PROGBITS ? "ld:\t%15s(progbit): 0x%08x(0x%08x) %s\n" : "ld:\t%15s(overlaydata): 0x%08x(0x%08x) %s\n",
+                              &ssNamesBase[nmOffs->nmOffs], sect->memPt, sect->size, sMovedNames[sect->moved]);
+        }
+        break;
+    case XFF_SECT_NOBITS:
+        // Because nobits is not present in the file, it is always allocated
+        zeroPt = ar->zeroPt;
+        if (sect->flags != 0)
+        {
+            sect->memPt = ldr->mallocMaxAlign(ldr, sect->size);
+            sect->moved = 2;
+        }
+        else
+        {
+            sect->memPt = ldr->mallocAlign(ldr, sect->size, sect->align);
+            sect->moved = 1;
+        }
+
+        if (sect->memPt != 0)
+            ClearNobits(ldr, sect->memPt, sect->size, zeroPt);
+
+        if (ldr->ldrDbgPrintf != NULL)
+        {
+            ldr->ldrDbgPrintf("ld:\t%15s(nobit)  : 0x%08x(0x%08x) %s\n", &ssNamesBase[nmOffs->nmOffs], sect->memPt, sect->size, sMovedNames[sect->moved]);
+        }
+        break;
+    }
+    if (sect->moved != 0 && sect->memPt == 0)
+        return XFF_ERR_NOMEM;
+    ldr->stats.sections++;
+    return XFF_OK;
+}
+
+// Brings the contents of a placed progbits section in, copied out of the file if it was
+// moved. Needs the section bytes of the file to be resident. Nobits sections are already
+// cleared by XffPlaceSection().
+void XffFillSection(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp, s32 ix)
+{
+    const struct XffArena *ar = &ldr->arena;
+    struct t_xffSectEnt *sect = (struct t_xffSectEnt *)XffPtr(ar, xffEp->sectTab) + ix;
+
+    if (sect->size == 0 || sect->memPt == 0)
+        return;
+
+    switch (sect->type)
+    {
+    case XFF_SECT_PROGBITS:
+    case XFF_SECT_OVERLAYDATA:
+        if (sect->moved != 0)
+        {
+            memcpy(XffPtr(ar, sect->memPt), XffPtr(ar, sect->filePt), sect->size);
+            ldr->stats.bytesCopied += sect->size;
+        }
+        break;
+    }
+}
+
+// The entry point is relative to the first section that got memory.
+void XffSetEntryPoint(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp)
+{
+    struct t_xffSectEnt *sect = XffPtr(ar, xffEp->sectTab);
+    u32 entPntSectBs = 0;
+    s32 i;
+
+    for (i = 1; i < xffEp->sectNrE && entPntSectBs == 0; i++)
+        entPntSectBs = sect[i].memPt;
+
+    xffEp->entryPnt = entPntSectBs + xffEp->entryPnt_Rel;
+}
+
+// Places and fills every section. Stops with XFF_ERR_NOMEM at the first section that
+// gets no memory; the image must not be linked then.
+s32 XffDecodeSection(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp)
+{
+    s32 ret;
+    s32 i;
+
+    if (ldr->ldrDbgPrintf != NULL)
+        ldr->ldrDbgPrintf("ld:\t\tdecode section\n");
+
+    // The zero section is not processed as it is all 0.
+    for (i = 1; i < xffEp->sectNrE; i++)
+    {
+        ret = XffPlaceSection(ldr, xffEp, i);
+        if (ret != XFF_OK)
+            return ret;
+        XffFillSection(ldr, xffEp, i);
+    }
+
+    XffSetEntryPoint(&ldr->arena, xffEp);
+    return XFF_OK;
+}
+
+// Turns the section relative symbol values in symRelTab into absolute addresses.
+void XffRelocateSelfSymbol(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp)
+{
+    s32 i;
+    struct t_xffSymEnt *sym = XffPtr(ar, xffEp->symTab);
+    struct t_xffSymRelEnt *symRel = XffPtr(ar, xffEp->symRelTab);
+    struct t_xffSectEnt *sectTab = XffPtr(ar, xffEp->sectTab);
+
+    for (i = 0; i < xffEp->symTabNrE; i++, sym++, symRel++)
+    {
+        if (sym->sect == 0)
+        {
+            // Imported, filled in by XffResolveImports()
+            continue;
+        }
+
+        if (sym->sect == XFF_SECT_ABS)
+        {
+            sym->addr = symRel->offs;
+        }
+        else if (sym->sect < xffEp->sectNrE)
+        {
+            sym->addr = sectTab[sym->sect].memPt + symRel->offs;
+        }
+    }
+}
+
+// FindExport() on interned names: one handle compare per symbol
+static u32 FindExportInterned(const struct XffLoader *ldr, u32 handle, struct t_xffSymEnt **symOut)
+{
+    const struct XffArena *ar = &ldr->arena;
+    struct XffSymIndexEnt *ent;
+    const struct XffModule *mod;
+    struct t_xffSymEnt *sym;
+    s32 i;
+
+    if (ldr->symIndex != NULL)
+    {
+        ent = XffSymIndexFind(ldr->symIndex, XffStrPoolName(ldr->strPool, handle), XffStrPoolHash(ldr->strPool, handle));
+        if (symOut != NULL)
+            *symOut = ent != NULL ? ent->sym : NULL;
+        return ent != NULL ? ent->sym->addr : 0;
+    }
+
+    for (mod = ldr->modules; mod != NULL; mod = mod->next)
+    {
+        if (mod->hashTab != 0)
+        {
+            sym = XffHashLookup(ldr, mod, XffStrPoolName(ldr->strPool, handle), XffStrPoolHash(ldr->strPool, handle));
+            if (sym == NULL)
+                continue;
+            if (symOut != NULL)
+                *symOut = sym;
+            return sym->addr;
+        }
+
+        sym = XffPtr(ar, mod->xffEp->symTab);
+        for (i = 0; i < mod->xffEp->symTabNrE; i++, sym++)
+        {
+            if ((u32)sym->nameOffs == handle && sym->sect != 0 && sym->bindAttr == XFF_STB_GLOBAL)
+            {
+                if (symOut != NULL)
+                    *symOut = sym;
+                return sym->addr;
+            }
+        }
+    }
+
+    if (symOut != NULL)
+        *symOut = NULL;
+    return 0;
+}
+
+// Exported symbol 'name' of one module, by comparing names
+static struct t_xffSymEnt *FindInModule(const struct XffArena *ar, const struct XffModule *mod, const char *name)
+{
+    struct t_xffSymEnt *sym = XffPtr(ar, mod->xffEp->symTab);
+    const char *str = XffPtr(ar, mod->xffEp->symTabStr);
+    s32 i;
+
+    for (i = 0; i < mod->xffEp->symTabNrE; i++, sym++)
+    {
+        if (sym->sect != 0 && sym->bindAttr == XFF_STB_GLOBAL && sym->nameOffs != 0 && strcmp(&str[sym->nameOffs], name) == 0)
+            return sym;
+    }
+    return NULL;
+}
+
+// FindExport() on names: 'hash' is XffStrHash(name), or 0 to hash it only when needed
+static u32 FindExportNamed(const struct XffLoader *ldr, const char *name, u32 hash, struct t_xffSymEnt **symOut)
+{
+    struct XffSymIndexEnt *ent;
+    const struct XffModule *mod;
+    struct t_xffSymEnt *sym = NULL;
+
+    if (ldr->symIndex != NULL)
+    {
+        ent = XffSymIndexFind(ldr->symIndex, name, hash != 0 ? hash : XffStrHash(name));
+        if (symOut != NULL)
+            *symOut = ent != NULL ? ent->sym : NULL;
+        return ent != NULL ? ent->sym->addr : 0;
+    }
+
+    // Modules with an XFF_EXT_HASH block are looked up in it
+    for (mod = ldr->modules; mod != NULL && sym == NULL; mod = mod->next)
+    {
+        if (mod->hashTab != 0)
+        {
+            if (hash == 0)
+                hash = XffStrHash(name);
+            sym = XffHashLookup(ldr, mod, name, hash);
+        }
+        else
+        {
+            sym = FindInModule(&ldr->arena, mod, name);
+        }
+    }
+
+    if (symOut != NULL)
+        *symOut = sym;
+    return sym != NULL ? sym->addr : 0;
+}
+
+// Looks 'name' up in the exports of every loaded module, newest first.
+u32 XffFindExport(const struct XffLoader *ldr, const char *name, struct t_xffSymEnt **symOut)
+{
+    u32 handle;
+
+    if (ldr->strPool != NULL)
+    {
+        // A name that was never interned is exported by nobody
+        handle = XffStrPoolFind(ldr->strPool, name);
+        if (handle != XFF_STRPOOL_NONE && handle != 0)
+            return FindExportInterned(ldr, handle, symOut);
+
+        if (symOut != NULL)
+            *symOut = NULL;
+        return 0;
+    }
+
+    return FindExportNamed(ldr, name, 0, symOut);
+}
+
+// XffFindExport() for symbol 'sym' of 'xffEp', without a string lookup when the names
+// are interned. 'hash' is the XffStrHash() of its name from the XFF_EXT_HASH block of
+// 'xffEp', 0 when there is none.
+u32 XffFindImport(const struct XffLoader *ldr, const struct t_xffEntPntHdr *xffEp, const struct t_xffSymEnt *sym, u32 hash,
+                  struct t_xffSymEnt **symOut)
+{
+    if (ldr->strPool != NULL && sym->nameOffs != 0)
+        return FindExportInterned(ldr, sym->nameOffs, symOut);
+    return FindExportNamed(ldr, XffSymName(ldr, xffEp, sym), hash, symOut);
+}
+
+// Binds every symbol listed in impSymIxs to the module exporting it. Symbols nobody
+// exports are mapped to the undefined symbol entry (symTab[0]). With lazy binding on,
+// imports still waiting at their stub are left alone.
+void XffResolveImports(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp)
+{
+    const struct XffArena *ar = &ldr->arena;
+    struct t_xffImpSymIxs *imp = XffPtr(ar, xffEp->impSymIxs);
+    struct t_xffSymEnt *symTab = XffPtr(ar, xffEp->symTab);
+    const u32 *impHash = XffHashImports(ldr, xffEp);
+    struct t_xffSymEnt *sym;
+    struct t_xffSymEnt *found;
+    u32 addr;
+    s32 i;
+
+    for (i = 0; i < xffEp->impSymIxsNrE; i++)
+    {
+        sym = &symTab[imp[i].stIx];
+        if (sym->unk0D == XFF_SYM_LAZY && ldr->lazyResolver != 0)
+            continue;
+
+        addr = XffFindImport(ldr, xffEp, sym, impHash != NULL ? impHash[i] : 0, &found);
+        ldr->stats.imports++;
+
+        if (found != NULL)
+        {
+            sym->addr = addr;
+            sym->unk0D = 1;
+        }
+        else
+        {
+            sym->addr = symTab[0].addr;
+            sym->unk0D = 0;
+            ldr->stats.unresolved++;
+        }
+    }
+}
+
+// Applies entry 'ix' of a relocation table and returns the number of entries consumed.
+// A run of XFF_R_HI16 entries takes the low half of its addend from the XFF_R_LO16
+// that closes it; the run is applied in one go and the LO16 is left for the next call.
+// The entries are range checked by XffCheckRelocTab() when the image comes in.
+s32 XffResolveRelocation(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp, struct t_xffRelocEnt *rt, u32 ix)
+{
+    struct t_xffRelocAddrEnt *addrTab = XffPtr(ar, rt->addr);
+    struct t_xffRelocInstEnt *instTab = XffPtr(ar, rt->inst);
+    struct t_xffSymEnt *symTab = XffPtr(ar, xffEp->symTab);
+    struct t_xffSectEnt *sect = (struct t_xffSectEnt *)XffPtr(ar, xffEp->sectTab) + rt->sect;
+    u8 *sectBs = XffPtr(ar, sect->memPt);
+    u32 inst = instTab[ix].inst;
+    u32 val = symTab[addrTab[ix].tgSymIx].addr;
+    u32 *site = (u32 *)(sectBs + addrTab[ix].addr);
+    u32 i;
+    u32 n;
+    u32 lo;
+
+    switch (addrTab[ix].relType)
+    {
+    case XFF_R_32:
+        *site = inst + val;
+        return 1;
+    case XFF_R_26:
+        *site = ((val / 4) & 0x03FFFFFF) + inst;
+        return 1;
+    case XFF_R_LO16:
+        *site = ((inst + val) & 0xFFFF) | (inst & 0xFFFF0000);
+        return 1;
+    case XFF_R_HI16:
+        for (n = ix; n < rt->nrEnt && addrTab[n].relType == XFF_R_HI16; n++)
+            ;
+
+        lo = 0;
+        if (n < rt->nrEnt && addrTab[n].relType == XFF_R_LO16)
+            lo = (s16)instTab[n].inst;
+
+        for (i = ix; i < n; i++)
+        {
+            inst = instTab[i].inst;
+            val = symTab[addrTab[i].tgSymIx].addr + (inst << 16) + lo;
+            site = (u32 *)(sectBs + addrTab[i].addr);
+            *site = (inst & 0xFFFF0000) | (((val + 0x8000) >> 16) & 0xFFFF);
+        }
+        return n - ix;
+    default:
+        return 1;
+    }
+}
+
+// Applies relocation tables [firstTab, firstTab + tabNrE) and returns the number of entries.
+u32 XffRelocateCode(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp, s32 firstTab, s32 tabNrE)
+{
+    struct t_xffRelocEnt *rt = (struct t_xffRelocEnt *)XffPtr(ar, xffEp->relocTab) + firstTab;
+    u32 relocs = 0;
+    u32 j;
+
+    for (; tabNrE-- > 0; rt++)
+    {
+        if (rt->type == XFF_RELOC_TYPE_PACKED)
+        {
+            relocs += XffApplyPackedRelocs(ar, xffEp, rt, NULL);
+            continue;
+        }
+
+        for (j = 0; j < rt->nrEnt;)
+        {
+            j += XffResolveRelocation(ar, xffEp, rt, j);
+        }
+        relocs += rt->nrEnt;
+    }
+
+    return relocs;
+}
+
+// Drops the local (second) half of the relocation tables, which is only needed while the
+// module is relocated for the first time. Returns the guest address from which the
+// file image is no longer needed.
+u32 XffDisposeRelocationElement(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp)
+{
+    struct t_xffRelocEnt *rt = XffPtr(ar, xffEp->relocTab);
+    s32 halfTabsNrE = xffEp->relocTabNrE / 2;
+    u32 externRefNrE = 0;
+    s32 i;
+
+    if (xffEp->ident != XFF_SHTEXE_MAGIC_XFF2 || halfTabsNrE == 0)
+        return 0;
+
+    for (i = 0; i < halfTabsNrE; i++)
+    {
+        externRefNrE += rt[i].nrEnt;
+    }
+
+    for (i = halfTabsNrE; i < halfTabsNrE * 2; i++)
+    {
+        rt[i].nrEnt = 0;
+    }
+
+    return rt[0].addr + externRefNrE * sizeof(struct t_xffRelocAddrEnt);
+}
+
+// A prelinked image can skip ResolveRelocation() when it landed at the predicted base,
+// DecodeSection() reproduced the predicted section layout and every import still
+// resolves to the address the image was patched with. A block too short for the
+// sections it claims is a miss.
+static s32 CheckPrelink(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp, u32 fileAddr, const struct XffPrelinkInfo *prelink,
+                        u32 size)
+{
+    const struct XffArena *ar = &ldr->arena;
+    struct t_xffSectEnt *sect = XffPtr(ar, xffEp->sectTab);
+    struct t_xffImpSymIxs *imp = XffPtr(ar, xffEp->impSymIxs);
+    struct t_xffSymEnt *symTab = XffPtr(ar, xffEp->symTab);
+    const u32 *impHash = XffHashImports(ldr, xffEp);
+    struct t_xffSymEnt *sym;
+    struct t_xffSymEnt *found;
+    u32 unresolved;
+    u32 addr;
+    s32 i;
+
+    if (size < sizeof(*prelink) || prelink->base != fileAddr || prelink->sectNrE != (u32)xffEp->sectNrE ||
+        (size - sizeof(*prelink)) / sizeof(prelink->memPt[0]) < prelink->sectNrE)
+        return 0;
+
+    for (i = 0; i < xffEp->sectNrE; i++)
+    {
+        if (sect[i].memPt != prelink->memPt[i])
+            return 0;
+    }
+
+    // Imports nobody exported at prelink time must still be missing
+    unresolved = 0;
+    for (i = 0; i < xffEp->impSymIxsNrE; i++)
+    {
+        sym = &symTab[imp[i].stIx];
+        addr = XffFindImport(ldr, xffEp, sym, impHash != NULL ? impHash[i] : 0, &found);
+        if (found == NULL)
+            addr = symTab[0].addr;
+        if (addr != sym->addr)
+            return 0;
+
+        sym->unk0D = found != NULL;
+        unresolved += found == NULL;
+    }
+
+    ldr->stats.imports += xffEp->impSymIxsNrE;
+    ldr->stats.unresolved += unresolved;
+    return 1;
+}
+
+// Releases the sections DecodeSection() allocated for a module and withdraws its exports.
+// The bump heap does not reclaim memory, the sections are only forgotten.
+void XffFreeDecodedSection(struct XffLoader *ldr, struct XffModule *mod)
+{
+    struct t_xffSectEnt *sect = XffPtr(&ldr->arena, mod->xffEp->sectTab);
+    s32 i;
+
+    if (ldr->symIndex != NULL)
+        XffSymIndexRemoveModule(ldr->symIndex, &ldr->arena, mod);
+
+    for (i = 1; i < mod->xffEp->sectNrE; i++)
+    {
+        if (sect[i].moved != 0)
+        {
+            sect[i].memPt = 0;
+            sect[i].moved = 0;
+        }
+    }
+}
+
+void XffUnloadModule(struct XffLoader *ldr, struct XffModule *mod)
+{
+    struct XffModule **link;
+
+    XffFreeDecodedSection(ldr, mod);
+
+    for (link = &ldr->modules; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == mod)
+        {
+            *link = mod->next;
+            break;
+        }
+    }
+
+    if (mod->region != NULL)
+        XffRegionRelease(ldr->regions, mod->region);
+
+    free(mod->name);
+    free(mod);
+}
+
+// Registers a loaded image as a module: links it in front of the module list and adds
+// its exports to the index. XFF_ERR_NOMEM leaves the loader as it was.
+s32 XffAddModule(struct XffLoader *ldr, const char *name, u32 fileAddr, u32 fileSize, struct XffModule **modOut)
+{
+    struct XffModule *mod;
+    struct t_xffSectEnt *sect;
+    s32 i;
+
+    mod = calloc(1, sizeof(*mod));
+    if (mod == NULL)
+        return XFF_ERR_NOMEM;
+
+    mod->name = strdup(name);
+    if (mod->name == NULL)
+    {
+        free(mod);
+        return XFF_ERR_NOMEM;
+    }
+    mod->fileAddr = fileAddr;
+    mod->fileSize = fileSize;
+    mod->xffEp = XffPtr(&ldr->arena, fileAddr);
+    if (ldr->symIndex != NULL && XffSymIndexAddModule(ldr->symIndex, &ldr->arena, mod) != XFF_OK)
+    {
+        free(mod->name);
+        free(mod);
+        return XFF_ERR_NOMEM;
+    }
+    sect = XffPtr(&ldr->arena, mod->xffEp->sectTab);
+    mod->hasLocalRelocs = ldr->keepLocalRelocs;
+    mod->region = ldr->region;
+    ldr->region = NULL;
+    mod->hashTab = ldr->hashTab;
+    ldr->hashTab = 0;
+    mod->lazyStubs = ldr->lazyStubs;
+    mod->lazyNrE = ldr->lazyNrE;
+    ldr->lazyStubs = 0;
+    ldr->lazyNrE = 0;
+
+    // What DecodeSection() had to copy out of the file image
+    for (i = 1; i < mod->xffEp->sectNrE; i++)
+    {
+        if (sect[i].moved != 0 && sect[i].memPt != 0 && sect[i].type != XFF_SECT_NOBITS)
+        {
+            mod->sectCopied++;
+            mod->bytesCopied += sect[i].size;
+        }
+    }
+    mod->seq = ldr->loadSeq++;
+    mod->next = ldr->modules;
+    ldr->modules = mod;
+    ldr->stats.files++;
+
+    if (modOut != NULL)
+        *modOut = mod;
+    return XFF_OK;
+}
+
+// Allocates the heap block a file image is loaded into. With a region heap this starts
+// the region of the module; a region left over by a load that failed is released.
+u32 XffAllocImage(struct XffLoader *ldr, const char *name, u32 size)
+{
+    if (ldr->regions == NULL)
+        return XffArenaAlloc(&ldr->arena, size, ldr->fileAlign);
+
+    if (ldr->region != NULL)
+        XffRegionRelease(ldr->regions, ldr->region);
+
+    ldr->region = XffRegionCreate(ldr->regions, name);
+    if (ldr->region == NULL)
+        return 0;
+    return XffRegionAllocBlock(ldr->regions, ldr->region, size, ldr->fileAlign);
+}
+
+// Gives back the image of a load that failed after XffAllocImage(), with everything the
+// load allocated behind it: the region of the module, or the bump heap from 'fileAddr' on.
+void XffFreeImage(struct XffLoader *ldr, u32 fileAddr)
+{
+    if (ldr->regions != NULL)
+    {
+        if (ldr->region != NULL)
+            XffRegionRelease(ldr->regions, ldr->region);
+        ldr->region = NULL;
+    }
+    else if (fileAddr >= ldr->arena.base && fileAddr < ldr->arena.heapPt)
+    {
+        ldr->arena.heapPt = fileAddr;
+    }
+
+    ldr->hashTab = 0;
+    ldr->lazyStubs = 0;
+    ldr->lazyNrE = 0;
+    ldr->relPlan = NULL;
+    ldr->strTabSize = 0;
+}
+
+static u32 MaxEnd(u32 keep, u32 addr, u32 size)
+{
+    return addr + size > keep ? addr + size : keep;
+}
+
+// End of the last symbol name in symTabStr
+static u32 StrTabEnd(const struct XffArena *ar, const struct t_xffEntPntHdr *xffEp)
+{
+    const struct t_xffSymEnt *sym = XffPtr(ar, xffEp->symTab);
+    const char *str = XffPtr(ar, xffEp->symTabStr);
+    u32 end = xffEp->symTabStr + 1;
+    s32 i;
+
+    for (i = 0; i < xffEp->symTabNrE; i++)
+    {
+        if (sym[i].nameOffs != 0)
+            end = MaxEnd(end, xffEp->symTabStr + sym[i].nameOffs, strlen(&str[sym[i].nameOffs]) + 1);
+    }
+    return end;
+}
+
+// Gives the end of a file image back to the region heap, from 'freeStart', the address
+// DisposeRelocationElement() returned, on; what iosFreeParts() does on the EE. Sections
+// used in place and the tables the module keeps must lie below it, the cut moves up
+// past them if they don't. symTabStr is only kept while the names are read from it;
+// the part of it a pooled image gives back is counted in strBytesFreed.
+void XffTrimImage(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp, u32 fileAddr, u32 fileSize, u32 freeStart)
+{
+    const struct XffArena *ar = &ldr->arena;
+    struct t_xffSectEnt *sect = XffPtr(ar, xffEp->sectTab);
+    u32 fileEnd = fileAddr + fileSize;
+    u32 keep = fileAddr + sizeof(*xffEp);
+    u32 strAddr = fileAddr + xffEp->symTabStr_Rel;
+    u32 strSize = ldr->strTabSize;
+    u32 trimmed;
+    u32 cut;
+    s32 i;
+
+    ldr->strTabSize = 0;
+    if (ldr->regions == NULL || ldr->region == NULL || freeStart <= fileAddr || freeStart >= fileEnd)
+        return;
+
+    // Section names have no size, they must start below the cut
+    if (xffEp->ssNamesBase >= freeStart)
+        return;
+
+    for (i = 1; i < xffEp->sectNrE; i++)
+    {
+        if (sect[i].memPt >= fileAddr && sect[i].memPt < fileEnd)
+            keep = MaxEnd(keep, sect[i].memPt, sect[i].size);
+    }
+    keep = MaxEnd(keep, xffEp->sectTab, xffEp->sectNrE * sizeof(struct t_xffSectEnt));
+    keep = MaxEnd(keep, xffEp->symTab, xffEp->symTabNrE * sizeof(struct t_xffSymEnt));
+    keep = MaxEnd(keep, xffEp->symRelTab, xffEp->symTabNrE * sizeof(struct t_xffSymRelEnt));
+    keep = MaxEnd(keep, xffEp->impSymIxs, xffEp->impSymIxsNrE * sizeof(struct t_xffImpSymIxs));
+    keep = MaxEnd(keep, xffEp->relocTab, xffEp->relocTabNrE * sizeof(struct t_xffRelocEnt));
+    keep = MaxEnd(keep, xffEp->ssNamesOffs, xffEp->sectNrE * sizeof(struct t_xffSsNmOffs));
+    if (xffEp->symTabStr != 0)
+        keep = MaxEnd(keep, xffEp->symTabStr, StrTabEnd(ar, xffEp) - xffEp->symTabStr);
+
+    if (keep > freeStart)
+        freeStart = keep;
+    if (freeStart >= fileEnd)
+        return;
+
+    trimmed = XffRegionTrim(ldr->regions, ldr->region, freeStart);
+    ldr->trimmed += trimmed;
+
+    // The region cuts at the next 0x10
+    cut = (freeStart + 0xF) & ~0xF;
+    if (trimmed != 0 && xffEp->symTabStr == 0 && strSize != 0 && strAddr + strSize > cut)
+        ldr->stats.strBytesFreed += strAddr + strSize - (strAddr > cut ? strAddr : cut);
+}
+
+// Binds the imports of a decoded image and applies all of its relocation tables, from
+// the plan of the image when XffLoadImage() found one.
+void XffLinkImage(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp)
+{
+    u64 t = XffProfBegin(ldr);
+    u32 *vals;
+    u32 slotNrE;
+    u32 relocs;
+
+    if (ldr->lazyResolver != 0)
+        XffLazyImports(ldr, xffEp);
+    else
+        XffResolveImports(ldr, xffEp);
+    XffProfEnd(ldr, XFF_PHASE_IMPORTS, t, xffEp->impSymIxsNrE, 0);
+
+    t = XffProfBegin(ldr);
+    slotNrE = ldr->relPlan != NULL ? XffRelPlanSlots(ldr->relPlan) : 0;
+    if (slotNrE > ldr->relPlanValNrE && (vals = realloc(ldr->relPlanVals, slotNrE * sizeof(*vals))) != NULL)
+    {
+        ldr->relPlanVals = vals;
+        ldr->relPlanValNrE = slotNrE;
+    }
+
+    if (ldr->relPlan != NULL && slotNrE <= ldr->relPlanValNrE)
+        relocs = XffApplyRelPlan(&ldr->arena, xffEp, ldr->relPlan, ldr->relPlanVals);
+    else if (ldr->relocPool != NULL)
+        relocs = XffRelocateCodeParallel(ldr->relocPool, &ldr->arena, xffEp, 0, xffEp->relocTabNrE, ldr->relocChunk);
+    else
+        relocs = XffRelocateCode(&ldr->arena, xffEp, 0, xffEp->relocTabNrE);
+    ldr->relPlan = NULL;
+    ldr->stats.relocs += relocs;
+    XffProfEnd(ldr, XFF_PHASE_RELOC, t, relocs, 0);
+}
+
+// Copies a matching XFF_EXT_HASH block to the heap for XffAddModule() to hand to the
+// module. Without one, or without memory for it, the imports are resolved by name.
+static void LoadHashTab(struct XffLoader *ldr, const struct t_xffEntPntHdr *xffEp, const struct XffHashHdr *blk, u32 size)
+{
+    u32 addr;
+
+    if (!XffHashCheck(blk, size, xffEp))
+    {
+        ldr->stats.hashMisses++;
+        return;
+    }
+
+    addr = ldr->mallocAlign(ldr, size, 4);
+    if (addr == 0)
+        return;
+
+    memcpy(XffPtr(&ldr->arena, addr), blk, size);
+    ldr->hashTab = addr;
+    ldr->stats.hashTabs++;
+}
+
+s32 XffLoadImage(struct XffLoader *ldr, const char *name, const void *data, u32 size, struct XffModule **modOut)
+{
+    struct XffArena *ar = &ldr->arena;
+    struct t_xffEntPntHdr *xffEp;
+    u32 fileAddr;
+    s32 ret;
+
+    const struct XffPrelinkInfo *prelink = NULL;
+    u32 prelinkSize;
+    const struct XffHashHdr *hash = NULL;
+    u32 hashSize;
+    const struct XffRelPlanHdr *relPlan = NULL;
+    u32 relPlanSize;
+    u32 imgSize;
+    u64 decoded;
+    u64 t;
+
+    if (ldr->prof != NULL)
+        XffProfSetModule(ldr->prof, name, ldr->loadSeq);
+
+    if (XffPackIsPacked(data, size))
+        return XffLoadPacked(ldr, name, data, size, modOut);
+
+    if (size < sizeof(struct t_xffEntPntHdr))
+        return XFF_ERR_FORMAT;
+
+    // Extension blocks are read from the source, only the image goes to the heap
+    imgSize = XffExtImageSize(data, size);
+    ret = XffCheckImage(data, imgSize);
+    if (ret != XFF_OK)
+        return ret;
+    if (!ldr->noPrelink)
+        prelink = XffExtFind(data, size, XFF_EXT_PRELINK, &prelinkSize);
+    if (!ldr->noHash)
+        hash = XffExtFind(data, size, XFF_EXT_HASH, &hashSize);
+    if (!ldr->noRelPlan)
+        relPlan = XffExtFind(data, size, XFF_EXT_RELPLAN, &relPlanSize);
+
+    t = XffProfBegin(ldr);
+    fileAddr = XffAllocImage(ldr, name, imgSize);
+    if (fileAddr == 0)
+        return XFF_ERR_NOMEM;
+
+    xffEp = XffPtr(ar, fileAddr);
+    memcpy(xffEp, data, imgSize);
+    ldr->stats.bytesRead += imgSize;
+    XffProfEnd(ldr, XFF_PHASE_READ, t, 1, imgSize);
+
+    t = XffProfBegin(ldr);
+    ret = XffRelocateElfInfoHeader(ar, xffEp, fileAddr);
+    if (ret != XFF_OK)
+    {
+        XffFreeImage(ldr, fileAddr);
+        return ret;
+    }
+    XffProfEnd(ldr, XFF_PHASE_HEADER, t, xffEp->sectNrE, 0);
+
+    // Used straight from the source, it is only read while linking
+    if (relPlan != NULL && !XffRelPlanCheck(ar, relPlan, relPlanSize, xffEp))
+    {
+        ldr->stats.relPlanMisses++;
+        relPlan = NULL;
+    }
+
+    t = XffProfBegin(ldr);
+    decoded = ldr->stats.bytesCopied + ldr->stats.bytesZeroed;
+    ret = XffDecodeSection(ldr, xffEp);
+    if (ret != XFF_OK)
+    {
+        XffFreeImage(ldr, fileAddr);
+        return ret;
+    }
+    XffProfEnd(ldr, XFF_PHASE_DECODE, t, xffEp->sectNrE - 1, (u32)(ldr->stats.bytesCopied + ldr->stats.bytesZeroed - decoded));
+
+    // After the sections, where xffprelink saw it
+    if (hash != NULL)
+        LoadHashTab(ldr, xffEp, hash, hashSize);
+
+    t = XffProfBegin(ldr);
+    XffRelocateSelfSymbol(ar, xffEp);
+    ret = XffInternModule(ldr, xffEp);
+    if (ret != XFF_OK)
+    {
+        XffFreeImage(ldr, fileAddr);
+        return ret;
+    }
+    XffProfEnd(ldr, XFF_PHASE_SELFSYM, t, xffEp->symTabNrE, 0);
+
+    t = XffProfBegin(ldr);
+    if (prelink != NULL && CheckPrelink(ldr, xffEp, fileAddr, prelink, prelinkSize))
+    {
+        // The check stands in for relocation, no entries applied
+        XffProfEnd(ldr, XFF_PHASE_RELOC, t, 0, 0);
+        ldr->stats.prelinked++;
+    }
+    else
+    {
+        if (prelink != NULL)
+            ldr->stats.prelinkMisses++;
+
+        ldr->relPlan = relPlan;
+        ldr->stats.relPlans += relPlan != NULL;
+        XffLinkImage(ldr, xffEp);
+    }
+    if (!ldr->keepLocalRelocs)
+    {
+        t = XffProfBegin(ldr);
+        XffTrimImage(ldr, xffEp, fileAddr, imgSize, XffPackRelocations(ldr, xffEp, XffDisposeRelocationElement(ar, xffEp)));
+        XffProfEnd(ldr, XFF_PHASE_DISPOSE, t, xffEp->relocTabNrE / 2, 0);
+    }
+
+    ret = XffAddModule(ldr, name, fileAddr, imgSize, modOut);
+    if (ret != XFF_OK)
+        XffFreeImage(ldr, fileAddr);
+    return ret;
+}
+
+s32 XffLoadFile(struct XffLoader *ldr, const char *path, struct XffModule **modOut)
+{
+    void *data;
+    u32 size;
+    s32 ret;
+    u64 t = XffProfBegin(ldr);
+
+    data = XffMapFile(path, &size);
+    if (data == NULL)
+        return XFF_ERR_IO;
+
+    if (ldr->prof != NULL)
+    {
+        XffProfSetModule(ldr->prof, path, ldr->loadSeq);
+        XffProfRecord(ldr->prof, XFF_PHASE_READ, t, 0, 0); // open and map, the copy is recorded by XffLoadImage()
+    }
+
+    ret = XffLoadImage(ldr, path, data, size, modOut);
+    XffUnmapFile(data, size);
+    return ret;
+}
+
+void *XffMapFile(const char *path, u32 *sizeOut)
+{
+    struct stat st;
+    void *data;
+    s32 fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &st) != 0 || st.st_size == 0 || st.st_size > 0x7FFFFFFF)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+
+    *sizeOut = st.st_size;
+    return data;
+}
+
+void XffUnmapFile(void *data, u32 size)
+{
+    munmap(data, size);
+}
@@ -0,0 +1,187 @@
+#include <string.h>
+
+#include "libxff.h"
+
+/*
+Byte oriented LZ77 codec in the style of LZ4, used by packed XFF containers.
+
+A block is a run of sequences, each one
+    token         high nibble: literal count, low nibble: match length - 4
+    [count bytes] 255... then the rest, when the nibble is 15
+    literals
+    offset        u16 little endian, 1..0xFFFF back from the current position
+    [count bytes] for the match length, as for the literals
+The last sequence ends after its literals. Decoding is a loop of copies with no state
+besides the two pointers, which keeps it cheap enough to run as data arrives.
+*/
+
+#define LZ_MIN_MATCH (4)
+#define LZ_HASH_BITS (14)
+#define LZ_MAX_OFFSET (0xFFFF)
+
+static inline u32 Read32(const u8 *p)
+{
+    u32 v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline u32 Hash(u32 v)
+{
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static u8 *PutCount(u8 *op, u32 n)
+{
+    for (; n >= 255; n -= 255)
+        *op++ = 255;
+    *op++ = n;
+    return op;
+}
+
+u32 XffLzBound(u32 size)
+{
+    return size + size / 255 + 16;
+}
+
+// Compresses 'size' bytes of 'src' into 'dst', which must hold XffLzBound(size) bytes.
+// Returns the compressed size.
+u32 XffLzCompress(const u8 *src, u32 size, u8 *dst)
+{
+    u32 table[1 << LZ_HASH_BITS];
+    u8 *op = dst;
+    u8 *token;
+    u32 ip = 0;
+    u32 anchor = 0;
+    u32 cand;
+    u32 h;
+    u32 lit;
+    u32 ml;
+
+    memset(table, 0, sizeof(table));
+
+    while (ip + LZ_MIN_MATCH <= size)
+    {
+        h = Hash(Read32(src + ip));
+        cand = table[h];
+        table[h] = ip;
+
+        if (cand >= ip || ip - cand > LZ_MAX_OFFSET || Read32(src + cand) != Read32(src + ip))
+        {
+            ip++;
+            continue;
+        }
+
+        for (ml = LZ_MIN_MATCH; ip + ml < size && src[cand + ml] == src[ip + ml]; ml++)
+            ;
+
+        lit = ip - anchor;
+        token = op++;
+        *token = ((lit < 15 ? lit : 15) << 4) | (ml - LZ_MIN_MATCH < 15 ? ml - LZ_MIN_MATCH : 15);
+        if (lit >= 15)
+            op = PutCount(op, lit - 15);
+        memcpy(op, src + anchor, lit);
+        op += lit;
+
+        *op++ = (ip - cand) & 0xFF;
+        *op++ = (ip - cand) >> 8;
+        if (ml - LZ_MIN_MATCH >= 15)
+            op = PutCount(op, ml - LZ_MIN_MATCH - 15);
+
+        // Seed the table inside the match so that repeats of it are found too
+        if (ip + ml + LZ_MIN_MATCH <= size)
+            table[Hash(Read32(src + ip + ml - 2))] = ip + ml - 2;
+
+        ip += ml;
+        anchor = ip;
+    }
+
+    lit = size - anchor;
+    token = op++;
+    *token = (lit < 15 ? lit : 15) << 4;
+    if (lit >= 15)
+        op = PutCount(op, lit - 15);
+    memcpy(op, src + anchor, lit);
+    op += lit;
+
+    return op - dst;
+}
+
+// Decompresses a block into exactly 'rawSize' bytes at 'dst'. Returns XFF_OK, or
+// XFF_ERR_FORMAT if the block is malformed or doesn't produce 'rawSize' bytes.
+s32 XffLzDecompress(const u8 *src, u32 size, u8 *dst, u32 rawSize)
+{
+    const u8 *ip = src;
+    const u8 *iend = src + size;
+    u8 *op = dst;
+    u8 *oend = dst + rawSize;
+    const u8 *match;
+    u32 token;
+    u32 lit;
+    u32 ml;
+    u32 offs;
+    u32 b;
+
+    while (ip < iend)
+    {
+        token = *ip++;
+
+        lit = token >> 4;
+        if (lit == 15)
+        {
+            do
+            {
+                if (ip >= iend)
+                    return XFF_ERR_FORMAT;
+                b = *ip++;
+                lit += b;
+            } while (b == 255);
+        }
+
+        if (lit > (u32)(iend - ip) || lit > (u32)(oend - op))
+            return XFF_ERR_FORMAT;
+        memcpy(op, ip, lit);
+        ip += lit;
+        op += lit;
+
+        // The last sequence has no match
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return XFF_ERR_FORMAT;
+        offs = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        ml = (token & 0xF) + LZ_MIN_MATCH;
+        if ((token & 0xF) == 15)
+        {
+            do
+            {
+                if (ip >= iend)
+                    return XFF_ERR_FORMAT;
+                b = *ip++;
+                ml += b;
+            } while (b == 255);
+        }
+
+        if (offs == 0 || offs > (u32)(op - dst) || ml > (u32)(oend - op))
+            return XFF_ERR_FORMAT;
+
+        match = op - offs;
+        if (offs >= ml)
+        {
+            memcpy(op, match, ml);
+            op += ml;
+        }
+        else
+        {
+            // Overlapping copy repeats the last 'offs' bytes
+            while (ml--)
+                *op++ = *match++;
+        }
+    }
+
+    return op == oend ? XFF_OK : XFF_ERR_FORMAT;
+}
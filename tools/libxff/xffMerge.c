@@ -0,0 +1,678 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xffBuild.h"
+
+/*
+Offline merge of several XFF2 modules into one.
+
+A boot that loads a chain of small modules pays, per module, for a header relocation,
+a section decode, symbol registration and a seek. XffMerge() turns the chain into one
+module that loads in one go:
+ - sections of the same name, type and flags are concatenated in input order, each
+   piece at its own alignment, the merged one at the largest,
+ - symbols are renumbered into one symTab: defined ones move by the offset of their
+   piece, the section symbol of a piece that doesn't start its merged section becomes a
+   local symbol at that offset, so no addend has to change,
+ - an import exported by another input is bound to that export here, its relocation
+   entries move from the extern to the local tables; the imports left are those nobody
+   in the set exports, one entry per name,
+ - the relocation tables are rebuilt per merged section, sites moved by their piece.
+
+Only the entry point of the first input survives; it must lie in the first merged
+section with memory. Two inputs exporting the same name can't be merged, the loader
+would only ever find one of them. Section names are read the way XffBuilderWrite()
+writes them, one ssNamesOffs entry per section including the zero one.
+*/
+
+struct MergeIn
+{
+    const char *name;
+    const u8 *img;
+    u32 size;
+    const struct t_xffEntPntHdr *hdr;
+    const struct t_xffSectEnt *sect;
+    const struct t_xffSymEnt *sym;
+    const struct t_xffSymRelEnt *symRel;
+    const struct t_xffRelocEnt *rt;
+    const s32 *nmOffs;
+    const char *nmBase;
+    u32 nmSize;
+    const char *str;
+    u32 strSize;
+    u32 *group;     // input section -> merged section
+    u32 *pieceOffs; // input section -> offset in the merged section
+    u32 *symMap;    // input symbol -> merged symbol
+};
+
+struct Group
+{
+    const char *name;
+    u32 type;
+    s32 flags;
+    u32 align;
+    u32 size;
+};
+
+struct NameEnt
+{
+    const char *name;
+    u32 hash;
+    u32 symIx;
+    u32 in; // input that defines or first imports it
+    u32 next;
+};
+
+// Chained hash of merged symbol names, one for the exports and one for the imports
+struct NameTab
+{
+    u32 *head;
+    u32 mask;
+    struct NameEnt *ent;
+    u32 nrE;
+};
+
+struct Merge
+{
+    struct MergeIn *in;
+    u32 inNrE;
+    struct Group *group;
+    u32 groupNrE; // merged sections, the zero one included
+    struct XffMergeInfo *info;
+};
+
+#define NAME_NONE (0xFFFFFFFF)
+#define SECT_NRE_MAX (0xFF00)
+
+static s32 Fail(struct Merge *m, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(m->info->err, sizeof(m->info->err), fmt, ap);
+    va_end(ap);
+    return XFF_ERR_FORMAT;
+}
+
+static inline s32 InImage(const struct MergeIn *in, u32 offs, u32 nrE, u32 entSz)
+{
+    return offs <= in->size && nrE <= (in->size - offs) / entSz;
+}
+
+static const char *SymName(const struct MergeIn *in, u32 i)
+{
+    return (u32)in->sym[i].nameOffs < in->strSize ? in->str + in->sym[i].nameOffs : "";
+}
+
+static const char *SectName(const struct MergeIn *in, u32 i)
+{
+    return (u32)in->nmOffs[i] < in->nmSize ? in->nmBase + in->nmOffs[i] : "";
+}
+
+// Checks the tables of one input and points at them
+static s32 Open(struct Merge *m, struct MergeIn *in)
+{
+    const struct t_xffEntPntHdr *hdr = (const struct t_xffEntPntHdr *)in->img;
+    const struct t_xffRelocEnt *rt;
+    const struct t_xffRelocAddrEnt *addrTab;
+    u32 end;
+    u32 i;
+    u32 j;
+
+    in->size = XffExtImageSize(in->img, in->size);
+    if (in->size < sizeof(*hdr) || hdr->ident != XFF_SHTEXE_MAGIC_XFF2)
+        return Fail(m, "%s: not an XFF2 module", in->name);
+
+    if (hdr->sectNrE < 1 || hdr->symTabNrE < 1 || hdr->impSymIxsNrE < 0 || hdr->relocTabNrE < 0 || (hdr->relocTabNrE & 1) ||
+        !InImage(in, hdr->sectTab_Rel, hdr->sectNrE, sizeof(*in->sect)) ||
+        !InImage(in, hdr->symTab_Rel, hdr->symTabNrE, sizeof(*in->sym)) ||
+        !InImage(in, hdr->symRelTab_Rel, hdr->symTabNrE, sizeof(*in->symRel)) ||
+        !InImage(in, hdr->impSymIxs_Rel, hdr->impSymIxsNrE, sizeof(struct t_xffImpSymIxs)) ||
+        !InImage(in, hdr->relocTab_Rel, hdr->relocTabNrE, sizeof(*in->rt)) ||
+        !InImage(in, hdr->ssNamesOffs_Rel, hdr->sectNrE, sizeof(*in->nmOffs)) || hdr->symTabStr_Rel > in->size ||
+        hdr->ssNamesBase_Rel > in->size)
+        return Fail(m, "%s: bad header", in->name);
+
+    in->hdr = hdr;
+    in->sect = (const struct t_xffSectEnt *)(in->img + hdr->sectTab_Rel);
+    in->sym = (const struct t_xffSymEnt *)(in->img + hdr->symTab_Rel);
+    in->symRel = (const struct t_xffSymRelEnt *)(in->img + hdr->symRelTab_Rel);
+    in->rt = (const struct t_xffRelocEnt *)(in->img + hdr->relocTab_Rel);
+    in->nmOffs = (const s32 *)(in->img + hdr->ssNamesOffs_Rel);
+    in->nmBase = (const char *)in->img + hdr->ssNamesBase_Rel;
+    in->nmSize = in->size - hdr->ssNamesBase_Rel;
+    in->str = (const char *)in->img + hdr->symTabStr_Rel;
+    in->strSize = in->size - hdr->symTabStr_Rel;
+
+    for (i = 1; i < (u32)hdr->sectNrE; i++)
+    {
+        end = in->sect[i].offs_Rel + in->sect[i].size;
+        if (in->sect[i].size < 0 || in->sect[i].align < 1 || (in->sect[i].align & (in->sect[i].align - 1)) != 0 ||
+            (in->sect[i].type != XFF_SECT_NOBITS && (end < (u32)in->sect[i].size || end > in->size)))
+            return Fail(m, "%s: bad section %u", in->name, i);
+    }
+
+    for (i = 0; i < (u32)hdr->symTabNrE; i++)
+    {
+        if (in->sym[i].sect != 0 && in->sym[i].sect != XFF_SECT_ABS && in->sym[i].sect >= hdr->sectNrE)
+            return Fail(m, "%s: symbol %s is in unknown section 0x%x", in->name, SymName(in, i), in->sym[i].sect);
+    }
+
+    for (i = 0; i < (u32)hdr->relocTabNrE; i++)
+    {
+        rt = &in->rt[i];
+        if (rt->type == XFF_RELOC_TYPE_PACKED || rt->sect < 1 || rt->sect >= (u32)hdr->sectNrE ||
+            !InImage(in, rt->addr_Rel, rt->nrEnt, sizeof(*addrTab)) ||
+            !InImage(in, rt->inst_Rel, rt->nrEnt, sizeof(struct t_xffRelocInstEnt)))
+            return Fail(m, "%s: bad relocation table %u", in->name, i);
+
+        addrTab = (const struct t_xffRelocAddrEnt *)(in->img + rt->addr_Rel);
+        for (j = 0; j < rt->nrEnt; j++)
+        {
+            if (addrTab[j].tgSymIx >= (u32)hdr->symTabNrE || in->sect[rt->sect].size < 4 ||
+                addrTab[j].addr > (u32)in->sect[rt->sect].size - 4)
+                return Fail(m, "%s: bad relocation %u of table %u", in->name, j, i);
+        }
+    }
+
+    in->group = calloc(hdr->sectNrE, sizeof(*in->group));
+    in->pieceOffs = calloc(hdr->sectNrE, sizeof(*in->pieceOffs));
+    in->symMap = calloc(hdr->symTabNrE, sizeof(*in->symMap));
+    if (in->group == NULL || in->pieceOffs == NULL || in->symMap == NULL)
+        return XFF_ERR_NOMEM;
+    return XFF_OK;
+}
+
+static void Close(struct Merge *m)
+{
+    u32 i;
+
+    for (i = 0; i < m->inNrE; i++)
+    {
+        free(m->in[i].group);
+        free(m->in[i].pieceOffs);
+        free(m->in[i].symMap);
+    }
+    free(m->in);
+    free(m->group);
+}
+
+// Opens every input and places its sections in the merged ones
+static s32 Plan(struct Merge *m, const u8 *const *img, const u32 *size, const char *const *names, u32 nrE,
+                struct XffMergeInfo *info)
+{
+    struct MergeIn *in;
+    struct Group *g;
+    u32 i;
+    u32 k;
+    u32 gi;
+    s32 ret;
+
+    memset(m, 0, sizeof(*m));
+    memset(info, 0, sizeof(*info));
+    m->info = info;
+    if (nrE == 0)
+        return Fail(m, "nothing to merge");
+
+    m->in = calloc(nrE, sizeof(*m->in));
+    m->group = calloc(1, sizeof(*m->group));
+    if (m->in == NULL || m->group == NULL)
+        return XFF_ERR_NOMEM;
+    m->groupNrE = 1;
+
+    for (i = 0; i < nrE; i++)
+    {
+        in = &m->in[i];
+        in->name = names[i];
+        in->img = img[i];
+        in->size = size[i];
+        m->inNrE++;
+        ret = Open(m, in);
+        if (ret != XFF_OK)
+            return ret;
+
+        info->sectionsIn += in->hdr->sectNrE - 1;
+        for (k = 1; k < (u32)in->hdr->sectNrE; k++)
+        {
+            for (gi = 1; gi < m->groupNrE; gi++)
+            {
+                g = &m->group[gi];
+                if (g->type == in->sect[k].type && g->flags == in->sect[k].flags && strcmp(g->name, SectName(in, k)) == 0)
+                    break;
+            }
+
+            if (gi == m->groupNrE)
+            {
+                if (gi == SECT_NRE_MAX)
+                    return Fail(m, "too many sections");
+                g = realloc(m->group, (gi + 1) * sizeof(*m->group));
+                if (g == NULL)
+                    return XFF_ERR_NOMEM;
+                m->group = g;
+                g = &m->group[gi];
+                g->name = SectName(in, k);
+                g->type = in->sect[k].type;
+                g->flags = in->sect[k].flags;
+                g->align = 1;
+                g->size = 0;
+                m->groupNrE++;
+            }
+
+            g = &m->group[gi];
+            g->size = (g->size + in->sect[k].align - 1) & ~(in->sect[k].align - 1);
+            if (g->size + (u32)in->sect[k].size < g->size)
+                return Fail(m, "merged section %s is too large", g->name);
+            in->group[k] = gi;
+            in->pieceOffs[k] = g->size;
+            g->size += in->sect[k].size;
+            if ((u32)in->sect[k].align > g->align)
+                g->align = in->sect[k].align;
+        }
+    }
+
+    info->modules = nrE;
+    info->sections = m->groupNrE - 1;
+    return XFF_OK;
+}
+
+static s32 NameTabInit(struct NameTab *t, u32 cap)
+{
+    u32 i;
+
+    for (t->mask = 15; t->mask < cap; t->mask = t->mask * 2 + 1)
+        ;
+    t->head = malloc((t->mask + 1) * sizeof(*t->head));
+    t->ent = malloc((cap + 1) * sizeof(*t->ent));
+    t->nrE = 0;
+    if (t->head == NULL || t->ent == NULL)
+        return XFF_ERR_NOMEM;
+    for (i = 0; i <= t->mask; i++)
+        t->head[i] = NAME_NONE;
+    return XFF_OK;
+}
+
+static void NameTabFree(struct NameTab *t)
+{
+    free(t->head);
+    free(t->ent);
+}
+
+static struct NameEnt *NameTabFind(const struct NameTab *t, const char *name, u32 hash)
+{
+    u32 i;
+
+    for (i = t->head[hash & t->mask]; i != NAME_NONE; i = t->ent[i].next)
+    {
+        if (t->ent[i].hash == hash && strcmp(t->ent[i].name, name) == 0)
+            return &t->ent[i];
+    }
+    return NULL;
+}
+
+// 'cap' in NameTabInit() bounds the entries, there is always room
+static void NameTabAdd(struct NameTab *t, const char *name, u32 hash, u32 symIx, u32 in)
+{
+    struct NameEnt *ent = &t->ent[t->nrE];
+
+    ent->name = name;
+    ent->hash = hash;
+    ent->symIx = symIx;
+    ent->in = in;
+    ent->next = t->head[hash & t->mask];
+    t->head[hash & t->mask] = t->nrE++;
+}
+
+// Defined symbols of every input, then the imports against them
+static s32 MergeSymbols(struct Merge *m, struct XffBuilder *b, struct NameTab *exports, struct NameTab *imports)
+{
+    const struct t_xffSymEnt *sym;
+    struct MergeIn *in;
+    struct NameEnt *ent;
+    const char *name;
+    u32 hash;
+    u32 offs;
+    u32 i;
+    u32 s;
+    u16 sect;
+
+    for (i = 0; i < m->inNrE; i++)
+    {
+        in = &m->in[i];
+        for (s = 1; s < (u32)in->hdr->symTabNrE; s++)
+        {
+            sym = &in->sym[s];
+            if (sym->sect == 0)
+                continue;
+
+            name = SymName(in, s);
+            sect = sym->sect;
+            offs = in->symRel[s].offs;
+            if (sect != XFF_SECT_ABS)
+            {
+                offs += in->pieceOffs[sect];
+                sect = in->group[sect];
+            }
+
+            if (sym->type == XFF_STT_SECTION && sect != XFF_SECT_ABS && offs == 0 && name[0] == '\0')
+            {
+                in->symMap[s] = b->sect[sect].symIx;
+                continue;
+            }
+
+            in->symMap[s] = XffBuilderAddSymbol(b, name, sect, offs, sym->size, sym->type, sym->bindAttr);
+            if (sym->bindAttr != XFF_STB_GLOBAL || name[0] == '\0')
+                continue;
+
+            hash = XffStrHash(name);
+            ent = NameTabFind(exports, name, hash);
+            if (ent != NULL)
+                return Fail(m, "%s is exported by both %s and %s", name, m->in[ent->in].name, in->name);
+            NameTabAdd(exports, name, hash, in->symMap[s], i);
+        }
+    }
+
+    for (i = 0; i < m->inNrE; i++)
+    {
+        in = &m->in[i];
+        m->info->importsIn += in->hdr->impSymIxsNrE;
+        for (s = 1; s < (u32)in->hdr->symTabNrE; s++)
+        {
+            sym = &in->sym[s];
+            if (sym->sect != 0)
+                continue;
+
+            name = SymName(in, s);
+            hash = XffStrHash(name);
+            ent = NameTabFind(exports, name, hash);
+            if (ent != NULL)
+            {
+                in->symMap[s] = ent->symIx;
+                m->info->importsBound++;
+                continue;
+            }
+
+            ent = NameTabFind(imports, name, hash);
+            if (ent == NULL)
+            {
+                NameTabAdd(imports, name, hash, XffBuilderAddSymbol(b, name, 0, 0, sym->size, sym->type, sym->bindAttr), i);
+                ent = &imports->ent[imports->nrE - 1];
+            }
+            in->symMap[s] = ent->symIx;
+        }
+    }
+
+    m->info->imports = imports->nrE;
+    return XFF_OK;
+}
+
+static inline s32 IsExtern(const struct XffBuilder *b, u32 symIx)
+{
+    return symIx != 0 && b->sym[symIx].sect == 0;
+}
+
+// Relocation tables of every input, moved to the merged sections. A HI16 run and the
+// LO16 closing it must stay in one table.
+static s32 MergeRelocs(struct Merge *m, struct XffBuilder *b)
+{
+    const struct t_xffRelocAddrEnt *addrTab;
+    const struct t_xffRelocInstEnt *instTab;
+    const struct t_xffRelocEnt *rt;
+    struct MergeIn *in;
+    u32 sect;
+    u32 pieceOffs;
+    u32 i;
+    u32 t;
+    u32 j;
+    u32 n;
+    s32 ext;
+
+    for (i = 0; i < m->inNrE; i++)
+    {
+        in = &m->in[i];
+        for (t = 0; t < (u32)in->hdr->relocTabNrE; t++)
+        {
+            rt = &in->rt[t];
+            addrTab = (const struct t_xffRelocAddrEnt *)(in->img + rt->addr_Rel);
+            instTab = (const struct t_xffRelocInstEnt *)(in->img + rt->inst_Rel);
+            sect = in->group[rt->sect];
+            pieceOffs = in->pieceOffs[rt->sect];
+            m->info->relocs += rt->nrEnt;
+            if (t < (u32)in->hdr->relocTabNrE / 2)
+                m->info->extRelocsIn += rt->nrEnt;
+
+            for (j = 0; j < rt->nrEnt; j = n)
+            {
+                n = j + 1;
+                if (addrTab[j].relType == XFF_R_HI16)
+                {
+                    for (; n < rt->nrEnt && addrTab[n].relType == XFF_R_HI16; n++)
+                        ;
+                    if (n < rt->nrEnt && addrTab[n].relType == XFF_R_LO16)
+                        n++;
+                }
+
+                ext = IsExtern(b, in->symMap[addrTab[j].tgSymIx]);
+                for (; j < n; j++)
+                {
+                    if (IsExtern(b, in->symMap[addrTab[j].tgSymIx]) != ext)
+                        return Fail(m, "%s: HI16/LO16 at %s+0x%x refer to both merged and external symbols", in->name,
+                                    SectName(in, rt->sect), addrTab[j].addr);
+                    XffBuilderAddReloc(b, sect, addrTab[j].addr + pieceOffs, addrTab[j].relType, in->symMap[addrTab[j].tgSymIx],
+                                       instTab[j].inst);
+                }
+            }
+        }
+    }
+
+    for (sect = 1; sect < b->sectNrE; sect++)
+        m->info->extRelocs += b->sect[sect].ext.nrEnt;
+    return XFF_OK;
+}
+
+// The entry point of the first input, relative to the first merged section with memory
+static s32 MergeEntry(struct Merge *m, struct XffBuilder *b)
+{
+    const struct MergeIn *in = &m->in[0];
+    u32 k;
+    u32 gi;
+
+    for (k = 1; k < (u32)in->hdr->sectNrE && in->sect[k].size == 0; k++)
+        ;
+    for (gi = 1; gi < m->groupNrE && m->group[gi].size == 0; gi++)
+        ;
+
+    if (k == (u32)in->hdr->sectNrE)
+    {
+        b->entryOffs = in->hdr->entryPnt_Rel;
+        return XFF_OK;
+    }
+    if (in->group[k] != gi)
+        return Fail(m, "the entry point of %s would not be in the first merged section", in->name);
+
+    b->entryOffs = in->pieceOffs[k] + in->hdr->entryPnt_Rel;
+    return XFF_OK;
+}
+
+// Merges the modules img[0..nrE) into 'b'. names[] only appear in error messages.
+// XFF_ERR_FORMAT comes with info->err set.
+s32 XffMerge(struct XffBuilder *b, const u8 *const *img, const u32 *size, const char *const *names, u32 nrE,
+             struct XffMergeInfo *info)
+{
+    struct NameTab exports = {NULL, 0, NULL, 0};
+    struct NameTab imports = {NULL, 0, NULL, 0};
+    struct Merge m;
+    struct MergeIn *in;
+    struct Group *g;
+    u32 symNrE = 0;
+    u32 i;
+    u32 k;
+    s32 ret;
+
+    ret = Plan(&m, img, size, names, nrE, info);
+    for (i = 0; i < m.inNrE && ret == XFF_OK; i++)
+        symNrE += m.in[i].hdr->symTabNrE;
+    if (ret == XFF_OK)
+        ret = NameTabInit(&exports, symNrE);
+    if (ret == XFF_OK)
+        ret = NameTabInit(&imports, symNrE);
+
+    for (i = 1; i < m.groupNrE && ret == XFF_OK; i++)
+    {
+        g = &m.group[i];
+        XffBuilderAddSection(b, g->name, g->type, g->align, g->flags, NULL, g->size);
+    }
+
+    for (i = 0; i < m.inNrE && ret == XFF_OK; i++)
+    {
+        in = &m.in[i];
+        info->symbolsIn += in->hdr->symTabNrE;
+        for (k = 1; k < (u32)in->hdr->sectNrE; k++)
+        {
+            if (b->sect[in->group[k]].data != NULL && in->sect[k].size != 0)
+                memcpy(b->sect[in->group[k]].data + in->pieceOffs[k], in->img + in->sect[k].offs_Rel, in->sect[k].size);
+        }
+    }
+
+    if (ret == XFF_OK)
+        ret = MergeSymbols(&m, b, &exports, &imports);
+    if (ret == XFF_OK)
+        ret = MergeRelocs(&m, b);
+    if (ret == XFF_OK)
+        ret = MergeEntry(&m, b);
+    if (ret == XFF_OK)
+    {
+        b->specSectNrE = m.in[0].hdr->specSectNrE;
+        info->symbols = b->symNrE;
+    }
+
+    NameTabFree(&exports);
+    NameTabFree(&imports);
+    Close(&m);
+    return ret;
+}
+
+// Loads the inputs one after the other and moves every section to where the merged
+// module, loaded on its own, put the same bytes; after relocation both must match.
+// Returns XFF_ERR_FORMAT with info->err set on a mismatch.
+s32 XffMergeCheck(const u8 *const *img, const u32 *size, const char *const *names, u32 nrE, const u8 *xff, u32 xffSize,
+                  struct XffMergeInfo *info)
+{
+    struct XffLoader merged;
+    struct XffLoader chain;
+    struct XffModule *mod;
+    struct XffModule **mods = NULL;
+    struct XffMoveStats st;
+    struct Merge m;
+    const struct t_xffSectEnt *mergedSect;
+    const struct t_xffSectEnt *sect;
+    struct MergeIn *in;
+    u32 *newMemPt = NULL;
+    u32 arenaSize = xffSize * 2 + 0x100000;
+    u32 heap;
+    u32 addr;
+    u32 i;
+    u32 k;
+    s32 ret;
+
+    ret = Plan(&m, img, size, names, nrE, info);
+    if (ret != XFF_OK)
+    {
+        Close(&m);
+        return ret;
+    }
+
+    for (i = 0; i < m.inNrE; i++)
+        arenaSize += m.in[i].size * 2;
+    for (i = 1; i < m.groupNrE; i++)
+        arenaSize += m.group[i].type == XFF_SECT_NOBITS || m.group[i].flags != 0 ? m.group[i].size * 2 + 0x100 : 0;
+
+    if (XffLoaderInit(&merged, XFF_ARENA_DEFAULT_BASE, arenaSize) != XFF_OK)
+    {
+        Close(&m);
+        return XFF_ERR_NOMEM;
+    }
+    ret = XffLoadImage(&merged, "merged", xff, xffSize, &mod);
+    if (ret != XFF_OK)
+        ret = Fail(&m, "the merged file doesn't load (%d)", ret);
+    else if (mod->xffEp->sectNrE != (s32)m.groupNrE)
+        ret = Fail(&m, "the merged file has %d sections, expected %u", mod->xffEp->sectNrE - 1, m.groupNrE - 1);
+    if (ret != XFF_OK)
+    {
+        XffLoaderTerm(&merged);
+        Close(&m);
+        return ret;
+    }
+    mergedSect = XffPtr(&merged.arena, mod->xffEp->sectTab);
+
+    // The chain loads above everything the merged module uses
+    heap = (merged.arena.heapPt + 0xFFFF) & ~0xFFFF;
+    if (XffLoaderInit(&chain, XFF_ARENA_DEFAULT_BASE, heap - XFF_ARENA_DEFAULT_BASE + arenaSize) != XFF_OK)
+    {
+        XffLoaderTerm(&merged);
+        Close(&m);
+        return XFF_ERR_NOMEM;
+    }
+    XffSetHeapStartPoint(&chain.arena, heap);
+    chain.keepLocalRelocs = 1;
+
+    mods = calloc(nrE, sizeof(*mods));
+    if (mods == NULL)
+        ret = XFF_ERR_NOMEM;
+    for (i = 0; i < m.inNrE && ret == XFF_OK; i++)
+    {
+        ret = XffLoadImage(&chain, m.in[i].name, img[i], size[i], &mods[i]);
+        if (ret != XFF_OK)
+            ret = Fail(&m, "%s doesn't load (%d)", m.in[i].name, ret);
+    }
+
+    for (i = 0; i < m.inNrE && ret == XFF_OK; i++)
+    {
+        in = &m.in[i];
+        free(newMemPt);
+        newMemPt = calloc(in->hdr->sectNrE, sizeof(*newMemPt));
+        if (newMemPt == NULL)
+        {
+            ret = XFF_ERR_NOMEM;
+            break;
+        }
+        for (k = 1; k < (u32)in->hdr->sectNrE; k++)
+        {
+            if (in->sect[k].size != 0 && mergedSect[in->group[k]].memPt != 0)
+                newMemPt[k] = mergedSect[in->group[k]].memPt + in->pieceOffs[k];
+        }
+        ret = XffMoveSections(&chain, mods[i], newMemPt, 0, &st);
+    }
+
+    // Imports of earlier inputs bound to later ones only resolve now that all are loaded
+    for (i = 0; i < m.inNrE && ret == XFF_OK; i++)
+    {
+        XffResolveImports(&chain, mods[i]->xffEp);
+        XffRelocateCode(&chain.arena, mods[i]->xffEp, 0, mods[i]->xffEp->relocTabNrE);
+    }
+
+    for (i = 0; i < m.inNrE && ret == XFF_OK; i++)
+    {
+        in = &m.in[i];
+        sect = XffPtr(&chain.arena, mods[i]->xffEp->sectTab);
+        for (k = 1; k < (u32)in->hdr->sectNrE && ret == XFF_OK; k++)
+        {
+            if (sect[k].type == XFF_SECT_NOBITS || sect[k].size == 0)
+                continue;
+            addr = mergedSect[in->group[k]].memPt + in->pieceOffs[k];
+            if (sect[k].memPt != addr || memcmp(XffPtr(&chain.arena, addr), XffPtr(&merged.arena, addr), sect[k].size) != 0)
+                ret = Fail(&m, "%s of %s differs from its part of the merged module", SectName(in, k), in->name);
+            info->checked += sect[k].size;
+        }
+    }
+    if (ret == XFF_OK && mods[0]->xffEp->entryPnt != mod->xffEp->entryPnt)
+        ret = Fail(&m, "the entry point moved from 0x%x to 0x%x", mods[0]->xffEp->entryPnt, mod->xffEp->entryPnt);
+
+    free(newMemPt);
+    free(mods);
+    XffLoaderTerm(&chain);
+    XffLoaderTerm(&merged);
+    Close(&m);
+    return ret;
+}
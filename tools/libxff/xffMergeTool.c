@@ -0,0 +1,212 @@
+/*
+xffmerge: merges a chain of XFF2 modules into one, see xffMerge.c.
+
+Usage: xffmerge [-H] [-P] [-c] -o out.xff in.xff...
+
+The inputs are given in the order they are loaded, the entry point is the one of the
+first. -H adds an XFF_EXT_HASH block, -P an XFF_EXT_RELPLAN block. -c checks the result:
+the inputs, loaded one after the other and moved to where the merged module has their
+sections, must relocate to the same bytes; both ways of loading are then timed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xffBuild.h"
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static s32 WriteFile(const char *path, const void *data, u32 size)
+{
+    FILE *f = fopen(path, "wb");
+
+    if (f == NULL)
+        return XFF_ERR_IO;
+
+    if (fwrite(data, 1, size, f) != size)
+    {
+        fclose(f);
+        return XFF_ERR_IO;
+    }
+
+    return fclose(f) == 0 ? XFF_OK : XFF_ERR_IO;
+}
+
+// Loads img[0..nrE) into a fresh loader, best of a few runs. Returns the seconds, < 0 on
+// a load error.
+static double TimeLoad(const u8 *const *img, const u32 *size, u32 nrE, struct XffLoadStats *st)
+{
+    struct XffLoader ldr;
+    struct XffModule *mod;
+    double best = 1e30;
+    double t0;
+    double sec;
+    s32 r;
+    u32 i;
+
+    if (XffLoaderInit(&ldr, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK)
+        return -1;
+
+    for (r = 0; r < 10; r++)
+    {
+        XffLoaderReset(&ldr);
+        memset(&ldr.stats, 0, sizeof(ldr.stats));
+        t0 = NowSec();
+        for (i = 0; i < nrE; i++)
+        {
+            if (XffLoadImage(&ldr, "bench", img[i], size[i], &mod) != XFF_OK)
+            {
+                XffLoaderTerm(&ldr);
+                return -1;
+            }
+        }
+        sec = NowSec() - t0;
+        if (sec < best)
+            best = sec;
+    }
+
+    *st = ldr.stats;
+    XffLoaderTerm(&ldr);
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    struct XffMergeInfo info;
+    struct XffMergeInfo checkInfo;
+    struct XffLoadStats chainSt;
+    struct XffLoadStats mergedSt;
+    struct XffBuilder b;
+    const char *outPath = NULL;
+    const char **names;
+    const u8 **img;
+    u32 *size;
+    u8 *out;
+    u32 outSize;
+    u32 inBytes = 0;
+    u32 nrE;
+    u32 i;
+    s32 bad = 0;
+    s32 hash = 0;
+    s32 relPlan = 0;
+    s32 check = 0;
+    s32 opt;
+    s32 ret;
+    double tChain;
+    double tMerged;
+
+    while ((opt = getopt(argc, argv, "HPco:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'H':
+            hash = 1;
+            break;
+        case 'P':
+            relPlan = 1;
+            break;
+        case 'c':
+            check = 1;
+            break;
+        case 'o':
+            outPath = optarg;
+            break;
+        default:
+            bad = 1;
+            break;
+        }
+    }
+
+    if (bad || outPath == NULL || optind >= argc)
+    {
+        fprintf(stderr, "usage: %s [-H] [-P] [-c] -o out.xff in.xff...\n", argv[0]);
+        return 1;
+    }
+
+    nrE = argc - optind;
+    names = (const char **)&argv[optind];
+    img = calloc(nrE, sizeof(*img));
+    size = calloc(nrE, sizeof(*size));
+    if (img == NULL || size == NULL)
+    {
+        fprintf(stderr, "xffmerge: out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < nrE; i++)
+    {
+        img[i] = XffMapFile(names[i], &size[i]);
+        if (img[i] == NULL)
+        {
+            fprintf(stderr, "xffmerge: can't map %s\n", names[i]);
+            return 1;
+        }
+        inBytes += size[i];
+    }
+
+    XffBuilderInit(&b);
+    b.hashSection = hash;
+    b.relPlanSection = relPlan;
+    ret = XffMerge(&b, img, size, names, nrE, &info);
+    if (ret == XFF_OK)
+        ret = XffBuilderWrite(&b, &out, &outSize);
+    XffBuilderFree(&b);
+    if (ret != XFF_OK)
+    {
+        fprintf(stderr, "xffmerge: %s\n", ret == XFF_ERR_FORMAT ? info.err : "out of memory");
+        return 1;
+    }
+
+    printf("%u modules, %u bytes in, %u bytes out\n", info.modules, inBytes, outSize);
+    printf("sections    : %u -> %u\n", info.sectionsIn, info.sections);
+    printf("symbols     : %u -> %u\n", info.symbolsIn, info.symbols);
+    printf("imports     : %u -> %u, %u bound at merge time\n", info.importsIn, info.imports, info.importsBound);
+    printf("relocations : %u, extern %u -> %u, %u no longer bound at load time\n", info.relocs, info.extRelocsIn,
+           info.extRelocs, info.extRelocsIn - info.extRelocs);
+    printf("per load    : %u header relocations and section decodes, %u import lookups less\n", info.modules - 1,
+           info.importsIn - info.imports);
+
+    if (check)
+    {
+        ret = XffMergeCheck(img, size, names, nrE, out, outSize, &checkInfo);
+        if (ret != XFF_OK)
+        {
+            fprintf(stderr, "xffmerge: check failed: %s\n", ret == XFF_ERR_FORMAT ? checkInfo.err : "out of memory");
+            return 1;
+        }
+        printf("check       : %u section bytes match the chain\n", checkInfo.checked);
+
+        tChain = TimeLoad(img, size, nrE, &chainSt);
+        tMerged = TimeLoad((const u8 *const *)&out, &outSize, 1, &mergedSt);
+        if (tChain < 0 || tMerged < 0)
+        {
+            fprintf(stderr, "xffmerge: load failed\n");
+            return 1;
+        }
+        printf("load, chain : %8.3f ms, %u files, %u imports looked up, %u relocations\n", tChain * 1e3, chainSt.files,
+               chainSt.imports, chainSt.relocs);
+        printf("load, merged: %8.3f ms, %u files, %u imports looked up, %u relocations (%.2fx)\n", tMerged * 1e3,
+               mergedSt.files, mergedSt.imports, mergedSt.relocs, tChain / tMerged);
+    }
+
+    for (i = 0; i < nrE; i++)
+        XffUnmapFile((void *)img[i], size[i]);
+
+    if (WriteFile(outPath, out, outSize) != XFF_OK)
+    {
+        fprintf(stderr, "xffmerge: can't write %s\n", outPath);
+        return 1;
+    }
+    free(out);
+    free(img);
+    free(size);
+    return 0;
+}
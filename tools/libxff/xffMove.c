@@ -0,0 +1,286 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libxff.h"
+
+/*
+MoveElf() for the host loader.
+
+Sections of a loaded module are copied to new addresses and everything that points at
+them is re-relocated. The full mode does what LoaderSysRelocateOnlineElfInfo() does after
+MoveElf(): every relocation table of the moved module and the extern half of every other
+module is applied again.
+
+The incremental mode works from the per-section delta instead. The copied words already
+hold values relocated for the old layout, so a site only needs patching when the symbol
+it refers to changed address:
+ - own symbols of a section whose delta is not 0,
+ - imports of other modules bound to one of those (unk0D set, the address differs).
+A site whose target didn't move keeps a correct value no matter where the site itself went.
+*/
+
+// Applies the entries of a table whose target symbol is flagged in 'changed'. A HI16 run
+// is applied as a whole when any of its entries is flagged. Returns the sites patched.
+u32 XffPatchChanged(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp, struct t_xffRelocEnt *rt, const u8 *changed)
+{
+    struct t_xffRelocAddrEnt *addrTab = XffPtr(ar, rt->addr);
+    u32 patched = 0;
+    u32 hit;
+    u32 j;
+    u32 n;
+
+    if (rt->type == XFF_RELOC_TYPE_PACKED)
+        return XffApplyPackedRelocs(ar, xffEp, rt, changed);
+
+    for (j = 0; j < rt->nrEnt; j = n)
+    {
+        if (addrTab[j].relType != XFF_R_HI16)
+        {
+            n = j + 1;
+            if (changed[addrTab[j].tgSymIx])
+            {
+                XffResolveRelocation(ar, xffEp, rt, j);
+                patched++;
+            }
+            continue;
+        }
+
+        hit = 0;
+        for (n = j; n < rt->nrEnt && addrTab[n].relType == XFF_R_HI16; n++)
+            hit |= changed[addrTab[n].tgSymIx];
+
+        if (hit)
+        {
+            XffResolveRelocation(ar, xffEp, rt, j);
+            patched += n - j;
+        }
+    }
+
+    return patched;
+}
+
+// Re-binds the resolved imports of 'xffEp' and flags those whose address changed.
+// Returns the number of flagged imports.
+static u32 RebindImports(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp, u8 *changed)
+{
+    const struct XffArena *ar = &ldr->arena;
+    struct t_xffImpSymIxs *imp = XffPtr(ar, xffEp->impSymIxs);
+    struct t_xffSymEnt *symTab = XffPtr(ar, xffEp->symTab);
+    const u32 *impHash = XffHashImports(ldr, xffEp);
+    struct t_xffSymEnt *sym;
+    struct t_xffSymEnt *found;
+    u32 flagged = 0;
+    u32 addr;
+    s32 i;
+
+    for (i = 0; i < xffEp->impSymIxsNrE; i++)
+    {
+        sym = &symTab[imp[i].stIx];
+
+        // Unresolved imports point at symTab[0] and lazy ones that weren't called yet at
+        // their stub, neither can refer to the moved module
+        if (sym->unk0D != 1)
+            continue;
+
+        addr = XffFindImport(ldr, xffEp, sym, impHash != NULL ? impHash[i] : 0, &found);
+        if (found != NULL && addr != sym->addr)
+        {
+            sym->addr = addr;
+            changed[imp[i].stIx] = 1;
+            flagged++;
+        }
+    }
+
+    return flagged;
+}
+
+static u32 CountEntries(const struct XffArena *ar, const struct t_xffEntPntHdr *xffEp, s32 firstTab, s32 tabNrE)
+{
+    const struct t_xffRelocEnt *rt = (const struct t_xffRelocEnt *)XffPtr(ar, xffEp->relocTab) + firstTab;
+    u32 n = 0;
+
+    for (; tabNrE-- > 0; rt++)
+        n += rt->nrEnt;
+
+    return n;
+}
+
+// LoaderSysRelocateOnlineElfInfo(): the sections of 'mod' already sit at their new
+// memPt, delta[] gives how far each one went. Fixes the entry point and the symbols of
+// 'mod' and re-relocates the loaded modules; adds to 'st'. The local relocation tables
+// of 'mod' must still be there, see XffLoader.keepLocalRelocs.
+s32 XffRelocateOnline(struct XffLoader *ldr, struct XffModule *mod, const s32 *delta, s32 incremental, struct XffMoveStats *st)
+{
+    const struct XffArena *ar = &ldr->arena;
+    struct t_xffEntPntHdr *xffEp = mod->xffEp;
+    struct t_xffSectEnt *sect = XffPtr(ar, xffEp->sectTab);
+    struct t_xffSymEnt *sym = XffPtr(ar, xffEp->symTab);
+    struct t_xffRelocEnt *rt = XffPtr(ar, xffEp->relocTab);
+    struct XffModule *other;
+    u8 *changed;
+    u32 symChanged = 0;
+    u32 sites;
+    s32 halfTabsNrE;
+    s32 i;
+
+    if (!mod->hasLocalRelocs)
+        return XFF_ERR_FORMAT;
+
+    changed = calloc(xffEp->symTabNrE, 1);
+    if (changed == NULL)
+        return XFF_ERR_NOMEM;
+
+    // The entry point follows the first section with memory, as in DecodeSection()
+    for (i = 1; i < xffEp->sectNrE; i++)
+    {
+        if (sect[i].memPt != 0)
+        {
+            xffEp->entryPnt += delta[i];
+            break;
+        }
+    }
+
+    for (i = 0; i < xffEp->symTabNrE; i++, sym++)
+    {
+        if (sym->sect != 0 && sym->sect != XFF_SECT_ABS && sym->sect < xffEp->sectNrE && delta[sym->sect] != 0)
+        {
+            sym->addr += delta[sym->sect];
+            changed[i] = 1;
+            symChanged++;
+        }
+    }
+    st->symbols += symChanged;
+
+    // Moved module: all of its tables
+    st->fullSites += CountEntries(ar, xffEp, 0, xffEp->relocTabNrE);
+    if (incremental)
+    {
+        for (i = 0, sites = 0; i < xffEp->relocTabNrE; i++)
+            sites += XffPatchChanged(ar, xffEp, &rt[i], changed);
+    }
+    else
+    {
+        sites = XffRelocateCode(ar, xffEp, 0, xffEp->relocTabNrE);
+    }
+    st->sites += sites;
+    st->modules += sites != 0;
+    free(changed);
+
+    // Every other module: the extern half, the only one it still has
+    for (other = ldr->modules; other != NULL; other = other->next)
+    {
+        if (other == mod)
+            continue;
+
+        xffEp = other->xffEp;
+        halfTabsNrE = xffEp->relocTabNrE / 2;
+        st->fullSites += CountEntries(ar, xffEp, 0, halfTabsNrE);
+
+        if (!incremental)
+        {
+            XffResolveImports(ldr, xffEp);
+            st->sites += XffRelocateCode(ar, xffEp, 0, halfTabsNrE);
+            st->modules++;
+            continue;
+        }
+
+        // Nothing in here can have changed unless the moved module exported something
+        if (symChanged == 0)
+            continue;
+
+        changed = calloc(xffEp->symTabNrE, 1);
+        if (changed == NULL)
+            return XFF_ERR_NOMEM;
+
+        if (RebindImports(ldr, xffEp, changed) != 0)
+        {
+            rt = XffPtr(ar, xffEp->relocTab);
+            sites = 0;
+            for (i = 0; i < halfTabsNrE; i++)
+                sites += XffPatchChanged(ar, xffEp, &rt[i], changed);
+
+            st->sites += sites;
+            st->modules += sites != 0;
+        }
+        free(changed);
+    }
+
+    return XFF_OK;
+}
+
+// Moves the sections of 'mod' to newMemPt[] (0 keeps a section where it is) and
+// re-relocates the loaded modules, see XffRelocateOnline().
+s32 XffMoveSections(struct XffLoader *ldr, struct XffModule *mod, const u32 *newMemPt, s32 incremental, struct XffMoveStats *st)
+{
+    const struct XffArena *ar = &ldr->arena;
+    struct t_xffEntPntHdr *xffEp = mod->xffEp;
+    struct t_xffSectEnt *sect = XffPtr(ar, xffEp->sectTab);
+    s32 *delta;
+    s32 ret;
+    s32 i;
+
+    if (!mod->hasLocalRelocs)
+        return XFF_ERR_FORMAT;
+
+    memset(st, 0, sizeof(*st));
+    delta = calloc(xffEp->sectNrE, sizeof(*delta));
+    if (delta == NULL)
+        return XFF_ERR_NOMEM;
+
+    for (i = 1; i < xffEp->sectNrE; i++)
+    {
+        if (newMemPt[i] == 0 || newMemPt[i] == sect[i].memPt || sect[i].memPt == 0)
+            continue;
+
+        memmove(XffPtr(ar, newMemPt[i]), XffPtr(ar, sect[i].memPt), sect[i].size);
+        delta[i] = newMemPt[i] - sect[i].memPt;
+        sect[i].memPt = newMemPt[i];
+        if (sect[i].moved == 0)
+            sect[i].moved = 1;
+        st->sections++;
+        st->bytesMoved += sect[i].size;
+    }
+
+    ret = XffRelocateOnline(ldr, mod, delta, incremental, st);
+    free(delta);
+    return ret;
+}
+
+// Moves every section of 'mod' that has memory to a fresh allocation of the same kind.
+s32 XffMoveModule(struct XffLoader *ldr, struct XffModule *mod, s32 incremental, struct XffMoveStats *st)
+{
+    struct t_xffEntPntHdr *xffEp = mod->xffEp;
+    struct t_xffSectEnt *sect = XffPtr(&ldr->arena, xffEp->sectTab);
+    u32 *newMemPt;
+    s32 ret;
+    s32 i;
+
+    newMemPt = calloc(xffEp->sectNrE, sizeof(*newMemPt));
+    if (newMemPt == NULL)
+        return XFF_ERR_NOMEM;
+
+    // With a region heap the new memory comes from the module's own region
+    ldr->region = mod->region;
+    for (i = 1; i < xffEp->sectNrE; i++)
+    {
+        if (sect[i].memPt == 0 || sect[i].size == 0)
+            continue;
+
+        if (sect[i].flags != 0)
+            newMemPt[i] = ldr->mallocMaxAlign(ldr, sect[i].size);
+        else
+            newMemPt[i] = ldr->mallocAlign(ldr, sect[i].size, sect[i].align);
+
+        if (newMemPt[i] == 0)
+        {
+            ldr->region = NULL;
+            free(newMemPt);
+            return XFF_ERR_NOMEM;
+        }
+    }
+    ldr->region = NULL;
+
+    ret = XffMoveSections(ldr, mod, newMemPt, incremental, st);
+    free(newMemPt);
+    return ret;
+}
@@ -0,0 +1,229 @@
+/*
+xffmovebench: incremental against full re-relocation after MoveElf().
+
+Usage: xffmovebench [-m modules] [-r relocs] [-k module] [-s section] [-n iterations]
+
+Builds a chain of synthetic modules, each importing functions of the ones loaded before
+it, and loads it twice with the local relocation tables kept. Module 'k' (default 0, the
+one everybody imports from) is then moved in both copies, incrementally in one and with
+a full re-relocation in the other, and the two heaps are compared section by section.
+With -s only that section of the module moves.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xffBuild.h"
+
+#define EXPORT_NRE (256)
+#define IMPORT_NRE (64)
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static u8 *BuildModule(s32 modIx, u32 relocNrE, u32 *sizeOut)
+{
+    struct XffBuilder b;
+    u32 syms[EXPORT_NRE + IMPORT_NRE];
+    char name[64];
+    u32 text;
+    u32 data;
+    u32 symNrE = 0;
+    u32 symIx;
+    u32 addr;
+    u32 i;
+    u8 *img;
+
+    srand(modIx + 1);
+    XffBuilderInit(&b);
+    text = XffBuilderAddSection(&b, ".text", XFF_SECT_PROGBITS, 16, 0, NULL, relocNrE * 8 + EXPORT_NRE * 16);
+    data = XffBuilderAddSection(&b, ".data", XFF_SECT_PROGBITS, 16, 0, NULL, 0x1000);
+    XffBuilderAddSection(&b, ".bss", XFF_SECT_NOBITS, 16, 0, NULL, 0x1000);
+
+    for (i = 0; i < EXPORT_NRE; i++)
+    {
+        snprintf(name, sizeof(name), "m%d_f%u", modIx, i);
+        syms[symNrE++] = XffBuilderAddSymbol(&b, name, text, relocNrE * 8 + i * 16, 16, XFF_STT_FUNC, XFF_STB_GLOBAL);
+    }
+    for (i = 0; modIx > 0 && i < IMPORT_NRE; i++)
+    {
+        snprintf(name, sizeof(name), "m%d_f%u", rand() % modIx, rand() % EXPORT_NRE);
+        syms[symNrE++] = XffBuilderAddSymbol(&b, name, 0, 0, 0, XFF_STT_FUNC, XFF_STB_GLOBAL);
+    }
+
+    // One site per word, calls and lui/addiu pairs into own and imported functions
+    for (i = 0, addr = 0; i < relocNrE; addr += 8)
+    {
+        symIx = (rand() % 4 == 0) ? b.sect[data].symIx : syms[rand() % symNrE];
+        if (rand() % 2)
+        {
+            XffBuilderAddReloc(&b, text, addr, XFF_R_26, symIx, 0x0C000000);
+            i++;
+        }
+        else
+        {
+            XffBuilderAddReloc(&b, text, addr, XFF_R_HI16, symIx, 0x3C020000);
+            XffBuilderAddReloc(&b, text, addr + 4, XFF_R_LO16, symIx, 0x24420000 | (rand() & 0x7FFF));
+            i += 2;
+        }
+    }
+
+    XffBuilderWrite(&b, &img, sizeOut);
+    XffBuilderFree(&b);
+    return img;
+}
+
+static struct XffModule *FindModule(struct XffLoader *ldr, u32 seq)
+{
+    struct XffModule *mod;
+
+    for (mod = ldr->modules; mod != NULL && mod->seq != seq; mod = mod->next)
+        ;
+    return mod;
+}
+
+// Compares the section contents of every module in two loaders.
+static s32 SameHeap(struct XffLoader *a, struct XffLoader *b)
+{
+    struct XffModule *ma;
+    struct XffModule *mb;
+    struct t_xffSectEnt *sa;
+    struct t_xffSectEnt *sb;
+    s32 i;
+
+    for (ma = a->modules, mb = b->modules; ma != NULL && mb != NULL; ma = ma->next, mb = mb->next)
+    {
+        sa = XffPtr(&a->arena, ma->xffEp->sectTab);
+        sb = XffPtr(&b->arena, mb->xffEp->sectTab);
+        for (i = 1; i < ma->xffEp->sectNrE; i++)
+        {
+            if (sa[i].memPt != sb[i].memPt || memcmp(XffPtr(&a->arena, sa[i].memPt), XffPtr(&b->arena, sb[i].memPt), sa[i].size) != 0)
+                return 0;
+        }
+    }
+
+    return ma == NULL && mb == NULL;
+}
+
+static s32 Move(struct XffLoader *ldr, struct XffModule *mod, s32 sectIx, s32 incremental, struct XffMoveStats *st)
+{
+    struct t_xffSectEnt *sect = XffPtr(&ldr->arena, mod->xffEp->sectTab);
+    u32 newMemPt[16] = {0};
+
+    if (sectIx <= 0)
+        return XffMoveModule(ldr, mod, incremental, st);
+
+    if (sectIx >= mod->xffEp->sectNrE || sectIx >= 16)
+        return XFF_ERR_FORMAT;
+
+    newMemPt[sectIx] = XffArenaAlloc(&ldr->arena, sect[sectIx].size, sect[sectIx].align);
+    return XffMoveSections(ldr, mod, newMemPt, incremental, st);
+}
+
+int main(int argc, char **argv)
+{
+    struct XffLoader inc;
+    struct XffLoader full;
+    struct XffMoveStats incSt;
+    struct XffMoveStats fullSt;
+    char name[32];
+    u32 modNrE = 16;
+    u32 relocNrE = 20000;
+    u32 target = 0;
+    s32 sectIx = 0;
+    s32 iterations = 10;
+    s32 identical = 1;
+    s32 opt;
+    s32 it;
+    u32 i;
+    u32 size;
+    u8 *img;
+    double t0;
+    double incSec = 0;
+    double fullSec = 0;
+
+    while ((opt = getopt(argc, argv, "m:r:k:s:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            modNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            relocNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            target = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            sectIx = strtol(optarg, NULL, 0);
+            break;
+        case 'n':
+            iterations = strtol(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-m modules] [-r relocs] [-k module] [-s section] [-n iterations]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (modNrE == 0 || target >= modNrE || iterations < 1)
+        return 1;
+
+    XffLoaderInit(&inc, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE);
+    XffLoaderInit(&full, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE);
+    XffLoaderUseSymIndex(&inc, 1);
+    XffLoaderUseSymIndex(&full, 1);
+    inc.keepLocalRelocs = 1;
+    full.keepLocalRelocs = 1;
+
+    for (i = 0; i < modNrE; i++)
+    {
+        img = BuildModule(i, relocNrE, &size);
+        snprintf(name, sizeof(name), "m%u", i);
+        if (img == NULL || XffLoadImage(&inc, name, img, size, NULL) != XFF_OK ||
+            XffLoadImage(&full, name, img, size, NULL) != XFF_OK)
+        {
+            fprintf(stderr, "xffmovebench: load of %s failed\n", name);
+            return 1;
+        }
+        free(img);
+    }
+
+    for (it = 0; it < iterations; it++)
+    {
+        t0 = NowSec();
+        if (Move(&inc, FindModule(&inc, target), sectIx, 1, &incSt) != XFF_OK)
+            return 1;
+        incSec += NowSec() - t0;
+
+        t0 = NowSec();
+        if (Move(&full, FindModule(&full, target), sectIx, 0, &fullSt) != XFF_OK)
+            return 1;
+        fullSec += NowSec() - t0;
+
+        identical &= SameHeap(&inc, &full);
+    }
+
+    printf("chain           : %u modules, %u relocs each, moving m%u", modNrE, relocNrE, target);
+    if (sectIx > 0)
+        printf(" section %d", sectIx);
+    printf("\n");
+    printf("moved           : %u sections, %u bytes, %u symbols changed\n", incSt.sections, incSt.bytesMoved, incSt.symbols);
+    printf("full            : %u sites in %u modules, %.3f ms\n", fullSt.sites, fullSt.modules, fullSec * 1e3 / iterations);
+    printf("incremental     : %u sites in %u modules, %.3f ms (%.1f%% of full)\n", incSt.sites, incSt.modules,
+           incSec * 1e3 / iterations, incSt.fullSites ? incSt.sites * 100.0 / incSt.fullSites : 0.0);
+    printf("result          : %s\n", identical ? "identical" : "MISMATCH");
+
+    XffLoaderTerm(&inc);
+    XffLoaderTerm(&full);
+    return identical ? 0 : 1;
+}
@@ -0,0 +1,356 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libxff.h"
+
+/*
+Packed XFF container:
+    XffPackHdr
+    XffPackBlock[blockNrE], sorted by rawOffs and covering the raw file
+    compressed block data
+Every progbits section gets blocks of its own (XffPackBlock.sect), the rest of the file
+(header, tables, relocation tables, extension blocks) goes into blocks with sect 0. A
+block that doesn't compress is stored as is (packSize == rawSize).
+
+The loader inflates the sect 0 blocks into the file image, places the sections and then
+inflates the section blocks straight to their memPt, so a section that DecodeSection()
+would move is never copied out of the file image.
+*/
+
+#define PACK_BLOCK_SIZE (0x10000)
+
+s32 XffPackIsPacked(const void *data, u32 size)
+{
+    return size >= sizeof(struct XffPackHdr) && ((const struct XffPackHdr *)data)->magic == XFF_PACK_MAGIC;
+}
+
+struct PackOut
+{
+    u8 *data;
+    u32 size;
+    u32 cap;
+};
+
+// Makes room for 'n' more bytes. Returns 0 without memory, the buffer is left as it was.
+static s32 Reserve(struct PackOut *o, u32 n)
+{
+    u8 *data;
+    u32 cap = o->cap;
+
+    if (o->size + n <= o->cap)
+        return 1;
+
+    while (o->size + n > cap)
+        cap = cap ? cap * 2 : 0x10000;
+    data = realloc(o->data, cap);
+    if (data == NULL)
+        return 0;
+    o->data = data;
+    o->cap = cap;
+    return 1;
+}
+
+// Splits [offs, offs + size) into blocks and appends their index entries. Returns 0
+// without memory.
+static s32 AddBlocks(struct XffPackBlock **blk, u32 *blkNrE, u32 *blkCap, u32 offs, u32 size, u32 sect)
+{
+    struct XffPackBlock *grown;
+    u32 n;
+
+    for (; size != 0; offs += n, size -= n)
+    {
+        n = size < PACK_BLOCK_SIZE ? size : PACK_BLOCK_SIZE;
+        if (*blkNrE == *blkCap)
+        {
+            grown = realloc(*blk, (*blkCap ? *blkCap * 2 : 64) * sizeof(**blk));
+            if (grown == NULL)
+                return 0;
+            *blk = grown;
+            *blkCap = *blkCap ? *blkCap * 2 : 64;
+        }
+        memset(&(*blk)[*blkNrE], 0, sizeof(**blk));
+        (*blk)[*blkNrE].rawOffs = offs;
+        (*blk)[*blkNrE].rawSize = n;
+        (*blk)[*blkNrE].sect = sect;
+        (*blkNrE)++;
+    }
+    return 1;
+}
+
+// Packs an XFF file. Returns XFF_OK and a malloc'd container in *out, XFF_ERR_NOMEM
+// without memory.
+s32 XffPack(const u8 *data, u32 size, u8 **out, u32 *outSize)
+{
+    const struct t_xffEntPntHdr *xffEp = (const struct t_xffEntPntHdr *)data;
+    const struct t_xffSectEnt *sect;
+    struct XffPackBlock *blk = NULL;
+    struct XffPackHdr hdr;
+    struct PackOut o = {0};
+    u32 blkNrE = 0;
+    u32 blkCap = 0;
+    u32 pos = 0;
+    u32 next;
+    u32 best;
+    u32 n;
+    s32 i;
+
+    if (XffCheckHeader(xffEp, size) != XFF_OK)
+        return XFF_ERR_FORMAT;
+
+    sect = (const struct t_xffSectEnt *)(data + xffEp->sectTab_Rel);
+
+    // Walk the file in offset order, cutting out the progbits sections
+    while (pos < size)
+    {
+        best = 0;
+        next = size;
+        for (i = 1; i < xffEp->sectNrE; i++)
+        {
+            if ((sect[i].type == XFF_SECT_PROGBITS || sect[i].type == XFF_SECT_OVERLAYDATA) && sect[i].size != 0 &&
+                sect[i].offs_Rel >= pos && sect[i].offs_Rel < next && sect[i].size <= size - sect[i].offs_Rel)
+            {
+                next = sect[i].offs_Rel;
+                best = i;
+            }
+        }
+
+        if (!AddBlocks(&blk, &blkNrE, &blkCap, pos, next - pos, 0) ||
+            (best != 0 && !AddBlocks(&blk, &blkNrE, &blkCap, sect[best].offs_Rel, sect[best].size, best)))
+        {
+            free(blk);
+            return XFF_ERR_NOMEM;
+        }
+        if (best == 0)
+            break;
+
+        pos = sect[best].offs_Rel + sect[best].size;
+    }
+
+    hdr.magic = XFF_PACK_MAGIC;
+    hdr.rawSize = size;
+    hdr.blockNrE = blkNrE;
+    hdr.dataOffs = sizeof(hdr) + blkNrE * sizeof(*blk);
+
+    if (!Reserve(&o, hdr.dataOffs))
+    {
+        free(blk);
+        return XFF_ERR_NOMEM;
+    }
+    o.size = hdr.dataOffs;
+    for (i = 0; i < (s32)blkNrE; i++)
+    {
+        if (!Reserve(&o, XffLzBound(blk[i].rawSize)))
+        {
+            free(blk);
+            free(o.data);
+            return XFF_ERR_NOMEM;
+        }
+        n = XffLzCompress(data + blk[i].rawOffs, blk[i].rawSize, o.data + o.size);
+        if (n >= blk[i].rawSize)
+        {
+            memcpy(o.data + o.size, data + blk[i].rawOffs, blk[i].rawSize);
+            n = blk[i].rawSize;
+        }
+        blk[i].packOffs = o.size - hdr.dataOffs;
+        blk[i].packSize = n;
+        o.size += n;
+    }
+
+    memcpy(o.data, &hdr, sizeof(hdr));
+    memcpy(o.data + sizeof(hdr), blk, blkNrE * sizeof(*blk));
+    free(blk);
+
+    *out = o.data;
+    *outSize = o.size;
+    return XFF_OK;
+}
+
+static s32 CheckBlock(const struct XffPackHdr *hdr, const struct XffPackBlock *blk, u32 size)
+{
+    if (blk->rawOffs > hdr->rawSize || blk->rawSize > hdr->rawSize - blk->rawOffs)
+        return 0;
+    if (blk->packSize > blk->rawSize || blk->packOffs > size - hdr->dataOffs || blk->packSize > size - hdr->dataOffs - blk->packOffs)
+        return 0;
+    return 1;
+}
+
+static s32 Inflate(const u8 *data, const struct XffPackHdr *hdr, const struct XffPackBlock *blk, u8 *dst)
+{
+    const u8 *src = data + hdr->dataOffs + blk->packOffs;
+
+    if (blk->packSize == blk->rawSize)
+    {
+        memcpy(dst, src, blk->rawSize);
+        return XFF_OK;
+    }
+    return XffLzDecompress(src, blk->packSize, dst, blk->rawSize);
+}
+
+static const struct XffPackHdr *GetHdr(const void *data, u32 size)
+{
+    const struct XffPackHdr *hdr = data;
+
+    if (!XffPackIsPacked(data, size) || hdr->dataOffs > size || hdr->blockNrE > (hdr->dataOffs - sizeof(*hdr)) / sizeof(struct XffPackBlock))
+        return NULL;
+    return hdr;
+}
+
+// Restores the original file from a container.
+s32 XffUnpack(const u8 *data, u32 size, u8 **out, u32 *outSize)
+{
+    const struct XffPackHdr *hdr = GetHdr(data, size);
+    const struct XffPackBlock *blk;
+    u8 *raw;
+    u32 i;
+
+    if (hdr == NULL)
+        return XFF_ERR_FORMAT;
+
+    raw = malloc(hdr->rawSize ? hdr->rawSize : 1);
+    if (raw == NULL)
+        return XFF_ERR_NOMEM;
+
+    blk = (const struct XffPackBlock *)(hdr + 1);
+    for (i = 0; i < hdr->blockNrE; i++, blk++)
+    {
+        if (!CheckBlock(hdr, blk, size) || Inflate(data, hdr, blk, raw + blk->rawOffs) != XFF_OK)
+        {
+            free(raw);
+            return XFF_ERR_FORMAT;
+        }
+    }
+
+    *out = raw;
+    *outSize = hdr->rawSize;
+    return XFF_OK;
+}
+
+// Everything XffLoadPacked() does once the file image is allocated at 'fileAddr'
+static s32 LoadPackedImage(struct XffLoader *ldr, const char *name, const struct XffPackHdr *hdr, const void *data, u32 size,
+                           u32 fileAddr, struct XffModule **modOut)
+{
+    struct XffArena *ar = &ldr->arena;
+    const struct XffPackBlock *blkTab;
+    const struct XffPackBlock *blk;
+    struct t_xffEntPntHdr *xffEp = XffPtr(ar, fileAddr);
+    struct t_xffSectEnt *sect;
+    u32 i;
+    s32 j;
+    s32 ret;
+    u64 inflated;
+    u64 t;
+
+    t = XffProfBegin(ldr);
+    ldr->stats.bytesRead += size;
+
+    // Everything but the sections goes to the file image
+    inflated = ldr->stats.bytesInflated;
+    blkTab = (const struct XffPackBlock *)(hdr + 1);
+    for (i = 0, blk = blkTab; i < hdr->blockNrE; i++, blk++)
+    {
+        if (!CheckBlock(hdr, blk, size))
+            return XFF_ERR_FORMAT;
+        if (blk->sect != 0)
+            continue;
+
+        if (Inflate(data, hdr, blk, (u8 *)xffEp + blk->rawOffs) != XFF_OK)
+            return XFF_ERR_FORMAT;
+        ldr->stats.bytesInflated += blk->rawSize;
+    }
+    XffProfEnd(ldr, XFF_PHASE_READ, t, 1, (u32)(ldr->stats.bytesInflated - inflated));
+
+    t = XffProfBegin(ldr);
+    ret = XffCheckImage(xffEp, hdr->rawSize);
+    if (ret != XFF_OK)
+        return ret;
+
+    ret = XffRelocateElfInfoHeader(ar, xffEp, fileAddr);
+    if (ret != XFF_OK)
+        return ret;
+    XffProfEnd(ldr, XFF_PHASE_HEADER, t, xffEp->sectNrE, 0);
+
+    t = XffProfBegin(ldr);
+    inflated = ldr->stats.bytesInflated + ldr->stats.bytesZeroed;
+
+    if (ldr->ldrDbgPrintf != NULL)
+        ldr->ldrDbgPrintf("ld:\t\tdecode section\n");
+
+    sect = XffPtr(ar, xffEp->sectTab);
+    for (j = 1; j < xffEp->sectNrE; j++)
+    {
+        ret = XffPlaceSection(ldr, xffEp, j);
+        if (ret != XFF_OK)
+            return ret;
+    }
+    XffSetEntryPoint(ar, xffEp);
+
+    // Sections land where they are used, in place or moved. A block always lies inside
+    // its section, so the section isn't empty and got memory.
+    for (i = 0, blk = blkTab; i < hdr->blockNrE; i++, blk++)
+    {
+        if (blk->sect == 0)
+            continue;
+
+        if (blk->sect >= (u32)xffEp->sectNrE || sect[blk->sect].type == XFF_SECT_NOBITS || blk->rawSize == 0 ||
+            blk->rawOffs < sect[blk->sect].offs_Rel || blk->rawOffs + blk->rawSize > sect[blk->sect].offs_Rel + sect[blk->sect].size)
+            return XFF_ERR_FORMAT;
+
+        if (Inflate(data, hdr, blk, (u8 *)XffPtr(ar, sect[blk->sect].memPt) + blk->rawOffs - sect[blk->sect].offs_Rel) != XFF_OK)
+            return XFF_ERR_FORMAT;
+        ldr->stats.bytesInflated += blk->rawSize;
+    }
+    XffProfEnd(ldr, XFF_PHASE_DECODE, t, xffEp->sectNrE - 1, (u32)(ldr->stats.bytesInflated + ldr->stats.bytesZeroed - inflated));
+
+    t = XffProfBegin(ldr);
+    XffRelocateSelfSymbol(ar, xffEp);
+    ret = XffInternModule(ldr, xffEp);
+    if (ret != XFF_OK)
+        return ret;
+    XffProfEnd(ldr, XFF_PHASE_SELFSYM, t, xffEp->symTabNrE, 0);
+    XffLinkImage(ldr, xffEp);
+
+    if (!ldr->keepLocalRelocs)
+    {
+        t = XffProfBegin(ldr);
+        XffTrimImage(ldr, xffEp, fileAddr, hdr->rawSize, XffPackRelocations(ldr, xffEp, XffDisposeRelocationElement(ar, xffEp)));
+        XffProfEnd(ldr, XFF_PHASE_DISPOSE, t, xffEp->relocTabNrE / 2, 0);
+    }
+
+    ret = XffAddModule(ldr, name, fileAddr, hdr->rawSize, modOut);
+    if (ret != XFF_OK)
+        return ret;
+
+    // Moved sections were inflated in place, nothing was copied
+    (*modOut)->sectCopied = 0;
+    (*modOut)->bytesCopied = 0;
+    return XFF_OK;
+}
+
+// XffLoadImage() for a packed container. XFF_EXT_PRELINK is not looked at. The profiler's
+// read phase is the inflation of the file image, decode that of the section blocks. A load
+// that fails gives its file image back.
+s32 XffLoadPacked(struct XffLoader *ldr, const char *name, const void *data, u32 size, struct XffModule **modOut)
+{
+    const struct XffPackHdr *hdr = GetHdr(data, size);
+    struct XffModule *mod;
+    u32 fileAddr;
+    s32 ret;
+
+    if (hdr == NULL || hdr->rawSize < sizeof(struct t_xffEntPntHdr))
+        return XFF_ERR_FORMAT;
+
+    fileAddr = XffAllocImage(ldr, name, hdr->rawSize);
+    if (fileAddr == 0)
+        return XFF_ERR_NOMEM;
+
+    ret = LoadPackedImage(ldr, name, hdr, data, size, fileAddr, &mod);
+    if (ret != XFF_OK)
+    {
+        XffFreeImage(ldr, fileAddr);
+        return ret;
+    }
+
+    if (modOut != NULL)
+        *modOut = mod;
+    return XFF_OK;
+}
@@ -0,0 +1,172 @@
+/*
+xffpackbench: packed against raw XFF loads at disc speed.
+
+Usage: xffpackbench [-B bytesPerSec] [-n iterations] file.xff...
+
+Every file is packed in memory, then both versions are loaded in order 'iterations'
+times. A load costs the transfer of its file at 'bytesPerSec' (default 3.6 MB/s, a 24x
+CD-ROM) plus the measured loader time, which includes decompression for the packed
+files. Both loads must give the same heap layout and the same section contents.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libxff.h"
+
+struct BenchFile
+{
+    const char *path;
+    void *data;
+    u32 size;
+    u8 *packed;
+    u32 packedSize;
+};
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    struct XffLoader raw;
+    struct XffLoader packed;
+    struct BenchFile *files;
+    struct XffModule *a;
+    struct XffModule *b;
+    struct t_xffSectEnt *sect;
+    double bytesPerSec = 3.6e6;
+    s32 iterations = 20;
+    s32 fileNrE;
+    s32 opt;
+    s32 it;
+    s32 i;
+    u64 rawBytes = 0;
+    u64 packedBytes = 0;
+    double t0;
+    double rawSec = 0;
+    double packedSec = 0;
+    double rawIo;
+    double packedIo;
+
+    while ((opt = getopt(argc, argv, "B:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'B':
+            bytesPerSec = strtod(optarg, NULL);
+            break;
+        case 'n':
+            iterations = strtol(optarg, NULL, 0);
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+
+    fileNrE = argc - optind;
+    if (fileNrE <= 0 || iterations <= 0 || bytesPerSec <= 0)
+    {
+        fprintf(stderr, "usage: %s [-B bytesPerSec] [-n iterations] file.xff...\n", argv[0]);
+        return 1;
+    }
+
+    files = calloc(fileNrE, sizeof(*files));
+    for (i = 0; i < fileNrE; i++)
+    {
+        files[i].path = argv[optind + i];
+        files[i].data = XffMapFile(files[i].path, &files[i].size);
+        if (files[i].data == NULL || XffPack(files[i].data, files[i].size, &files[i].packed, &files[i].packedSize) != XFF_OK)
+        {
+            fprintf(stderr, "xffpackbench: can't pack %s\n", files[i].path);
+            return 1;
+        }
+        rawBytes += files[i].size;
+        packedBytes += files[i].packedSize;
+    }
+
+    if (XffLoaderInit(&raw, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK ||
+        XffLoaderInit(&packed, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK)
+    {
+        fprintf(stderr, "xffpackbench: can't create arena\n");
+        return 1;
+    }
+    raw.noPrelink = 1;
+
+    for (it = 0; it < iterations; it++)
+    {
+        XffLoaderReset(&raw);
+        XffLoaderReset(&packed);
+
+        for (i = 0; i < fileNrE; i++)
+        {
+            t0 = NowSec();
+            if (XffLoadImage(&raw, files[i].path, files[i].data, files[i].size, NULL) != XFF_OK)
+            {
+                fprintf(stderr, "xffpackbench: %s: load failed\n", files[i].path);
+                return 1;
+            }
+            rawSec += NowSec() - t0;
+
+            t0 = NowSec();
+            if (XffLoadImage(&packed, files[i].path, files[i].packed, files[i].packedSize, NULL) != XFF_OK)
+            {
+                fprintf(stderr, "xffpackbench: %s: packed load failed\n", files[i].path);
+                return 1;
+            }
+            packedSec += NowSec() - t0;
+        }
+
+        if (raw.arena.heapPt != packed.arena.heapPt)
+        {
+            fprintf(stderr, "xffpackbench: heap layouts differ\n");
+            return 1;
+        }
+    }
+
+    // Only the section contents have to match, moved sections leave their file copy unset
+    for (a = raw.modules, b = packed.modules; a != NULL && b != NULL; a = a->next, b = b->next)
+    {
+        sect = XffPtr(&raw.arena, a->xffEp->sectTab);
+        for (i = 1; i < a->xffEp->sectNrE; i++)
+        {
+            if (sect[i].memPt != 0 && memcmp(XffPtr(&raw.arena, sect[i].memPt), XffPtr(&packed.arena, sect[i].memPt), sect[i].size) != 0)
+            {
+                fprintf(stderr, "xffpackbench: %s: section %d differs\n", a->name, i);
+                return 1;
+            }
+        }
+    }
+
+    rawIo = rawBytes / bytesPerSec;
+    packedIo = packedBytes / bytesPerSec;
+    rawSec /= iterations;
+    packedSec /= iterations;
+
+    printf("files           : %d, %llu -> %llu bytes (%.1f%%)\n", fileNrE, (unsigned long long)rawBytes, (unsigned long long)packedBytes,
+           packedBytes * 100.0 / rawBytes);
+    printf("disc            : %.2f MB/s\n", bytesPerSec * 1e-6);
+    printf("raw             : %.3f ms (read %.3f + load %.3f)\n", (rawIo + rawSec) * 1e3, rawIo * 1e3, rawSec * 1e3);
+    printf("packed          : %.3f ms (read %.3f + load and inflate %.3f)\n", (packedIo + packedSec) * 1e3, packedIo * 1e3, packedSec * 1e3);
+    printf("inflate         : %.1f MB/s\n", packed.stats.bytesInflated / (packedSec * iterations) * 1e-6);
+    printf("bytes copied    : raw %llu, packed %llu per iteration\n", (unsigned long long)(raw.stats.bytesCopied / iterations),
+           (unsigned long long)(packed.stats.bytesCopied / iterations));
+
+    XffLoaderTerm(&raw);
+    XffLoaderTerm(&packed);
+    for (i = 0; i < fileNrE; i++)
+    {
+        XffUnmapFile(files[i].data, files[i].size);
+        free(files[i].packed);
+    }
+    free(files);
+    return 0;
+}
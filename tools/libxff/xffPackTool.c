@@ -0,0 +1,90 @@
+/*
+xffpack: packs XFF files into compressed containers and back.
+
+Usage: xffpack [-d] -o out in
+
+Without -d 'in' is packed, with -d a container is unpacked to the original file.
+The loader takes packed files as they are, see XffLoadPacked().
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "libxff.h"
+
+static s32 WriteFile(const char *path, const void *data, u32 size)
+{
+    FILE *f = fopen(path, "wb");
+
+    if (f == NULL)
+        return XFF_ERR_IO;
+
+    if (fwrite(data, 1, size, f) != size)
+    {
+        fclose(f);
+        return XFF_ERR_IO;
+    }
+
+    return fclose(f) == 0 ? XFF_OK : XFF_ERR_IO;
+}
+
+int main(int argc, char **argv)
+{
+    const char *outPath = NULL;
+    s32 unpack = 0;
+    void *data;
+    u8 *out;
+    u32 size;
+    u32 outSize;
+    s32 opt;
+    s32 ret;
+
+    while ((opt = getopt(argc, argv, "do:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            unpack = 1;
+            break;
+        case 'o':
+            outPath = optarg;
+            break;
+        default:
+            outPath = NULL;
+            optind = argc;
+            break;
+        }
+    }
+
+    if (outPath == NULL || optind != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [-d] -o out in\n", argv[0]);
+        return 1;
+    }
+
+    data = XffMapFile(argv[optind], &size);
+    if (data == NULL)
+    {
+        fprintf(stderr, "xffpack: can't map %s\n", argv[optind]);
+        return 1;
+    }
+
+    ret = unpack ? XffUnpack(data, size, &out, &outSize) : XffPack(data, size, &out, &outSize);
+    XffUnmapFile(data, size);
+    if (ret != XFF_OK)
+    {
+        fprintf(stderr, "xffpack: %s: %s failed (%d)\n", argv[optind], unpack ? "unpack" : "pack", ret);
+        return 1;
+    }
+
+    if (WriteFile(outPath, out, outSize) != XFF_OK)
+    {
+        fprintf(stderr, "xffpack: can't write %s\n", outPath);
+        return 1;
+    }
+
+    printf("%s: %u -> %u bytes (%.1f%%)\n", outPath, size, outSize, outSize * 100.0 / size);
+    free(out);
+    return 0;
+}
@@ -0,0 +1,355 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "libxff.h"
+
+/*
+Prefetch of the module a running program will load next.
+
+execProgWithThread() reads a module only once it is asked for, so the whole transfer
+sits in the load. A program that knows what comes next calls XffPrefetchHint() while it
+runs; a thread below its priority fetches the file into one of two staging buffers and,
+with 'decode', inflates a packed container and adds a relocation plan (xffRelPlan.c)
+when the image has none, so the load is left with the copy into the heap and a planned
+relocation. XffPrefetchLoad() then takes the staged image, waits for the thread when it
+is still on that very file, and reads the file itself otherwise.
+
+The two buffers let the thread stage the next hint while the last staged image is still
+there for a load: an image only goes once a newer one is complete. The thread never
+touches the loader, loads run on the caller's thread as before. Only the latest hint is
+kept, a fetch under way is not cancelled.
+*/
+
+struct Stage
+{
+    u8 *buf;
+    u32 size;
+    u64 ns; // the thread spent fetching and decoding it
+    s32 used;
+    char name[XFF_PREFETCH_NAME_MAX];
+};
+
+struct XffPrefetch
+{
+    struct XffLoader *ldr;
+    XffFetchFunc fetch;
+    void *ctx;
+    u32 stageSize;
+    s32 decode;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake; // a hint came in or we quit
+    pthread_cond_t done; // a fetch finished or a load let go of its stage
+    struct Stage stage[2];
+    s32 ready;   // stage with the newest complete image, -1 = none
+    s32 filling; // stage the thread is filling, -1 = idle
+    s32 inUse;   // stage a load is reading from, -1 = none
+    s32 hasHint;
+    char hint[XFF_PREFETCH_NAME_MAX];
+    s32 quit;
+    struct XffPrefetchStats stats;
+};
+
+// Reads a host file, the default XffFetchFunc
+s32 XffFetchFile(void *ctx, const char *name, void *buf, u32 cap, u32 *sizeOut)
+{
+    FILE *f = fopen(name, "rb");
+    long size;
+
+    (void)ctx;
+    if (f == NULL)
+        return XFF_ERR_NOENT;
+
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) <= 0 || size > 0x7FFFFFFF || fseek(f, 0, SEEK_SET) != 0)
+    {
+        fclose(f);
+        return XFF_ERR_IO;
+    }
+
+    *sizeOut = size;
+    if ((u32)size > cap)
+    {
+        fclose(f);
+        return XFF_ERR_FULL;
+    }
+
+    if (fread(buf, 1, size, f) != (size_t)size)
+    {
+        fclose(f);
+        return XFF_ERR_IO;
+    }
+
+    fclose(f);
+    return XFF_OK;
+}
+
+// Inflates a packed image and gives it a relocation plan, in place when the result fits.
+// The raw file stays when it doesn't, XffLoadImage() takes either.
+static void Decode(struct XffPrefetch *pf, struct Stage *st)
+{
+    u8 *img;
+    u32 imgSize;
+
+    if (XffPackIsPacked(st->buf, st->size))
+    {
+        if (XffUnpack(st->buf, st->size, &img, &imgSize) != XFF_OK)
+            return;
+    }
+    else
+    {
+        img = malloc(st->size);
+        if (img == NULL)
+            return;
+        memcpy(img, st->buf, st->size);
+        imgSize = st->size;
+    }
+
+    if (XffExtFind(img, imgSize, XFF_EXT_RELPLAN, NULL) == NULL)
+        img = XffRelPlanAttach(img, &imgSize);
+
+    if (imgSize <= pf->stageSize)
+    {
+        memcpy(st->buf, img, imgSize);
+        st->size = imgSize;
+    }
+    free(img);
+}
+
+static void *Worker(void *arg)
+{
+    struct XffPrefetch *pf = arg;
+    struct Stage *st;
+    s32 f;
+    s32 ret;
+    u64 t;
+
+    // Below the program it prefetches for; a thread priority under the caller's on the EE
+    setpriority(PRIO_PROCESS, 0, 19);
+
+    pthread_mutex_lock(&pf->lock);
+    while (1)
+    {
+        while (!pf->quit && !pf->hasHint)
+            pthread_cond_wait(&pf->wake, &pf->lock);
+        if (pf->quit)
+            break;
+
+        // The stage that doesn't hold the newest image, once no load reads from it
+        f = pf->ready == 0;
+        while (!pf->quit && pf->inUse == f)
+            pthread_cond_wait(&pf->done, &pf->lock);
+        if (pf->quit)
+            break;
+
+        st = &pf->stage[f];
+        strcpy(st->name, pf->hint);
+        pf->hasHint = 0;
+        pf->filling = f;
+        pthread_mutex_unlock(&pf->lock);
+
+        t = XffProfNow();
+        ret = pf->fetch(pf->ctx, st->name, st->buf, pf->stageSize, &st->size);
+        if (ret == XFF_OK && pf->decode)
+            Decode(pf, st);
+        st->ns = XffProfNow() - t;
+
+        pthread_mutex_lock(&pf->lock);
+        pf->filling = -1;
+        if (ret == XFF_OK)
+        {
+            if (pf->ready >= 0 && !pf->stage[pf->ready].used)
+                pf->stats.dropped++;
+            st->used = 0;
+            pf->ready = f;
+            pf->stats.staged++;
+            pf->stats.bytesStaged += st->size;
+        }
+        else
+        {
+            pf->stats.failed++;
+        }
+        pthread_cond_broadcast(&pf->done);
+    }
+    pthread_mutex_unlock(&pf->lock);
+    return NULL;
+}
+
+// Creates a prefetcher for 'ldr' with two staging buffers of 'stageSize' bytes. 'fetch'
+// reads a whole file, NULL = XffFetchFile(). Returns NULL without memory or thread.
+struct XffPrefetch *XffPrefetchCreate(struct XffLoader *ldr, u32 stageSize, s32 decode, XffFetchFunc fetch, void *ctx)
+{
+    struct XffPrefetch *pf;
+
+    pf = calloc(1, sizeof(*pf));
+    if (pf == NULL)
+        return NULL;
+
+    pf->stage[0].buf = malloc(stageSize);
+    pf->stage[1].buf = malloc(stageSize);
+    if (pf->stage[0].buf == NULL || pf->stage[1].buf == NULL)
+    {
+        free(pf->stage[0].buf);
+        free(pf->stage[1].buf);
+        free(pf);
+        return NULL;
+    }
+
+    pf->ldr = ldr;
+    pf->fetch = fetch != NULL ? fetch : XffFetchFile;
+    pf->ctx = ctx;
+    pf->stageSize = stageSize;
+    pf->decode = decode;
+    pf->ready = -1;
+    pf->filling = -1;
+    pf->inUse = -1;
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->wake, NULL);
+    pthread_cond_init(&pf->done, NULL);
+
+    if (pthread_create(&pf->thread, NULL, Worker, pf) != 0)
+    {
+        pthread_mutex_destroy(&pf->lock);
+        pthread_cond_destroy(&pf->wake);
+        pthread_cond_destroy(&pf->done);
+        free(pf->stage[0].buf);
+        free(pf->stage[1].buf);
+        free(pf);
+        return NULL;
+    }
+
+    return pf;
+}
+
+// Stops the thread once its current fetch is done
+void XffPrefetchDestroy(struct XffPrefetch *pf)
+{
+    if (pf == NULL)
+        return;
+
+    pthread_mutex_lock(&pf->lock);
+    pf->quit = 1;
+    pthread_cond_broadcast(&pf->wake);
+    pthread_cond_broadcast(&pf->done);
+    pthread_mutex_unlock(&pf->lock);
+    pthread_join(pf->thread, NULL);
+
+    pthread_mutex_destroy(&pf->lock);
+    pthread_cond_destroy(&pf->wake);
+    pthread_cond_destroy(&pf->done);
+    free(pf->stage[0].buf);
+    free(pf->stage[1].buf);
+    free(pf);
+}
+
+// The module 'name' will be loaded next. Replaces a hint the thread hasn't started on;
+// nothing happens when the newest staged image or the fetch under way is that file.
+void XffPrefetchHint(struct XffPrefetch *pf, const char *name)
+{
+    if (strlen(name) >= XFF_PREFETCH_NAME_MAX)
+        return;
+
+    pthread_mutex_lock(&pf->lock);
+    pf->stats.hints++;
+    if ((pf->filling >= 0 && strcmp(pf->stage[pf->filling].name, name) == 0) ||
+        (pf->filling < 0 && pf->ready >= 0 && strcmp(pf->stage[pf->ready].name, name) == 0))
+    {
+        pf->hasHint = 0;
+    }
+    else
+    {
+        strcpy(pf->hint, name);
+        pf->hasHint = 1;
+        pthread_cond_signal(&pf->wake);
+    }
+    pthread_mutex_unlock(&pf->lock);
+}
+
+// Whether the thread has 'name' queued or under way
+static s32 Pending(const struct XffPrefetch *pf, const char *name)
+{
+    return (pf->hasHint && strcmp(pf->hint, name) == 0) || (pf->filling >= 0 && strcmp(pf->stage[pf->filling].name, name) == 0);
+}
+
+// Reads a file the thread doesn't have
+static s32 LoadMiss(struct XffPrefetch *pf, const char *name, struct XffModule **modOut)
+{
+    u8 *buf;
+    u8 *more;
+    u32 size;
+    s32 ret;
+
+    buf = malloc(pf->stageSize);
+    if (buf == NULL)
+        return XFF_ERR_NOMEM;
+
+    ret = pf->fetch(pf->ctx, name, buf, pf->stageSize, &size);
+    if (ret == XFF_ERR_FULL)
+    {
+        more = realloc(buf, size);
+        if (more == NULL)
+        {
+            free(buf);
+            return XFF_ERR_NOMEM;
+        }
+        buf = more;
+        ret = pf->fetch(pf->ctx, name, buf, size, &size);
+    }
+    if (ret == XFF_OK)
+        ret = XffLoadImage(pf->ldr, name, buf, size, modOut);
+
+    free(buf);
+    return ret;
+}
+
+// XffLoadImage() of the file 'name', from its staged image when there is one
+s32 XffPrefetchLoad(struct XffPrefetch *pf, const char *name, struct XffModule **modOut)
+{
+    struct Stage *st;
+    s32 late = 0;
+    s32 ret;
+    u64 t;
+
+    pthread_mutex_lock(&pf->lock);
+    if (Pending(pf, name))
+    {
+        late = 1;
+        t = XffProfNow();
+        while (Pending(pf, name))
+            pthread_cond_wait(&pf->done, &pf->lock);
+        pf->stats.waitNs += XffProfNow() - t;
+    }
+
+    if (pf->ready < 0 || strcmp(pf->stage[pf->ready].name, name) != 0)
+    {
+        pf->stats.misses++;
+        pthread_mutex_unlock(&pf->lock);
+        return LoadMiss(pf, name, modOut);
+    }
+
+    st = &pf->stage[pf->ready];
+    pf->inUse = pf->ready;
+    pf->stats.hits++;
+    pf->stats.lateHits += late;
+    pf->stats.stageNs += st->ns;
+    st->used = 1;
+    pthread_mutex_unlock(&pf->lock);
+
+    ret = XffLoadImage(pf->ldr, name, st->buf, st->size, modOut);
+
+    pthread_mutex_lock(&pf->lock);
+    pf->inUse = -1;
+    pthread_cond_broadcast(&pf->done);
+    pthread_mutex_unlock(&pf->lock);
+    return ret;
+}
+
+void XffPrefetchGetStats(struct XffPrefetch *pf, struct XffPrefetchStats *st)
+{
+    pthread_mutex_lock(&pf->lock);
+    *st = pf->stats;
+    pthread_mutex_unlock(&pf->lock);
+}
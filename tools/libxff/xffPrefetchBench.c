@@ -0,0 +1,324 @@
+/*
+xffprefetchbench: module loads with and without prefetching the next one.
+
+Usage: xffprefetchbench [-s stages] [-r relocs] [-g gameMs] [-u busyPercent] [-B bytesPerSec] [-m missEvery] [-d] [-z]
+                        [file.xff...]
+
+A game goes through its stages in order: the files given, or 'stages' generated modules
+(xffGen.c, 'relocs' relocation entries each, default 4 and 60000). It loads a stage, runs
+it for 'gameMs' milliseconds (default 300) and loads the next. Running is frames of 1/60 s,
+the main thread busy for 'busyPercent' of each (default 75) and waiting for the vblank
+for the rest; that wait is all the prefetch thread gets on a single core, as on the EE.
+The files come from a disc modelled at 'bytesPerSec' (default 3.6 MB/s, a 24x CD-ROM):
+a fetch sleeps for the transfer. The game is played twice, once loading every stage
+when it is asked for and once hinting the next stage as soon as the current one runs
+(XffPrefetchHint()); every 'missEvery'-th hint names the wrong stage (default 0 = never).
+-d has the prefetch thread decode the images, -z packs them on the disc. The load
+latency of every stage is printed for both, with the prefetch statistics, and both
+heaps must end up with the same sections.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xffBuild.h"
+
+struct Disc
+{
+    char (*names)[32];
+    u8 **data;
+    u32 *size;
+    u32 nrE;
+    double bytesPerSec;
+};
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void SleepSec(double sec)
+{
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)sec;
+    ts.tv_nsec = (long)((sec - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+}
+
+// XffFetchFunc for the disc, the transfer takes its modelled time
+static s32 Fetch(void *ctx, const char *name, void *buf, u32 cap, u32 *sizeOut)
+{
+    struct Disc *d = ctx;
+    u32 i;
+
+    for (i = 0; i < d->nrE && strcmp(d->names[i], name) != 0; i++)
+        ;
+    if (i == d->nrE)
+        return XFF_ERR_NOENT;
+
+    *sizeOut = d->size[i];
+    if (d->size[i] > cap)
+        return XFF_ERR_FULL;
+
+    SleepSec(d->size[i] / d->bytesPerSec);
+    memcpy(buf, d->data[i], d->size[i]);
+    return XFF_OK;
+}
+
+// The game running its stage: frames busy for 'busy' of their time, then the vblank wait
+static void Run(double sec, double busy)
+{
+    double end = NowSec() + sec;
+    double frame;
+
+    while ((frame = NowSec()) < end)
+    {
+        while (NowSec() < frame + busy / 60)
+            ;
+        SleepSec(frame + 1.0 / 60 - NowSec());
+    }
+}
+
+// Plays every stage once, hinting the next one when 'hint' is set. lat[] gets the load
+// latency of every stage.
+static s32 Play(struct XffPrefetch *pf, const struct Disc *d, double gameSec, double busy, s32 hint, u32 missEvery, double *lat)
+{
+    struct XffModule *mod;
+    double t0;
+    u32 next;
+    u32 i;
+
+    for (i = 0; i < d->nrE; i++)
+    {
+        t0 = NowSec();
+        if (XffPrefetchLoad(pf, d->names[i], &mod) != XFF_OK)
+            return XFF_ERR_FORMAT;
+        lat[i] = NowSec() - t0;
+
+        if (hint && i + 1 < d->nrE)
+        {
+            next = i + 1;
+            if (missEvery != 0 && (i + 1) % missEvery == 0)
+                next = (i + 2) % d->nrE;
+            XffPrefetchHint(pf, d->names[next]);
+        }
+        Run(gameSec, busy);
+    }
+    return XFF_OK;
+}
+
+// Whether both loaders hold the same modules with the same sections at the same places
+static s32 SameSections(const struct XffLoader *a, const struct XffLoader *b, u32 *checked)
+{
+    const struct XffModule *ma;
+    const struct XffModule *mb;
+    const struct t_xffSectEnt *sa;
+    const struct t_xffSectEnt *sb;
+    s32 k;
+
+    for (ma = a->modules, mb = b->modules; ma != NULL && mb != NULL; ma = ma->next, mb = mb->next)
+    {
+        if (ma->xffEp->sectNrE != mb->xffEp->sectNrE)
+            return 0;
+        sa = XffPtr(&a->arena, ma->xffEp->sectTab);
+        sb = XffPtr(&b->arena, mb->xffEp->sectTab);
+        for (k = 1; k < ma->xffEp->sectNrE; k++)
+        {
+            if (sa[k].memPt != sb[k].memPt || sa[k].size != sb[k].size)
+                return 0;
+            if (sa[k].type == XFF_SECT_NOBITS || sa[k].size == 0)
+                continue;
+            if (memcmp(XffPtr(&a->arena, sa[k].memPt), XffPtr(&b->arena, sb[k].memPt), sa[k].size) != 0)
+                return 0;
+            *checked += sa[k].size;
+        }
+    }
+    return ma == NULL && mb == NULL;
+}
+
+int main(int argc, char **argv)
+{
+    struct XffGenParams p;
+    struct XffPrefetchStats st;
+    struct XffLoader syncLdr;
+    struct XffLoader pfLdr;
+    struct XffPrefetch *syncPf;
+    struct XffPrefetch *pf;
+    struct Disc d;
+    const char *base;
+    void *data;
+    u8 *packed;
+    u32 packedSize;
+    u32 stageSize = 0;
+    u32 relocNrE = 60000;
+    u32 missEvery = 0;
+    u32 checked = 0;
+    u32 i;
+    s32 stageNrE = 4;
+    s32 decode = 0;
+    s32 pack = 0;
+    s32 opt;
+    s32 bad = 0;
+    double gameMs = 300;
+    double busyPercent = 75;
+    double *latSync;
+    double *latPf;
+    double totSync = 0;
+    double totPf = 0;
+
+    d.bytesPerSec = 3.6e6;
+    while ((opt = getopt(argc, argv, "s:r:g:u:B:m:dz")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            stageNrE = strtol(optarg, NULL, 0);
+            break;
+        case 'r':
+            relocNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'g':
+            gameMs = strtod(optarg, NULL);
+            break;
+        case 'u':
+            busyPercent = strtod(optarg, NULL);
+            break;
+        case 'B':
+            d.bytesPerSec = strtod(optarg, NULL);
+            break;
+        case 'm':
+            missEvery = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            decode = 1;
+            break;
+        case 'z':
+            pack = 1;
+            break;
+        default:
+            bad = 1;
+            break;
+        }
+    }
+
+    if (bad || stageNrE < 1 || gameMs < 0 || busyPercent < 0 || busyPercent > 100 || d.bytesPerSec <= 0)
+    {
+        fprintf(stderr,
+                "usage: %s [-s stages] [-r relocs] [-g gameMs] [-u busyPercent] [-B bytesPerSec] [-m missEvery] [-d] [-z]\n"
+                "       [file.xff...]\n",
+                argv[0]);
+        return 1;
+    }
+
+    d.nrE = optind < argc ? (u32)(argc - optind) : (u32)stageNrE;
+    d.names = calloc(d.nrE, sizeof(*d.names));
+    d.data = calloc(d.nrE, sizeof(*d.data));
+    d.size = calloc(d.nrE, sizeof(*d.size));
+    latSync = calloc(d.nrE, sizeof(*latSync));
+    latPf = calloc(d.nrE, sizeof(*latPf));
+    if (d.names == NULL || d.data == NULL || d.size == NULL || latSync == NULL || latPf == NULL)
+    {
+        fprintf(stderr, "xffprefetchbench: out of memory\n");
+        return 1;
+    }
+
+    for (i = 0; i < d.nrE; i++)
+    {
+        if (optind < argc)
+        {
+            data = XffMapFile(argv[optind + i], &d.size[i]);
+            d.data[i] = data != NULL ? malloc(d.size[i]) : NULL;
+            if (d.data[i] == NULL)
+            {
+                fprintf(stderr, "xffprefetchbench: can't read %s\n", argv[optind + i]);
+                return 1;
+            }
+            memcpy(d.data[i], data, d.size[i]);
+            XffUnmapFile(data, d.size[i]);
+            base = strrchr(argv[optind + i], '/');
+            snprintf(d.names[i], sizeof(d.names[i]), "%s", base != NULL ? base + 1 : argv[optind + i]);
+        }
+        else
+        {
+            XffGenDefaults(&p);
+            p.seed = i + 1;
+            p.relocNrE = relocNrE;
+            p.importNrE = 0;
+            p.exportPrefix = "stage_";
+            snprintf(d.names[i], sizeof(d.names[i]), "STAGE%u.XFF", i);
+            if (XffGenerate(&p, &d.data[i], &d.size[i]) != XFF_OK)
+            {
+                fprintf(stderr, "xffprefetchbench: can't generate %s\n", d.names[i]);
+                return 1;
+            }
+        }
+
+        if (pack && XffPack(d.data[i], d.size[i], &packed, &packedSize) == XFF_OK)
+        {
+            free(d.data[i]);
+            d.data[i] = packed;
+            d.size[i] = packedSize;
+        }
+    }
+
+    // Staging buffers take the largest image, decoded ones included
+    for (i = 0; i < d.nrE; i++)
+        stageSize = d.size[i] > stageSize ? d.size[i] : stageSize;
+    stageSize = pack || decode ? stageSize * 4 : stageSize;
+
+    if (XffLoaderInit(&syncLdr, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK ||
+        XffLoaderInit(&pfLdr, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK ||
+        (syncPf = XffPrefetchCreate(&syncLdr, stageSize, 0, Fetch, &d)) == NULL ||
+        (pf = XffPrefetchCreate(&pfLdr, stageSize, decode, Fetch, &d)) == NULL)
+    {
+        fprintf(stderr, "xffprefetchbench: out of memory\n");
+        return 1;
+    }
+
+    if (Play(syncPf, &d, gameMs * 1e-3, busyPercent / 100, 0, 0, latSync) != XFF_OK ||
+        Play(pf, &d, gameMs * 1e-3, busyPercent / 100, 1, missEvery, latPf) != XFF_OK)
+    {
+        fprintf(stderr, "xffprefetchbench: load failed\n");
+        return 1;
+    }
+    XffPrefetchGetStats(pf, &st);
+
+    printf("%u stages, %.0f ms each, %.0f%% busy, disc %.1f MB/s%s%s\n", d.nrE, gameMs, busyPercent, d.bytesPerSec / 1e6,
+           pack ? ", packed" : "", decode ? ", decoded by the thread" : "");
+    for (i = 0; i < d.nrE; i++)
+    {
+        printf("%-12s: %8u bytes, load %8.3f ms on demand, %8.3f ms prefetched\n", d.names[i], d.size[i], latSync[i] * 1e3,
+               latPf[i] * 1e3);
+        totSync += latSync[i];
+        totPf += latPf[i];
+    }
+    printf("total       : %8.3f ms on demand, %8.3f ms prefetched, %.3f ms saved\n", totSync * 1e3, totPf * 1e3,
+           (totSync - totPf) * 1e3);
+    printf("prefetch    : %u hints, %u staged (%llu bytes), %u hits (%u late), %u misses, %u dropped, %u failed\n", st.hints,
+           st.staged, (unsigned long long)st.bytesStaged, st.hits, st.lateHits, st.misses, st.dropped, st.failed);
+    printf("hits        : %.3f ms of staging, %.3f ms of it waited for, %.3f ms hidden\n", st.stageNs * 1e-6,
+           st.waitNs * 1e-6, (double)(s64)(st.stageNs - st.waitNs) * 1e-6);
+
+    bad = !SameSections(&syncLdr, &pfLdr, &checked);
+    printf("check       : %u section bytes, %s\n", checked, bad ? "DIFFER" : "same");
+
+    XffPrefetchDestroy(syncPf);
+    XffPrefetchDestroy(pf);
+    XffLoaderTerm(&syncLdr);
+    XffLoaderTerm(&pfLdr);
+    for (i = 0; i < d.nrE; i++)
+        free(d.data[i]);
+    free(d.names);
+    free(d.data);
+    free(d.size);
+    free(latSync);
+    free(latPf);
+    return bad;
+}
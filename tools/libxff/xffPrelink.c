@@ -0,0 +1,188 @@
+/*
+xffprelink: relocate a chain of XFF modules ahead of time.
+
+Usage: xffprelink [-b heapBase] -o outDir file.xff...
+
+The files are loaded in order from heapBase, the way loaderLoop() loads the STARTUP.XFF
+chain after SetHeapStartPoint(D_0013A110). Each output keeps the original image with
+its sections already relocated for that layout, the resolved imports in symTab[].addr
+and an XFF_EXT_PRELINK block recording the layout. The relocation tables stay, so a
+load at any other address falls back to normal relocation.
+*/
+
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libxff.h"
+
+static s32 WriteFile(const char *path, const void *data, u32 size)
+{
+    FILE *f = fopen(path, "wb");
+
+    if (f == NULL)
+        return XFF_ERR_IO;
+
+    if (fwrite(data, 1, size, f) != size)
+    {
+        fclose(f);
+        return XFF_ERR_IO;
+    }
+
+    return fclose(f) == 0 ? XFF_OK : XFF_ERR_IO;
+}
+
+// Returns the prelinked image, NULL without memory
+static u8 *Prelink(const struct XffArena *ar, const struct XffModule *mod, const u8 *src, u32 srcSize, u32 *sizeOut)
+{
+    const struct t_xffEntPntHdr *xffEp = mod->xffEp;
+    const struct t_xffSectEnt *sect = XffPtr(ar, xffEp->sectTab);
+    const struct t_xffImpSymIxs *imp = XffPtr(ar, xffEp->impSymIxs);
+    const struct t_xffSymEnt *symTab = XffPtr(ar, xffEp->symTab);
+    struct XffPrelinkInfo *info;
+    struct t_xffSymEnt *outSym;
+    const void *hash;
+    u32 hashSize;
+    u32 infoSize;
+    u32 size = mod->fileSize;
+    u8 *out;
+    u8 *ext;
+    s32 i;
+
+    out = malloc(size);
+    if (out == NULL)
+        return NULL;
+    memcpy(out, src, size);
+
+    // Relocated section contents go back to where DecodeSection() takes them from
+    for (i = 1; i < xffEp->sectNrE; i++)
+    {
+        if (sect[i].type != XFF_SECT_NOBITS && sect[i].size != 0 && sect[i].memPt != 0)
+            memcpy(out + sect[i].offs_Rel, XffPtr(ar, sect[i].memPt), sect[i].size);
+    }
+
+    outSym = (struct t_xffSymEnt *)(out + xffEp->symTab_Rel);
+    for (i = 0; i < xffEp->impSymIxsNrE; i++)
+    {
+        outSym[imp[i].stIx].addr = symTab[imp[i].stIx].addr;
+    }
+
+    infoSize = sizeof(*info) + xffEp->sectNrE * sizeof(info->memPt[0]);
+    info = malloc(infoSize);
+    if (info == NULL)
+    {
+        free(out);
+        return NULL;
+    }
+    info->base = mod->fileAddr;
+    info->sectNrE = xffEp->sectNrE;
+    for (i = 0; i < xffEp->sectNrE; i++)
+    {
+        info->memPt[i] = sect[i].memPt;
+    }
+
+    ext = XffExtSet(out, &size, XFF_EXT_PRELINK, info, infoSize);
+    free(info);
+
+    // The layout was taken with the hash block in the heap, it has to come along
+    hash = XffExtFind(src, srcSize, XFF_EXT_HASH, &hashSize);
+    if (ext != NULL && hash != NULL)
+    {
+        out = ext;
+        ext = XffExtSet(out, &size, XFF_EXT_HASH, hash, hashSize);
+    }
+    if (ext == NULL)
+    {
+        free(out);
+        return NULL;
+    }
+    out = ext;
+
+    *sizeOut = size;
+    return out;
+}
+
+int main(int argc, char **argv)
+{
+    struct XffLoader ldr;
+    struct XffModule *mod;
+    const char *outDir = NULL;
+    u32 heapBase = XFF_ARENA_DEFAULT_BASE;
+    char name[1024];
+    char path[1024];
+    void *data;
+    u8 *out;
+    u32 size;
+    u32 outSize;
+    s32 opt;
+    s32 ret;
+    s32 i;
+
+    while ((opt = getopt(argc, argv, "b:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+            heapBase = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            outDir = optarg;
+            break;
+        default:
+            outDir = NULL;
+            optind = argc;
+            break;
+        }
+    }
+
+    if (outDir == NULL || optind >= argc)
+    {
+        fprintf(stderr, "usage: %s [-b heapBase] -o outDir file.xff...\n", argv[0]);
+        return 1;
+    }
+
+    if (XffLoaderInit(&ldr, heapBase, XFF_ARENA_DEFAULT_SIZE) != XFF_OK)
+        return 1;
+    ldr.noPrelink = 1;
+
+    for (i = optind; i < argc; i++)
+    {
+        data = XffMapFile(argv[i], &size);
+        if (data == NULL)
+        {
+            fprintf(stderr, "xffprelink: can't map %s\n", argv[i]);
+            return 1;
+        }
+
+        ret = XffLoadImage(&ldr, argv[i], data, size, &mod);
+        if (ret != XFF_OK)
+        {
+            fprintf(stderr, "xffprelink: %s: load failed (%d)\n", argv[i], ret);
+            return 1;
+        }
+
+        out = Prelink(&ldr.arena, mod, data, size, &outSize);
+        XffUnmapFile(data, size);
+        if (out == NULL)
+        {
+            fprintf(stderr, "xffprelink: %s: out of memory\n", argv[i]);
+            return 1;
+        }
+
+        snprintf(name, sizeof(name), "%s", argv[i]);
+        snprintf(path, sizeof(path), "%s/%s", outDir, basename(name));
+
+        if (WriteFile(path, out, outSize) != XFF_OK)
+        {
+            fprintf(stderr, "xffprelink: can't write %s\n", path);
+            return 1;
+        }
+        printf("%s: prelinked at 0x%08x, %d sections\n", path, mod->fileAddr, mod->xffEp->sectNrE);
+        free(out);
+    }
+
+    XffLoaderTerm(&ldr);
+    return 0;
+}
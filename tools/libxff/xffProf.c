@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libxff.h"
+
+/*
+Loader phase profiler.
+
+Every phase of a module load appends one fixed size XffProfEvent to a ring buffer; once
+the ring is full the oldest events are overwritten, so a profiler can stay attached for
+any number of boots at a fixed memory cost. Recording is a clock read and a struct copy,
+nothing is formatted until XffProfWriteTrace() turns the ring into Chrome trace_event
+JSON (chrome://tracing, Perfetto): one process per boot, one complete ("X") event per
+phase with the module name and the counts as arguments.
+*/
+
+static const char *sPhaseNames[XFF_PHASE_NRE] = {
+    "read", "RelocateElfInfoHeader", "DecodeSection", "RelocateSelfSymbol", "ResolveImports", "RelocateCode",
+    "DisposeRelocationElement", "entry",
+};
+
+const char *XffProfPhaseName(u32 phase)
+{
+    return phase < XFF_PHASE_NRE ? sPhaseNames[phase] : "?";
+}
+
+u64 XffProfNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// 'cap' is rounded up to a power of two.
+struct XffProfile *XffProfCreate(u32 cap)
+{
+    struct XffProfile *prof;
+    u32 n = 1;
+
+    while (n < cap && n < 0x80000000)
+        n <<= 1;
+
+    prof = calloc(1, sizeof(*prof));
+    if (prof == NULL)
+        return NULL;
+
+    prof->ev = calloc(n, sizeof(*prof->ev));
+    if (prof->ev == NULL)
+    {
+        free(prof);
+        return NULL;
+    }
+    prof->cap = n;
+    return prof;
+}
+
+void XffProfDestroy(struct XffProfile *prof)
+{
+    if (prof == NULL)
+        return;
+
+    free(prof->ev);
+    free(prof);
+}
+
+// Names the module the following events belong to.
+void XffProfSetModule(struct XffProfile *prof, const char *name, u32 seq)
+{
+    const char *base = strrchr(name, '/');
+
+    snprintf(prof->module, sizeof(prof->module), "%s", base != NULL ? base + 1 : name);
+    prof->seq = seq;
+}
+
+// Records a phase of the current module that ran from 'begin' until now.
+void XffProfRecord(struct XffProfile *prof, u32 phase, u64 begin, u32 count, u32 bytes)
+{
+    struct XffProfEvent *ev = &prof->ev[prof->head & (prof->cap - 1)];
+    u64 end = XffProfNow();
+
+    ev->begin = begin;
+    ev->dur = end - begin > 0xFFFFFFFF ? 0xFFFFFFFF : (u32)(end - begin);
+    ev->phase = phase;
+    ev->boot = prof->boot;
+    ev->seq = prof->seq;
+    ev->count = count;
+    ev->bytes = bytes;
+    memcpy(ev->module, prof->module, sizeof(ev->module));
+    prof->head++;
+}
+
+// Oldest event still in the ring and the number of events from there on.
+static u32 RingStart(const struct XffProfile *prof, u32 *nrE)
+{
+    u64 n = prof->head < prof->cap ? prof->head : prof->cap;
+
+    *nrE = (u32)n;
+    return (u32)(prof->head - n);
+}
+
+void XffProfTotals(const struct XffProfile *prof, struct XffProfTotal *tot)
+{
+    const struct XffProfEvent *ev;
+    u32 start;
+    u32 nrE;
+    u32 i;
+
+    memset(tot, 0, sizeof(*tot) * XFF_PHASE_NRE);
+    start = RingStart(prof, &nrE);
+    for (i = 0; i < nrE; i++)
+    {
+        ev = &prof->ev[(start + i) & (prof->cap - 1)];
+        if (ev->phase >= XFF_PHASE_NRE)
+            continue;
+
+        if (tot[ev->phase].events == 0 || ev->dur < tot[ev->phase].minNs)
+            tot[ev->phase].minNs = ev->dur;
+        if (ev->dur > tot[ev->phase].maxNs)
+            tot[ev->phase].maxNs = ev->dur;
+        tot[ev->phase].events++;
+        tot[ev->phase].ns += ev->dur;
+        tot[ev->phase].count += ev->count;
+        tot[ev->phase].bytes += ev->bytes;
+    }
+}
+
+static void WriteJsonString(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s != '\0'; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fprintf(f, "\\%c", *s);
+        else if ((u8)*s < 0x20)
+            fprintf(f, "\\u%04x", (u8)*s);
+        else
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+// Writes the events in the ring as Chrome trace_event JSON, timestamps relative to the
+// oldest event.
+s32 XffProfWriteTrace(const struct XffProfile *prof, const char *path)
+{
+    const struct XffProfEvent *ev;
+    FILE *f;
+    u64 t0;
+    u32 start;
+    u32 nrE;
+    u32 i;
+
+    f = fopen(path, "w");
+    if (f == NULL)
+        return XFF_ERR_IO;
+
+    start = RingStart(prof, &nrE);
+    t0 = nrE != 0 ? prof->ev[start & (prof->cap - 1)].begin : 0;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (i = 0; i < nrE; i++)
+    {
+        ev = &prof->ev[(start + i) & (prof->cap - 1)];
+        fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"xff\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u,\"args\":{\"module\":",
+                i != 0 ? ",\n" : "", XffProfPhaseName(ev->phase), (ev->begin - t0) * 1e-3, ev->dur * 1e-3, ev->boot, ev->seq);
+        WriteJsonString(f, ev->module);
+        fprintf(f, ",\"count\":%u,\"bytes\":%u}}", ev->count, ev->bytes);
+    }
+    fprintf(f, "\n]}\n");
+
+    return fclose(f) == 0 ? XFF_OK : XFF_ERR_IO;
+}
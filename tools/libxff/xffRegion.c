@@ -0,0 +1,411 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libxff.h"
+
+/*
+Region allocator for loaded modules.
+
+The heap is a list of free extents, kept in address order and coalesced on release.
+Every module gets a region: a list of chunks taken from the heap, at least 'chunkSize'
+bytes each, that its allocations are bumped out of. Nothing inside a region is freed
+one by one, so releasing a module hands its few chunks back without looking at the
+sections they hold. The file image is given a chunk of its own so that the part
+DisposeRelocationElement() no longer needs can be trimmed off its end, the way
+iosFreeParts() shortens the file block on the EE.
+
+The region heap owns the arena from its start up, XffArenaAlloc() must not be used next
+to it. Chunks raise the arena zero watermark like XffArenaAlloc() does.
+*/
+
+struct XffFreeExtent
+{
+    struct XffFreeExtent *next;
+    u32 addr;
+    u32 size;
+};
+
+static u32 AlignUp(u32 v, u32 align)
+{
+    return (v + align - 1) & ~(align - 1);
+}
+
+s32 XffRegionHeapInit(struct XffRegionHeap *heap, struct XffArena *ar, u32 start, u32 end, u32 chunkSize)
+{
+    memset(heap, 0, sizeof(*heap));
+    heap->ar = ar;
+    heap->start = AlignUp(start, 0x10);
+    heap->end = end & ~0xF;
+    heap->chunkSize = AlignUp(chunkSize != 0 ? chunkSize : XFF_REGION_CHUNK_DEFAULT, 0x10);
+    if (heap->start >= heap->end)
+        return XFF_ERR_NOMEM;
+
+    heap->free = calloc(1, sizeof(*heap->free));
+    if (heap->free == NULL)
+        return XFF_ERR_NOMEM;
+    heap->free->addr = heap->start;
+    heap->free->size = heap->end - heap->start;
+    heap->highPt = heap->start;
+    return XFF_OK;
+}
+
+static void FreeChunkList(struct XffRegionChunk *chunk)
+{
+    struct XffRegionChunk *next;
+
+    for (; chunk != NULL; chunk = next)
+    {
+        next = chunk->next;
+        free(chunk);
+    }
+}
+
+void XffRegionHeapTerm(struct XffRegionHeap *heap)
+{
+    struct XffFreeExtent *ext;
+    struct XffRegion *rgn;
+
+    while ((ext = heap->free) != NULL)
+    {
+        heap->free = ext->next;
+        free(ext);
+    }
+
+    while ((rgn = heap->regions) != NULL)
+    {
+        heap->regions = rgn->next;
+        FreeChunkList(rgn->chunks);
+        free(rgn);
+    }
+}
+
+// Drops every region, as a reset of the bump heap does.
+void XffRegionHeapReset(struct XffRegionHeap *heap)
+{
+    struct XffRegionHeap fresh;
+
+    if (XffRegionHeapInit(&fresh, heap->ar, heap->start, heap->end, heap->chunkSize) != XFF_OK)
+        return;
+
+    XffRegionHeapTerm(heap);
+    fresh.highPt = heap->highPt;
+    *heap = fresh;
+}
+
+// Hands back [addr, addr + size) to the free list, merging with its neighbours.
+static void PutExtent(struct XffRegionHeap *heap, u32 addr, u32 size)
+{
+    struct XffFreeExtent **link = &heap->free;
+    struct XffFreeExtent *prev = NULL;
+    struct XffFreeExtent *next;
+    struct XffFreeExtent *ext;
+
+    if (size == 0)
+        return;
+
+    for (; *link != NULL && (*link)->addr < addr; link = &(*link)->next)
+        prev = *link;
+    next = *link;
+
+    if (prev != NULL && prev->addr + prev->size == addr)
+    {
+        prev->size += size;
+        if (next != NULL && prev->addr + prev->size == next->addr)
+        {
+            prev->size += next->size;
+            prev->next = next->next;
+            free(next);
+        }
+        return;
+    }
+
+    if (next != NULL && addr + size == next->addr)
+    {
+        next->addr = addr;
+        next->size += size;
+        return;
+    }
+
+    ext = malloc(sizeof(*ext));
+    if (ext == NULL)
+        return; // the bytes are lost to the heap, not to correctness
+    ext->addr = addr;
+    ext->size = size;
+    ext->next = next;
+    *link = ext;
+}
+
+// First fit for 'size' bytes at an address that is 'phase' modulo 'align'. The part of
+// an extent in front of that start stays free.
+static u32 TakeExtent(struct XffRegionHeap *heap, u32 size, u32 align, u32 phase)
+{
+    struct XffFreeExtent **link;
+    struct XffFreeExtent *ext;
+    u32 addr;
+    u32 front;
+
+    for (link = &heap->free; (ext = *link) != NULL; link = &ext->next)
+    {
+        addr = ext->addr + ((phase - ext->addr) & (align - 1));
+        front = addr - ext->addr;
+        if (addr < ext->addr || front > ext->size || size > ext->size - front)
+            continue;
+
+        if (front + size == ext->size)
+        {
+            if (front == 0)
+            {
+                *link = ext->next;
+                free(ext);
+            }
+            else
+            {
+                ext->size = front;
+            }
+        }
+        else if (front == 0)
+        {
+            ext->addr += size;
+            ext->size -= size;
+        }
+        else
+        {
+            PutExtent(heap, addr + size, ext->addr + ext->size - (addr + size));
+            ext->size = front;
+        }
+
+        if (addr + size > heap->highPt)
+            heap->highPt = addr + size;
+        if (addr + size > heap->ar->zeroPt)
+            heap->ar->zeroPt = addr + size;
+        return addr;
+    }
+
+    return 0;
+}
+
+struct XffRegion *XffRegionCreate(struct XffRegionHeap *heap, const char *name)
+{
+    struct XffRegion *rgn = calloc(1, sizeof(*rgn));
+
+    if (rgn == NULL)
+        return NULL;
+
+    strncpy(rgn->name, name, sizeof(rgn->name) - 1);
+    rgn->next = heap->regions;
+    heap->regions = rgn;
+    return rgn;
+}
+
+static struct XffRegionChunk *NewChunk(struct XffRegionHeap *heap, struct XffRegion *rgn, u32 size, u32 align)
+{
+    struct XffRegionChunk *chunk = calloc(1, sizeof(*chunk));
+
+    if (chunk == NULL)
+        return NULL;
+
+    chunk->size = AlignUp(size, 0x10);
+    chunk->align = align < 0x10 ? 0x10 : align;
+    chunk->addr = TakeExtent(heap, chunk->size, chunk->align, 0);
+    if (chunk->addr == 0)
+    {
+        free(chunk);
+        return NULL;
+    }
+
+    chunk->next = rgn->chunks;
+    rgn->chunks = chunk;
+    rgn->reserved += chunk->size;
+    return chunk;
+}
+
+static void Account(struct XffRegion *rgn, u32 size)
+{
+    rgn->allocs++;
+    rgn->used += size;
+    if (rgn->used > rgn->peak)
+        rgn->peak = rgn->used;
+}
+
+// Sub-allocates from the chunks of 'rgn', taking a new chunk when none has room.
+u32 XffRegionAlloc(struct XffRegionHeap *heap, struct XffRegion *rgn, u32 size, u32 align)
+{
+    struct XffRegionChunk *chunk;
+    u32 addr;
+
+    if (align < 0x10)
+        align = 0x10;
+
+    for (chunk = rgn->chunks; chunk != NULL; chunk = chunk->next)
+    {
+        if (chunk->used == chunk->size)
+            continue;
+
+        addr = AlignUp(chunk->addr + chunk->used, align);
+        if (addr <= chunk->addr + chunk->size && size <= chunk->addr + chunk->size - addr)
+        {
+            chunk->used = AlignUp(addr + size - chunk->addr, 0x10);
+            if (align > chunk->align)
+                chunk->align = align;
+            Account(rgn, size);
+            return addr;
+        }
+    }
+
+    chunk = NewChunk(heap, rgn, size > heap->chunkSize ? size : heap->chunkSize, align);
+    if (chunk == NULL)
+        return 0;
+
+    chunk->used = AlignUp(size, 0x10);
+    Account(rgn, size);
+    return chunk->addr;
+}
+
+// A chunk holding exactly one block, for memory that is later trimmed from its end.
+u32 XffRegionAllocBlock(struct XffRegionHeap *heap, struct XffRegion *rgn, u32 size, u32 align)
+{
+    struct XffRegionChunk *chunk = NewChunk(heap, rgn, size, align);
+
+    if (chunk == NULL)
+        return 0;
+
+    chunk->used = chunk->size;
+    Account(rgn, size);
+    return chunk->addr;
+}
+
+// Gives back the end of the block 'addr' lies in, from 'addr' (rounded up to 0x10) on.
+// Returns the bytes released.
+u32 XffRegionTrim(struct XffRegionHeap *heap, struct XffRegion *rgn, u32 addr)
+{
+    struct XffRegionChunk *chunk;
+    u32 cut;
+    u32 n;
+
+    for (chunk = rgn->chunks; chunk != NULL; chunk = chunk->next)
+    {
+        if (addr <= chunk->addr || addr >= chunk->addr + chunk->size)
+            continue;
+
+        cut = AlignUp(addr, 0x10);
+        if (cut >= chunk->addr + chunk->used)
+            return 0;
+
+        n = chunk->addr + chunk->size - cut;
+        PutExtent(heap, cut, n);
+        chunk->size -= n;
+        chunk->used = chunk->size;
+        rgn->reserved -= n;
+        rgn->used -= n < rgn->used ? n : rgn->used;
+        return n;
+    }
+
+    return 0;
+}
+
+// Carves [addr, addr + size) out of the free extent holding it.
+static void TakeAt(struct XffRegionHeap *heap, u32 addr, u32 size)
+{
+    struct XffFreeExtent **link;
+    struct XffFreeExtent *ext;
+    u32 end;
+
+    for (link = &heap->free; (ext = *link) != NULL; link = &ext->next)
+    {
+        if (addr < ext->addr || addr + size > ext->addr + ext->size)
+            continue;
+
+        end = ext->addr + ext->size;
+        if (addr == ext->addr)
+        {
+            ext->addr += size;
+            ext->size -= size;
+            if (ext->size == 0)
+            {
+                *link = ext->next;
+                free(ext);
+            }
+        }
+        else
+        {
+            ext->size = addr - ext->addr;
+            PutExtent(heap, addr + size, end - (addr + size));
+        }
+        return;
+    }
+}
+
+// Finds the lowest address 'chunk' can go to, counting its own memory as free, and
+// moves it there in the heap bookkeeping. The new address keeps the old one modulo the
+// chunk alignment, so everything inside stays aligned. The contents are not touched,
+// the caller memmove()s them; the two places may overlap. Returns the new address, the
+// old one when nothing lower fits.
+u32 XffRegionRelocateChunk(struct XffRegionHeap *heap, struct XffRegionChunk *chunk)
+{
+    u32 addr;
+
+    PutExtent(heap, chunk->addr, chunk->size);
+    addr = TakeExtent(heap, chunk->size, chunk->align, chunk->addr);
+    if (addr == 0)
+    {
+        // Only when PutExtent() couldn't get memory for a new extent
+        TakeAt(heap, chunk->addr, chunk->size);
+        return chunk->addr;
+    }
+
+    chunk->addr = addr;
+    return addr;
+}
+
+// Start of the lowest free extent, 0 when the heap is full.
+u32 XffRegionLowestFree(const struct XffRegionHeap *heap)
+{
+    return heap->free != NULL ? heap->free->addr : 0;
+}
+
+// Releases every chunk of 'rgn' at once and frees the region.
+void XffRegionRelease(struct XffRegionHeap *heap, struct XffRegion *rgn)
+{
+    struct XffRegionChunk *chunk;
+    struct XffRegion **link;
+
+    for (chunk = rgn->chunks; chunk != NULL; chunk = chunk->next)
+        PutExtent(heap, chunk->addr, chunk->size);
+
+    for (link = &heap->regions; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == rgn)
+        {
+            *link = rgn->next;
+            break;
+        }
+    }
+
+    FreeChunkList(rgn->chunks);
+    free(rgn);
+}
+
+void XffRegionHeapStats(const struct XffRegionHeap *heap, struct XffRegionHeapStats *st)
+{
+    const struct XffFreeExtent *ext;
+    const struct XffRegion *rgn;
+
+    memset(st, 0, sizeof(*st));
+    st->heapSize = heap->end - heap->start;
+    st->highWater = heap->highPt - heap->start;
+
+    for (ext = heap->free; ext != NULL; ext = ext->next)
+    {
+        st->freeBytes += ext->size;
+        st->freeExtents++;
+        if (ext->size > st->largestFree)
+            st->largestFree = ext->size;
+    }
+
+    for (rgn = heap->regions; rgn != NULL; rgn = rgn->next)
+    {
+        st->regions++;
+        st->reserved += rgn->reserved;
+        st->used += rgn->used;
+    }
+}
@@ -0,0 +1,267 @@
+/*
+xffregionbench: region heap against the bump heap over a load/unload trace.
+
+Usage: xffregionbench [-c chunkSize] [-n rounds] [-t trace] file.xff...
+
+The trace has one step per line, "+ path" loads a file and "- path" unloads the most
+recently loaded module of that path; lines starting with '#' are ignored. Without -t
+every file is loaded and then, for 'rounds' rounds, one module after the other is
+unloaded and loaded again. Both heaps replay the same steps. The bump heap never gets
+memory back before a reset, the region heap releases a module's region on unload.
+Reported are the heap high water mark, free space and its fragmentation, the bytes lost
+to alignment and chunk tails, and the current and peak usage of every module still
+loaded at the end.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libxff.h"
+
+struct TraceStep
+{
+    s32 load;
+    s32 file; // index into 'files'
+};
+
+struct BenchFile
+{
+    const char *path;
+    void *data;
+    u32 size;
+};
+
+static s32 FindFile(struct BenchFile *files, s32 fileNrE, const char *path)
+{
+    s32 i;
+
+    for (i = 0; i < fileNrE; i++)
+    {
+        if (strcmp(files[i].path, path) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Reads a trace, adding the files it names to 'files'.
+static struct TraceStep *ReadTrace(const char *path, struct BenchFile **files, s32 *fileNrE, s32 *stepNrE)
+{
+    struct TraceStep *step = NULL;
+    char line[1024];
+    char *name;
+    FILE *f;
+    s32 cap = 0;
+    s32 ix;
+
+    f = fopen(path, "r");
+    if (f == NULL)
+        return NULL;
+
+    *stepNrE = 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if ((line[0] != '+' && line[0] != '-') || line[1] != ' ')
+            continue;
+
+        name = line + 2;
+        ix = FindFile(*files, *fileNrE, name);
+        if (ix < 0)
+        {
+            *files = realloc(*files, (*fileNrE + 1) * sizeof(**files));
+            memset(&(*files)[*fileNrE], 0, sizeof(**files));
+            (*files)[*fileNrE].path = strdup(name);
+            ix = (*fileNrE)++;
+        }
+
+        if (*stepNrE == cap)
+        {
+            cap = cap ? cap * 2 : 64;
+            step = realloc(step, cap * sizeof(*step));
+        }
+        step[*stepNrE].load = line[0] == '+';
+        step[*stepNrE].file = ix;
+        (*stepNrE)++;
+    }
+
+    fclose(f);
+    return step;
+}
+
+static struct XffModule *FindModule(struct XffLoader *ldr, const char *path)
+{
+    struct XffModule *mod;
+
+    for (mod = ldr->modules; mod != NULL; mod = mod->next)
+    {
+        if (strcmp(mod->name, path) == 0)
+            return mod;
+    }
+    return NULL;
+}
+
+// Replays the trace, returns the number of steps done before the heap ran out.
+static s32 Replay(struct XffLoader *ldr, struct BenchFile *files, const struct TraceStep *step, s32 stepNrE, u32 *minLargest)
+{
+    struct XffRegionHeapStats st;
+    struct XffModule *mod;
+    s32 i;
+
+    for (i = 0; i < stepNrE; i++)
+    {
+        if (step[i].load)
+        {
+            if (XffLoadImage(ldr, files[step[i].file].path, files[step[i].file].data, files[step[i].file].size, NULL) != XFF_OK)
+                return i;
+        }
+        else if ((mod = FindModule(ldr, files[step[i].file].path)) != NULL)
+        {
+            XffUnloadModule(ldr, mod);
+        }
+
+        if (ldr->regions != NULL)
+        {
+            XffRegionHeapStats(ldr->regions, &st);
+            if (st.largestFree < *minLargest)
+                *minLargest = st.largestFree;
+        }
+    }
+    return i;
+}
+
+int main(int argc, char **argv)
+{
+    struct XffLoader bump;
+    struct XffLoader rgn;
+    struct XffRegionHeapStats st;
+    struct BenchFile *files = NULL;
+    struct TraceStep *step = NULL;
+    struct XffModule *mod;
+    const char *tracePath = NULL;
+    u32 chunkSize = XFF_REGION_CHUNK_DEFAULT;
+    u32 minLargest = 0xFFFFFFFF;
+    u32 bumpMin = 0xFFFFFFFF;
+    u32 liveUsed;
+    s32 rounds = 50;
+    s32 fileNrE = 0;
+    s32 stepNrE = 0;
+    s32 bumpSteps;
+    s32 rgnSteps;
+    s32 opt;
+    s32 i;
+
+    while ((opt = getopt(argc, argv, "c:n:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            chunkSize = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            rounds = strtol(optarg, NULL, 0);
+            break;
+        case 't':
+            tracePath = optarg;
+            break;
+        default:
+            optind = argc;
+            tracePath = NULL;
+            rounds = -1;
+            break;
+        }
+    }
+
+    if (tracePath != NULL)
+    {
+        step = ReadTrace(tracePath, &files, &fileNrE, &stepNrE);
+        if (step == NULL)
+        {
+            fprintf(stderr, "xffregionbench: can't read %s\n", tracePath);
+            return 1;
+        }
+    }
+    else if (optind < argc && rounds >= 0)
+    {
+        fileNrE = argc - optind;
+        files = calloc(fileNrE, sizeof(*files));
+        stepNrE = fileNrE + rounds * 2;
+        step = calloc(stepNrE, sizeof(*step));
+        for (i = 0; i < fileNrE; i++)
+        {
+            files[i].path = argv[optind + i];
+            step[i].load = 1;
+            step[i].file = i;
+        }
+        for (i = 0; i < rounds; i++)
+        {
+            step[fileNrE + i * 2].file = i % fileNrE;
+            step[fileNrE + i * 2 + 1].load = 1;
+            step[fileNrE + i * 2 + 1].file = i % fileNrE;
+        }
+    }
+
+    if (step == NULL || fileNrE == 0)
+    {
+        fprintf(stderr, "usage: %s [-c chunkSize] [-n rounds] [-t trace] file.xff...\n", argv[0]);
+        return 1;
+    }
+
+    for (i = 0; i < fileNrE; i++)
+    {
+        files[i].data = XffMapFile(files[i].path, &files[i].size);
+        if (files[i].data == NULL)
+        {
+            fprintf(stderr, "xffregionbench: can't map %s\n", files[i].path);
+            return 1;
+        }
+    }
+
+    if (XffLoaderInit(&bump, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK ||
+        XffLoaderInit(&rgn, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK || XffLoaderUseRegions(&rgn, chunkSize) != XFF_OK)
+    {
+        fprintf(stderr, "xffregionbench: can't create arena\n");
+        return 1;
+    }
+    bump.noPrelink = 1;
+    rgn.noPrelink = 1;
+
+    bumpSteps = Replay(&bump, files, step, stepNrE, &bumpMin);
+    rgnSteps = Replay(&rgn, files, step, stepNrE, &minLargest);
+    XffRegionHeapStats(rgn.regions, &st);
+
+    liveUsed = 0;
+    for (mod = rgn.modules; mod != NULL; mod = mod->next)
+        liveUsed += mod->region->used;
+
+    printf("steps           : %d (%d files)\n", stepNrE, fileNrE);
+    printf("                     bump heap    region heap\n");
+    printf("steps completed : %12d   %12d\n", bumpSteps, rgnSteps);
+    printf("high water      : %12u   %12u bytes\n", bump.arena.heapPt - bump.arena.base, st.highWater);
+    printf("live modules    : %12u   %12u bytes in use\n", liveUsed, st.used);
+    printf("lost            : %12u   %12u bytes (alignment, chunk tails, unloaded modules)\n",
+           bump.arena.heapPt - bump.arena.base - liveUsed, st.reserved - st.used);
+    printf("free            : %12u   %12u bytes in %u extents\n", bump.arena.base + bump.arena.size - bump.arena.heapPt, st.freeBytes,
+           st.freeExtents);
+    printf("largest free    : %12u   %12u bytes (%.1f%% fragmented, worst %u)\n", bump.arena.base + bump.arena.size - bump.arena.heapPt,
+           st.largestFree, st.freeBytes ? (st.freeBytes - st.largestFree) * 100.0 / st.freeBytes : 0.0, minLargest);
+    printf("file bytes trimmed after DisposeRelocationElement(): %u\n", rgn.trimmed);
+
+    printf("module                            allocs       used       peak   reserved\n");
+    for (mod = rgn.modules; mod != NULL; mod = mod->next)
+    {
+        printf("  %-30s %8u %10u %10u %10u\n", mod->name, mod->region->allocs, mod->region->used, mod->region->peak,
+               mod->region->reserved);
+    }
+
+    XffLoaderTerm(&bump);
+    XffLoaderTerm(&rgn);
+    for (i = 0; i < fileNrE; i++)
+    {
+        XffUnmapFile(files[i].data, files[i].size);
+    }
+    free(files);
+    free(step);
+    return 0;
+}
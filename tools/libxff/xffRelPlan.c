@@ -0,0 +1,443 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libxff.h"
+
+/*
+Relocation plans, the XFF_EXT_RELPLAN extension block.
+
+XffRelocateCode() walks every table in file order: per entry it reads the address and
+the instruction table, the 16-byte symTab entry of the target and, for a HI16 run, looks
+ahead for the LO16, then dispatches on the type. The symTab reads land all over the
+table and a table the toolchain didn't sort jumps around its section. A plan is the
+same work compiled offline, per table, cut into groups of consecutive sites. A group
+patches at most XFF_RELPLAN_GROUP_SPAN bytes of its section and refers to at most
+XFF_RELPLAN_GROUP_SLOTS symbols, 4 KiB of words and 512 bytes of values that stay in the
+8 KiB EE data cache while the group is applied. Per group:
+ - the symbols it refers to, in order of first use; the loader gathers their addresses
+   into a dense array before the group's loops,
+ - the entries grouped by type, R_32, R_26, HI16 then LO16, sorted by site within a
+   type, 12 bytes each: site offset, slot in the dense array and the addend. A HI16
+   carries its full addend, the low half of its LO16 included, and its opcode half.
+Every type is then one branch-free loop over words the previous loop left in the cache.
+A symbol used all over a table is gathered once per group, a symTab read the tables
+would have made per entry anyway. Tables that patch a word twice keep their file order,
+the result would depend on it.
+
+Block layout:
+  XffRelPlanHdr
+  XffRelPlanTab[relocTabNrE]
+  XffRelPlanGroup[groupNrE]     per table from firstGroup
+  u32 slot[slotNrE]             symIx, per group from firstSlot
+  XffRelPlanEnt[entNrE]         per group from firstEnt
+
+The loader applies the plan of the image it loads instead of its tables (XffLinkImage());
+the tables stay as they are for everything after, moves and rebinding. Files without a
+block, or with one that doesn't match the image, load as before.
+*/
+
+enum
+{
+    KIND_32,
+    KIND_26,
+    KIND_HI16,
+    KIND_LO16,
+    KIND_NONE,
+};
+
+struct SortEnt
+{
+    u32 kind;
+    u32 offs;
+    u32 symIx;
+    u32 slot;
+    u32 op;
+    u32 addend;
+    u32 order; // position in the table, keeps the sort stable
+};
+
+static int CompareEnt(const void *a, const void *b)
+{
+    const struct SortEnt *ea = a;
+    const struct SortEnt *eb = b;
+
+    if (ea->kind != eb->kind)
+        return ea->kind < eb->kind ? -1 : 1;
+    if (ea->offs != eb->offs)
+        return ea->offs < eb->offs ? -1 : 1;
+    return ea->order < eb->order ? -1 : ea->order > eb->order;
+}
+
+static int CompareSite(const void *a, const void *b)
+{
+    const struct SortEnt *ea = a;
+    const struct SortEnt *eb = b;
+
+    if (ea->offs != eb->offs)
+        return ea->offs < eb->offs ? -1 : 1;
+    return ea->order < eb->order ? -1 : ea->order > eb->order;
+}
+
+static inline u32 Kind(u32 relType)
+{
+    switch (relType)
+    {
+    case XFF_R_32:
+        return KIND_32;
+    case XFF_R_26:
+        return KIND_26;
+    case XFF_R_HI16:
+        return KIND_HI16;
+    case XFF_R_LO16:
+        return KIND_LO16;
+    default:
+        return KIND_NONE;
+    }
+}
+
+// Entries of one table sorted by site, 'ent' holds rt->nrEnt. Returns the planned
+// entries, 0 with *dup set when two entries patch the same word.
+static u32 SortTable(const struct t_xffRelocAddrEnt *addrTab, const struct t_xffRelocInstEnt *instTab, u32 nrEnt,
+                     struct SortEnt *ent, s32 *dup)
+{
+    u32 entNrE = 0;
+    u32 lo;
+    u32 j;
+    u32 n;
+
+    for (j = 0; j < nrEnt; j++)
+    {
+        ent[j].offs = addrTab[j].addr;
+        ent[j].order = j;
+    }
+    qsort(ent, nrEnt, sizeof(*ent), CompareSite);
+    for (j = 1, *dup = 0; j < nrEnt; j++)
+        *dup |= ent[j].offs == ent[j - 1].offs;
+    if (*dup)
+        return 0;
+
+    for (j = 0; j < nrEnt; j = n)
+    {
+        n = j + 1;
+        lo = 0;
+        if (addrTab[j].relType == XFF_R_HI16)
+        {
+            for (; n < nrEnt && addrTab[n].relType == XFF_R_HI16; n++)
+                ;
+            if (n < nrEnt && addrTab[n].relType == XFF_R_LO16)
+                lo = (s16)instTab[n].inst;
+        }
+
+        for (; j < n; j++)
+        {
+            if (Kind(addrTab[j].relType) == KIND_NONE)
+                continue;
+            ent[entNrE].kind = Kind(addrTab[j].relType);
+            ent[entNrE].offs = addrTab[j].addr;
+            ent[entNrE].symIx = addrTab[j].tgSymIx;
+            ent[entNrE].order = j;
+            ent[entNrE].op = instTab[j].inst >> 16;
+            ent[entNrE].addend = addrTab[j].relType == XFF_R_HI16 ? (instTab[j].inst << 16) + lo : instTab[j].inst;
+            entNrE++;
+        }
+    }
+    qsort(ent, entNrE, sizeof(*ent), CompareSite);
+    return entNrE;
+}
+
+// Cuts the site sorted entries of one table into groups, appending groups, slots and
+// entries to 'grp', 'slot' and 'pe' and counting them in 'hdr'. 'slotOf' holds, per
+// symbol, the index + 1 of the last slot it got, 0 for none yet.
+static void GroupTable(struct SortEnt *ent, u32 entNrE, struct XffRelPlanHdr *hdr, struct XffRelPlanGroup *grp, u32 *slot,
+                       struct XffRelPlanEnt *pe, u32 *slotOf)
+{
+    struct XffRelPlanGroup *g;
+    u32 j;
+    u32 k;
+
+    for (j = 0; j < entNrE; j = k)
+    {
+        g = &grp[hdr->groupNrE++];
+        memset(g, 0, sizeof(*g));
+        g->firstSlot = hdr->slotNrE;
+        g->firstEnt = hdr->entNrE;
+        for (k = j; k < entNrE && ent[k].offs - ent[j].offs < XFF_RELPLAN_GROUP_SPAN; k++)
+        {
+            if (slotOf[ent[k].symIx] <= g->firstSlot)
+            {
+                if (g->slotNrE == XFF_RELPLAN_GROUP_SLOTS)
+                    break;
+                slot[hdr->slotNrE++] = ent[k].symIx;
+                slotOf[ent[k].symIx] = hdr->slotNrE;
+                g->slotNrE++;
+            }
+            ent[k].slot = slotOf[ent[k].symIx] - 1 - g->firstSlot;
+        }
+
+        qsort(ent + j, k - j, sizeof(*ent), CompareEnt);
+        for (; j < k; j++)
+        {
+            g->kindNrE[ent[j].kind]++;
+            pe[hdr->entNrE].offs = ent[j].offs;
+            pe[hdr->entNrE].slot = ent[j].slot;
+            pe[hdr->entNrE].op = ent[j].op;
+            pe[hdr->entNrE].addend = ent[j].addend;
+            hdr->entNrE++;
+        }
+    }
+}
+
+// Builds the plan of the tables, groups, slots and entries going to scratch arrays
+// sized for the worst case, one of each per table entry. Returns the block.
+static struct XffRelPlanHdr *BuildPlan(const u8 *data, u32 maxNrEnt, u32 totalEnt, u32 *outSize)
+{
+    const struct t_xffEntPntHdr *xffEp = (const struct t_xffEntPntHdr *)data;
+    const struct t_xffRelocEnt *rt = (const struct t_xffRelocEnt *)(data + xffEp->relocTab_Rel);
+    struct XffRelPlanHdr plan = { xffEp->relocTabNrE, xffEp->symTabNrE, 0, 0, 0 };
+    struct XffRelPlanHdr *hdr = NULL;
+    struct XffRelPlanTab *tab = calloc(xffEp->relocTabNrE + 1, sizeof(*tab));
+    struct XffRelPlanGroup *grp = malloc((totalEnt + 1) * sizeof(*grp));
+    struct XffRelPlanEnt *pe = malloc((totalEnt + 1) * sizeof(*pe));
+    struct SortEnt *ent = malloc((maxNrEnt + 1) * sizeof(*ent));
+    u32 *slot = malloc((totalEnt + 1) * sizeof(*slot));
+    u32 *slotOf = calloc(xffEp->symTabNrE + 1, sizeof(*slotOf));
+    u32 entNrE;
+    u8 *p;
+    s32 dup;
+    s32 i;
+
+    if (tab != NULL && grp != NULL && pe != NULL && ent != NULL && slot != NULL && slotOf != NULL)
+    {
+        for (i = 0; i < xffEp->relocTabNrE; i++)
+        {
+            tab[i].nrEnt = rt[i].nrEnt;
+            tab[i].firstGroup = plan.groupNrE;
+            entNrE = SortTable((const struct t_xffRelocAddrEnt *)(data + rt[i].addr_Rel),
+                               (const struct t_xffRelocInstEnt *)(data + rt[i].inst_Rel), rt[i].nrEnt, ent, &dup);
+            tab[i].fileOrder = dup;
+            GroupTable(ent, entNrE, &plan, grp, slot, pe, slotOf);
+            tab[i].groupNrE = plan.groupNrE - tab[i].firstGroup;
+        }
+
+        *outSize = sizeof(plan) + plan.relocTabNrE * sizeof(*tab) + plan.groupNrE * sizeof(*grp) + plan.slotNrE * sizeof(*slot) +
+                   plan.entNrE * sizeof(*pe);
+        hdr = malloc(*outSize);
+    }
+    if (hdr != NULL)
+    {
+        p = (u8 *)(hdr + 1);
+        *hdr = plan;
+        memcpy(p, tab, plan.relocTabNrE * sizeof(*tab));
+        p += plan.relocTabNrE * sizeof(*tab);
+        memcpy(p, grp, plan.groupNrE * sizeof(*grp));
+        p += plan.groupNrE * sizeof(*grp);
+        memcpy(p, slot, plan.slotNrE * sizeof(*slot));
+        p += plan.slotNrE * sizeof(*slot);
+        memcpy(p, pe, plan.entNrE * sizeof(*pe));
+    }
+
+    free(tab);
+    free(grp);
+    free(pe);
+    free(ent);
+    free(slot);
+    free(slotOf);
+    return hdr;
+}
+
+// Builds the block for an XFF file as it is on disc. Returns XFF_ERR_FORMAT when the
+// tables don't lie inside the file.
+s32 XffRelPlanBuild(const u8 *data, u32 size, u8 **out, u32 *outSize)
+{
+    const struct t_xffEntPntHdr *xffEp = (const struct t_xffEntPntHdr *)data;
+    const struct t_xffRelocEnt *rt;
+    const struct t_xffRelocAddrEnt *addrTab;
+    struct XffRelPlanHdr *hdr;
+    u32 maxNrEnt = 0;
+    u32 totalEnt = 0;
+    u32 j;
+    s32 i;
+
+    size = XffExtImageSize(data, size);
+    if (size < sizeof(*xffEp) || xffEp->ident != XFF_SHTEXE_MAGIC_XFF2 || xffEp->relocTabNrE < 0 || xffEp->symTabNrE < 0 ||
+        xffEp->relocTab_Rel > size || (u32)xffEp->relocTabNrE > (size - xffEp->relocTab_Rel) / sizeof(*rt))
+        return XFF_ERR_FORMAT;
+
+    rt = (const struct t_xffRelocEnt *)(data + xffEp->relocTab_Rel);
+    for (i = 0; i < xffEp->relocTabNrE; i++)
+    {
+        if (rt[i].type == XFF_RELOC_TYPE_PACKED || rt[i].addr_Rel > size || rt[i].inst_Rel > size ||
+            rt[i].nrEnt > (size - rt[i].addr_Rel) / sizeof(*addrTab) ||
+            rt[i].nrEnt > (size - rt[i].inst_Rel) / sizeof(struct t_xffRelocInstEnt))
+            return XFF_ERR_FORMAT;
+        addrTab = (const struct t_xffRelocAddrEnt *)(data + rt[i].addr_Rel);
+        for (j = 0; j < rt[i].nrEnt; j++)
+        {
+            if (addrTab[j].tgSymIx >= (u32)xffEp->symTabNrE)
+                return XFF_ERR_FORMAT;
+        }
+        maxNrEnt = rt[i].nrEnt > maxNrEnt ? rt[i].nrEnt : maxNrEnt;
+        totalEnt += rt[i].nrEnt;
+    }
+
+    hdr = BuildPlan(data, maxNrEnt, totalEnt, outSize);
+    if (hdr == NULL)
+        return XFF_ERR_NOMEM;
+    *out = (u8 *)hdr;
+    return XFF_OK;
+}
+
+// Returns the image with an XFF_EXT_RELPLAN block added or replaced, see XffExtSet().
+u8 *XffRelPlanAttach(u8 *data, u32 *size)
+{
+    u8 *blk;
+    u8 *out;
+    u32 blkSize;
+
+    if (XffRelPlanBuild(data, *size, &blk, &blkSize) != XFF_OK)
+        return data;
+
+    out = XffExtSet(data, size, XFF_EXT_RELPLAN, blk, blkSize);
+    free(blk);
+    return out != NULL ? out : data;
+}
+
+// Whether the groups of one table are well formed: slots and entries within the block,
+// no more entries than the table has, every entry within the slots of its group and on
+// a word of 'sectSize' bytes
+static s32 CheckGroups(const struct XffRelPlanHdr *hdr, const struct XffRelPlanTab *tab, u32 sectSize)
+{
+    const struct XffRelPlanGroup *g = (const struct XffRelPlanGroup *)((const struct XffRelPlanTab *)(hdr + 1) + hdr->relocTabNrE);
+    const u32 *slot = (const u32 *)(g + hdr->groupNrE);
+    const struct XffRelPlanEnt *pe = (const struct XffRelPlanEnt *)(slot + hdr->slotNrE);
+    u32 entNrE = 0;
+    u32 n;
+    u32 j;
+    u32 k;
+
+    for (g += tab->firstGroup, k = 0; k < tab->groupNrE; k++, g++)
+    {
+        for (j = 0, n = 0; j < 4; j++)
+        {
+            if (g->kindNrE[j] > hdr->entNrE)
+                return 0;
+            n += g->kindNrE[j];
+        }
+        if (g->slotNrE > XFF_RELPLAN_GROUP_SLOTS || g->firstSlot > hdr->slotNrE || g->slotNrE > hdr->slotNrE - g->firstSlot ||
+            g->firstEnt > hdr->entNrE || n > hdr->entNrE - g->firstEnt || n > tab->nrEnt - entNrE)
+            return 0;
+        entNrE += n;
+
+        for (j = 0; j < g->slotNrE; j++)
+        {
+            if (slot[g->firstSlot + j] >= hdr->symTabNrE)
+                return 0;
+        }
+        for (j = 0; j < n; j++)
+        {
+            if (pe[g->firstEnt + j].slot >= g->slotNrE || (pe[g->firstEnt + j].offs & 3) != 0 || sectSize < 4 ||
+                pe[g->firstEnt + j].offs > sectSize - 4)
+                return 0;
+        }
+    }
+    return 1;
+}
+
+// Whether a block of 'size' bytes is well formed and was built for 'xffEp'
+s32 XffRelPlanCheck(const struct XffArena *ar, const struct XffRelPlanHdr *hdr, u32 size, const struct t_xffEntPntHdr *xffEp)
+{
+    const struct XffRelPlanTab *tab = (const struct XffRelPlanTab *)(hdr + 1);
+    const struct t_xffRelocEnt *rt = XffPtr(ar, xffEp->relocTab);
+    const struct t_xffSectEnt *sectTab = XffPtr(ar, xffEp->sectTab);
+    s32 i;
+
+    if (size < sizeof(*hdr) || (s32)hdr->relocTabNrE != xffEp->relocTabNrE || (s32)hdr->symTabNrE != xffEp->symTabNrE ||
+        hdr->relocTabNrE > 0x10000 || hdr->groupNrE > 0x01000000 || hdr->slotNrE > 0x01000000 || hdr->entNrE > 0x01000000 ||
+        size - sizeof(*hdr) != hdr->relocTabNrE * sizeof(*tab) + hdr->groupNrE * sizeof(struct XffRelPlanGroup) +
+                                   hdr->slotNrE * 4 + hdr->entNrE * sizeof(struct XffRelPlanEnt))
+        return 0;
+
+    for (i = 0; i < xffEp->relocTabNrE; i++)
+    {
+        if (tab[i].nrEnt != rt[i].nrEnt || tab[i].firstGroup > hdr->groupNrE || tab[i].groupNrE > hdr->groupNrE - tab[i].firstGroup)
+            return 0;
+        if (!tab[i].fileOrder && tab[i].groupNrE != 0 && !CheckGroups(hdr, &tab[i], sectTab[rt[i].sect].size))
+            return 0;
+    }
+    return 1;
+}
+
+// The largest slot array of a plan group, what XffApplyRelPlan() needs in 'vals'
+u32 XffRelPlanSlots(const struct XffRelPlanHdr *hdr)
+{
+    const struct XffRelPlanTab *tab = (const struct XffRelPlanTab *)(hdr + 1);
+    const struct XffRelPlanGroup *grp = (const struct XffRelPlanGroup *)(tab + hdr->relocTabNrE);
+    u32 slotNrE = 0;
+    u32 i;
+    u32 k;
+
+    for (i = 0; i < hdr->relocTabNrE; i++)
+    {
+        for (k = tab[i].firstGroup; !tab[i].fileOrder && k < tab[i].firstGroup + tab[i].groupNrE; k++)
+            slotNrE = grp[k].slotNrE > slotNrE ? grp[k].slotNrE : slotNrE;
+    }
+    return slotNrE;
+}
+
+// Applies the relocation tables of 'xffEp' the way 'hdr' plans them and returns the
+// number of entries. 'vals' holds XffRelPlanSlots() words, the dense symbol values of one
+// group at a time; XffRelPlanCheck() keeps every entry within the slots of its group.
+u32 XffApplyRelPlan(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp, const struct XffRelPlanHdr *hdr, u32 *vals)
+{
+    const struct XffRelPlanTab *tab = (const struct XffRelPlanTab *)(hdr + 1);
+    const struct XffRelPlanGroup *grp = (const struct XffRelPlanGroup *)(tab + hdr->relocTabNrE);
+    const u32 *slotBase = (const u32 *)(grp + hdr->groupNrE);
+    const struct XffRelPlanEnt *entBase = (const struct XffRelPlanEnt *)(slotBase + hdr->slotNrE);
+    const struct t_xffSymEnt *symTab = XffPtr(ar, xffEp->symTab);
+    const struct t_xffSectEnt *sectTab = XffPtr(ar, xffEp->sectTab);
+    struct t_xffRelocEnt *rt = XffPtr(ar, xffEp->relocTab);
+    const struct XffRelPlanGroup *g;
+    const struct XffRelPlanEnt *pe;
+    const struct XffRelPlanEnt *end;
+    const u32 *slot;
+    u8 *sectBs;
+    u32 relocs = 0;
+    u32 v;
+    u32 j;
+    u32 k;
+    s32 i;
+
+    for (i = 0; i < xffEp->relocTabNrE; i++, rt++, tab++)
+    {
+        relocs += rt->nrEnt;
+        if (tab->fileOrder)
+        {
+            for (j = 0; j < rt->nrEnt;)
+                j += XffResolveRelocation(ar, xffEp, rt, j);
+            continue;
+        }
+
+        sectBs = XffPtr(ar, sectTab[rt->sect].memPt);
+        for (g = grp + tab->firstGroup, k = 0; k < tab->groupNrE; k++, g++)
+        {
+            slot = slotBase + g->firstSlot;
+            for (j = 0; j < g->slotNrE; j++)
+                vals[j] = symTab[slot[j]].addr;
+
+            pe = entBase + g->firstEnt;
+            for (end = pe + g->kindNrE[0]; pe < end; pe++)
+                *(u32 *)(sectBs + pe->offs) = pe->addend + vals[pe->slot];
+            for (end = pe + g->kindNrE[1]; pe < end; pe++)
+                *(u32 *)(sectBs + pe->offs) = ((vals[pe->slot] / 4) & 0x03FFFFFF) + pe->addend;
+            for (end = pe + g->kindNrE[2]; pe < end; pe++)
+            {
+                v = vals[pe->slot] + pe->addend;
+                *(u32 *)(sectBs + pe->offs) = ((u32)pe->op << 16) | (((v + 0x8000) >> 16) & 0xFFFF);
+            }
+            for (end = pe + g->kindNrE[3]; pe < end; pe++)
+                *(u32 *)(sectBs + pe->offs) = ((pe->addend + vals[pe->slot]) & 0xFFFF) | (pe->addend & 0xFFFF0000);
+        }
+    }
+
+    return relocs;
+}
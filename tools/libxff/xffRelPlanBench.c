@@ -0,0 +1,531 @@
+/*
+xffrelplanbench: relocation from the tables in file order against relocation from an
+XFF_EXT_RELPLAN plan, see xffRelPlan.c.
+
+Usage: xffrelplanbench [-n reps] [-r relocs] [-y symbols] [-k]
+
+A synthetic module (xffGen.c) with 'relocs' relocation entries (default 400000) and
+'symbols' symbols (default 65536) gets a plan. Unless -k keeps the order the generator
+wrote, the entries of every table are shuffled first, a HI16 run and its LO16 staying
+together: tables concatenated from many objects, or sorted by symbol, don't follow the
+sites. Both ways are timed on the loaded module with the caches cleared before every
+run, best of 'reps', and as a whole XffLoadImage(). Cache misses come from the hardware
+counters when perf_event_open() lets us have them, and from a replay of the accesses
+of both loops through models of the EE data cache (8 KiB, 2-way), a host L1 (32 KiB,
+8-way) and a host L2 (256 KiB, 8-way), 64-byte lines and LRU. The planned sections must
+come out byte for byte the same as the relocated ones.
+*/
+
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xffBuild.h"
+
+#define EVICT_SIZE (64 << 20)
+
+struct Cache
+{
+    const char *name;
+    u32 setNrE;
+    u32 ways;
+    uintptr_t *tag; // per set, most recently used first; line + 1, 0 = empty
+    u64 misses;
+};
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static u32 NextRand(u32 *rnd)
+{
+    *rnd = *rnd * 1103515245 + 12345;
+    return *rnd >> 8;
+}
+
+// Writes over a buffer larger than the last level cache
+static void Evict(u8 *buf)
+{
+    u32 i;
+
+    for (i = 0; i < EVICT_SIZE; i += 64)
+        buf[i]++;
+}
+
+static s32 CacheInit(struct Cache *c, const char *name, u32 size, u32 ways)
+{
+    c->name = name;
+    c->setNrE = size / 64 / ways;
+    c->ways = ways;
+    c->misses = 0;
+    c->tag = calloc(c->setNrE * ways, sizeof(*c->tag));
+    return c->tag != NULL;
+}
+
+static void CacheReset(struct Cache *c)
+{
+    memset(c->tag, 0, c->setNrE * c->ways * sizeof(*c->tag));
+    c->misses = 0;
+}
+
+static void CacheAccess(struct Cache *c, uintptr_t line)
+{
+    uintptr_t *set = c->tag + (line % c->setNrE) * c->ways;
+    u32 w;
+
+    for (w = 0; w < c->ways - 1 && set[w] != line + 1; w++)
+        ;
+    if (set[w] != line + 1)
+        c->misses++;
+    memmove(set + 1, set, w * sizeof(*set));
+    set[0] = line + 1;
+}
+
+// Every line of [p, p + bytes) through every model
+static void Touch(struct Cache *c, u32 nrE, const void *p, u32 bytes)
+{
+    uintptr_t line;
+    u32 i;
+
+    for (line = (uintptr_t)p / 64; line <= ((uintptr_t)p + bytes - 1) / 64; line++)
+    {
+        for (i = 0; i < nrE; i++)
+            CacheAccess(&c[i], line);
+    }
+}
+
+// The accesses of XffRelocateCode()
+static void TraceTables(const struct XffArena *ar, const struct t_xffEntPntHdr *xffEp, struct Cache *c, u32 nrE)
+{
+    const struct t_xffRelocEnt *rt = XffPtr(ar, xffEp->relocTab);
+    const struct t_xffSymEnt *symTab = XffPtr(ar, xffEp->symTab);
+    const struct t_xffSectEnt *sect;
+    const struct t_xffRelocAddrEnt *addrTab;
+    const struct t_xffRelocInstEnt *instTab;
+    const u8 *sectBs;
+    u32 j;
+    u32 n;
+    u32 end;
+    s32 t;
+
+    for (t = 0; t < xffEp->relocTabNrE; t++, rt++)
+    {
+        Touch(c, nrE, rt, sizeof(*rt));
+        addrTab = XffPtr(ar, rt->addr);
+        instTab = XffPtr(ar, rt->inst);
+        sect = (const struct t_xffSectEnt *)XffPtr(ar, xffEp->sectTab) + rt->sect;
+        sectBs = XffPtr(ar, sect->memPt);
+        for (j = 0; j < rt->nrEnt; j = end)
+        {
+            end = j + 1;
+            if (addrTab[j].relType == XFF_R_HI16)
+            {
+                for (end = j; end < rt->nrEnt && addrTab[end].relType == XFF_R_HI16; end++)
+                    Touch(c, nrE, &addrTab[end], sizeof(*addrTab));
+                if (end < rt->nrEnt)
+                    Touch(c, nrE, &addrTab[end], sizeof(*addrTab));
+                if (end < rt->nrEnt && addrTab[end].relType == XFF_R_LO16)
+                    Touch(c, nrE, &instTab[end], sizeof(*instTab));
+            }
+            for (n = j; n < end; n++)
+            {
+                Touch(c, nrE, sect, sizeof(*sect));
+                Touch(c, nrE, &addrTab[n], sizeof(*addrTab));
+                Touch(c, nrE, &instTab[n], sizeof(*instTab));
+                Touch(c, nrE, &symTab[addrTab[n].tgSymIx].addr, 4);
+                Touch(c, nrE, sectBs + addrTab[n].addr, 4);
+            }
+        }
+    }
+}
+
+// The accesses of XffApplyRelPlan()
+static void TracePlan(const struct XffArena *ar, const struct t_xffEntPntHdr *xffEp, const struct XffRelPlanHdr *hdr,
+                      const u32 *vals, struct Cache *c, u32 nrE)
+{
+    const struct XffRelPlanTab *tab = (const struct XffRelPlanTab *)(hdr + 1);
+    const struct XffRelPlanGroup *grp = (const struct XffRelPlanGroup *)(tab + hdr->relocTabNrE);
+    const u32 *slot = (const u32 *)(grp + hdr->groupNrE);
+    const struct XffRelPlanEnt *ent = (const struct XffRelPlanEnt *)(slot + hdr->slotNrE);
+    const struct XffRelPlanGroup *g;
+    const struct XffRelPlanEnt *pe;
+    const struct t_xffRelocEnt *rt = XffPtr(ar, xffEp->relocTab);
+    const struct t_xffSymEnt *symTab = XffPtr(ar, xffEp->symTab);
+    const struct t_xffSectEnt *sect;
+    const u8 *sectBs;
+    u32 entNrE;
+    u32 j;
+    u32 k;
+    s32 t;
+
+    for (t = 0; t < xffEp->relocTabNrE; t++, tab++, rt++)
+    {
+        Touch(c, nrE, tab, sizeof(*tab));
+        Touch(c, nrE, rt, sizeof(*rt));
+        sect = (const struct t_xffSectEnt *)XffPtr(ar, xffEp->sectTab) + rt->sect;
+        Touch(c, nrE, sect, sizeof(*sect));
+        sectBs = XffPtr(ar, sect->memPt);
+
+        for (g = grp + tab->firstGroup, k = 0; k < tab->groupNrE; k++, g++)
+        {
+            Touch(c, nrE, g, sizeof(*g));
+            for (j = 0; j < g->slotNrE; j++)
+            {
+                Touch(c, nrE, &slot[g->firstSlot + j], 4);
+                Touch(c, nrE, &symTab[slot[g->firstSlot + j]].addr, 4);
+                Touch(c, nrE, &vals[j], 4);
+            }
+
+            entNrE = g->kindNrE[0] + g->kindNrE[1] + g->kindNrE[2] + g->kindNrE[3];
+            for (pe = ent + g->firstEnt; pe < ent + g->firstEnt + entNrE; pe++)
+            {
+                Touch(c, nrE, pe, sizeof(*pe));
+                Touch(c, nrE, &vals[pe->slot], 4);
+                Touch(c, nrE, sectBs + pe->offs, 4);
+            }
+        }
+    }
+}
+
+// Shuffles the entries of every table of a file image, a HI16 run and its LO16 as one
+static s32 ShuffleTables(u8 *data, u32 seed)
+{
+    const struct t_xffEntPntHdr *xffEp = (const struct t_xffEntPntHdr *)data;
+    const struct t_xffRelocEnt *rt = (const struct t_xffRelocEnt *)(data + xffEp->relocTab_Rel);
+    struct t_xffRelocAddrEnt *addrTab;
+    struct t_xffRelocInstEnt *instTab;
+    struct t_xffRelocAddrEnt *addrTmp;
+    struct t_xffRelocInstEnt *instTmp;
+    u32 *unit;
+    u32 unitNrE;
+    u32 rnd = seed;
+    u32 j;
+    u32 k;
+    u32 n;
+    u32 len;
+    u32 swap;
+    s32 t;
+
+    for (t = 0; t < xffEp->relocTabNrE; t++)
+    {
+        addrTab = (struct t_xffRelocAddrEnt *)(data + rt[t].addr_Rel);
+        instTab = (struct t_xffRelocInstEnt *)(data + rt[t].inst_Rel);
+        unit = malloc((rt[t].nrEnt + 1) * sizeof(*unit));
+        addrTmp = malloc((rt[t].nrEnt + 1) * sizeof(*addrTmp));
+        instTmp = malloc((rt[t].nrEnt + 1) * sizeof(*instTmp));
+        if (unit == NULL || addrTmp == NULL || instTmp == NULL)
+            return XFF_ERR_NOMEM;
+
+        for (j = 0, unitNrE = 0; j < rt[t].nrEnt; j = n)
+        {
+            for (n = j; n < rt[t].nrEnt && addrTab[n].relType == XFF_R_HI16; n++)
+                ;
+            n += n == j || n < rt[t].nrEnt;
+            unit[unitNrE++] = j;
+        }
+        for (j = unitNrE; j > 1; j--)
+        {
+            k = NextRand(&rnd) % j;
+            swap = unit[j - 1];
+            unit[j - 1] = unit[k];
+            unit[k] = swap;
+        }
+
+        for (j = 0, n = 0; j < unitNrE; j++)
+        {
+            k = unit[j];
+            for (len = 0; k + len < rt[t].nrEnt && addrTab[k + len].relType == XFF_R_HI16; len++)
+                ;
+            len += len == 0 || k + len < rt[t].nrEnt;
+            memcpy(&addrTmp[n], &addrTab[k], len * sizeof(*addrTab));
+            memcpy(&instTmp[n], &instTab[k], len * sizeof(*instTab));
+            n += len;
+        }
+        memcpy(addrTab, addrTmp, rt[t].nrEnt * sizeof(*addrTab));
+        memcpy(instTab, instTmp, rt[t].nrEnt * sizeof(*instTab));
+        free(unit);
+        free(addrTmp);
+        free(instTmp);
+    }
+    return XFF_OK;
+}
+
+static s32 OpenCounter(u32 type, u64 config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void CounterStart(s32 fd)
+{
+    if (fd >= 0)
+    {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+static void CounterStop(s32 fd, u64 *count)
+{
+    if (fd < 0)
+        return;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, count, sizeof(*count)) != sizeof(*count))
+        *count = 0;
+}
+
+static void PrintCounter(const char *name, s32 fd, u64 tables, u64 plan, u32 relocs)
+{
+    if (fd < 0)
+    {
+        printf("%-18s: n/a (no hardware counters here)\n", name);
+        return;
+    }
+    printf("%-18s: tables %10llu (%.3f per entry), plan %10llu (%.3f per entry)\n", name, (unsigned long long)tables,
+           (double)tables / relocs, (unsigned long long)plan, (double)plan / relocs);
+}
+
+// Loads 'img' into a reset loader, returns the seconds
+static double TimeLoad(struct XffLoader *ldr, const u8 *img, u32 size)
+{
+    struct XffModule *mod;
+    double t0;
+
+    XffLoaderReset(ldr);
+    t0 = NowSec();
+    if (XffLoadImage(ldr, "bench", img, size, &mod) != XFF_OK)
+        return -1;
+    return NowSec() - t0;
+}
+
+int main(int argc, char **argv)
+{
+    struct XffGenParams p;
+    struct XffLoader ldr;
+    struct XffModule *mod;
+    struct Cache cache[3];
+    const struct XffRelPlanHdr *plan;
+    const struct XffRelPlanTab *tab;
+    const struct t_xffSectEnt *sect;
+    struct t_xffEntPntHdr *xffEp;
+    u8 **ref;
+    u8 *evict;
+    u8 *img;
+    u32 *vals;
+    u32 size;
+    u32 planSize;
+    u32 symNrE = 65536;
+    u32 relocNrE = 400000;
+    u32 relocs = 0;
+    u32 checked = 0;
+    u32 planned = 0;
+    u32 bad = 0;
+    u64 hwTables[2] = {0, 0};
+    u64 hwPlan[2] = {0, 0};
+    u64 simTables[3];
+    s32 fd[2];
+    s32 keepOrder = 0;
+    s32 reps = 10;
+    s32 opt;
+    s32 r;
+    s32 i;
+    double sec;
+    double tTables = 1e30;
+    double tPlan = 1e30;
+    double tLoad = 1e30;
+    double tLoadPlan = 1e30;
+
+    while ((opt = getopt(argc, argv, "n:r:y:k")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            reps = strtol(optarg, NULL, 0);
+            break;
+        case 'r':
+            relocNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'y':
+            symNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            keepOrder = 1;
+            break;
+        default:
+            reps = 0;
+            break;
+        }
+    }
+
+    if (reps < 1 || optind != argc || relocNrE == 0 || symNrE < 2)
+    {
+        fprintf(stderr, "usage: %s [-n reps] [-r relocs] [-y symbols] [-k]\n", argv[0]);
+        return 1;
+    }
+
+    XffGenDefaults(&p);
+    p.exportNrE = symNrE / 2;
+    p.localNrE = symNrE - symNrE / 2;
+    p.importNrE = 0;
+    p.relocNrE = relocNrE;
+
+    evict = calloc(1, EVICT_SIZE);
+    if (evict == NULL || XffGenerate(&p, &img, &size) != XFF_OK ||
+        (!keepOrder && ShuffleTables(img, 7) != XFF_OK) || !CacheInit(&cache[0], "sim EE D$ 8K/2", 8 << 10, 2) ||
+        !CacheInit(&cache[1], "sim host L1 32K/8", 32 << 10, 8) || !CacheInit(&cache[2], "sim host L2 256K/8", 256 << 10, 8) ||
+        XffLoaderInit(&ldr, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK)
+    {
+        fprintf(stderr, "xffrelplanbench: out of memory\n");
+        return 1;
+    }
+    img = XffRelPlanAttach(img, &size);
+    plan = XffExtFind(img, size, XFF_EXT_RELPLAN, &planSize);
+    if (plan == NULL)
+    {
+        fprintf(stderr, "xffrelplanbench: no plan for the module\n");
+        return 1;
+    }
+    vals = malloc((XffRelPlanSlots(plan) + 1) * sizeof(*vals));
+    if (vals == NULL)
+    {
+        fprintf(stderr, "xffrelplanbench: out of memory\n");
+        return 1;
+    }
+
+    // Whole loads first, the plan picked up by XffLoadImage() or ignored
+    for (r = 0; r < reps; r++)
+    {
+        ldr.noRelPlan = 1;
+        Evict(evict);
+        sec = TimeLoad(&ldr, img, size);
+        tLoad = sec >= 0 && sec < tLoad ? sec : tLoad;
+        ldr.noRelPlan = 0;
+        Evict(evict);
+        sec = TimeLoad(&ldr, img, size);
+        tLoadPlan = sec >= 0 && sec < tLoadPlan ? sec : tLoadPlan;
+        if (sec < 0)
+        {
+            fprintf(stderr, "xffrelplanbench: load failed\n");
+            return 1;
+        }
+    }
+    planned = ldr.stats.relPlans;
+
+    // The relocation loops alone, on a module that keeps its tables
+    XffLoaderReset(&ldr);
+    ldr.noRelPlan = 1;
+    ldr.keepLocalRelocs = 1;
+    if (XffLoadImage(&ldr, "bench", img, size, &mod) != XFF_OK || !XffRelPlanCheck(&ldr.arena, plan, planSize, mod->xffEp))
+    {
+        fprintf(stderr, "xffrelplanbench: load failed\n");
+        return 1;
+    }
+    xffEp = mod->xffEp;
+    sect = XffPtr(&ldr.arena, xffEp->sectTab);
+
+    fd[0] = OpenCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    fd[1] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    for (r = 0; r < reps; r++)
+    {
+        Evict(evict);
+        for (i = 0; i < 2; i++)
+            CounterStart(fd[i]);
+        sec = NowSec();
+        relocs = XffRelocateCode(&ldr.arena, xffEp, 0, xffEp->relocTabNrE);
+        sec = NowSec() - sec;
+        for (i = 0; i < 2; i++)
+            CounterStop(fd[i], &hwTables[i]);
+        tTables = sec < tTables ? sec : tTables;
+
+        Evict(evict);
+        for (i = 0; i < 2; i++)
+            CounterStart(fd[i]);
+        sec = NowSec();
+        XffApplyRelPlan(&ldr.arena, xffEp, plan, vals);
+        sec = NowSec() - sec;
+        for (i = 0; i < 2; i++)
+            CounterStop(fd[i], &hwPlan[i]);
+        tPlan = sec < tPlan ? sec : tPlan;
+    }
+
+    // The sections as the tables leave them, then cleared and planned again
+    ref = calloc(xffEp->sectNrE, sizeof(*ref));
+    XffRelocateCode(&ldr.arena, xffEp, 0, xffEp->relocTabNrE);
+    for (i = 1; i < xffEp->sectNrE; i++)
+    {
+        if (sect[i].type == XFF_SECT_NOBITS || sect[i].size == 0)
+            continue;
+        ref[i] = malloc(sect[i].size);
+        memcpy(ref[i], XffPtr(&ldr.arena, sect[i].memPt), sect[i].size);
+        memset(XffPtr(&ldr.arena, sect[i].memPt), 0, sect[i].size);
+    }
+    XffApplyRelPlan(&ldr.arena, xffEp, plan, vals);
+    for (i = 1; i < xffEp->sectNrE; i++)
+    {
+        if (ref[i] == NULL)
+            continue;
+        bad += memcmp(ref[i], XffPtr(&ldr.arena, sect[i].memPt), sect[i].size) != 0;
+        checked += sect[i].size;
+        free(ref[i]);
+    }
+    free(ref);
+
+    TraceTables(&ldr.arena, xffEp, cache, 3);
+    for (i = 0; i < 3; i++)
+    {
+        simTables[i] = cache[i].misses;
+        CacheReset(&cache[i]);
+    }
+    TracePlan(&ldr.arena, xffEp, plan, vals, cache, 3);
+
+    tab = (const struct XffRelPlanTab *)(plan + 1);
+    for (i = 0, r = 0; i < xffEp->relocTabNrE; i++)
+        r += tab[i].fileOrder;
+
+    printf("module            : %u relocations in %d tables, %u symbols (symTab %u KiB), %s\n", relocs, xffEp->relocTabNrE,
+           symNrE, (u32)(xffEp->symTabNrE * sizeof(struct t_xffSymEnt)) >> 10, keepOrder ? "generator order" : "shuffled");
+    printf("plan              : %u bytes, %u entries, %u groups, %u slots, %d tables left in file order\n", planSize,
+           plan->entNrE, plan->groupNrE, plan->slotNrE, r);
+    printf("relocate, tables  : %8.3f ms (%.2f ns per entry)\n", tTables * 1e3, tTables * 1e9 / relocs);
+    printf("relocate, plan    : %8.3f ms (%.2f ns per entry, %.2fx)\n", tPlan * 1e3, tPlan * 1e9 / relocs, tTables / tPlan);
+    printf("load, tables      : %8.3f ms\n", tLoad * 1e3);
+    printf("load, plan        : %8.3f ms (%.2fx), %u of %d loads planned\n", tLoadPlan * 1e3, tLoad / tLoadPlan, planned,
+           reps);
+    PrintCounter("hw L1D read miss", fd[0], hwTables[0], hwPlan[0], relocs);
+    PrintCounter("hw cache misses", fd[1], hwTables[1], hwPlan[1], relocs);
+    for (i = 0; i < 3; i++)
+        PrintCounter(cache[i].name, 0, simTables[i], cache[i].misses, relocs);
+    printf("check             : %u section bytes, %u sections differ\n", checked, bad);
+
+    for (i = 0; i < 2; i++)
+    {
+        if (fd[i] >= 0)
+            close(fd[i]);
+    }
+    for (i = 0; i < 3; i++)
+        free(cache[i].tag);
+    free(img);
+    free(vals);
+    free(evict);
+    XffLoaderTerm(&ldr);
+    return bad != 0;
+}
@@ -0,0 +1,234 @@
+/*
+xffrelocbench: scaling of the parallel relocation engine.
+
+Usage: xffrelocbench [-r relocs] [-t maxThreads] [-c chunk] [-n iterations]
+
+Builds a synthetic module with 'relocs' relocation entries (default 200000) spread over
+.text/.data/.rodata, with extern and local halves and HI16/LO16 runs. RelocateCode is
+timed serially and then on 1 to maxThreads threads; every parallel result is compared
+byte for byte with the serial one.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xffBuild.h"
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Fills a section with relocations, one site per word, HI16/LO16 pairs and runs included.
+static void AddRelocs(struct XffBuilder *b, u32 sect, u32 relocNrE, u32 *imports, u32 importNrE, u32 localSym)
+{
+    u32 addr = 0;
+    u32 symIx;
+    u32 r;
+    u32 i;
+    u32 hiNrE;
+
+    for (i = 0; i < relocNrE;)
+    {
+        r = rand();
+        symIx = (r & 0x300) == 0 ? imports[(r >> 12) % importNrE] : localSym;
+
+        switch (r % 4)
+        {
+        case 0:
+            XffBuilderAddReloc(b, sect, addr, XFF_R_32, symIx, (r >> 4) & 0xFFF);
+            addr += 4;
+            i++;
+            break;
+        case 1:
+            XffBuilderAddReloc(b, sect, addr, XFF_R_26, symIx, 0x0C000000 | ((r >> 4) & 0xFFF));
+            addr += 4;
+            i++;
+            break;
+        default:
+            // lui/addiu, sometimes several lui sharing one addiu
+            for (hiNrE = 1 + ((r >> 16) % 3 == 0); hiNrE--; i++, addr += 4)
+            {
+                XffBuilderAddReloc(b, sect, addr, XFF_R_HI16, symIx, 0x3C020000 | ((r >> 20) & 0xF));
+            }
+            XffBuilderAddReloc(b, sect, addr, XFF_R_LO16, symIx, 0x24420000 | ((r >> 5) & 0xFFFF));
+            addr += 4;
+            i++;
+            break;
+        }
+    }
+}
+
+static u8 *BuildModule(u32 relocNrE, u32 *sizeOut)
+{
+    struct XffBuilder b;
+    static const char *names[] = {".text", ".data", ".rodata"};
+    static const u32 share[] = {70, 20, 10};
+    u32 imports[64];
+    u32 sect[3];
+    u32 i;
+    u8 *img;
+
+    XffBuilderInit(&b);
+    for (i = 0; i < 3; i++)
+    {
+        // Every reloc needs at most one word, plus slack for HI16 runs
+        sect[i] = XffBuilderAddSection(&b, names[i], XFF_SECT_PROGBITS, 16, 0, NULL, (relocNrE * share[i] / 100 + 16) * 8);
+    }
+    for (i = 0; i < 64; i++)
+    {
+        imports[i] = XffBuilderAddSymbol(&b, "", 0, 0, 0, XFF_STT_FUNC, XFF_STB_GLOBAL);
+    }
+    for (i = 0; i < 3; i++)
+    {
+        AddRelocs(&b, sect[i], relocNrE * share[i] / 100, imports, 64, b.sect[sect[i]].symIx);
+    }
+
+    XffBuilderWrite(&b, &img, sizeOut);
+    XffBuilderFree(&b);
+    return img;
+}
+
+static u32 SectBytes(const struct XffArena *ar, const struct t_xffEntPntHdr *xffEp, u8 *out)
+{
+    const struct t_xffSectEnt *sect = XffPtr(ar, xffEp->sectTab);
+    u32 size = 0;
+    s32 i;
+
+    for (i = 1; i < xffEp->sectNrE; i++)
+    {
+        if (out != NULL)
+            memcpy(out + size, XffPtr(ar, sect[i].memPt), sect[i].size);
+        size += sect[i].size;
+    }
+    return size;
+}
+
+static void FillSections(const struct XffArena *ar, const struct t_xffEntPntHdr *xffEp, u8 fill)
+{
+    const struct t_xffSectEnt *sect = XffPtr(ar, xffEp->sectTab);
+    s32 i;
+
+    for (i = 1; i < xffEp->sectNrE; i++)
+    {
+        memset(XffPtr(ar, sect[i].memPt), fill, sect[i].size);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct XffLoader ldr;
+    struct t_xffEntPntHdr *xffEp;
+    struct XffRelocPool *pool;
+    u32 relocNrE = 200000;
+    u32 chunk = XFF_RELOC_CHUNK_DEFAULT;
+    s32 maxThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    s32 iterations = 20;
+    s32 opt;
+    s32 t;
+    s32 it;
+    u32 size;
+    u32 fileAddr;
+    u32 sectSize;
+    u32 relocs = 0;
+    u8 *img;
+    u8 *ref;
+    u8 *cur;
+    double t0;
+    double serialSec;
+    double sec;
+
+    while ((opt = getopt(argc, argv, "r:t:c:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            relocNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            maxThreads = strtol(optarg, NULL, 0);
+            break;
+        case 'c':
+            chunk = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            iterations = strtol(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r relocs] [-t maxThreads] [-c chunk] [-n iterations]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (maxThreads < 1 || iterations < 1 || chunk == 0)
+        return 1;
+
+    img = BuildModule(relocNrE, &size);
+    if (img == NULL)
+    {
+        fprintf(stderr, "xffrelocbench: out of memory\n");
+        return 1;
+    }
+    XffLoaderInit(&ldr, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE);
+
+    // Load by hand so the local relocation tables aren't disposed
+    fileAddr = XffArenaAlloc(&ldr.arena, size, 0x10);
+    xffEp = XffPtr(&ldr.arena, fileAddr);
+    if (fileAddr != 0)
+        memcpy(xffEp, img, size);
+    if (fileAddr == 0 || XffRelocateElfInfoHeader(&ldr.arena, xffEp, fileAddr) != XFF_OK || XffDecodeSection(&ldr, xffEp) != XFF_OK)
+    {
+        fprintf(stderr, "xffrelocbench: can't load the module\n");
+        return 1;
+    }
+    XffRelocateSelfSymbol(&ldr.arena, xffEp);
+    XffResolveImports(&ldr, xffEp);
+
+    sectSize = SectBytes(&ldr.arena, xffEp, NULL);
+    ref = malloc(sectSize);
+    cur = malloc(sectSize);
+
+    FillSections(&ldr.arena, xffEp, 0xA5);
+    t0 = NowSec();
+    for (it = 0; it < iterations; it++)
+    {
+        relocs = XffRelocateCode(&ldr.arena, xffEp, 0, xffEp->relocTabNrE);
+    }
+    serialSec = (NowSec() - t0) / iterations;
+    SectBytes(&ldr.arena, xffEp, ref);
+
+    printf("module: %u relocs in %d tables, %u section bytes, chunk %u\n", relocs, xffEp->relocTabNrE, sectSize, chunk);
+    printf("serial     : %8.3f ms  %8.2f M relocs/sec\n", serialSec * 1e3, relocs / serialSec * 1e-6);
+
+    for (t = 1; t <= maxThreads; t++)
+    {
+        pool = XffRelocPoolCreate(t);
+
+        // Scribble over the sections so a missed site can't pass the comparison
+        FillSections(&ldr.arena, xffEp, 0xA5);
+
+        t0 = NowSec();
+        for (it = 0; it < iterations; it++)
+        {
+            XffRelocateCodeParallel(pool, &ldr.arena, xffEp, 0, xffEp->relocTabNrE, chunk);
+        }
+        sec = (NowSec() - t0) / iterations;
+        XffRelocPoolDestroy(pool);
+
+        SectBytes(&ldr.arena, xffEp, cur);
+        printf("%2d threads : %8.3f ms  %8.2f M relocs/sec  speedup %5.2fx  %s\n", t, sec * 1e3, relocs / sec * 1e-6,
+               serialSec / sec, memcmp(ref, cur, sectSize) == 0 ? "identical" : "MISMATCH");
+    }
+
+    free(ref);
+    free(cur);
+    free(img);
+    XffLoaderTerm(&ldr);
+    return 0;
+}
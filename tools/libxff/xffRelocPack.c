@@ -0,0 +1,314 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libxff.h"
+
+/*
+Compact form of the relocation tables a module keeps resident.
+
+After DisposeRelocationElement() a module still holds the extern half of its tables,
+16 bytes per entry: a t_xffRelocAddrEnt and a t_xffRelocInstEnt. They are applied again
+whenever a module the imports bind to moves. XffPackRelocations() rewrites them in place
+as byte streams, one per table, and the file image can be trimmed right after the last
+stream instead of after the raw tables.
+
+Stream of a table:
+  u8 shift                      site offsets are multiples of 1 << shift
+  per entry, sorted by site offset:
+    varint (offset - previous offset) >> shift
+    varint symIx << 3 | kind
+    varint argument of the kind
+The opcode bits of HI16, LO16 and 26-bit sites are not stored, relocation never changes
+them and they are read back from the site. A HI16 carries the full addend, the low half
+included, so the entries don't depend on their order anymore. A 26-bit site whose
+addend carried into the opcode when it was relocated stores the whole instruction.
+*/
+
+// Extern tables of a module, one per relocated section
+#define PACK_MAX_TABS (64)
+
+enum
+{
+    PACK_R_32,     // zigzag addend, the whole instruction word
+    PACK_R_26,     // low 26 bits of the instruction
+    PACK_R_HI16,   // zigzag (inst << 16) + low half of the addend
+    PACK_R_LO16,   // zigzag (s16)inst
+    PACK_R_26_RAW, // the whole instruction
+};
+
+struct PackEnt
+{
+    u32 offs;
+    u32 tag;
+    u32 arg;
+};
+
+static inline u32 ZigZag(s32 v)
+{
+    return ((u32)v << 1) ^ (u32)(v >> 31);
+}
+
+static inline s32 UnZigZag(u32 v)
+{
+    return (s32)(v >> 1) ^ -(s32)(v & 1);
+}
+
+static u8 *PutVarint(u8 *p, u32 v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static inline u32 GetVarint(const u8 **pp)
+{
+    const u8 *p = *pp;
+    u32 v = *p++;
+    u32 b;
+    u32 shift;
+
+    if (v >= 0x80)
+    {
+        v &= 0x7F;
+        shift = 7;
+        do
+        {
+            b = *p++;
+            v |= (b & 0x7F) << shift;
+            shift += 7;
+        } while (b & 0x80);
+    }
+    *pp = p;
+    return v;
+}
+
+static int CompareEnt(const void *a, const void *b)
+{
+    const struct PackEnt *x = a;
+    const struct PackEnt *y = b;
+
+    return x->offs < y->offs ? -1 : x->offs > y->offs;
+}
+
+// Encodes one raw table at 'p'. Returns the end of the stream and the entries kept in
+// 'nrEntOut'; entries of types the loader ignores are dropped.
+static u8 *PackTable(const struct XffArena *ar, const struct t_xffEntPntHdr *xffEp, const struct t_xffRelocEnt *rt,
+                     struct PackEnt *ent, u8 *p, u32 *nrEntOut)
+{
+    const struct t_xffRelocAddrEnt *addrTab = XffPtr(ar, rt->addr);
+    const struct t_xffRelocInstEnt *instTab = XffPtr(ar, rt->inst);
+    const struct t_xffSectEnt *sect = (const struct t_xffSectEnt *)XffPtr(ar, xffEp->sectTab) + rt->sect;
+    const u8 *sectBs = XffPtr(ar, sect->memPt);
+    u32 site;
+    u32 inst;
+    u32 align = 0;
+    u32 shift;
+    u32 prev;
+    u32 n = 0;
+    u32 lo;
+    u32 i;
+    u32 k;
+
+    for (i = 0; i < rt->nrEnt; i++)
+    {
+        inst = instTab[i].inst;
+        memcpy(&site, sectBs + addrTab[i].addr, 4);
+        ent[n].offs = addrTab[i].addr;
+        ent[n].tag = addrTab[i].tgSymIx << 3;
+
+        switch (addrTab[i].relType)
+        {
+        case XFF_R_32:
+            ent[n].tag |= PACK_R_32;
+            ent[n].arg = ZigZag(inst);
+            break;
+        case XFF_R_26:
+            if ((site >> 26) == (inst >> 26))
+            {
+                ent[n].tag |= PACK_R_26;
+                ent[n].arg = inst & 0x03FFFFFF;
+            }
+            else
+            {
+                ent[n].tag |= PACK_R_26_RAW;
+                ent[n].arg = inst;
+            }
+            break;
+        case XFF_R_HI16:
+            // The LO16 closing the run, as XffResolveRelocation() finds it
+            for (k = i; k < rt->nrEnt && addrTab[k].relType == XFF_R_HI16; k++)
+                ;
+            lo = (k < rt->nrEnt && addrTab[k].relType == XFF_R_LO16) ? (s16)instTab[k].inst : 0;
+            ent[n].tag |= PACK_R_HI16;
+            ent[n].arg = ZigZag((inst << 16) + lo);
+            break;
+        case XFF_R_LO16:
+            ent[n].tag |= PACK_R_LO16;
+            ent[n].arg = ZigZag((s16)inst);
+            break;
+        default:
+            continue;
+        }
+        align |= ent[n].offs;
+        n++;
+    }
+
+    qsort(ent, n, sizeof(*ent), CompareEnt);
+
+    shift = (align & 3) == 0 ? 2 : 0;
+    *p++ = shift;
+    for (i = 0, prev = 0; i < n; i++)
+    {
+        p = PutVarint(p, (ent[i].offs - prev) >> shift);
+        prev = ent[i].offs;
+        p = PutVarint(p, ent[i].tag);
+        p = PutVarint(p, ent[i].arg);
+    }
+
+    *nrEntOut = n;
+    return p;
+}
+
+// Applies a packed table. With 'changed' only the entries whose target symbol is flagged
+// in it, see XffRelocateOnline(). Returns the sites patched.
+u32 XffApplyPackedRelocs(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp, const struct t_xffRelocEnt *rt, const u8 *changed)
+{
+    const struct t_xffSymEnt *symTab = XffPtr(ar, xffEp->symTab);
+    const struct t_xffSectEnt *sect = (const struct t_xffSectEnt *)XffPtr(ar, xffEp->sectTab) + rt->sect;
+    u8 *sectBs = XffPtr(ar, sect->memPt);
+    const u8 *p = XffPtr(ar, rt->addr);
+    u32 shift = *p++;
+    u32 offs = 0;
+    u32 patched = 0;
+    u32 tag;
+    u32 arg;
+    u32 val;
+    u32 *site;
+    u32 j;
+
+    for (j = 0; j < rt->nrEnt; j++)
+    {
+        offs += GetVarint(&p) << shift;
+        tag = GetVarint(&p);
+        arg = GetVarint(&p);
+        if (changed != NULL && !changed[tag >> 3])
+            continue;
+
+        site = (u32 *)(sectBs + offs);
+        val = symTab[tag >> 3].addr;
+        switch (tag & 7)
+        {
+        case PACK_R_32:
+            *site = UnZigZag(arg) + val;
+            break;
+        case PACK_R_26:
+            *site = ((val / 4) & 0x03FFFFFF) + ((*site & 0xFC000000) | arg);
+            break;
+        case PACK_R_26_RAW:
+            *site = ((val / 4) & 0x03FFFFFF) + arg;
+            break;
+        case PACK_R_HI16:
+            val += UnZigZag(arg);
+            *site = (*site & 0xFFFF0000) | (((val + 0x8000) >> 16) & 0xFFFF);
+            break;
+        case PACK_R_LO16:
+            *site = ((UnZigZag(arg) + val) & 0xFFFF) | (*site & 0xFFFF0000);
+            break;
+        }
+        patched++;
+    }
+
+    return patched;
+}
+
+// Replaces the extern relocation tables of a relocated image by their packed form, when
+// XffLoader.packRelocs is set. 'freeStart' is what XffDisposeRelocationElement() returned;
+// the result is the new start of the unneeded part of the file image, 'freeStart' itself
+// when the tables were left alone. They are packed only when they tile the bytes right
+// below 'freeStart', the layout xffBuild and the original tools write.
+u32 XffPackRelocations(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp, u32 freeStart)
+{
+    const struct XffArena *ar = &ldr->arena;
+    struct t_xffRelocEnt *rt = XffPtr(ar, xffEp->relocTab);
+    struct t_xffSectEnt *sect = XffPtr(ar, xffEp->sectTab);
+    s32 halfTabsNrE = xffEp->relocTabNrE / 2;
+    struct PackEnt *ent;
+    u32 lo = 0xFFFFFFFF;
+    u32 hi = 0;
+    u32 rawSize = 0;
+    u32 maxNrE = 0;
+    u32 offs[PACK_MAX_TABS + 1];
+    u32 nrEnt[PACK_MAX_TABS];
+    u32 size;
+    u8 *buf;
+    u8 *p;
+    s32 i;
+
+    if (!ldr->packRelocs || freeStart == 0 || halfTabsNrE == 0 || halfTabsNrE > PACK_MAX_TABS)
+        return freeStart;
+
+    for (i = 0; i < halfTabsNrE; i++)
+    {
+        if (rt[i].nrEnt == 0)
+            continue;
+        if (rt[i].type == XFF_RELOC_TYPE_PACKED || rt[i].sect >= (u32)xffEp->sectNrE || sect[rt[i].sect].memPt == 0)
+            return freeStart;
+
+        lo = rt[i].addr < lo ? rt[i].addr : lo;
+        lo = rt[i].inst < lo ? rt[i].inst : lo;
+        hi = rt[i].addr + rt[i].nrEnt * sizeof(struct t_xffRelocAddrEnt) > hi ? rt[i].addr + rt[i].nrEnt * sizeof(struct t_xffRelocAddrEnt) : hi;
+        hi = rt[i].inst + rt[i].nrEnt * sizeof(struct t_xffRelocInstEnt) > hi ? rt[i].inst + rt[i].nrEnt * sizeof(struct t_xffRelocInstEnt) : hi;
+        rawSize += rt[i].nrEnt * (sizeof(struct t_xffRelocAddrEnt) + sizeof(struct t_xffRelocInstEnt));
+        maxNrE = rt[i].nrEnt > maxNrE ? rt[i].nrEnt : maxNrE;
+    }
+    if (rawSize == 0 || hi != freeStart || hi - lo != rawSize)
+        return freeStart;
+
+    // Three varints of at most 5 bytes and the shift byte of each table
+    buf = malloc(rawSize + halfTabsNrE);
+    ent = malloc(maxNrE * sizeof(*ent));
+    if (buf == NULL || ent == NULL)
+    {
+        free(buf);
+        free(ent);
+        return freeStart;
+    }
+
+    for (i = 0, p = buf; i < halfTabsNrE; i++)
+    {
+        offs[i] = p - buf;
+        nrEnt[i] = 0;
+        if (rt[i].nrEnt != 0)
+            p = PackTable(ar, xffEp, &rt[i], ent, p, &nrEnt[i]);
+    }
+    offs[i] = p - buf;
+    size = p - buf;
+    free(ent);
+
+    if (size >= rawSize)
+    {
+        free(buf);
+        return freeStart;
+    }
+
+    memcpy(XffPtr(ar, lo), buf, size);
+    free(buf);
+
+    for (i = 0; i < halfTabsNrE; i++)
+    {
+        if (rt[i].nrEnt == 0)
+            continue;
+        rt[i].type = XFF_RELOC_TYPE_PACKED;
+        rt[i].nrEnt = nrEnt[i];
+        rt[i].addr = lo + offs[i];
+        rt[i].inst = lo + offs[i + 1];
+    }
+
+    ldr->stats.relocBytesRaw += rawSize;
+    ldr->stats.relocBytesPacked += size;
+    return (lo + size + 3) & ~3;
+}
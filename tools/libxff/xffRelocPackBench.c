@@ -0,0 +1,231 @@
+/*
+xffrelocpackbench: resident extern relocation tables, raw against packed.
+
+Usage: xffrelocpackbench [-n reps] STARTUP.XFF [file.xff...]
+
+The boot sequence is loaded twice on the bump heap, once as the EE does and once with
+XffLoader.packRelocs. For every module the extern tables it keeps are listed with their
+raw and packed size, and applying them again (what happens to a module when one it
+imports from moves) is timed 'reps' times on both. The imports are then shifted and the
+tables applied on both sides, and the section contents must stay identical. Last the
+sequence is loaded on region heaps, where the image ends are given back, to show the
+memory the packed tables return.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libxff.h"
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static s32 Boot(struct XffLoader *ldr, char **paths, s32 pathNrE, s32 pack, s32 regions)
+{
+    s32 i;
+
+    if (XffLoaderInit(ldr, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK ||
+        (regions && XffLoaderUseRegions(ldr, XFF_REGION_CHUNK_DEFAULT) != XFF_OK))
+    {
+        fprintf(stderr, "xffrelocpackbench: out of memory\n");
+        return XFF_ERR_NOMEM;
+    }
+    ldr->packRelocs = pack;
+
+    for (i = 0; i < pathNrE; i++)
+    {
+        if (XffLoadFile(ldr, paths[i], NULL) != XFF_OK)
+        {
+            fprintf(stderr, "xffrelocpackbench: %s: load failed\n", paths[i]);
+            return XFF_ERR_IO;
+        }
+    }
+    return XFF_OK;
+}
+
+// Modules come newest first, both loaders hold the same sequence
+static struct XffModule *NthModule(const struct XffLoader *ldr, s32 n)
+{
+    struct XffModule *mod = ldr->modules;
+
+    while (mod != NULL && n-- > 0)
+        mod = mod->next;
+    return mod;
+}
+
+static u32 ExternEntries(const struct XffArena *ar, const struct t_xffEntPntHdr *xffEp)
+{
+    const struct t_xffRelocEnt *rt = XffPtr(ar, xffEp->relocTab);
+    u32 n = 0;
+    s32 i;
+
+    for (i = 0; i < xffEp->relocTabNrE / 2; i++)
+        n += rt[i].nrEnt;
+    return n;
+}
+
+static u32 PackedBytes(const struct XffArena *ar, const struct t_xffEntPntHdr *xffEp)
+{
+    const struct t_xffRelocEnt *rt = XffPtr(ar, xffEp->relocTab);
+    u32 n = 0;
+    s32 i;
+
+    for (i = 0; i < xffEp->relocTabNrE / 2; i++)
+    {
+        if (rt[i].type == XFF_RELOC_TYPE_PACKED)
+            n += rt[i].inst - rt[i].addr;
+    }
+    return n;
+}
+
+// Both images have the same layout on the bump heap
+static s32 SameSections(const struct XffArena *ar, const struct t_xffEntPntHdr *a, const struct t_xffEntPntHdr *b)
+{
+    const struct t_xffSectEnt *sa = XffPtr(ar, a->sectTab);
+    const struct t_xffSectEnt *sb = XffPtr(ar, b->sectTab);
+    s32 i;
+
+    for (i = 1; i < a->sectNrE; i++)
+    {
+        if (sa[i].memPt != sb[i].memPt || sa[i].size != sb[i].size)
+            return 0;
+        if (sa[i].memPt != 0 && sa[i].type != XFF_SECT_NOBITS && memcmp(XffPtr(ar, sa[i].memPt), XffPtr(ar, sb[i].memPt), sa[i].size) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+static void ShiftImports(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp, s32 delta)
+{
+    struct t_xffImpSymIxs *imp = XffPtr(ar, xffEp->impSymIxs);
+    struct t_xffSymEnt *symTab = XffPtr(ar, xffEp->symTab);
+    s32 i;
+
+    for (i = 0; i < xffEp->impSymIxsNrE; i++)
+        symTab[imp[i].stIx].addr += delta;
+}
+
+int main(int argc, char **argv)
+{
+    struct XffLoader raw;
+    struct XffLoader packed;
+    struct XffModule *modRaw;
+    struct XffModule *modPacked;
+    char **paths;
+    u32 reps = 200;
+    u32 entries;
+    u32 rawBytes;
+    u32 packedBytes;
+    u32 totalEntries = 0;
+    u32 totalRaw = 0;
+    u32 totalPacked = 0;
+    u32 bad = 0;
+    u32 r;
+    s32 pathNrE;
+    s32 opt;
+    s32 i;
+    double tRaw;
+    double tPacked;
+    double sumRaw = 0;
+    double sumPacked = 0;
+    double t0;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            reps = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+
+    if (optind >= argc || reps == 0)
+    {
+        fprintf(stderr, "usage: %s [-n reps] STARTUP.XFF [file.xff...]\n", argv[0]);
+        return 1;
+    }
+    paths = argv + optind;
+    pathNrE = argc - optind;
+
+    if (Boot(&raw, paths, pathNrE, 0, 0) != XFF_OK || Boot(&packed, paths, pathNrE, 1, 0) != XFF_OK)
+        return 1;
+
+    printf("%-24s %8s %10s %10s %6s %10s %10s\n", "module", "extern", "raw", "packed", "B/ent", "raw ns", "packed ns");
+    for (i = pathNrE - 1; i >= 0; i--)
+    {
+        modRaw = NthModule(&raw, i);
+        modPacked = NthModule(&packed, i);
+        entries = ExternEntries(&raw.arena, modRaw->xffEp);
+        rawBytes = entries * (sizeof(struct t_xffRelocAddrEnt) + sizeof(struct t_xffRelocInstEnt));
+        packedBytes = PackedBytes(&packed.arena, modPacked->xffEp);
+
+        t0 = NowSec();
+        for (r = 0; r < reps; r++)
+            XffRelocateCode(&raw.arena, modRaw->xffEp, 0, modRaw->xffEp->relocTabNrE / 2);
+        tRaw = (NowSec() - t0) / reps;
+
+        t0 = NowSec();
+        for (r = 0; r < reps; r++)
+            XffRelocateCode(&packed.arena, modPacked->xffEp, 0, modPacked->xffEp->relocTabNrE / 2);
+        tPacked = (NowSec() - t0) / reps;
+
+        bad += ExternEntries(&packed.arena, modPacked->xffEp) != entries || !SameSections(&raw.arena, modRaw->xffEp, modPacked->xffEp);
+
+        // Imports bound somewhere else: both must patch the same sites the same way
+        ShiftImports(&raw.arena, modRaw->xffEp, 0x12340);
+        ShiftImports(&packed.arena, modPacked->xffEp, 0x12340);
+        XffRelocateCode(&raw.arena, modRaw->xffEp, 0, modRaw->xffEp->relocTabNrE / 2);
+        XffRelocateCode(&packed.arena, modPacked->xffEp, 0, modPacked->xffEp->relocTabNrE / 2);
+        bad += !SameSections(&raw.arena, modRaw->xffEp, modPacked->xffEp);
+        ShiftImports(&raw.arena, modRaw->xffEp, -0x12340);
+        ShiftImports(&packed.arena, modPacked->xffEp, -0x12340);
+        XffRelocateCode(&raw.arena, modRaw->xffEp, 0, modRaw->xffEp->relocTabNrE / 2);
+        XffRelocateCode(&packed.arena, modPacked->xffEp, 0, modPacked->xffEp->relocTabNrE / 2);
+        bad += !SameSections(&raw.arena, modRaw->xffEp, modPacked->xffEp);
+
+        printf("%-24.24s %8u %10u %10u %6.2f %10.0f %10.0f\n", modRaw->name, entries, rawBytes, packedBytes,
+               entries ? (double)packedBytes / entries : 0.0, tRaw * 1e9, tPacked * 1e9);
+        totalEntries += entries;
+        totalRaw += rawBytes;
+        totalPacked += packedBytes;
+        sumRaw += tRaw;
+        sumPacked += tPacked;
+    }
+
+    printf("%-24s %8u %10u %10u %6.2f %10.0f %10.0f\n", "total", totalEntries, totalRaw, totalPacked,
+           totalEntries ? (double)totalPacked / totalEntries : 0.0, sumRaw * 1e9, sumPacked * 1e9);
+    if (totalEntries != 0)
+    {
+        printf("apply            : raw %.2f ns/entry, packed %.2f ns/entry (%.2fx)\n", sumRaw * 1e9 / totalEntries,
+               sumPacked * 1e9 / totalEntries, sumRaw / sumPacked);
+    }
+    XffLoaderTerm(&raw);
+    XffLoaderTerm(&packed);
+
+    // Where the image ends go back to the heap
+    if (Boot(&raw, paths, pathNrE, 0, 1) != XFF_OK || Boot(&packed, paths, pathNrE, 1, 1) != XFF_OK)
+        return 1;
+    printf("region heap      : %u bytes trimmed raw, %u packed, %u bytes more free\n", raw.trimmed, packed.trimmed,
+           packed.trimmed - raw.trimmed);
+    XffLoaderTerm(&raw);
+    XffLoaderTerm(&packed);
+
+    if (bad != 0)
+    {
+        fprintf(stderr, "xffrelocpackbench: %u mismatches between raw and packed tables\n", bad);
+        return 1;
+    }
+    return 0;
+}
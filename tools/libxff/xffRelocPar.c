@@ -0,0 +1,260 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libxff.h"
+
+/*
+Parallel RelocateCode() for the host loader and offline tools.
+
+Every relocation table targets its own section half, so tables can be applied
+independently, and large tables are further cut into entry ranges. A range never starts
+right after an XFF_R_HI16: a HI16 run is applied in one go and reads its addend from the
+LO16 that closes it, so a cut may fall before that LO16 but never inside the run.
+
+Relocation values come from the instruction table and symTab only, never from the words
+being patched, which makes the result independent of the order ranges run in. Only a
+table whose sites strictly ascend is cut: any other may patch a word twice, the last
+entry winning, so it runs as one job in file order. Either way the result is byte
+identical to the serial path.
+*/
+
+struct RelocJob
+{
+    struct t_xffRelocEnt *rt;
+    u32 begin;
+    u32 end;
+};
+
+struct XffRelocPool
+{
+    pthread_t *threads;
+    s32 threadNrE;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    u32 generation; // bumped for every batch of jobs
+    s32 busy;       // workers still inside the current batch
+    s32 quit;
+
+    // Current batch
+    const struct XffArena *ar;
+    struct t_xffEntPntHdr *xffEp;
+    struct RelocJob *jobs;
+    u32 jobNrE;
+    u32 jobCap;
+    u32 nextJob; // taken with an atomic add
+};
+
+// Applies entries [begin, end) of a table. 'end' must not split a HI16 run from its LO16.
+u32 XffRelocateRange(const struct XffArena *ar, struct t_xffEntPntHdr *xffEp, struct t_xffRelocEnt *rt, u32 begin, u32 end)
+{
+    u32 j;
+
+    for (j = begin; j < end;)
+    {
+        j += XffResolveRelocation(ar, xffEp, rt, j);
+    }
+    return end - begin;
+}
+
+static void RunJobs(struct XffRelocPool *pool)
+{
+    struct RelocJob *job;
+    u32 ix;
+
+    while ((ix = __atomic_fetch_add(&pool->nextJob, 1, __ATOMIC_RELAXED)) < pool->jobNrE)
+    {
+        job = &pool->jobs[ix];
+        XffRelocateRange(pool->ar, pool->xffEp, job->rt, job->begin, job->end);
+    }
+}
+
+static void *Worker(void *arg)
+{
+    struct XffRelocPool *pool = arg;
+    u32 seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1)
+    {
+        while (!pool->quit && pool->generation == seen)
+            pthread_cond_wait(&pool->start, &pool->lock);
+
+        if (pool->quit)
+            break;
+
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        RunJobs(pool);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Creates a pool of 'threadNrE' threads in total, the calling thread being one of them.
+// Returns NULL without memory; fewer threads than asked for run when the system won't
+// start more.
+struct XffRelocPool *XffRelocPoolCreate(s32 threadNrE)
+{
+    struct XffRelocPool *pool;
+    s32 i;
+
+    pool = calloc(1, sizeof(*pool));
+    if (pool == NULL)
+        return NULL;
+    threadNrE = threadNrE > 1 ? threadNrE - 1 : 0;
+    pool->threads = calloc(threadNrE + 1, sizeof(*pool->threads));
+    if (pool->threads == NULL)
+    {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    // Workers don't read threadNrE, it only counts the ones there are to join
+    for (i = 0; i < threadNrE && pthread_create(&pool->threads[i], NULL, Worker, pool) == 0; i++)
+        ;
+    pool->threadNrE = i;
+
+    return pool;
+}
+
+void XffRelocPoolDestroy(struct XffRelocPool *pool)
+{
+    s32 i;
+
+    if (pool == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->threadNrE; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool->jobs);
+    free(pool);
+}
+
+// Returns 0 when the job list can't grow, the list unchanged
+static s32 AddJob(struct XffRelocPool *pool, struct t_xffRelocEnt *rt, u32 begin, u32 end)
+{
+    struct RelocJob *jobs;
+    u32 cap;
+
+    if (pool->jobNrE == pool->jobCap)
+    {
+        cap = pool->jobCap ? pool->jobCap * 2 : 64;
+        jobs = realloc(pool->jobs, cap * sizeof(*jobs));
+        if (jobs == NULL)
+            return 0;
+        pool->jobs = jobs;
+        pool->jobCap = cap;
+    }
+
+    pool->jobs[pool->jobNrE].rt = rt;
+    pool->jobs[pool->jobNrE].begin = begin;
+    pool->jobs[pool->jobNrE].end = end;
+    pool->jobNrE++;
+    return 1;
+}
+
+// Whether the sites of a table strictly ascend, no word patched twice
+static s32 Ascending(const struct t_xffRelocAddrEnt *addrTab, u32 nrEnt)
+{
+    u32 j;
+
+    for (j = 1; j < nrEnt; j++)
+    {
+        if (addrTab[j].addr <= addrTab[j - 1].addr)
+            return 0;
+    }
+    return 1;
+}
+
+// Parallel XffRelocateCode(). Tables are cut into ranges of about 'chunkEnt' entries, 0 is
+// taken as 1.
+u32 XffRelocateCodeParallel(struct XffRelocPool *pool, const struct XffArena *ar, struct t_xffEntPntHdr *xffEp,
+                            s32 firstTab, s32 tabNrE, u32 chunkEnt)
+{
+    struct t_xffRelocEnt *rt = (struct t_xffRelocEnt *)XffPtr(ar, xffEp->relocTab) + firstTab;
+    struct t_xffRelocAddrEnt *addrTab;
+    u32 relocs = 0;
+    u32 begin;
+    u32 end;
+    s32 cut;
+    s32 i;
+
+    if (pool == NULL || pool->threadNrE == 0)
+        return XffRelocateCode(ar, xffEp, firstTab, tabNrE);
+    if (chunkEnt == 0)
+        chunkEnt = 1;
+
+    pool->jobNrE = 0;
+    for (i = 0; i < tabNrE; i++, rt++)
+    {
+        // A packed table can't be cut, it is applied here
+        if (rt->type == XFF_RELOC_TYPE_PACKED)
+        {
+            relocs += XffApplyPackedRelocs(ar, xffEp, rt, NULL);
+            continue;
+        }
+
+        addrTab = XffPtr(ar, rt->addr);
+        cut = Ascending(addrTab, rt->nrEnt);
+        for (begin = 0; begin < rt->nrEnt; begin = end)
+        {
+            end = (cut && rt->nrEnt - begin > chunkEnt) ? begin + chunkEnt : rt->nrEnt;
+
+            // Don't cut between a HI16 and the entry closing its run
+            while (end < rt->nrEnt && addrTab[end - 1].relType == XFF_R_HI16)
+                end++;
+
+            // Without room for the job it runs right away, no worker has started yet
+            if (!AddJob(pool, rt, begin, end))
+                XffRelocateRange(ar, xffEp, rt, begin, end);
+        }
+        relocs += rt->nrEnt;
+    }
+
+    pool->ar = ar;
+    pool->xffEp = xffEp;
+    pool->nextJob = 0;
+
+    if (pool->jobNrE <= 1)
+    {
+        RunJobs(pool);
+        return relocs;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->busy = pool->threadNrE;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    RunJobs(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy != 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+
+    return relocs;
+}
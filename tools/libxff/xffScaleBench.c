@@ -0,0 +1,406 @@
+/*
+xffscalebench: how the load phases scale with the shape of a module.
+
+Usage: xffscalebench [-n reps] [-d dimension] [-x] [-o out.csv]
+
+Sweeps one dimension at a time over synthetic modules (xffGen.c), all other parameters at
+their base values:
+  sections  progbits sections the relocations are spread over
+  symbols   defined symbols, half exported, half local
+  imports   imports, satisfied by a provider module loaded first with as many exports
+  relocs    relocation entries
+  hirun     HI16 entries sharing one LO16, every site a HI16/LO16 one
+  align     section alignment, 64 progbits and 64 nobits sections
+-d picks one of them, by default all are run. -x resolves imports through the export
+index instead of the linear search.
+
+The consumer module is loaded by hand so each phase can be timed on its own: DecodeSection
+(decode), RelocateSelfSymbol (selfsym), the import search (imports), RelocateCode over all
+tables (relocate) and ResolveRelocation called once per entry in random order, the way a
+moved module is patched site by site (resolve). Times are the best of 'reps' runs in
+microseconds. Memory is the heap the image and its sections take while relocating
+(load_bytes) and what stays after XffLoadImage() disposed the local tables (resident_bytes).
+
+The CSV goes to out.csv, or stdout. For each dimension a summary on stderr gives the
+exponent k of time ~ value^k between the first and last point, and the largest one
+between neighbouring points; anything above 1.2 is marked superlinear.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xffBuild.h"
+
+#define SCALE_ARENA_SIZE (0x10000000)
+#define SCALE_POINT_MAX (8)
+#define SUPERLINEAR (1.2)
+
+enum
+{
+    STAGE_DECODE,
+    STAGE_SELFSYM,
+    STAGE_IMPORTS,
+    STAGE_RELOCATE,
+    STAGE_RESOLVE,
+    STAGE_NRE
+};
+
+static const char *sStageNames[STAGE_NRE] = {"decode", "selfsym", "imports", "relocate", "resolve"};
+
+struct ScaleDim
+{
+    const char *name;
+    u32 values[SCALE_POINT_MAX];
+};
+
+static const struct ScaleDim sDims[] = {
+    {"sections", {1, 4, 16, 64, 256, 1024}},
+    {"symbols", {1024, 4096, 16384, 65536, 262144}},
+    {"imports", {64, 256, 1024, 4096, 16384}},
+    {"relocs", {4000, 16000, 64000, 256000, 1024000}},
+    {"hirun", {1, 2, 4, 8, 16, 64}},
+    {"align", {16, 64, 256, 1024, 4096}},
+};
+
+#define DIM_NRE ((s32)(sizeof(sDims) / sizeof(sDims[0])))
+
+struct ScaleResult
+{
+    u32 symbols;
+    u32 relocs;
+    u32 fileBytes;
+    u32 loadBytes;
+    u32 residentBytes;
+    double sec[STAGE_NRE];
+};
+
+// A relocation entry ResolveRelocation() can start at
+struct ResolveSite
+{
+    u32 tab;
+    u32 ix;
+};
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void SetParams(s32 dim, u32 value, struct XffGenParams *cons, struct XffGenParams *prov)
+{
+    XffGenDefaults(cons);
+    cons->exportNrE = 1024;
+    cons->localNrE = 1024;
+    cons->importNrE = 256;
+    cons->relocNrE = 64000;
+    cons->exportPrefix = "mod_";
+    cons->importPrefix = "lib_";
+
+    switch (dim)
+    {
+    case 0:
+        cons->sectNrE = value;
+        break;
+    case 1:
+        cons->exportNrE = value / 2;
+        cons->localNrE = value / 2;
+        break;
+    case 2:
+        cons->importNrE = value;
+        break;
+    case 3:
+        cons->relocNrE = value;
+        break;
+    case 4:
+        cons->hiRunMax = value;
+        cons->weight[0] = 0;
+        cons->weight[1] = 0;
+        break;
+    case 5:
+        cons->sectNrE = 64;
+        cons->bssNrE = 64;
+        cons->alignMin = value;
+        cons->alignMax = value;
+        break;
+    }
+
+    XffGenDefaults(prov);
+    prov->seed = 2;
+    prov->exportNrE = cons->importNrE;
+    prov->localNrE = 0;
+    prov->importNrE = 0;
+    prov->relocNrE = 0;
+    prov->padBytes = 64;
+    prov->exportPrefix = cons->importPrefix;
+}
+
+// Run starts of every table, shuffled
+static struct ResolveSite *CollectSites(const struct XffArena *ar, const struct t_xffEntPntHdr *xffEp, u32 *siteNrE)
+{
+    const struct t_xffRelocEnt *rt = XffPtr(ar, xffEp->relocTab);
+    const struct t_xffRelocAddrEnt *addrTab;
+    struct ResolveSite *sites;
+    struct ResolveSite tmp;
+    u32 nrE = 0;
+    u32 rnd = 1;
+    u32 i;
+    u32 j;
+    s32 t;
+
+    for (t = 0; t < xffEp->relocTabNrE; t++)
+        nrE += rt[t].nrEnt;
+    sites = malloc((nrE + 1) * sizeof(*sites));
+
+    nrE = 0;
+    for (t = 0; t < xffEp->relocTabNrE; t++)
+    {
+        addrTab = XffPtr(ar, rt[t].addr);
+        for (j = 0; j < rt[t].nrEnt; j++)
+        {
+            if (addrTab[j].relType == XFF_R_HI16 && j != 0 && addrTab[j - 1].relType == XFF_R_HI16)
+                continue;
+            sites[nrE].tab = t;
+            sites[nrE].ix = j;
+            nrE++;
+        }
+    }
+
+    for (i = nrE; i > 1; i--)
+    {
+        rnd = rnd * 1103515245 + 12345;
+        j = (rnd >> 8) % i;
+        tmp = sites[i - 1];
+        sites[i - 1] = sites[j];
+        sites[j] = tmp;
+    }
+
+    *siteNrE = nrE;
+    return sites;
+}
+
+static s32 LoadProvider(struct XffLoader *ldr, const u8 *prov, u32 provSize)
+{
+    struct XffModule *mod;
+
+    XffLoaderReset(ldr);
+    return XffLoadImage(ldr, "provider", prov, provSize, &mod);
+}
+
+static s32 RunPoint(struct XffLoader *ldr, const u8 *img, u32 size, const u8 *prov, u32 provSize, s32 reps, struct ScaleResult *res)
+{
+    struct XffArena *ar = &ldr->arena;
+    struct t_xffEntPntHdr *xffEp;
+    struct t_xffRelocEnt *rt;
+    struct ResolveSite *sites = NULL;
+    struct XffModule *mod;
+    u32 siteNrE = 0;
+    u32 heap0;
+    u32 fileAddr;
+    u32 i;
+    s32 r;
+    s32 s;
+    double t[STAGE_NRE + 1];
+
+    for (s = 0; s < STAGE_NRE; s++)
+        res->sec[s] = 1e30;
+    res->fileBytes = size;
+
+    for (r = 0; r < reps; r++)
+    {
+        if (LoadProvider(ldr, prov, provSize) != XFF_OK)
+            return XFF_ERR_NOMEM;
+
+        heap0 = XffGetHeapCurrentPoint(ar);
+        fileAddr = XffArenaAlloc(ar, size, 0x10);
+        if (fileAddr == 0)
+            return XFF_ERR_NOMEM;
+        xffEp = XffPtr(ar, fileAddr);
+        memcpy(xffEp, img, size);
+        if (XffRelocateElfInfoHeader(ar, xffEp, fileAddr) != XFF_OK)
+            return XFF_ERR_FORMAT;
+        if (sites == NULL)
+            sites = CollectSites(ar, xffEp, &siteNrE);
+
+        t[0] = NowSec();
+        if (XffDecodeSection(ldr, xffEp) != XFF_OK)
+            return XFF_ERR_NOMEM;
+        t[1] = NowSec();
+        XffRelocateSelfSymbol(ar, xffEp);
+        t[2] = NowSec();
+        XffResolveImports(ldr, xffEp);
+        t[3] = NowSec();
+        res->relocs = XffRelocateCode(ar, xffEp, 0, xffEp->relocTabNrE);
+        t[4] = NowSec();
+
+        rt = XffPtr(ar, xffEp->relocTab);
+        for (i = 0; i < siteNrE; i++)
+            XffResolveRelocation(ar, xffEp, &rt[sites[i].tab], sites[i].ix);
+        t[5] = NowSec();
+
+        for (s = 0; s < STAGE_NRE; s++)
+        {
+            if (t[s + 1] - t[s] < res->sec[s])
+                res->sec[s] = t[s + 1] - t[s];
+        }
+        res->symbols = xffEp->symTabNrE;
+        res->loadBytes = XffGetHeapCurrentPoint(ar) - heap0;
+    }
+    free(sites);
+
+    // The whole load, for what stays resident
+    if (LoadProvider(ldr, prov, provSize) != XFF_OK)
+        return XFF_ERR_NOMEM;
+    heap0 = XffGetHeapCurrentPoint(ar);
+    if (XffLoadImage(ldr, "consumer", img, size, &mod) != XFF_OK)
+        return XFF_ERR_NOMEM;
+    res->residentBytes = XffGetHeapCurrentPoint(ar) - heap0;
+    return XFF_OK;
+}
+
+// Exponent k of sec ~ value^k
+static double Slope(u32 v0, double s0, u32 v1, double s1)
+{
+    // Below a microsecond the timer says little
+    if (s0 < 1e-6)
+        s0 = 1e-6;
+    if (s1 < 1e-6)
+        s1 = 1e-6;
+    return log(s1 / s0) / log((double)v1 / v0);
+}
+
+static void Summary(const struct ScaleDim *dim, const struct ScaleResult *res, s32 pointNrE)
+{
+    double total;
+    double local;
+    double k;
+    s32 s;
+    s32 i;
+
+    fprintf(stderr, "%s:\n", dim->name);
+    for (s = 0; s < STAGE_NRE; s++)
+    {
+        total = Slope(dim->values[0], res[0].sec[s], dim->values[pointNrE - 1], res[pointNrE - 1].sec[s]);
+        local = -1e30;
+        for (i = 1; i < pointNrE; i++)
+        {
+            k = Slope(dim->values[i - 1], res[i - 1].sec[s], dim->values[i], res[i].sec[s]);
+            if (k > local)
+                local = k;
+        }
+        fprintf(stderr, "  %-9s k = %5.2f (max %5.2f)  %10.1f -> %10.1f us%s\n", sStageNames[s], total, local, res[0].sec[s] * 1e6,
+                res[pointNrE - 1].sec[s] * 1e6, total > SUPERLINEAR || local > SUPERLINEAR ? "  superlinear" : "");
+    }
+    fprintf(stderr, "  %-9s k = %5.2f  %10u -> %10u bytes resident\n", "memory",
+            log((double)res[pointNrE - 1].residentBytes / res[0].residentBytes) / log((double)dim->values[pointNrE - 1] / dim->values[0]),
+            res[0].residentBytes, res[pointNrE - 1].residentBytes);
+}
+
+int main(int argc, char **argv)
+{
+    struct XffLoader ldr;
+    struct XffGenParams cons;
+    struct XffGenParams prov;
+    struct ScaleResult res[SCALE_POINT_MAX];
+    const char *only = NULL;
+    const char *csvPath = NULL;
+    FILE *csv = stdout;
+    s32 reps = 10;
+    s32 indexed = 0;
+    s32 pointNrE;
+    s32 opt;
+    s32 d;
+    s32 s;
+    u8 *img;
+    u8 *provImg;
+    u32 size;
+    u32 provSize;
+
+    while ((opt = getopt(argc, argv, "n:d:xo:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            reps = strtol(optarg, NULL, 0);
+            break;
+        case 'd':
+            only = optarg;
+            break;
+        case 'x':
+            indexed = 1;
+            break;
+        case 'o':
+            csvPath = optarg;
+            break;
+        default:
+            reps = 0;
+            break;
+        }
+    }
+
+    for (d = 0; only != NULL && d < DIM_NRE && strcmp(only, sDims[d].name) != 0; d++)
+        ;
+
+    if (reps < 1 || optind != argc || d == DIM_NRE)
+    {
+        fprintf(stderr, "usage: %s [-n reps] [-d dimension] [-x] [-o out.csv]\n", argv[0]);
+        return 1;
+    }
+
+    if (csvPath != NULL && (csv = fopen(csvPath, "w")) == NULL)
+    {
+        fprintf(stderr, "xffscalebench: can't write %s\n", csvPath);
+        return 1;
+    }
+
+    if (XffLoaderInit(&ldr, XFF_ARENA_DEFAULT_BASE, SCALE_ARENA_SIZE) != XFF_OK)
+    {
+        fprintf(stderr, "xffscalebench: out of memory\n");
+        return 1;
+    }
+    XffLoaderUseSymIndex(&ldr, indexed);
+
+    fprintf(csv, "dimension,value,symbols,relocs,file_bytes,load_bytes,resident_bytes");
+    for (s = 0; s < STAGE_NRE; s++)
+        fprintf(csv, ",%s_us", sStageNames[s]);
+    fprintf(csv, "\n");
+
+    for (d = 0; d < DIM_NRE; d++)
+    {
+        if (only != NULL && strcmp(only, sDims[d].name) != 0)
+            continue;
+
+        for (pointNrE = 0; pointNrE < SCALE_POINT_MAX && sDims[d].values[pointNrE] != 0; pointNrE++)
+        {
+            SetParams(d, sDims[d].values[pointNrE], &cons, &prov);
+            if (XffGenerate(&cons, &img, &size) != XFF_OK || XffGenerate(&prov, &provImg, &provSize) != XFF_OK ||
+                RunPoint(&ldr, img, size, provImg, provSize, reps, &res[pointNrE]) != XFF_OK)
+            {
+                fprintf(stderr, "xffscalebench: %s %u failed\n", sDims[d].name, sDims[d].values[pointNrE]);
+                return 1;
+            }
+            free(img);
+            free(provImg);
+
+            fprintf(csv, "%s,%u,%u,%u,%u,%u,%u", sDims[d].name, sDims[d].values[pointNrE], res[pointNrE].symbols,
+                    res[pointNrE].relocs, res[pointNrE].fileBytes, res[pointNrE].loadBytes, res[pointNrE].residentBytes);
+            for (s = 0; s < STAGE_NRE; s++)
+                fprintf(csv, ",%.2f", res[pointNrE].sec[s] * 1e6);
+            fprintf(csv, "\n");
+            fflush(csv);
+        }
+
+        Summary(&sDims[d], res, pointNrE);
+    }
+
+    if (csv != stdout)
+        fclose(csv);
+    XffLoaderTerm(&ldr);
+    return 0;
+}
@@ -0,0 +1,256 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libxff.h"
+
+/*
+Warm reset from a snapshot of the loaded heap.
+
+After a soft reset loaderLoop() reads STARTUP.XFF again and execProgWithThread() relocates
+it from scratch, although the result is the same every time. XffSnapshotTake() saves the
+heap right after a load, before the entry point ran: the relocated images, their data and
+their cleared bss, together with the module list. XffSnapshotRestore() puts all of it back
+and returns the entry point, so a warm reset costs one copy.
+
+The block stands in for memory reserved on the EE that survives the reset, nothing keeps
+the program from writing over it. It carries a checksum over everything after the
+header's checksum field. Restore sums the heap bytes while it copies them back and
+refuses a block that doesn't match; the heap is then garbage, the caller loads cold and
+takes a new snapshot.
+
+Block layout:
+  XffSnapshotHdr
+  XffSnapshotModule[moduleNrE], oldest first
+  module names, NUL terminated
+  heap bytes [base, heapEnd), 16-aligned
+*/
+
+#define XFF_SNAPSHOT_MAGIC (0x706E7378) // "xsnp"
+
+struct XffSnapshotHdr
+{
+    u32 magic;
+    u32 checksum;
+    u32 blockSize;
+    u32 base;      // arena base the heap was taken at
+    u32 heapEnd;   // heap point
+    u32 loadSeq;
+    u32 moduleNrE;
+    u32 imageOffs; // of the heap bytes in the block
+};
+
+struct XffSnapshotModule
+{
+    u32 nameOffs;
+    u32 seq;
+    u32 fileAddr;
+    u32 fileSize;
+    s32 hasLocalRelocs;
+    u32 hashTab;
+    u32 lazyStubs;
+    u32 lazyNrE;
+};
+
+// Fletcher style sums over four 64-bit lanes: independent add chains that keep up
+// with the copy they are folded into. 'dst' may be NULL to only sum.
+struct Checksum
+{
+    u64 a[4];
+    u64 b[4];
+};
+
+static void ChecksumCopy(struct Checksum *sum, void *dst, const void *src, u32 size)
+{
+    const u8 *s = src;
+    u8 *d = dst;
+    u64 w[4];
+    u32 i;
+    s32 k;
+
+    for (i = 0; i + 32 <= size; i += 32)
+    {
+        memcpy(w, s + i, 32);
+        if (d != NULL)
+            memcpy(d + i, w, 32);
+        for (k = 0; k < 4; k++)
+        {
+            sum->a[k] += w[k];
+            sum->b[k] += sum->a[k];
+        }
+    }
+
+    if (i < size)
+    {
+        memset(w, 0, sizeof(w));
+        memcpy(w, s + i, size - i);
+        if (d != NULL)
+            memcpy(d + i, w, size - i);
+        for (k = 0; k < 4; k++)
+        {
+            sum->a[k] += w[k];
+            sum->b[k] += sum->a[k];
+        }
+    }
+}
+
+static u32 ChecksumFinal(const struct Checksum *sum)
+{
+    u64 h = 0;
+    s32 k;
+
+    for (k = 0; k < 4; k++)
+        h = (h ^ sum->a[k] ^ (sum->b[k] << 1)) * 0x100000001B3ull;
+    return (u32)(h ^ (h >> 32));
+}
+
+s32 XffSnapshotInit(struct XffSnapshot *snap, u32 size)
+{
+    memset(snap, 0, sizeof(*snap));
+    snap->data = malloc(size);
+    if (snap->data == NULL)
+        return XFF_ERR_NOMEM;
+
+    snap->size = size;
+    return XFF_OK;
+}
+
+void XffSnapshotTerm(struct XffSnapshot *snap)
+{
+    free(snap->data);
+    memset(snap, 0, sizeof(*snap));
+}
+
+// Saves the heap and the module list. Only the bump heap is supported, the region heap
+// keeps its bookkeeping outside the arena, and so does the string pool.
+s32 XffSnapshotTake(const struct XffLoader *ldr, struct XffSnapshot *snap)
+{
+    struct XffSnapshotHdr *hdr = snap->data;
+    struct XffSnapshotModule *rec;
+    const struct XffModule *mod;
+    struct Checksum sum;
+    u32 heapSize = ldr->arena.heapPt - ldr->arena.base;
+    u32 nameSize = 0;
+    u32 moduleNrE = 0;
+    u32 offs;
+    u32 i;
+
+    snap->valid = 0;
+    if (ldr->regions != NULL || ldr->strPool != NULL)
+        return XFF_ERR_FORMAT;
+
+    for (mod = ldr->modules; mod != NULL; mod = mod->next)
+    {
+        moduleNrE++;
+        nameSize += strlen(mod->name) + 1;
+    }
+
+    offs = (sizeof(*hdr) + moduleNrE * sizeof(*rec) + nameSize + 0xF) & ~0xF;
+    if (offs + heapSize < offs || offs + heapSize > snap->size)
+        return XFF_ERR_NOMEM;
+
+    memset(hdr, 0, offs);
+    hdr->magic = XFF_SNAPSHOT_MAGIC;
+    hdr->blockSize = offs + heapSize;
+    hdr->base = ldr->arena.base;
+    hdr->heapEnd = ldr->arena.heapPt;
+    hdr->loadSeq = ldr->loadSeq;
+    hdr->moduleNrE = moduleNrE;
+    hdr->imageOffs = offs;
+
+    // The list is newest first, the records oldest first
+    rec = (struct XffSnapshotModule *)(hdr + 1);
+    nameSize = sizeof(*hdr) + moduleNrE * sizeof(*rec);
+    for (mod = ldr->modules, i = moduleNrE; mod != NULL; mod = mod->next)
+    {
+        i--;
+        rec[i].nameOffs = nameSize;
+        rec[i].seq = mod->seq;
+        rec[i].fileAddr = mod->fileAddr;
+        rec[i].fileSize = mod->fileSize;
+        rec[i].hasLocalRelocs = mod->hasLocalRelocs;
+        rec[i].hashTab = mod->hashTab;
+        rec[i].lazyStubs = mod->lazyStubs;
+        rec[i].lazyNrE = mod->lazyNrE;
+        strcpy((char *)snap->data + nameSize, mod->name);
+        nameSize += strlen(mod->name) + 1;
+    }
+
+    memset(&sum, 0, sizeof(sum));
+    ChecksumCopy(&sum, NULL, (u8 *)snap->data + 8, offs - 8);
+    ChecksumCopy(&sum, (u8 *)snap->data + offs, ldr->arena.host, heapSize);
+    hdr->checksum = ChecksumFinal(&sum);
+    snap->used = hdr->blockSize;
+    snap->valid = 1;
+    snap->taken++;
+    return XFF_OK;
+}
+
+// Resets the loader to the state the snapshot was taken in. Returns XFF_ERR_FORMAT when
+// there is no snapshot or it doesn't check out; the loader is left reset then, with
+// whatever the copy put in the heap.
+s32 XffSnapshotRestore(struct XffLoader *ldr, struct XffSnapshot *snap, u32 *entryOut)
+{
+    const struct XffSnapshotHdr *hdr = snap->data;
+    const struct XffSnapshotModule *rec;
+    struct XffModule *mod;
+    struct Checksum sum;
+    u32 heapSize;
+    u32 i;
+
+    XffLoaderReset(ldr);
+
+    if (!snap->valid || hdr->magic != XFF_SNAPSHOT_MAGIC || hdr->blockSize > snap->size || hdr->blockSize < sizeof(*hdr) ||
+        hdr->base != ldr->arena.base || ldr->regions != NULL || ldr->strPool != NULL)
+    {
+        snap->rejected++;
+        return XFF_ERR_FORMAT;
+    }
+
+    heapSize = hdr->heapEnd - hdr->base;
+    if (hdr->imageOffs < sizeof(*hdr) || hdr->imageOffs + heapSize != hdr->blockSize || heapSize > ldr->arena.size)
+    {
+        snap->valid = 0;
+        snap->rejected++;
+        return XFF_ERR_FORMAT;
+    }
+
+    memset(&sum, 0, sizeof(sum));
+    ChecksumCopy(&sum, NULL, (u8 *)snap->data + 8, hdr->imageOffs - 8);
+    ChecksumCopy(&sum, ldr->arena.host, (u8 *)snap->data + hdr->imageOffs, heapSize);
+    if (ChecksumFinal(&sum) != hdr->checksum)
+    {
+        snap->valid = 0;
+        snap->rejected++;
+        return XFF_ERR_FORMAT;
+    }
+
+    ldr->arena.heapPt = hdr->heapEnd;
+    if (hdr->heapEnd > ldr->arena.zeroPt)
+        ldr->arena.zeroPt = hdr->heapEnd;
+
+    rec = (const struct XffSnapshotModule *)(hdr + 1);
+    for (i = 0; i < hdr->moduleNrE; i++)
+    {
+        ldr->loadSeq = rec[i].seq;
+        if (XffAddModule(ldr, (const char *)snap->data + rec[i].nameOffs, rec[i].fileAddr, rec[i].fileSize, &mod) != XFF_OK)
+        {
+            XffLoaderReset(ldr);
+            return XFF_ERR_NOMEM;
+        }
+        mod->hasLocalRelocs = rec[i].hasLocalRelocs;
+        mod->hashTab = rec[i].hashTab;
+        mod->lazyStubs = rec[i].lazyStubs;
+        mod->lazyNrE = rec[i].lazyNrE;
+    }
+    ldr->loadSeq = hdr->loadSeq;
+
+    // Execution starts at the first module loaded, STARTUP.XFF
+    if (entryOut != NULL)
+    {
+        for (mod = ldr->modules; mod != NULL && mod->next != NULL; mod = mod->next)
+            ;
+        *entryOut = mod != NULL ? mod->xffEp->entryPnt : 0;
+    }
+    snap->restored++;
+    return XFF_OK;
+}
@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libxff.h"
+
+/*
+Symbol names shared by all loaded modules.
+
+Every module brings its own symTabStr, and the names a module imports are spelled out
+again in each module importing them. With a pool attached (XffLoaderUseStrPool()) a
+module's names are interned as it is loaded: t_xffSymEnt.nameOffs becomes a handle into
+the pool and symTabStr is no longer needed. A name is stored once, so two names are
+equal exactly when their handles are; the export search and the export index compare
+handles and pointers instead of strings.
+
+Names are kept in chunks that never move, each one preceded by its hash:
+  u32 hash (unaligned), chars, NUL
+and the handle is the position of the first char, chunk * XFF_STRPOOL_CHUNK + offset.
+Handle 0 is the empty name at the start of the first chunk. Names stay until the pool is
+cleared with XffLoaderReset(); a module loaded again finds its names there.
+*/
+
+#define POOL_MIN_CAP (1024)
+
+s32 XffStrPoolInit(struct XffStrPool *pool)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->chunk = malloc(sizeof(*pool->chunk));
+    if (pool->chunk == NULL)
+        return XFF_ERR_NOMEM;
+
+    pool->chunk[0] = calloc(1, XFF_STRPOOL_CHUNK);
+    if (pool->chunk[0] == NULL)
+    {
+        free(pool->chunk);
+        return XFF_ERR_NOMEM;
+    }
+    pool->chunkNrE = 1;
+    pool->used = 4; // the empty name
+    return XFF_OK;
+}
+
+void XffStrPoolTerm(struct XffStrPool *pool)
+{
+    u32 i;
+
+    for (i = 0; i < pool->chunkNrE; i++)
+        free(pool->chunk[i]);
+    free(pool->chunk);
+    free(pool->ent);
+    memset(pool, 0, sizeof(*pool));
+}
+
+// Forgets every name, the first chunk is kept
+void XffStrPoolClear(struct XffStrPool *pool)
+{
+    u32 i;
+
+    for (i = 1; i < pool->chunkNrE; i++)
+        free(pool->chunk[i]);
+    pool->chunkNrE = 1;
+    pool->used = 4;
+    pool->bytes = 0;
+    pool->live = 0;
+    if (pool->ent != NULL)
+        memset(pool->ent, 0, pool->cap * sizeof(*pool->ent));
+}
+
+// Returns 0 without memory, the table as it was
+static s32 Rehash(struct XffStrPool *pool)
+{
+    struct XffStrPoolEnt *old = pool->ent;
+    struct XffStrPoolEnt *ent;
+    u32 oldCap = pool->cap;
+    u32 cap = oldCap ? oldCap * 2 : POOL_MIN_CAP;
+    u32 i;
+    u32 j;
+
+    ent = calloc(cap, sizeof(*ent));
+    if (ent == NULL)
+        return 0;
+    pool->ent = ent;
+    pool->cap = cap;
+    for (i = 0; i < oldCap; i++)
+    {
+        if (old[i].handle == 0)
+            continue;
+        for (j = old[i].hash & (pool->cap - 1); pool->ent[j].handle != 0; j = (j + 1) & (pool->cap - 1))
+            ;
+        pool->ent[j] = old[i];
+    }
+    free(old);
+    return 1;
+}
+
+// Slot of 'name', or the empty slot it would go to
+static struct XffStrPoolEnt *Lookup(const struct XffStrPool *pool, const char *name, u32 hash)
+{
+    struct XffStrPoolEnt *ent;
+    u32 mask = pool->cap - 1;
+    u32 j;
+
+    for (j = hash & mask;; j = (j + 1) & mask)
+    {
+        ent = &pool->ent[j];
+        if (ent->handle == 0 || (ent->hash == hash && strcmp(XffStrPoolName(pool, ent->handle), name) == 0))
+            return ent;
+    }
+}
+
+// Returns the handle of 'name', XFF_STRPOOL_NONE when it was never interned
+u32 XffStrPoolFind(const struct XffStrPool *pool, const char *name)
+{
+    u32 h;
+
+    if (*name == '\0')
+        return 0;
+    if (pool->live == 0)
+        return XFF_STRPOOL_NONE;
+
+    h = Lookup(pool, name, XffStrHash(name))->handle;
+    return h != 0 ? h : XFF_STRPOOL_NONE;
+}
+
+// Returns the handle of 'name', adding it when it is new; XFF_STRPOOL_NONE when out of
+// memory or the name doesn't fit a chunk.
+u32 XffStrPoolIntern(struct XffStrPool *pool, const char *name)
+{
+    struct XffStrPoolEnt *ent;
+    u8 **chunk;
+    u32 hash;
+    u32 len;
+    u32 size;
+    u8 *p;
+
+    if (*name == '\0')
+        return 0;
+
+    // A table that can't grow takes names as long as a slot stays empty for the probes
+    if ((pool->live + 1) * 2 > pool->cap && !Rehash(pool) && pool->live + 2 > pool->cap)
+        return XFF_STRPOOL_NONE;
+
+    pool->lookups++;
+    hash = XffStrHash(name);
+    ent = Lookup(pool, name, hash);
+    if (ent->handle != 0)
+        return ent->handle;
+
+    len = strlen(name);
+    size = 4 + len + 1;
+    if (size > XFF_STRPOOL_CHUNK)
+        return XFF_STRPOOL_NONE;
+
+    if (pool->used + size > XFF_STRPOOL_CHUNK)
+    {
+        chunk = realloc(pool->chunk, (pool->chunkNrE + 1) * sizeof(*chunk));
+        if (chunk == NULL)
+            return XFF_STRPOOL_NONE;
+        pool->chunk = chunk;
+        pool->chunk[pool->chunkNrE] = malloc(XFF_STRPOOL_CHUNK);
+        if (pool->chunk[pool->chunkNrE] == NULL)
+            return XFF_STRPOOL_NONE;
+        pool->chunkNrE++;
+        pool->used = 0;
+    }
+
+    p = pool->chunk[pool->chunkNrE - 1] + pool->used;
+    memcpy(p, &hash, 4);
+    memcpy(p + 4, name, len + 1);
+    ent->hash = hash;
+    ent->handle = (pool->chunkNrE - 1) * XFF_STRPOOL_CHUNK + pool->used + 4;
+    pool->used += size;
+    pool->bytes += size;
+    pool->live++;
+    pool->added++;
+    return ent->handle;
+}
+
+// Moves the symbol names of a module into the pool: nameOffs becomes a handle and
+// symTabStr is dropped. The bytes of the string table, from its start to the end of the
+// last name, go to XffLoader.strTabSize for XffTrimImage() to give back. Nothing is
+// rewritten when a name can't be interned.
+s32 XffInternModule(struct XffLoader *ldr, struct t_xffEntPntHdr *xffEp)
+{
+    const struct XffArena *ar = &ldr->arena;
+    struct t_xffSymEnt *sym = XffPtr(ar, xffEp->symTab);
+    const char *str = XffPtr(ar, xffEp->symTabStr);
+    u32 tabSize = 1;
+    u32 *handle;
+    u32 end;
+    s32 i;
+
+    ldr->strTabSize = 0;
+    if (ldr->strPool == NULL || xffEp->symTabStr == 0)
+        return XFF_OK;
+
+    handle = malloc(xffEp->symTabNrE * sizeof(*handle) + 1);
+    if (handle == NULL)
+        return XFF_ERR_NOMEM;
+
+    for (i = 0; i < xffEp->symTabNrE; i++)
+    {
+        handle[i] = 0;
+        if (sym[i].nameOffs == 0)
+            continue;
+
+        end = sym[i].nameOffs + strlen(&str[sym[i].nameOffs]) + 1;
+        tabSize = end > tabSize ? end : tabSize;
+        handle[i] = XffStrPoolIntern(ldr->strPool, &str[sym[i].nameOffs]);
+        if (handle[i] == XFF_STRPOOL_NONE)
+        {
+            free(handle);
+            return XFF_ERR_NOMEM;
+        }
+    }
+
+    for (i = 0; i < xffEp->symTabNrE; i++)
+        sym[i].nameOffs = handle[i];
+    free(handle);
+
+    xffEp->symTabStr = 0;
+    ldr->strTabSize = tabSize;
+    return XFF_OK;
+}
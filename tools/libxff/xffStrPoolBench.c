@@ -0,0 +1,179 @@
+/*
+xffstrpoolbench: symbol names per module against a shared string pool.
+
+Usage: xffstrpoolbench [-n reps] STARTUP.XFF [file.xff...]
+
+The boot sequence is loaded with the names in every module's symTabStr and again with
+a string pool, once on the bump heap and once on region heaps. For every module the
+bytes its region keeps on both region loaders are listed with the symTabStr bytes the
+pooled one gave back and the bytes its new names added to the pool; the total nets the
+pool against what the regions saved. Images written before symTabStr moved behind the
+extern relocation tables (xffBuild.h) give nothing back. Then XffResolveImports() is
+timed 'reps' times for every module, with the linear export search and with the export
+index, on the bump heap loaders; both must bind every import to the same address.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libxff.h"
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Modules come newest first
+static struct XffModule *NthModule(const struct XffLoader *ldr, s32 n)
+{
+    struct XffModule *mod = ldr->modules;
+
+    while (mod != NULL && n-- > 0)
+        mod = mod->next;
+    return mod;
+}
+
+static s32 SameImports(const struct XffLoader *a, const struct XffModule *ma, const struct XffLoader *b, const struct XffModule *mb)
+{
+    const struct t_xffImpSymIxs *imp = XffPtr(&a->arena, ma->xffEp->impSymIxs);
+    const struct t_xffSymEnt *sa = XffPtr(&a->arena, ma->xffEp->symTab);
+    const struct t_xffSymEnt *sb = XffPtr(&b->arena, mb->xffEp->symTab);
+    s32 i;
+
+    for (i = 0; i < ma->xffEp->impSymIxsNrE; i++)
+    {
+        if (sa[imp[i].stIx].addr != sb[imp[i].stIx].addr || sa[imp[i].stIx].unk0D != sb[imp[i].stIx].unk0D ||
+            strcmp(XffSymName(a, ma->xffEp, &sa[imp[i].stIx]), XffSymName(b, mb->xffEp, &sb[imp[i].stIx])) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+static double TimeResolve(struct XffLoader *ldr, s32 pathNrE, u32 reps)
+{
+    double t0 = NowSec();
+    u32 r;
+    s32 i;
+
+    for (r = 0; r < reps; r++)
+    {
+        for (i = 0; i < pathNrE; i++)
+            XffResolveImports(ldr, NthModule(ldr, i)->xffEp);
+    }
+    return (NowSec() - t0) / reps;
+}
+
+int main(int argc, char **argv)
+{
+    struct XffLoader plain;
+    struct XffLoader pooled;
+    struct XffLoader plainRgn;
+    struct XffLoader pooledRgn;
+    struct XffModule *modPlain;
+    struct XffModule *modPooled;
+    struct XffModule *rgnPlain;
+    struct XffModule *rgnPooled;
+    char **paths;
+    u32 reps = 200;
+    u32 freed;
+    u32 added;
+    u32 plainBytes = 0;
+    u32 pooledBytes = 0;
+    u32 imports = 0;
+    u32 bad = 0;
+    s32 pathNrE;
+    s32 opt;
+    s32 i;
+    s32 indexed;
+    double tPlain;
+    double tPooled;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            reps = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+
+    if (optind >= argc || reps == 0)
+    {
+        fprintf(stderr, "usage: %s [-n reps] STARTUP.XFF [file.xff...]\n", argv[0]);
+        return 1;
+    }
+    paths = argv + optind;
+    pathNrE = argc - optind;
+
+    if (XffLoaderInit(&plain, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK ||
+        XffLoaderInit(&pooled, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK ||
+        XffLoaderUseStrPool(&pooled, 1) != XFF_OK || XffLoaderInit(&plainRgn, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK ||
+        XffLoaderInit(&pooledRgn, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK ||
+        XffLoaderUseRegions(&plainRgn, XFF_REGION_CHUNK_DEFAULT) != XFF_OK ||
+        XffLoaderUseRegions(&pooledRgn, XFF_REGION_CHUNK_DEFAULT) != XFF_OK || XffLoaderUseStrPool(&pooledRgn, 1) != XFF_OK)
+    {
+        fprintf(stderr, "xffstrpoolbench: out of memory\n");
+        return 1;
+    }
+
+    printf("%-24s %8s %10s %10s %10s %10s\n", "module", "symbols", "plain", "pooled", "freed", "pool +");
+    for (i = 0; i < pathNrE; i++)
+    {
+        freed = pooledRgn.stats.strBytesFreed;
+        added = pooled.strPool->bytes;
+        if (XffLoadFile(&plain, paths[i], &modPlain) != XFF_OK || XffLoadFile(&pooled, paths[i], &modPooled) != XFF_OK ||
+            XffLoadFile(&plainRgn, paths[i], &rgnPlain) != XFF_OK || XffLoadFile(&pooledRgn, paths[i], &rgnPooled) != XFF_OK)
+        {
+            fprintf(stderr, "xffstrpoolbench: %s: load failed\n", paths[i]);
+            return 1;
+        }
+        freed = pooledRgn.stats.strBytesFreed - freed;
+        added = pooled.strPool->bytes - added;
+        imports += modPlain->xffEp->impSymIxsNrE;
+        bad += !SameImports(&plain, modPlain, &pooled, modPooled);
+        plainBytes += rgnPlain->region->used;
+        pooledBytes += rgnPooled->region->used;
+
+        printf("%-24.24s %8d %10u %10u %10u %10u\n", modPlain->name, modPlain->xffEp->symTabNrE, rgnPlain->region->used,
+               rgnPooled->region->used, freed, added);
+    }
+    printf("%-24s %8s %10u %10u %10u %10u\n", "total", "", plainBytes, pooledBytes, pooledRgn.stats.strBytesFreed,
+           pooled.strPool->bytes);
+    printf("resident         : %d bytes saved, pool included\n", (s32)(plainBytes - pooledBytes - pooled.strPool->bytes));
+    printf("pool             : %u names, %u interned, %u chunks\n", pooled.strPool->live, pooled.strPool->lookups, pooled.strPool->chunkNrE);
+
+    for (indexed = 0; indexed <= 1; indexed++)
+    {
+        XffLoaderUseSymIndex(&plain, indexed);
+        XffLoaderUseSymIndex(&pooled, indexed);
+        tPlain = TimeResolve(&plain, pathNrE, reps);
+        tPooled = TimeResolve(&pooled, pathNrE, reps);
+        printf("resolve, %-7s : %8.1f ns/import plain, %8.1f ns/import pooled (%.2fx)\n", indexed ? "index" : "linear",
+               imports ? tPlain * 1e9 / imports : 0.0, imports ? tPooled * 1e9 / imports : 0.0, tPlain / tPooled);
+
+        for (i = 0; i < pathNrE; i++)
+            bad += !SameImports(&plain, NthModule(&plain, i), &pooled, NthModule(&pooled, i));
+    }
+
+    XffLoaderTerm(&plain);
+    XffLoaderTerm(&pooled);
+    XffLoaderTerm(&plainRgn);
+    XffLoaderTerm(&pooledRgn);
+
+    if (bad != 0)
+    {
+        fprintf(stderr, "xffstrpoolbench: %u modules resolved differently\n", bad);
+        return 1;
+    }
+    return 0;
+}
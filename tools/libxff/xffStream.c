@@ -0,0 +1,354 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libxff.h"
+
+/*
+Streaming load: the file is read in chunks straight into its heap block and every step
+of XffLoadImage() runs as soon as the bytes it needs are resident:
+ - header: RelocateElfInfoHeader() and section placement once the header, sectTab,
+   relocTab and the section names are in; nobits sections are cleared right away,
+ - sections: copied out of the file (or used in place) once their bytes are in,
+ - symbols: RelocateSelfSymbol() and import resolution once symTab, symRelTab,
+   symTabStr and impSymIxs are in, with lazy binding also the extern addr tables,
+ - relocation: each table as soon as its section, its addr and inst tables and the
+   symbols are ready.
+Sections are placed in index order before any of them is filled, so the layout is the
+same as XffLoadImage() gives. With an asynchronous read underneath, the work done after
+a chunk overlaps the transfer of the next one.
+
+XFF_EXT_PRELINK is not looked at, the trailer is only known once the whole file is in.
+The profiler gets the phases of XffLoadImage() interleaved as they happen: a read event
+per chunk, the others every time a step did some work.
+*/
+
+struct XffStream
+{
+    struct XffLoader *ldr;
+    struct t_xffEntPntHdr *xffEp;
+    u32 fileAddr;
+    u32 size;
+    u32 resident; // bytes of the file read so far
+    s32 headerDone;
+    s32 symbolsDone;
+    u8 *sectDone;
+    u8 *relocDone;
+};
+
+static void LowerNext(u32 *next, u32 offs, u32 o)
+{
+    if (o > offs && o < *next)
+        *next = o;
+}
+
+// Smallest known table or section offset above 'offs', for tables without a stored
+// size (string tables). Needs sectTab and relocTab resident.
+static u32 NextOffset(const struct XffStream *s, u32 offs)
+{
+    const struct t_xffEntPntHdr *xffEp = s->xffEp;
+    const struct t_xffSectEnt *sect = (const struct t_xffSectEnt *)((const u8 *)xffEp + xffEp->sectTab_Rel);
+    const struct t_xffRelocEnt *rt = (const struct t_xffRelocEnt *)((const u8 *)xffEp + xffEp->relocTab_Rel);
+    const u32 hdrOffs[] = {xffEp->impSymIxs_Rel, xffEp->symTab_Rel, xffEp->symTabStr_Rel, xffEp->sectTab_Rel, xffEp->symRelTab_Rel,
+                           xffEp->relocTab_Rel, xffEp->ssNamesOffs_Rel, xffEp->ssNamesBase_Rel};
+    u32 next = s->size;
+    u32 i;
+
+    for (i = 0; i < sizeof(hdrOffs) / sizeof(hdrOffs[0]); i++)
+    {
+        LowerNext(&next, offs, hdrOffs[i]);
+    }
+    for (i = 1; i < (u32)xffEp->sectNrE; i++)
+    {
+        if (sect[i].type != XFF_SECT_NOBITS && sect[i].size != 0)
+        {
+            LowerNext(&next, offs, sect[i].offs_Rel);
+        }
+    }
+    for (i = 0; i < (u32)xffEp->relocTabNrE; i++)
+    {
+        if (rt[i].nrEnt != 0)
+        {
+            LowerNext(&next, offs, rt[i].addr_Rel);
+            LowerNext(&next, offs, rt[i].inst_Rel);
+        }
+    }
+
+    return next;
+}
+
+static s32 Resident(const struct XffStream *s, u32 offs, u32 size)
+{
+    return offs <= s->size && size <= s->size - offs && offs + size <= s->resident;
+}
+
+static s32 StepHeader(struct XffStream *s)
+{
+    struct t_xffEntPntHdr *xffEp = s->xffEp;
+    u64 zeroed;
+    u64 t;
+    s32 ret;
+    s32 i;
+
+    if (!Resident(s, 0, sizeof(*xffEp)))
+        return XFF_OK;
+
+    if (xffEp->ident != XFF_SHTEXE_MAGIC_XFF2 || xffEp->sectNrE < 1)
+        return XFF_ERR_FORMAT;
+
+    if (!Resident(s, xffEp->sectTab_Rel, xffEp->sectNrE * sizeof(struct t_xffSectEnt)) ||
+        !Resident(s, xffEp->relocTab_Rel, xffEp->relocTabNrE * sizeof(struct t_xffRelocEnt)) ||
+        !Resident(s, xffEp->ssNamesOffs_Rel, xffEp->sectNrE * sizeof(struct t_xffSsNmOffs)))
+        return XFF_OK;
+
+    if (s->ldr->ldrDbgPrintf != NULL && !Resident(s, xffEp->ssNamesBase_Rel, NextOffset(s, xffEp->ssNamesBase_Rel) - xffEp->ssNamesBase_Rel))
+        return XFF_OK;
+
+    t = XffProfBegin(s->ldr);
+    if (XffCheckHeader(xffEp, s->size) != XFF_OK)
+        return XFF_ERR_FORMAT;
+
+    XffRelocateElfInfoHeader(&s->ldr->arena, xffEp, s->fileAddr);
+    XffProfEnd(s->ldr, XFF_PHASE_HEADER, t, xffEp->sectNrE, 0);
+
+    s->sectDone = calloc(xffEp->sectNrE, 1);
+    s->relocDone = calloc(xffEp->relocTabNrE + 1, 1);
+    if (s->sectDone == NULL || s->relocDone == NULL)
+        return XFF_ERR_NOMEM;
+
+    if (s->ldr->ldrDbgPrintf != NULL)
+        s->ldr->ldrDbgPrintf("ld:\t\tdecode section\n");
+
+    // Placement is the first part of decoding, the sections are counted as StepSections()
+    // fills them
+    t = XffProfBegin(s->ldr);
+    zeroed = s->ldr->stats.bytesZeroed;
+    for (i = 1; i < xffEp->sectNrE; i++)
+    {
+        ret = XffPlaceSection(s->ldr, xffEp, i);
+        if (ret != XFF_OK)
+            return ret;
+    }
+    XffSetEntryPoint(&s->ldr->arena, xffEp);
+    XffProfEnd(s->ldr, XFF_PHASE_DECODE, t, 0, (u32)(s->ldr->stats.bytesZeroed - zeroed));
+
+    s->headerDone = 1;
+    return XFF_OK;
+}
+
+static void StepSections(struct XffStream *s)
+{
+    struct t_xffSectEnt *sect = XffPtr(&s->ldr->arena, s->xffEp->sectTab);
+    u64 copied = s->ldr->stats.bytesCopied;
+    u64 t = XffProfBegin(s->ldr);
+    u32 filled = 0;
+    s32 i;
+
+    for (i = 1; i < s->xffEp->sectNrE; i++)
+    {
+        if (s->sectDone[i])
+            continue;
+
+        if (sect[i].type == XFF_SECT_NOBITS || sect[i].size == 0 || Resident(s, sect[i].offs_Rel, sect[i].size))
+        {
+            XffFillSection(s->ldr, s->xffEp, i);
+            s->sectDone[i] = 1;
+            filled++;
+        }
+    }
+
+    if (filled != 0)
+        XffProfEnd(s->ldr, XFF_PHASE_DECODE, t, filled, (u32)(s->ldr->stats.bytesCopied - copied));
+}
+
+// Lazy binding tells jump-only imports by their extern relocation entries
+static s32 ExternAddrResident(const struct XffStream *s)
+{
+    const struct t_xffRelocEnt *rt = XffPtr(&s->ldr->arena, s->xffEp->relocTab);
+    s32 i;
+
+    for (i = 0; i < s->xffEp->relocTabNrE / 2; i++)
+    {
+        if (!Resident(s, rt[i].addr_Rel, rt[i].nrEnt * sizeof(struct t_xffRelocAddrEnt)))
+            return 0;
+    }
+    return 1;
+}
+
+static s32 StepSymbols(struct XffStream *s)
+{
+    struct t_xffEntPntHdr *xffEp = s->xffEp;
+    s32 ret;
+    s32 i;
+    u64 t;
+
+    if ((s->ldr->lazyResolver != 0 && !ExternAddrResident(s)) ||
+        !Resident(s, xffEp->symTab_Rel, xffEp->symTabNrE * sizeof(struct t_xffSymEnt)) ||
+        !Resident(s, xffEp->symRelTab_Rel, xffEp->symTabNrE * sizeof(struct t_xffSymRelEnt)) ||
+        !Resident(s, xffEp->impSymIxs_Rel, xffEp->impSymIxsNrE * sizeof(struct t_xffImpSymIxs)) ||
+        !Resident(s, xffEp->symTabStr_Rel, NextOffset(s, xffEp->symTabStr_Rel) - xffEp->symTabStr_Rel))
+        return XFF_OK;
+
+    if (XffCheckSymbols(xffEp, NextOffset(s, xffEp->symTabStr_Rel)) != XFF_OK)
+        return XFF_ERR_FORMAT;
+    for (i = 0; s->ldr->lazyResolver != 0 && i < xffEp->relocTabNrE / 2; i++)
+    {
+        if (XffCheckRelocTab(xffEp, i) != XFF_OK)
+            return XFF_ERR_FORMAT;
+    }
+
+    t = XffProfBegin(s->ldr);
+    XffRelocateSelfSymbol(&s->ldr->arena, xffEp);
+    ret = XffInternModule(s->ldr, xffEp);
+    if (ret != XFF_OK)
+        return ret;
+    XffProfEnd(s->ldr, XFF_PHASE_SELFSYM, t, xffEp->symTabNrE, 0);
+
+    t = XffProfBegin(s->ldr);
+    if (s->ldr->lazyResolver != 0)
+        XffLazyImports(s->ldr, xffEp);
+    else
+        XffResolveImports(s->ldr, xffEp);
+    XffProfEnd(s->ldr, XFF_PHASE_IMPORTS, t, xffEp->impSymIxsNrE, 0);
+    s->symbolsDone = 1;
+    return XFF_OK;
+}
+
+static s32 StepRelocation(struct XffStream *s)
+{
+    struct t_xffRelocEnt *rt = XffPtr(&s->ldr->arena, s->xffEp->relocTab);
+    u64 t = XffProfBegin(s->ldr);
+    u32 relocs = 0;
+    s32 i;
+
+    for (i = 0; i < s->xffEp->relocTabNrE; i++)
+    {
+        if (s->relocDone[i])
+            continue;
+
+        if (rt[i].nrEnt == 0)
+        {
+            s->relocDone[i] = 1;
+            continue;
+        }
+
+        if (rt[i].sect < (u32)s->xffEp->sectNrE && s->sectDone[rt[i].sect] &&
+            Resident(s, rt[i].addr_Rel, rt[i].nrEnt * sizeof(struct t_xffRelocAddrEnt)) &&
+            Resident(s, rt[i].inst_Rel, rt[i].nrEnt * sizeof(struct t_xffRelocInstEnt)))
+        {
+            if (XffCheckRelocTab(s->xffEp, i) != XFF_OK)
+                return XFF_ERR_FORMAT;
+            relocs += XffRelocateCode(&s->ldr->arena, s->xffEp, i, 1);
+            s->relocDone[i] = 1;
+        }
+    }
+
+    s->ldr->stats.relocs += relocs;
+    if (relocs != 0)
+        XffProfEnd(s->ldr, XFF_PHASE_RELOC, t, relocs, 0);
+    return XFF_OK;
+}
+
+// Runs whatever the bytes read so far allow.
+static s32 Advance(struct XffStream *s)
+{
+    s32 ret;
+
+    if (!s->headerDone)
+    {
+        ret = StepHeader(s);
+        if (ret != XFF_OK || !s->headerDone)
+            return ret;
+    }
+
+    StepSections(s);
+    if (!s->symbolsDone)
+    {
+        ret = StepSymbols(s);
+        if (ret != XFF_OK)
+            return ret;
+    }
+    if (s->symbolsDone)
+        return StepRelocation(s);
+    return XFF_OK;
+}
+
+static s32 Finished(const struct XffStream *s)
+{
+    s32 i;
+
+    if (!s->headerDone || !s->symbolsDone)
+        return 0;
+
+    for (i = 1; i < s->xffEp->sectNrE; i++)
+    {
+        if (!s->sectDone[i])
+            return 0;
+    }
+    for (i = 0; i < s->xffEp->relocTabNrE; i++)
+    {
+        if (!s->relocDone[i])
+            return 0;
+    }
+    return 1;
+}
+
+// Loads a 'size' byte XFF file by calling 'read' (LoaderSysFRead() semantics: bytes
+// read, 0 or less on failure) for at most 'chunk' bytes at a time.
+s32 XffLoadStream(struct XffLoader *ldr, const char *name, XffReadFunc read, void *ctx, u32 size, u32 chunk, struct XffModule **modOut)
+{
+    struct XffStream s;
+    s32 ret = XFF_OK;
+    s32 n;
+    u64 t;
+
+    if (size < sizeof(struct t_xffEntPntHdr) || chunk == 0)
+        return XFF_ERR_FORMAT;
+
+    if (ldr->prof != NULL)
+        XffProfSetModule(ldr->prof, name, ldr->loadSeq);
+
+    memset(&s, 0, sizeof(s));
+    s.ldr = ldr;
+    s.size = size;
+    s.fileAddr = XffAllocImage(ldr, name, size);
+    if (s.fileAddr == 0)
+        return XFF_ERR_NOMEM;
+    s.xffEp = XffPtr(&ldr->arena, s.fileAddr);
+
+    while (s.resident < size)
+    {
+        t = XffProfBegin(ldr);
+        n = read(ctx, (u8 *)s.xffEp + s.resident, size - s.resident < chunk ? size - s.resident : chunk);
+        if (n <= 0)
+        {
+            ret = XFF_ERR_IO;
+            break;
+        }
+        XffProfEnd(ldr, XFF_PHASE_READ, t, 1, n);
+
+        s.resident += n;
+        ldr->stats.bytesRead += n;
+
+        ret = Advance(&s);
+        if (ret != XFF_OK)
+            break;
+    }
+
+    // Tables pointing past the end of the file are never satisfied
+    if (ret == XFF_OK && !Finished(&s))
+        ret = XFF_ERR_FORMAT;
+
+    free(s.sectDone);
+    free(s.relocDone);
+    if (ret != XFF_OK)
+        return ret;
+
+    if (!ldr->keepLocalRelocs)
+    {
+        t = XffProfBegin(ldr);
+        XffTrimImage(ldr, s.xffEp, s.fileAddr, size, XffPackRelocations(ldr, s.xffEp, XffDisposeRelocationElement(&ldr->arena, s.xffEp)));
+        XffProfEnd(ldr, XFF_PHASE_DISPOSE, t, s.xffEp->relocTabNrE / 2, 0);
+    }
+
+    return XffAddModule(ldr, name, s.fileAddr, XffExtImageSize(s.xffEp, size), modOut);
+}
@@ -0,0 +1,202 @@
+/*
+xffstreambench: streaming load against read-then-load.
+
+Usage: xffstreambench [-c chunk] [-B bytesPerSec] [-n iterations] file.xff...
+
+The files are loaded in order with XffLoadStream(), 'chunk' bytes per read, and the
+resulting heap is compared with the one XffLoadImage() builds. Reads come from memory;
+the disc is modelled at 'bytesPerSec' (default 3.6 MB/s, a 24x CD-ROM) and the CPU work
+done between reads is measured. With the next read in flight while a chunk is processed,
+a load takes
+    io(0) + sum over k > 0 of max(io(k), cpu(k - 1)) + cpu(last)
+against io(all) + cpu(XffLoadImage) when the whole file is read first.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libxff.h"
+
+struct BenchFile
+{
+    const char *path;
+    void *data;
+    u32 size;
+};
+
+struct Reader
+{
+    const u8 *data;
+    u32 pos;
+    double bytesPerSec;
+    double lastReturn; // when the previous read returned
+    double pipelined;  // modelled time so far, without the pending cpu time
+    double pendingIo;  // transfer time of the last chunk
+    double io;
+    double cpu;
+    u32 reads;
+};
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static s32 Read(void *ctx, void *buf, s32 count)
+{
+    struct Reader *r = ctx;
+    double now = NowSec();
+    double cpu;
+    double io = count / r->bytesPerSec;
+
+    if (r->reads == 0)
+    {
+        r->pipelined = io;
+    }
+    else
+    {
+        // This chunk transferred while the previous one was processed
+        cpu = now - r->lastReturn;
+        r->cpu += cpu;
+        r->pipelined += io > cpu ? io : cpu;
+    }
+
+    memcpy(buf, r->data + r->pos, count);
+    r->pos += count;
+    r->io += io;
+    r->reads++;
+    r->lastReturn = NowSec();
+    return count;
+}
+
+int main(int argc, char **argv)
+{
+    struct XffLoader ref;
+    struct XffLoader ldr;
+    struct BenchFile *files;
+    struct Reader r;
+    u32 chunk = 0x8000;
+    double bytesPerSec = 3.6e6;
+    s32 iterations = 20;
+    s32 fileNrE;
+    s32 opt;
+    s32 it;
+    s32 i;
+    s32 ret;
+    double t0;
+    double tail;
+    double ioSec = 0;
+    double streamCpuSec = 0;
+    double pipelinedSec = 0;
+    double imageCpuSec = 0;
+    u32 reads = 0;
+
+    while ((opt = getopt(argc, argv, "c:B:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            chunk = strtoul(optarg, NULL, 0);
+            break;
+        case 'B':
+            bytesPerSec = strtod(optarg, NULL);
+            break;
+        case 'n':
+            iterations = strtol(optarg, NULL, 0);
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+
+    fileNrE = argc - optind;
+    if (fileNrE <= 0 || iterations <= 0 || chunk == 0 || bytesPerSec <= 0)
+    {
+        fprintf(stderr, "usage: %s [-c chunk] [-B bytesPerSec] [-n iterations] file.xff...\n", argv[0]);
+        return 1;
+    }
+
+    files = calloc(fileNrE, sizeof(*files));
+    for (i = 0; i < fileNrE; i++)
+    {
+        files[i].path = argv[optind + i];
+        files[i].data = XffMapFile(files[i].path, &files[i].size);
+        if (files[i].data == NULL)
+        {
+            fprintf(stderr, "xffstreambench: can't map %s\n", files[i].path);
+            return 1;
+        }
+    }
+
+    if (XffLoaderInit(&ref, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK ||
+        XffLoaderInit(&ldr, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK)
+    {
+        fprintf(stderr, "xffstreambench: can't create arena\n");
+        return 1;
+    }
+    ref.noPrelink = 1;
+
+    for (it = 0; it < iterations; it++)
+    {
+        XffLoaderReset(&ref);
+        XffLoaderReset(&ldr);
+
+        for (i = 0; i < fileNrE; i++)
+        {
+            t0 = NowSec();
+            ret = XffLoadImage(&ref, files[i].path, files[i].data, files[i].size, NULL);
+            imageCpuSec += NowSec() - t0;
+            if (ret != XFF_OK)
+            {
+                fprintf(stderr, "xffstreambench: %s: load failed (%d)\n", files[i].path, ret);
+                return 1;
+            }
+
+            memset(&r, 0, sizeof(r));
+            r.data = files[i].data;
+            r.bytesPerSec = bytesPerSec;
+            ret = XffLoadStream(&ldr, files[i].path, Read, &r, files[i].size, chunk, NULL);
+            if (ret != XFF_OK)
+            {
+                fprintf(stderr, "xffstreambench: %s: streaming load failed (%d)\n", files[i].path, ret);
+                return 1;
+            }
+
+            // Work after the last chunk can't overlap anything
+            tail = NowSec() - r.lastReturn;
+            ioSec += r.io;
+            streamCpuSec += r.cpu + tail;
+            pipelinedSec += r.pipelined + tail;
+            reads += r.reads;
+        }
+
+        if (ref.arena.heapPt != ldr.arena.heapPt || memcmp(ref.arena.host, ldr.arena.host, ref.arena.heapPt - ref.arena.base) != 0)
+        {
+            fprintf(stderr, "xffstreambench: streamed heap differs from XffLoadImage()\n");
+            return 1;
+        }
+    }
+
+    printf("files           : %d, chunk 0x%x, %u reads per iteration\n", fileNrE, chunk, reads / iterations);
+    printf("disc            : %.2f MB/s, %.3f ms per iteration\n", bytesPerSec * 1e-6, ioSec * 1e3 / iterations);
+    printf("read, then load : %.3f ms (cpu %.3f ms)\n", (ioSec + imageCpuSec) * 1e3 / iterations, imageCpuSec * 1e3 / iterations);
+    printf("streaming       : %.3f ms (cpu %.3f ms, %.1f%% hidden behind reads)\n", pipelinedSec * 1e3 / iterations,
+           streamCpuSec * 1e3 / iterations, streamCpuSec > 0 ? (ioSec + streamCpuSec - pipelinedSec) * 100.0 / streamCpuSec : 0.0);
+    printf("heap            : identical to XffLoadImage()\n");
+
+    XffLoaderTerm(&ref);
+    XffLoaderTerm(&ldr);
+    for (i = 0; i < fileNrE; i++)
+    {
+        XffUnmapFile(files[i].data, files[i].size);
+    }
+    free(files);
+    return 0;
+}
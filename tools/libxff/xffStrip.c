@@ -0,0 +1,327 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xffBuild.h"
+
+/*
+Whole-program stripping of dead symbols.
+
+A module exports every global of its objects, although most of them are never imported
+by anything else in the set; each one still costs a symTab and symRelTab entry, its name
+in symTabStr and a place in the export search. Given the builders of every module of the
+set (read back with XffMerge() of one input, or straight from a converter),
+XffStripSet() keeps:
+ - the exports some module of the set imports, and those named in 'keep' for lookups by
+   name from outside the set,
+ - every symbol a relocation entry refers to, an export nobody imports as a nameless
+   local; locals lose their names too unless 'keepLocalNames' is set,
+ - the undefined symbol and the section symbols.
+Imports no relocation entry refers to are dropped along with the other symbols. The
+surviving symbols are renumbered in order, and the relocation entries and the section
+symbol indices follow them.
+*/
+
+static inline s32 IsExport(const struct XffBuildSym *sym)
+{
+    return sym->sect != 0 && sym->bindAttr == XFF_STB_GLOBAL && sym->name[0] != '\0';
+}
+
+static void MarkRefs(const struct XffBuildRelTab *tab, u8 *ref)
+{
+    u32 i;
+
+    for (i = 0; i < tab->nrEnt; i++)
+        ref[tab->ent[i].symIx] = 1;
+}
+
+static void RemapRefs(struct XffBuildRelTab *tab, const u32 *newIx)
+{
+    u32 i;
+
+    for (i = 0; i < tab->nrEnt; i++)
+        tab->ent[i].symIx = newIx[tab->ent[i].symIx];
+}
+
+static u32 StrBytes(const struct XffBuilder *b)
+{
+    u32 bytes = 1;
+    u32 i;
+
+    for (i = 0; i < b->symNrE; i++)
+        bytes += b->sym[i].name[0] != '\0' ? strlen(b->sym[i].name) + 1 : 0;
+    return bytes;
+}
+
+static void CountSymbols(const struct XffBuilder *b, u32 *symbols, u32 *exports, u32 *imports)
+{
+    u32 i;
+
+    *symbols = b->symNrE;
+    *exports = 0;
+    *imports = 0;
+    for (i = 1; i < b->symNrE; i++)
+    {
+        *exports += IsExport(&b->sym[i]);
+        *imports += b->sym[i].sect == 0;
+    }
+}
+
+// Strips one module against the names of 'roots'
+static s32 StripModule(struct XffBuilder *b, const struct XffStrPool *roots, s32 keepLocalNames, struct XffStripInfo *info)
+{
+    struct XffBuildSym *sym;
+    u32 *newIx;
+    u8 *ref;
+    u32 symNrE = 0;
+    u32 i;
+
+    newIx = calloc(b->symNrE, sizeof(*newIx));
+    ref = calloc(b->symNrE, 1);
+    if (newIx == NULL || ref == NULL)
+    {
+        free(newIx);
+        free(ref);
+        return XFF_ERR_NOMEM;
+    }
+
+    for (i = 1; i < b->sectNrE; i++)
+    {
+        MarkRefs(&b->sect[i].ext, ref);
+        MarkRefs(&b->sect[i].loc, ref);
+        ref[b->sect[i].symIx] = 1;
+    }
+    ref[0] = 1;
+
+    for (i = 0; i < b->symNrE; i++)
+    {
+        sym = &b->sym[i];
+        if (IsExport(sym) && XffStrPoolFind(roots, sym->name) != XFF_STRPOOL_NONE)
+        {
+            b->sym[symNrE++] = *sym;
+            newIx[i] = symNrE - 1;
+            continue;
+        }
+
+        if (!ref[i])
+        {
+            free(sym->name);
+            continue;
+        }
+
+        if (IsExport(sym))
+        {
+            sym->bindAttr = 0;
+            info->demoted++;
+        }
+        if (sym->sect != 0 && !keepLocalNames && sym->name[0] != '\0')
+            sym->name[0] = '\0';
+
+        b->sym[symNrE++] = *sym;
+        newIx[i] = symNrE - 1;
+    }
+    b->symNrE = symNrE;
+
+    for (i = 1; i < b->sectNrE; i++)
+    {
+        RemapRefs(&b->sect[i].ext, newIx);
+        RemapRefs(&b->sect[i].loc, newIx);
+        b->sect[i].symIx = newIx[b->sect[i].symIx];
+    }
+
+    free(newIx);
+    free(ref);
+    return XFF_OK;
+}
+
+// Strips every module of the set b[0..nrE) in place. Exports are kept when a module of
+// the set imports them or they are named in keep[0..keepNrE). info[] gets one entry
+// per module.
+s32 XffStripSet(struct XffBuilder *b, u32 nrE, const char *const *keep, u32 keepNrE, s32 keepLocalNames,
+                struct XffStripInfo *info)
+{
+    struct XffStrPool roots;
+    const struct XffBuilder *mod;
+    u8 *ref;
+    s32 ret;
+    u32 i;
+    u32 k;
+    u32 s;
+
+    ret = XffStrPoolInit(&roots);
+    if (ret != XFF_OK)
+        return ret;
+
+    for (i = 0; i < keepNrE && ret == XFF_OK; i++)
+    {
+        if (XffStrPoolIntern(&roots, keep[i]) == XFF_STRPOOL_NONE)
+            ret = XFF_ERR_NOMEM;
+    }
+
+    // Imports some relocation entry refers to are what the set needs from its exports
+    for (i = 0; i < nrE && ret == XFF_OK; i++)
+    {
+        mod = &b[i];
+        ref = calloc(mod->symNrE, 1);
+        if (ref == NULL)
+        {
+            ret = XFF_ERR_NOMEM;
+            break;
+        }
+        for (k = 1; k < mod->sectNrE; k++)
+            MarkRefs(&mod->sect[k].ext, ref);
+        for (s = 1; s < mod->symNrE && ret == XFF_OK; s++)
+        {
+            if (mod->sym[s].sect == 0 && ref[s] && XffStrPoolIntern(&roots, mod->sym[s].name) == XFF_STRPOOL_NONE)
+                ret = XFF_ERR_NOMEM;
+        }
+        free(ref);
+    }
+
+    for (i = 0; i < nrE && ret == XFF_OK; i++)
+    {
+        memset(&info[i], 0, sizeof(info[i]));
+        CountSymbols(&b[i], &info[i].symbolsIn, &info[i].exportsIn, &info[i].importsIn);
+        info[i].strBytesIn = StrBytes(&b[i]);
+
+        ret = StripModule(&b[i], &roots, keepLocalNames, &info[i]);
+
+        CountSymbols(&b[i], &info[i].symbols, &info[i].exports, &info[i].imports);
+        info[i].strBytes = StrBytes(&b[i]);
+    }
+
+    XffStrPoolTerm(&roots);
+    return ret;
+}
+
+static s32 CheckFail(char *err, u32 errSize, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(err, errSize, fmt, ap);
+    va_end(ap);
+    return XFF_ERR_FORMAT;
+}
+
+// Loads the original set and the stripped one in the same order and moves the sections
+// of the stripped modules to where the originals are. Every section must relocate to the
+// same bytes and every export left must resolve to the same address. Returns
+// XFF_ERR_FORMAT with 'err' set on a mismatch, adds the section bytes compared to
+// 'checked'.
+s32 XffStripCheck(const u8 *const *img, const u32 *size, const u8 *const *out, const u32 *outSize, const char *const *names,
+                  u32 nrE, u32 *checked, char *err, u32 errSize)
+{
+    struct XffLoader orig;
+    struct XffLoader strip;
+    struct XffModule **origMod;
+    struct XffModule **stripMod;
+    struct XffMoveStats st;
+    const struct t_xffSectEnt *origSect;
+    const struct t_xffSectEnt *sect;
+    const struct t_xffSymEnt *sym;
+    u32 *newMemPt = NULL;
+    u32 arenaSize = 0x100000;
+    u32 heap;
+    u32 addr;
+    u32 i;
+    s32 k;
+    s32 ret = XFF_OK;
+
+    for (i = 0; i < nrE; i++)
+        arenaSize += (size[i] + outSize[i]) * 2;
+
+    origMod = calloc(nrE, sizeof(*origMod));
+    stripMod = calloc(nrE, sizeof(*stripMod));
+    if (origMod == NULL || stripMod == NULL || XffLoaderInit(&orig, XFF_ARENA_DEFAULT_BASE, arenaSize) != XFF_OK)
+    {
+        free(origMod);
+        free(stripMod);
+        return XFF_ERR_NOMEM;
+    }
+    for (i = 0; i < nrE && ret == XFF_OK; i++)
+    {
+        ret = XffLoadImage(&orig, names[i], img[i], size[i], &origMod[i]);
+        if (ret != XFF_OK)
+            ret = CheckFail(err, errSize, "%s doesn't load (%d)", names[i], ret);
+    }
+
+    // The stripped set loads above everything the original one uses
+    heap = (orig.arena.heapPt + 0xFFFF) & ~0xFFFF;
+    if (ret == XFF_OK && XffLoaderInit(&strip, XFF_ARENA_DEFAULT_BASE, heap - XFF_ARENA_DEFAULT_BASE + arenaSize) != XFF_OK)
+        ret = XFF_ERR_NOMEM;
+    if (ret != XFF_OK)
+    {
+        XffLoaderTerm(&orig);
+        free(origMod);
+        free(stripMod);
+        return ret;
+    }
+    XffSetHeapStartPoint(&strip.arena, heap);
+    strip.keepLocalRelocs = 1;
+
+    for (i = 0; i < nrE && ret == XFF_OK; i++)
+    {
+        ret = XffLoadImage(&strip, names[i], out[i], outSize[i], &stripMod[i]);
+        if (ret != XFF_OK)
+            ret = CheckFail(err, errSize, "stripped %s doesn't load (%d)", names[i], ret);
+        else if (stripMod[i]->xffEp->sectNrE != origMod[i]->xffEp->sectNrE)
+            ret = CheckFail(err, errSize, "stripped %s has %d sections, expected %d", names[i], stripMod[i]->xffEp->sectNrE,
+                            origMod[i]->xffEp->sectNrE);
+    }
+
+    for (i = 0; i < nrE && ret == XFF_OK; i++)
+    {
+        origSect = XffPtr(&orig.arena, origMod[i]->xffEp->sectTab);
+        free(newMemPt);
+        newMemPt = calloc(origMod[i]->xffEp->sectNrE, sizeof(*newMemPt));
+        if (newMemPt == NULL)
+        {
+            ret = XFF_ERR_NOMEM;
+            break;
+        }
+        for (k = 1; k < origMod[i]->xffEp->sectNrE; k++)
+            newMemPt[k] = origSect[k].memPt;
+        ret = XffMoveSections(&strip, stripMod[i], newMemPt, 0, &st);
+    }
+
+    // Imports of a module loaded before its exporter only resolve once all are there
+    for (i = 0; i < nrE && ret == XFF_OK; i++)
+    {
+        XffResolveImports(&strip, stripMod[i]->xffEp);
+        XffRelocateCode(&strip.arena, stripMod[i]->xffEp, 0, stripMod[i]->xffEp->relocTabNrE);
+    }
+
+    for (i = 0; i < nrE && ret == XFF_OK; i++)
+    {
+        origSect = XffPtr(&orig.arena, origMod[i]->xffEp->sectTab);
+        sect = XffPtr(&strip.arena, stripMod[i]->xffEp->sectTab);
+        for (k = 1; k < origMod[i]->xffEp->sectNrE && ret == XFF_OK; k++)
+        {
+            if (sect[k].type == XFF_SECT_NOBITS || sect[k].size == 0)
+                continue;
+            addr = origSect[k].memPt;
+            if (sect[k].memPt != addr || memcmp(XffPtr(&strip.arena, addr), XffPtr(&orig.arena, addr), sect[k].size) != 0)
+                ret = CheckFail(err, errSize, "section %d of %s differs after stripping", k, names[i]);
+            *checked += sect[k].size;
+        }
+
+        sym = XffPtr(&strip.arena, stripMod[i]->xffEp->symTab);
+        for (k = 0; k < stripMod[i]->xffEp->symTabNrE && ret == XFF_OK; k++, sym++)
+        {
+            if (sym->sect == 0 || sym->bindAttr != XFF_STB_GLOBAL || sym->nameOffs == 0)
+                continue;
+            if (XffFindExport(&orig, XffSymName(&strip, stripMod[i]->xffEp, sym), NULL) !=
+                XffFindExport(&strip, XffSymName(&strip, stripMod[i]->xffEp, sym), NULL))
+                ret = CheckFail(err, errSize, "export %s of %s moved", XffSymName(&strip, stripMod[i]->xffEp, sym), names[i]);
+        }
+    }
+
+    free(newMemPt);
+    free(origMod);
+    free(stripMod);
+    XffLoaderTerm(&strip);
+    XffLoaderTerm(&orig);
+    return ret;
+}
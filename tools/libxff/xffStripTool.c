@@ -0,0 +1,199 @@
+/*
+xffstrip: drops the symbols a set of XFF2 modules doesn't need, see xffStrip.c.
+
+Usage: xffstrip [-k export]... [-l] [-c] -o outDir in.xff...
+
+The inputs are the whole set, given in load order; each stripped module is written to
+outDir under its own file name. Exports no module of the set imports are dropped unless
+-k names them (exports looked up by name from outside the set); -k may be repeated. -l
+keeps the names of local symbols. -c loads the original and the stripped set and checks
+that every section relocates to the same bytes. Bytes saved are counted against the
+module written back unstripped, so layout differences to the input file don't count.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xffBuild.h"
+
+static s32 WriteFile(const char *path, const void *data, u32 size)
+{
+    FILE *f = fopen(path, "wb");
+
+    if (f == NULL)
+        return XFF_ERR_IO;
+
+    if (fwrite(data, 1, size, f) != size)
+    {
+        fclose(f);
+        return XFF_ERR_IO;
+    }
+
+    return fclose(f) == 0 ? XFF_OK : XFF_ERR_IO;
+}
+
+int main(int argc, char **argv)
+{
+    struct XffMergeInfo mergeInfo;
+    struct XffStripInfo *info;
+    struct XffBuilder *b;
+    const struct XffStripInfo *st;
+    const char **keep;
+    const char *outDir = NULL;
+    const char *base;
+    const char *const *names;
+    const u8 **img;
+    u32 *size;
+    u8 **out;
+    u32 *outSize;
+    u8 *full;
+    u32 fullSize;
+    u32 *fullSizes;
+    u32 keepNrE = 0;
+    u32 nrE;
+    u32 i;
+    u32 hashSize;
+    u32 checked = 0;
+    u32 symIn = 0;
+    u32 symOut = 0;
+    u32 bytesIn = 0;
+    u32 bytesOut = 0;
+    s32 keepLocalNames = 0;
+    s32 check = 0;
+    s32 bad = 0;
+    s32 opt;
+    s32 ret = XFF_OK;
+    char path[1024];
+    char err[160];
+
+    keep = calloc(argc, sizeof(*keep));
+    if (keep == NULL)
+        return 1;
+
+    while ((opt = getopt(argc, argv, "k:lco:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'k':
+            keep[keepNrE++] = optarg;
+            break;
+        case 'l':
+            keepLocalNames = 1;
+            break;
+        case 'c':
+            check = 1;
+            break;
+        case 'o':
+            outDir = optarg;
+            break;
+        default:
+            bad = 1;
+            break;
+        }
+    }
+
+    if (bad || outDir == NULL || optind >= argc)
+    {
+        fprintf(stderr, "usage: %s [-k export]... [-l] [-c] -o outDir in.xff...\n", argv[0]);
+        return 1;
+    }
+
+    nrE = argc - optind;
+    names = (const char *const *)&argv[optind];
+    img = calloc(nrE, sizeof(*img));
+    size = calloc(nrE, sizeof(*size));
+    out = calloc(nrE, sizeof(*out));
+    outSize = calloc(nrE, sizeof(*outSize));
+    fullSizes = calloc(nrE, sizeof(*fullSizes));
+    b = calloc(nrE, sizeof(*b));
+    info = calloc(nrE, sizeof(*info));
+    if (img == NULL || size == NULL || out == NULL || outSize == NULL || fullSizes == NULL || b == NULL || info == NULL)
+    {
+        fprintf(stderr, "xffstrip: out of memory\n");
+        return 1;
+    }
+
+    // Every module back into a builder; written out as is it is the baseline
+    for (i = 0; i < nrE && ret == XFF_OK; i++)
+    {
+        img[i] = XffMapFile(names[i], &size[i]);
+        if (img[i] == NULL)
+        {
+            fprintf(stderr, "xffstrip: can't map %s\n", names[i]);
+            return 1;
+        }
+
+        XffBuilderInit(&b[i]);
+        b[i].hashSection = XffExtFind(img[i], size[i], XFF_EXT_HASH, &hashSize) != NULL;
+        b[i].relPlanSection = XffExtFind(img[i], size[i], XFF_EXT_RELPLAN, NULL) != NULL;
+        ret = XffMerge(&b[i], &img[i], &size[i], &names[i], 1, &mergeInfo);
+        if (ret == XFF_OK)
+            ret = XffBuilderWrite(&b[i], &full, &fullSize);
+        if (ret == XFF_OK)
+        {
+            fullSizes[i] = fullSize;
+            free(full);
+        }
+    }
+    if (ret == XFF_OK)
+        ret = XffStripSet(b, nrE, keep, keepNrE, keepLocalNames, info);
+    for (i = 0; i < nrE && ret == XFF_OK; i++)
+        ret = XffBuilderWrite(&b[i], &out[i], &outSize[i]);
+    if (ret != XFF_OK)
+    {
+        fprintf(stderr, "xffstrip: %s\n", ret == XFF_ERR_FORMAT ? mergeInfo.err : "out of memory");
+        return 1;
+    }
+
+    for (i = 0; i < nrE; i++)
+    {
+        st = &info[i];
+        printf("%s: symbols %u -> %u (exports %u -> %u, %u now local, imports %u -> %u), strings %u -> %u, "
+               "bytes %u -> %u (%d)\n",
+               names[i], st->symbolsIn, st->symbols, st->exportsIn, st->exports, st->demoted, st->importsIn, st->imports,
+               st->strBytesIn, st->strBytes, fullSizes[i], outSize[i], (s32)(outSize[i] - fullSizes[i]));
+        symIn += st->symbolsIn;
+        symOut += st->symbols;
+        bytesIn += fullSizes[i];
+        bytesOut += outSize[i];
+    }
+    printf("total: symbols %u -> %u, bytes %u -> %u, %.1f%% saved\n", symIn, symOut, bytesIn, bytesOut,
+           bytesIn != 0 ? (bytesIn - bytesOut) * 100.0 / bytesIn : 0.0);
+
+    if (check)
+    {
+        ret = XffStripCheck(img, size, (const u8 *const *)out, outSize, names, nrE, &checked, err, sizeof(err));
+        if (ret != XFF_OK)
+        {
+            fprintf(stderr, "xffstrip: check failed: %s\n", ret == XFF_ERR_FORMAT ? err : "out of memory");
+            return 1;
+        }
+        printf("check: %u section bytes match the original set\n", checked);
+    }
+
+    for (i = 0; i < nrE; i++)
+    {
+        base = strrchr(names[i], '/');
+        snprintf(path, sizeof(path), "%s/%s", outDir, base != NULL ? base + 1 : names[i]);
+        if (WriteFile(path, out[i], outSize[i]) != XFF_OK)
+        {
+            fprintf(stderr, "xffstrip: can't write %s\n", path);
+            return 1;
+        }
+        free(out[i]);
+        XffBuilderFree(&b[i]);
+        XffUnmapFile((void *)img[i], size[i]);
+    }
+
+    free(keep);
+    free(img);
+    free(size);
+    free(out);
+    free(outSize);
+    free(fullSizes);
+    free(b);
+    free(info);
+    return 0;
+}
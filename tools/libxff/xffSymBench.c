@@ -0,0 +1,146 @@
+/*
+xffsymbench: imported symbol resolution, hashed export index vs the linear search.
+
+Usage: xffsymbench [-m modules] [-i imports] [-n iterations] [counts...]
+
+For every count of exported symbols (default 1000 10000 100000) the exports are
+spread over 'modules' provider modules, then a consumer importing 'imports'
+random names is resolved with both lookup paths.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xffBuild.h"
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void LoadBuilt(struct XffLoader *ldr, struct XffBuilder *b, const char *name, struct XffModule **modOut)
+{
+    u8 *img;
+    u32 size;
+
+    if (XffBuilderWrite(b, &img, &size) != XFF_OK || XffLoadImage(ldr, name, img, size, modOut) != XFF_OK)
+    {
+        fprintf(stderr, "xffsymbench: can't load %s\n", name);
+        exit(1);
+    }
+    free(img);
+}
+
+static double TimeResolve(struct XffLoader *ldr, struct XffModule *consumer, s32 iterations)
+{
+    double t0;
+    s32 it;
+
+    t0 = NowSec();
+    for (it = 0; it < iterations; it++)
+    {
+        XffResolveImports(ldr, consumer->xffEp);
+    }
+    return NowSec() - t0;
+}
+
+static void RunCount(u32 exportNrE, u32 moduleNrE, u32 importNrE, s32 iterations)
+{
+    struct XffLoader ldr;
+    struct XffBuilder b;
+    struct XffModule *consumer;
+    char name[64];
+    u32 text;
+    u32 m;
+    u32 i;
+    double linSec;
+    double hashSec;
+
+    XffLoaderInit(&ldr, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE);
+    srand(exportNrE);
+
+    for (m = 0; m < moduleNrE; m++)
+    {
+        XffBuilderInit(&b);
+        text = XffBuilderAddSection(&b, ".text", XFF_SECT_PROGBITS, 16, 0, NULL, 0x100);
+        for (i = m; i < exportNrE; i += moduleNrE)
+        {
+            sprintf(name, "GameCoreExport_%06u", i);
+            XffBuilderAddSymbol(&b, name, text, (i * 4) & 0xFF, 4, XFF_STT_FUNC, XFF_STB_GLOBAL);
+        }
+        sprintf(name, "provider%u", m);
+        LoadBuilt(&ldr, &b, name, NULL);
+        XffBuilderFree(&b);
+    }
+
+    XffBuilderInit(&b);
+    XffBuilderAddSection(&b, ".text", XFF_SECT_PROGBITS, 16, 0, NULL, 0x100);
+    for (i = 0; i < importNrE; i++)
+    {
+        sprintf(name, "GameCoreExport_%06u", (u32)rand() % exportNrE);
+        XffBuilderAddSymbol(&b, name, 0, 0, 0, XFF_STT_FUNC, XFF_STB_GLOBAL);
+    }
+    LoadBuilt(&ldr, &b, "consumer", &consumer);
+    XffBuilderFree(&b);
+
+    XffLoaderUseSymIndex(&ldr, 0);
+    linSec = TimeResolve(&ldr, consumer, iterations);
+    XffLoaderUseSymIndex(&ldr, 1);
+    hashSec = TimeResolve(&ldr, consumer, iterations);
+
+    printf("%8u exports: linear %10.0f lookups/sec, hashed %12.0f lookups/sec, speedup %8.1fx (%u unresolved)\n",
+           exportNrE, importNrE * iterations / linSec, importNrE * iterations / hashSec, linSec / hashSec,
+           ldr.stats.unresolved);
+
+    XffLoaderTerm(&ldr);
+}
+
+int main(int argc, char **argv)
+{
+    static const u32 defaultCounts[] = {1000, 10000, 100000};
+    u32 moduleNrE = 8;
+    u32 importNrE = 2000;
+    s32 iterations = 3;
+    s32 opt;
+    s32 i;
+
+    while ((opt = getopt(argc, argv, "m:i:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            moduleNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            importNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            iterations = strtol(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-m modules] [-i imports] [-n iterations] [counts...]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (moduleNrE == 0 || iterations <= 0)
+        return 1;
+
+    if (optind == argc)
+    {
+        for (i = 0; i < 3; i++)
+            RunCount(defaultCounts[i], moduleNrE, importNrE, iterations);
+    }
+    else
+    {
+        for (i = optind; i < argc; i++)
+            RunCount(strtoul(argv[i], NULL, 0), moduleNrE, importNrE, iterations);
+    }
+
+    return 0;
+}
@@ -0,0 +1,222 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "libxff.h"
+
+// Slot hash values with a special meaning, real hashes are folded away from them
+#define SLOT_EMPTY (0)
+#define SLOT_DELETED (1)
+
+#define INDEX_MIN_CAP (256)
+
+// FNV-1a
+u32 XffStrHash(const char *name)
+{
+    u32 hash = 0x811C9DC5;
+
+    while (*name != '\0')
+    {
+        hash ^= (u8)*name++;
+        hash *= 0x01000193;
+    }
+
+    return hash < 2 ? hash + 2 : hash;
+}
+
+static inline s32 IsExport(const struct t_xffSymEnt *sym)
+{
+    return sym->sect != 0 && sym->bindAttr == XFF_STB_GLOBAL && sym->nameOffs != 0;
+}
+
+void XffSymIndexInit(struct XffSymIndex *ix)
+{
+    memset(ix, 0, sizeof(*ix));
+}
+
+void XffSymIndexFree(struct XffSymIndex *ix)
+{
+    free(ix->ent);
+    memset(ix, 0, sizeof(*ix));
+}
+
+// 'minCap' is rounded up to a power of two, the probe masks need one. Returns 0 without
+// memory, the table as it was.
+static s32 Rehash(struct XffSymIndex *ix, u32 minCap)
+{
+    struct XffSymIndexEnt *old = ix->ent;
+    struct XffSymIndexEnt *ent;
+    u32 oldCap = ix->cap;
+    u32 newCap = INDEX_MIN_CAP;
+    u32 i;
+    u32 j;
+
+    while (newCap < minCap)
+        newCap <<= 1;
+
+    ent = calloc(newCap, sizeof(*ent));
+    if (ent == NULL)
+        return 0;
+    ix->ent = ent;
+    ix->cap = newCap;
+    ix->used = ix->live;
+
+    for (i = 0; i < oldCap; i++)
+    {
+        if (old[i].hash <= SLOT_DELETED)
+            continue;
+
+        for (j = old[i].hash & (newCap - 1); ix->ent[j].hash != SLOT_EMPTY; j = (j + 1) & (newCap - 1))
+            ;
+        ix->ent[j] = old[i];
+    }
+
+    free(old);
+    return 1;
+}
+
+// Returns the newest live entry for 'name', shadowed duplicates are skipped.
+struct XffSymIndexEnt *XffSymIndexFind(const struct XffSymIndex *ix, const char *name, u32 hash)
+{
+    struct XffSymIndexEnt *ent;
+    u32 mask = ix->cap - 1;
+    u32 j;
+
+    if (ix->live == 0)
+        return NULL;
+
+    for (j = hash & mask;; j = (j + 1) & mask)
+    {
+        ent = &ix->ent[j];
+        if (ent->hash == SLOT_EMPTY)
+            return NULL;
+
+        if (ent->hash == hash && !ent->shadowed && (ent->name == name || (ix->pool == NULL && strcmp(ent->name, name) == 0)))
+            return ent;
+    }
+}
+
+// Returns XFF_ERR_NOMEM when the table has to grow and can't, the index unchanged
+s32 XffSymIndexAdd(struct XffSymIndex *ix, const char *name, u32 hash, struct t_xffSymEnt *sym, struct XffModule *mod)
+{
+    struct XffSymIndexEnt *prev;
+    struct XffSymIndexEnt *ent;
+    u32 j;
+
+    // Keep the load factor (tombstones included) under 1/2
+    if ((ix->used + 1) * 2 > ix->cap && !Rehash(ix, ix->live * 4))
+        return XFF_ERR_NOMEM;
+
+    // A newer module exporting the same name hides the older one until it is unloaded
+    prev = XffSymIndexFind(ix, name, hash);
+    if (prev != NULL)
+        prev->shadowed = 1;
+
+    for (j = hash & (ix->cap - 1); ix->ent[j].hash > SLOT_DELETED; j = (j + 1) & (ix->cap - 1))
+        ;
+
+    ent = &ix->ent[j];
+    if (ent->hash == SLOT_EMPTY)
+        ix->used++;
+    ent->hash = hash;
+    ent->shadowed = 0;
+    ent->name = name;
+    ent->sym = sym;
+    ent->mod = mod;
+    ix->live++;
+    return XFF_OK;
+}
+
+static void Remove(struct XffSymIndex *ix, const char *name, u32 hash, const struct XffModule *mod)
+{
+    struct XffSymIndexEnt *newest = NULL;
+    struct XffSymIndexEnt *ent;
+    s32 wasVisible = 0;
+    u32 mask = ix->cap - 1;
+    u32 j;
+
+    for (j = hash & mask; ix->ent[j].hash != SLOT_EMPTY; j = (j + 1) & mask)
+    {
+        ent = &ix->ent[j];
+        if (ent->hash != hash || (ent->name != name && (ix->pool != NULL || strcmp(ent->name, name) != 0)))
+            continue;
+
+        if (ent->mod == mod)
+        {
+            wasVisible = !ent->shadowed;
+            ent->hash = SLOT_DELETED;
+            ent->name = NULL;
+            ix->live--;
+        }
+        else if (newest == NULL || ent->mod->seq > newest->mod->seq)
+        {
+            newest = ent;
+        }
+    }
+
+    // Uncover the most recently loaded remaining definition
+    if (wasVisible && newest != NULL)
+        newest->shadowed = 0;
+}
+
+// With a string pool the names are interned, the hash is stored with them. Returns
+// XFF_ERR_NOMEM with none of the exports of 'mod' in the index when one doesn't fit.
+s32 XffSymIndexAddModule(struct XffSymIndex *ix, const struct XffArena *ar, struct XffModule *mod)
+{
+    struct t_xffSymEnt *sym = XffPtr(ar, mod->xffEp->symTab);
+    const char *str = XffPtr(ar, mod->xffEp->symTabStr);
+    s32 ret = XFF_OK;
+    s32 i;
+
+    for (i = 0; i < mod->xffEp->symTabNrE && ret == XFF_OK; i++, sym++)
+    {
+        if (!IsExport(sym))
+            continue;
+
+        if (ix->pool != NULL)
+            ret = XffSymIndexAdd(ix, XffStrPoolName(ix->pool, sym->nameOffs), XffStrPoolHash(ix->pool, sym->nameOffs), sym, mod);
+        else
+            ret = XffSymIndexAdd(ix, &str[sym->nameOffs], XffStrHash(&str[sym->nameOffs]), sym, mod);
+    }
+
+    if (ret != XFF_OK)
+        XffSymIndexRemoveModule(ix, ar, mod);
+    return ret;
+}
+
+void XffSymIndexRemoveModule(struct XffSymIndex *ix, const struct XffArena *ar, const struct XffModule *mod)
+{
+    struct t_xffSymEnt *sym = XffPtr(ar, mod->xffEp->symTab);
+    const char *str = XffPtr(ar, mod->xffEp->symTabStr);
+    s32 i;
+
+    if (ix->live == 0)
+        return;
+
+    for (i = 0; i < mod->xffEp->symTabNrE; i++, sym++)
+    {
+        if (!IsExport(sym))
+            continue;
+
+        if (ix->pool != NULL)
+            Remove(ix, XffStrPoolName(ix->pool, sym->nameOffs), XffStrPoolHash(ix->pool, sym->nameOffs), mod);
+        else
+            Remove(ix, &str[sym->nameOffs], XffStrHash(&str[sym->nameOffs]), mod);
+    }
+}
+
+// The file image of 'mod' moved by 'shift' bytes: points its entries at the new copy.
+// Slots and shadowing stay as they are, the names didn't change.
+void XffSymIndexRebaseModule(struct XffSymIndex *ix, const struct XffModule *mod, s32 shift)
+{
+    u32 j;
+
+    for (j = 0; j < ix->cap; j++)
+    {
+        if (ix->ent[j].hash > SLOT_DELETED && ix->ent[j].mod == mod)
+        {
+            if (ix->pool == NULL)
+                ix->ent[j].name += shift;
+            ix->ent[j].sym = (struct t_xffSymEnt *)((u8 *)ix->ent[j].sym + shift);
+        }
+    }
+}
@@ -0,0 +1,559 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "libxff.h"
+
+/*
+Two-level segregated fit allocator (TLSF).
+
+A replacement for the newlib malloc the ELF links, whose free list search gets slower
+the more small blocks networking and module bookkeeping leave behind. Free blocks are
+kept in lists by size class: the first level splits sizes by powers of two, the second
+level splits every power of two into 32 ranges. A bitmap per level says which lists are
+non-empty, so malloc() finds a fitting list with two find-first-set operations and takes
+its head, and free() merges with both physical neighbours in constant time.
+
+Everything is kept in the managed memory: the control block at its start, then the
+blocks. Links are 32-bit offsets from the control block, so the layout is the same on the
+EE and on a 64-bit host. Every block starts with an 8 byte header (the offset of the
+previous block and its own size with two flag bits); the payload follows and is 16-byte
+aligned like newlib's on the EE. Free blocks keep their list links in the payload.
+A used block of size 0 ends the pool.
+
+Nothing here needs more than C89 and 32-bit arithmetic; without the GCC bit builtins a
+small table does the bit scans.
+*/
+
+#define ALIGN_LOG2 (4)
+#define ALIGN (1 << ALIGN_LOG2)
+#define SL_LOG2 (5)
+#define SL_COUNT (1 << SL_LOG2)
+#define FL_SHIFT (SL_LOG2 + ALIGN_LOG2)
+#define SMALL_BLOCK (1 << FL_SHIFT) // below this the first level list is split linearly
+#define FL_COUNT (32 - FL_SHIFT + 1)
+
+#define HDR_SIZE (8)
+#define MIN_BLOCK (16) // header and the two list links
+#define MAX_BLOCK (0x80000000)
+
+#define BLOCK_FREE (1)
+#define BLOCK_PREV_FREE (2)
+#define SIZE_MASK (~3u)
+
+struct XffTlsfBlock
+{
+    u32 prevPhys; // offset of the previous block, valid when BLOCK_PREV_FREE is set
+    u32 size;     // including the header, flags in the low bits
+    u32 nextFree; // the links are payload of a used block
+    u32 prevFree;
+};
+
+struct XffTlsf
+{
+    u32 memSize;
+    u32 poolStart;
+    u32 flBitmap;
+    u32 slBitmap[FL_COUNT];
+    u32 head[FL_COUNT][SL_COUNT]; // 0 = empty, offset 0 is the control block
+    u32 used;      // bytes in used blocks, headers included
+    u32 peak;
+    u32 usedBlocks;
+    u32 allocs;
+    u32 frees;
+    u32 failed;
+};
+
+// Index of the highest (Fls) and lowest (Ffs) bit set, 'x' is not 0
+#if defined(__GNUC__) && __GNUC__ >= 4
+static inline s32 Fls(u32 x)
+{
+    return 31 - __builtin_clz(x);
+}
+
+static inline s32 Ffs(u32 x)
+{
+    return __builtin_ctz(x);
+}
+#else
+static s32 Fls(u32 x)
+{
+    static const u8 sFls4[16] = {0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3};
+    s32 n = 0;
+
+    if (x & 0xFFFF0000)
+    {
+        n += 16;
+        x >>= 16;
+    }
+    if (x & 0xFF00)
+    {
+        n += 8;
+        x >>= 8;
+    }
+    if (x & 0xF0)
+    {
+        n += 4;
+        x >>= 4;
+    }
+    return n + sFls4[x];
+}
+
+static s32 Ffs(u32 x)
+{
+    return Fls(x & (~x + 1));
+}
+#endif
+
+static inline struct XffTlsfBlock *Blk(const struct XffTlsf *t, u32 off)
+{
+    return (struct XffTlsfBlock *)((u8 *)t + off);
+}
+
+static inline u32 BlkSize(const struct XffTlsfBlock *b)
+{
+    return b->size & SIZE_MASK;
+}
+
+static inline u32 Off(const struct XffTlsf *t, const void *pt)
+{
+    return (u32)((const u8 *)pt - (const u8 *)t);
+}
+
+static void Mapping(u32 size, s32 *fl, s32 *sl)
+{
+    s32 t;
+
+    if (size < SMALL_BLOCK)
+    {
+        *fl = 0;
+        *sl = size / (SMALL_BLOCK / SL_COUNT);
+        return;
+    }
+
+    t = Fls(size);
+    *sl = (size >> (t - SL_LOG2)) ^ SL_COUNT;
+    *fl = t - (FL_SHIFT - 1);
+}
+
+static void Insert(struct XffTlsf *t, u32 off)
+{
+    struct XffTlsfBlock *b = Blk(t, off);
+    s32 fl;
+    s32 sl;
+
+    Mapping(BlkSize(b), &fl, &sl);
+    b->prevFree = 0;
+    b->nextFree = t->head[fl][sl];
+    if (b->nextFree != 0)
+        Blk(t, b->nextFree)->prevFree = off;
+    t->head[fl][sl] = off;
+    t->flBitmap |= 1u << fl;
+    t->slBitmap[fl] |= 1u << sl;
+}
+
+static void Remove(struct XffTlsf *t, u32 off)
+{
+    struct XffTlsfBlock *b = Blk(t, off);
+    s32 fl;
+    s32 sl;
+
+    Mapping(BlkSize(b), &fl, &sl);
+    if (b->nextFree != 0)
+        Blk(t, b->nextFree)->prevFree = b->prevFree;
+    if (b->prevFree != 0)
+    {
+        Blk(t, b->prevFree)->nextFree = b->nextFree;
+        return;
+    }
+
+    t->head[fl][sl] = b->nextFree;
+    if (b->nextFree == 0)
+    {
+        t->slBitmap[fl] &= ~(1u << sl);
+        if (t->slBitmap[fl] == 0)
+            t->flBitmap &= ~(1u << fl);
+    }
+}
+
+// Head of the first list whose blocks are all at least 'size' bytes, 0 when none
+static u32 FindFree(const struct XffTlsf *t, u32 size)
+{
+    u32 map;
+    s32 fl;
+    s32 sl;
+
+    // Round up to the next list boundary so any block of the list fits
+    if (size >= SMALL_BLOCK)
+    {
+        size += (1u << (Fls(size) - SL_LOG2)) - 1;
+        if (size >= MAX_BLOCK)
+            return 0;
+    }
+    Mapping(size, &fl, &sl);
+
+    map = t->slBitmap[fl] & (~0u << sl);
+    if (map == 0)
+    {
+        map = fl + 1 < FL_COUNT ? t->flBitmap & (~0u << (fl + 1)) : 0;
+        if (map == 0)
+            return 0;
+
+        fl = Ffs(map);
+        map = t->slBitmap[fl];
+    }
+    return t->head[fl][Ffs(map)];
+}
+
+// Block size for a request of 'size' bytes
+static u32 AdjustSize(u32 size)
+{
+    if (size > MAX_BLOCK - HDR_SIZE - ALIGN)
+        return 0;
+
+    size = (size + HDR_SIZE + ALIGN - 1) & ~(ALIGN - 1);
+    return size < MIN_BLOCK ? MIN_BLOCK : size;
+}
+
+// Frees the tail of used block 'off' beyond 'size' bytes, when it is big enough for a
+// block of its own.
+static void Trim(struct XffTlsf *t, u32 off, u32 size)
+{
+    struct XffTlsfBlock *b = Blk(t, off);
+    struct XffTlsfBlock *rest;
+    struct XffTlsfBlock *next;
+    u32 restOff = off + size;
+    u32 restSize = BlkSize(b) - size;
+
+    if (restSize < MIN_BLOCK)
+        return;
+
+    b->size = size | (b->size & BLOCK_PREV_FREE);
+    rest = Blk(t, restOff);
+    rest->prevPhys = off;
+    rest->size = restSize | BLOCK_FREE;
+
+    next = Blk(t, restOff + restSize);
+    if (next->size & BLOCK_FREE)
+    {
+        Remove(t, restOff + restSize);
+        rest->size += BlkSize(next);
+        next = Blk(t, restOff + BlkSize(rest));
+    }
+    next->prevPhys = restOff;
+    next->size |= BLOCK_PREV_FREE;
+    Insert(t, restOff);
+}
+
+// Marks free block 'off', already out of its list, used and gives back what is beyond
+// 'size'.
+static void *Use(struct XffTlsf *t, u32 off, u32 size)
+{
+    struct XffTlsfBlock *b = Blk(t, off);
+
+    b->size &= ~BLOCK_FREE;
+    Blk(t, off + BlkSize(b))->size &= ~BLOCK_PREV_FREE;
+    Trim(t, off, size);
+
+    t->used += BlkSize(b);
+    if (t->used > t->peak)
+        t->peak = t->used;
+    t->usedBlocks++;
+    t->allocs++;
+    return (u8 *)b + HDR_SIZE;
+}
+
+// 'mem' must be 16-byte aligned. Returns NULL when it is too small for the control block
+// and one block.
+struct XffTlsf *XffTlsfCreate(void *mem, u32 size)
+{
+    struct XffTlsf *t = mem;
+    struct XffTlsfBlock *b;
+    u32 start;
+    u32 end;
+
+    if ((size_t)mem & (ALIGN - 1))
+        return NULL;
+
+    // Payloads must come out 16-aligned: headers sit at 8 modulo 16
+    start = ((sizeof(*t) + HDR_SIZE + ALIGN - 1) & ~(ALIGN - 1)) - HDR_SIZE;
+    if (size < start + MIN_BLOCK + HDR_SIZE)
+        return NULL;
+
+    end = start + ((size - start - HDR_SIZE) & ~(ALIGN - 1)); // offset of the end marker
+    if (end - start < MIN_BLOCK)
+        return NULL;
+
+    memset(t, 0, sizeof(*t));
+    t->memSize = size;
+    t->poolStart = start;
+
+    b = Blk(t, start);
+    b->prevPhys = 0;
+    b->size = (end - start) | BLOCK_FREE;
+    Insert(t, start);
+
+    b = Blk(t, end);
+    b->prevPhys = start;
+    b->size = BLOCK_PREV_FREE;
+    return t;
+}
+
+void *XffTlsfMalloc(struct XffTlsf *t, u32 size)
+{
+    u32 blkSize = AdjustSize(size);
+    u32 off;
+
+    off = blkSize != 0 ? FindFree(t, blkSize) : 0;
+    if (off == 0)
+    {
+        t->failed++;
+        return NULL;
+    }
+
+    Remove(t, off);
+    return Use(t, off, blkSize);
+}
+
+// 'align' is a power of two
+void *XffTlsfMemalign(struct XffTlsf *t, u32 align, u32 size)
+{
+    struct XffTlsfBlock *b;
+    struct XffTlsfBlock *nb;
+    u32 blkSize = AdjustSize(size);
+    u32 total;
+    u32 gap;
+    u32 off;
+    u32 payload;
+
+    if (align <= ALIGN)
+        return XffTlsfMalloc(t, size);
+
+    // Room for the payload at any alignment, with a free block in front of it
+    total = blkSize + align + MIN_BLOCK;
+    off = blkSize != 0 && total > blkSize && total < MAX_BLOCK ? FindFree(t, total) : 0;
+    if (off == 0)
+    {
+        t->failed++;
+        return NULL;
+    }
+    Remove(t, off);
+
+    b = Blk(t, off);
+    payload = (u32)(size_t)((u8 *)b + HDR_SIZE);
+    gap = ((payload + align - 1) & ~(align - 1)) - payload;
+    if (gap != 0 && gap < MIN_BLOCK)
+        gap += align;
+
+    if (gap != 0)
+    {
+        nb = Blk(t, off + gap);
+        nb->prevPhys = off;
+        nb->size = (BlkSize(b) - gap) | BLOCK_FREE | BLOCK_PREV_FREE;
+        Blk(t, off + BlkSize(b))->prevPhys = off + gap;
+        b->size = gap | BLOCK_FREE | (b->size & BLOCK_PREV_FREE);
+        Insert(t, off);
+        off += gap;
+    }
+    return Use(t, off, blkSize);
+}
+
+void XffTlsfFree(struct XffTlsf *t, void *ptr)
+{
+    struct XffTlsfBlock *b;
+    struct XffTlsfBlock *next;
+    u32 off;
+
+    if (ptr == NULL)
+        return;
+
+    off = Off(t, ptr) - HDR_SIZE;
+    b = Blk(t, off);
+    t->used -= BlkSize(b);
+    t->usedBlocks--;
+    t->frees++;
+    b->size |= BLOCK_FREE;
+
+    if (b->size & BLOCK_PREV_FREE)
+    {
+        Remove(t, b->prevPhys);
+        Blk(t, b->prevPhys)->size += BlkSize(b);
+        off = b->prevPhys;
+        b = Blk(t, off);
+    }
+
+    next = Blk(t, off + BlkSize(b));
+    if (next->size & BLOCK_FREE)
+    {
+        Remove(t, off + BlkSize(b));
+        b->size += BlkSize(next);
+        next = Blk(t, off + BlkSize(b));
+    }
+    next->prevPhys = off;
+    next->size |= BLOCK_PREV_FREE;
+    Insert(t, off);
+}
+
+// Grows in place into a free neighbour when it can, moves otherwise.
+void *XffTlsfRealloc(struct XffTlsf *t, void *ptr, u32 size)
+{
+    struct XffTlsfBlock *b;
+    struct XffTlsfBlock *next;
+    u32 blkSize = AdjustSize(size);
+    u32 off;
+    u32 old;
+    void *moved;
+
+    if (ptr == NULL)
+        return XffTlsfMalloc(t, size);
+    if (size == 0)
+    {
+        XffTlsfFree(t, ptr);
+        return NULL;
+    }
+    if (blkSize == 0)
+    {
+        t->failed++;
+        return NULL;
+    }
+
+    off = Off(t, ptr) - HDR_SIZE;
+    b = Blk(t, off);
+    old = BlkSize(b);
+    next = Blk(t, off + old);
+
+    if (blkSize > old && (next->size & BLOCK_FREE) && old + BlkSize(next) >= blkSize)
+    {
+        Remove(t, off + old);
+        b->size += BlkSize(next);
+        Blk(t, off + BlkSize(b))->size &= ~BLOCK_PREV_FREE;
+    }
+
+    if (BlkSize(b) >= blkSize)
+    {
+        Trim(t, off, blkSize);
+        t->used += BlkSize(b) - old;
+        if (t->used > t->peak)
+            t->peak = t->used;
+        return ptr;
+    }
+
+    moved = XffTlsfMalloc(t, size);
+    if (moved == NULL)
+        return NULL;
+    memcpy(moved, ptr, old - HDR_SIZE);
+    XffTlsfFree(t, ptr);
+    return moved;
+}
+
+// Payload bytes of an allocated block
+u32 XffTlsfBlockSize(const void *ptr)
+{
+    return BlkSize((const struct XffTlsfBlock *)((const u8 *)ptr - HDR_SIZE)) - HDR_SIZE;
+}
+
+// Visits every block in address order.
+void XffTlsfWalk(const struct XffTlsf *t, XffTlsfWalkFunc func, void *ctx)
+{
+    const struct XffTlsfBlock *b;
+    u32 off;
+
+    for (off = t->poolStart; (b = Blk(t, off))->size & SIZE_MASK; off += BlkSize(b))
+        func((u8 *)b + HDR_SIZE, BlkSize(b) - HDR_SIZE, !(b->size & BLOCK_FREE), ctx);
+}
+
+void XffTlsfStats(const struct XffTlsf *t, struct XffTlsfStats *st)
+{
+    const struct XffTlsfBlock *b;
+    u32 off;
+
+    memset(st, 0, sizeof(*st));
+    st->used = t->used;
+    st->peak = t->peak;
+    st->usedBlocks = t->usedBlocks;
+    st->allocs = t->allocs;
+    st->frees = t->frees;
+    st->failed = t->failed;
+
+    for (off = t->poolStart; (b = Blk(t, off))->size & SIZE_MASK; off += BlkSize(b))
+    {
+        st->poolSize += BlkSize(b);
+        if (b->size & BLOCK_FREE)
+        {
+            st->free += BlkSize(b);
+            st->freeBlocks++;
+            if (BlkSize(b) > st->largestFree)
+                st->largestFree = BlkSize(b);
+        }
+    }
+}
+
+// Walks the pool and the lists and checks that they agree. Returns XFF_ERR_FORMAT at
+// the first inconsistency.
+s32 XffTlsfCheck(const struct XffTlsf *t)
+{
+    const struct XffTlsfBlock *b;
+    const struct XffTlsfBlock *n;
+    u32 freeBlocks = 0;
+    u32 listed = 0;
+    u32 prev = 0;
+    u32 prevFree = 0;
+    u32 used = 0;
+    u32 off;
+    s32 fl;
+    s32 sl;
+    s32 mfl;
+    s32 msl;
+
+    for (off = t->poolStart;; off += BlkSize(b))
+    {
+        if (off < t->poolStart || off + HDR_SIZE > t->memSize)
+            return XFF_ERR_FORMAT;
+
+        b = Blk(t, off);
+        if (!!(b->size & BLOCK_PREV_FREE) != prevFree || (prevFree && b->prevPhys != prev))
+            return XFF_ERR_FORMAT;
+        if (BlkSize(b) == 0)
+            break;
+        if ((BlkSize(b) & (ALIGN - 1)) || BlkSize(b) < MIN_BLOCK)
+            return XFF_ERR_FORMAT;
+
+        if (b->size & BLOCK_FREE)
+        {
+            if (prevFree)
+                return XFF_ERR_FORMAT; // two free neighbours weren't merged
+            freeBlocks++;
+        }
+        else
+        {
+            used += BlkSize(b);
+        }
+        prevFree = b->size & BLOCK_FREE;
+        prev = off;
+    }
+    if (used != t->used)
+        return XFF_ERR_FORMAT;
+
+    for (fl = 0; fl < FL_COUNT; fl++)
+    {
+        if (!!(t->flBitmap & (1u << fl)) != (t->slBitmap[fl] != 0))
+            return XFF_ERR_FORMAT;
+
+        for (sl = 0; sl < SL_COUNT; sl++)
+        {
+            if (!!(t->slBitmap[fl] & (1u << sl)) != (t->head[fl][sl] != 0))
+                return XFF_ERR_FORMAT;
+
+            prev = 0;
+            for (off = t->head[fl][sl]; off != 0; off = n->nextFree)
+            {
+                n = Blk(t, off);
+                Mapping(BlkSize(n), &mfl, &msl);
+                if (!(n->size & BLOCK_FREE) || n->prevFree != prev || mfl != fl || msl != sl || ++listed > freeBlocks)
+                    return XFF_ERR_FORMAT;
+                prev = off;
+            }
+        }
+    }
+
+    return listed == freeBlocks ? XFF_OK : XFF_ERR_FORMAT;
+}
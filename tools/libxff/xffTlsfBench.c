@@ -0,0 +1,431 @@
+/*
+xfftlsfbench: allocation trace replay, TLSF against the host malloc.
+
+Usage: xfftlsfbench [-s poolSize] [-n ops] [-l live] [-r seed] [-w trace.out] [trace]
+
+A trace has one request per line:
+  a <id> <size> [align]   malloc, or memalign when 'align' is given
+  r <id> <size>           realloc
+  f <id>                  free
+Ids are small integers naming the live blocks. Without a trace file a synthetic one is
+made in the shape the ELF's own allocations have: mostly small, short lived blocks
+(network buffers, module bookkeeping) around 'live' long lived ones, some larger
+buffers, a few aligned and resized blocks; -w saves it for later runs.
+
+The trace is replayed on a TLSF pool of 'poolSize' bytes and on the host malloc, which
+stands in for the newlib malloc of the ELF (both are descendants of the same dlmalloc
+design). Every request is timed; reported are the mean, the 99th percentile and the
+worst case per request, the failed requests and the TLSF fragmentation at the end of
+the trace.
+The TLSF heap is checked after the replay, and every block's contents on the way.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libxff.h"
+
+enum
+{
+    OP_ALLOC,
+    OP_REALLOC,
+    OP_FREE,
+};
+
+struct TraceOp
+{
+    u8 op;
+    u32 id;
+    u32 size;
+    u32 align;
+};
+
+struct Replay
+{
+    double ns;
+    u32 hist[64]; // requests by log2 of their ns
+    double maxNs;
+    u32 failed;
+    u32 corrupt;
+};
+
+static inline u64 NowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static u32 Next(u32 *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+static struct TraceOp *ReadTrace(const char *path, u32 *opNrE, u32 *idNrE)
+{
+    struct TraceOp *ops = NULL;
+    char line[256];
+    char op;
+    u32 cap = 0;
+    s32 n;
+    FILE *f;
+
+    f = fopen(path, "r");
+    if (f == NULL)
+        return NULL;
+
+    *opNrE = 0;
+    *idNrE = 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        if (*opNrE == cap)
+        {
+            cap = cap ? cap * 2 : 0x1000;
+            ops = realloc(ops, cap * sizeof(*ops));
+        }
+        memset(&ops[*opNrE], 0, sizeof(*ops));
+        n = sscanf(line, " %c %u %u %u", &op, &ops[*opNrE].id, &ops[*opNrE].size, &ops[*opNrE].align);
+        if (n < 2 || (op == 'a' && n < 3) || (op == 'r' && n < 3) || (op != 'a' && op != 'r' && op != 'f'))
+            continue;
+
+        ops[*opNrE].op = op == 'a' ? OP_ALLOC : op == 'r' ? OP_REALLOC : OP_FREE;
+        if (ops[*opNrE].id >= *idNrE)
+            *idNrE = ops[*opNrE].id + 1;
+        (*opNrE)++;
+    }
+
+    fclose(f);
+    return ops;
+}
+
+static u32 SmallSize(u32 *seed)
+{
+    u32 r = Next(seed) % 100;
+
+    if (r < 70)
+        return 8 + Next(seed) % 120;
+    if (r < 95)
+        return 128 + Next(seed) % 1920;
+    return 4096 + Next(seed) % 0xF000;
+}
+
+// Synthetic trace: ids [0, live) are long lived, the rest churn
+static struct TraceOp *MakeTrace(u32 opNrE, u32 liveNrE, u32 seed, u32 *idNrE)
+{
+    struct TraceOp *ops = calloc(opNrE, sizeof(*ops));
+    u32 *state; // 0 = free, 1 = allocated
+    u32 *churn;
+    u32 churnNrE = 0;
+    u32 idCap = liveNrE * 4 + 64;
+    u32 i;
+    u32 k;
+    u32 r;
+
+    state = calloc(idCap, sizeof(*state));
+    churn = calloc(idCap, sizeof(*churn));
+    *idNrE = idCap;
+
+    for (i = 0; i < opNrE; i++)
+    {
+        r = Next(&seed) % 100;
+        if (i < liveNrE)
+        {
+            ops[i].op = OP_ALLOC;
+            ops[i].id = i;
+            ops[i].size = SmallSize(&seed);
+            state[i] = 1;
+        }
+        else if (r < 3)
+        {
+            // Resize a long lived block
+            ops[i].op = OP_REALLOC;
+            ops[i].id = Next(&seed) % liveNrE;
+            ops[i].size = SmallSize(&seed);
+        }
+        else if (churnNrE > 0 && (r < 50 || churnNrE + liveNrE >= idCap))
+        {
+            k = Next(&seed) % churnNrE;
+            ops[i].op = OP_FREE;
+            ops[i].id = churn[k];
+            state[churn[k]] = 0;
+            churn[k] = churn[--churnNrE];
+        }
+        else
+        {
+            for (k = liveNrE + Next(&seed) % (idCap - liveNrE); state[k] != 0; k = k + 1 < idCap ? k + 1 : liveNrE)
+                ;
+            ops[i].op = OP_ALLOC;
+            ops[i].id = k;
+            ops[i].size = SmallSize(&seed);
+            if (r > 95)
+                ops[i].align = 64 << (Next(&seed) % 3);
+            state[k] = 1;
+            churn[churnNrE++] = k;
+        }
+    }
+
+    free(state);
+    free(churn);
+    return ops;
+}
+
+static void Record(struct Replay *rp, u64 ns)
+{
+    u32 b = 0;
+
+    while ((ns >> b) > 1 && b < 63)
+        b++;
+    rp->hist[b]++;
+    rp->ns += ns;
+    if (ns > rp->maxNs)
+        rp->maxNs = ns;
+}
+
+static double Percentile(const struct Replay *rp, u32 total, double p)
+{
+    u32 want = (u32)(total * p);
+    u32 seen = 0;
+    u32 b;
+
+    for (b = 0; b < 64; b++)
+    {
+        seen += rp->hist[b];
+        if (seen > want)
+            return (double)(2ull << b);
+    }
+    return 0;
+}
+
+// Each block carries its id in its first and last word while it is allocated
+static void Tag(u8 *p, u32 size, u32 id)
+{
+    if (size >= 4)
+    {
+        memcpy(p, &id, 4);
+        memcpy(p + size - 4, &id, 4);
+    }
+}
+
+static s32 TagOk(const u8 *p, u32 size, u32 id)
+{
+    u32 a;
+    u32 b;
+
+    if (size < 4)
+        return 1;
+    memcpy(&a, p, 4);
+    memcpy(&b, p + size - 4, 4);
+    return a == id && b == id;
+}
+
+// With a TLSF pool, 'atEnd' gets its state before the blocks still live are freed
+static void ReplayTrace(const struct TraceOp *ops, u32 opNrE, u32 idNrE, struct XffTlsf *t, struct Replay *rp,
+                        struct XffTlsfStats *atEnd)
+{
+    void **ptr = calloc(idNrE, sizeof(*ptr));
+    u32 *size = calloc(idNrE, sizeof(*size));
+    void *p;
+    u64 t0;
+    u32 i;
+
+    memset(rp, 0, sizeof(*rp));
+    for (i = 0; i < opNrE; i++)
+    {
+        const struct TraceOp *op = &ops[i];
+
+        if (op->op != OP_ALLOC && ptr[op->id] != NULL && !TagOk(ptr[op->id], size[op->id], op->id))
+            rp->corrupt++;
+
+        t0 = NowNs();
+        switch (op->op)
+        {
+        case OP_ALLOC:
+            if (t != NULL)
+                p = op->align ? XffTlsfMemalign(t, op->align, op->size) : XffTlsfMalloc(t, op->size);
+            else
+                p = op->align ? aligned_alloc(op->align, (op->size + op->align - 1) & ~(op->align - 1)) : malloc(op->size);
+            break;
+        case OP_REALLOC:
+            p = t != NULL ? XffTlsfRealloc(t, ptr[op->id], op->size) : realloc(ptr[op->id], op->size);
+            break;
+        default:
+            if (t != NULL)
+                XffTlsfFree(t, ptr[op->id]);
+            else
+                free(ptr[op->id]);
+            p = NULL;
+            break;
+        }
+        Record(rp, NowNs() - t0);
+
+        if (op->op == OP_FREE)
+        {
+            ptr[op->id] = NULL;
+            continue;
+        }
+        if (p == NULL)
+        {
+            rp->failed++;
+            continue;
+        }
+        if (op->align != 0 && ((size_t)p & (op->align - 1)) != 0)
+            rp->corrupt++;
+        if (op->op == OP_REALLOC && ptr[op->id] != NULL && op->size >= 4 && size[op->id] >= 4)
+        {
+            u32 first;
+
+            memcpy(&first, p, 4);
+            rp->corrupt += first != op->id;
+        }
+        if (op->op == OP_ALLOC && ptr[op->id] != NULL)
+        {
+            // The trace reuses a live id: drop the old block
+            if (t != NULL)
+                XffTlsfFree(t, ptr[op->id]);
+            else
+                free(ptr[op->id]);
+        }
+        ptr[op->id] = p;
+        size[op->id] = op->size;
+        Tag(p, op->size, op->id);
+    }
+
+    if (t != NULL)
+        XffTlsfStats(t, atEnd);
+
+    for (i = 0; i < idNrE; i++)
+    {
+        if (ptr[i] == NULL)
+            continue;
+        if (t != NULL)
+            XffTlsfFree(t, ptr[i]);
+        else
+            free(ptr[i]);
+    }
+    free(ptr);
+    free(size);
+}
+
+int main(int argc, char **argv)
+{
+    struct XffTlsfStats end;
+    struct XffTlsfStats st;
+    struct Replay rp[2];
+    struct TraceOp *ops;
+    struct XffTlsf *t;
+    const char *outPath = NULL;
+    void *mem;
+    u32 poolSize = 0x01000000;
+    u32 opNrE = 1000000;
+    u32 liveNrE = 2000;
+    u32 seed = 1;
+    u32 idNrE;
+    u32 i;
+    s32 opt;
+    s32 ret = 0;
+    FILE *f;
+
+    while ((opt = getopt(argc, argv, "s:n:l:r:w:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            poolSize = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            opNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            liveNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            outPath = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s poolSize] [-n ops] [-l live] [-r seed] [-w trace.out] [trace]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind < argc)
+    {
+        ops = ReadTrace(argv[optind], &opNrE, &idNrE);
+        if (ops == NULL)
+        {
+            fprintf(stderr, "xfftlsfbench: can't read %s\n", argv[optind]);
+            return 1;
+        }
+    }
+    else
+    {
+        if (liveNrE == 0 || liveNrE >= opNrE)
+        {
+            fprintf(stderr, "xfftlsfbench: need 0 < live < ops\n");
+            return 1;
+        }
+        ops = MakeTrace(opNrE, liveNrE, seed, &idNrE);
+    }
+
+    if (outPath != NULL)
+    {
+        f = fopen(outPath, "w");
+        if (f == NULL)
+        {
+            fprintf(stderr, "xfftlsfbench: can't write %s\n", outPath);
+            return 1;
+        }
+        for (i = 0; i < opNrE; i++)
+        {
+            if (ops[i].op == OP_FREE)
+                fprintf(f, "f %u\n", ops[i].id);
+            else if (ops[i].op == OP_REALLOC)
+                fprintf(f, "r %u %u\n", ops[i].id, ops[i].size);
+            else if (ops[i].align != 0)
+                fprintf(f, "a %u %u %u\n", ops[i].id, ops[i].size, ops[i].align);
+            else
+                fprintf(f, "a %u %u\n", ops[i].id, ops[i].size);
+        }
+        fclose(f);
+    }
+
+    // Touched up front so page faults don't land in the timings; EE memory is all there
+    mem = aligned_alloc(16, (poolSize + 15) & ~15);
+    if (mem != NULL)
+        memset(mem, 0, poolSize);
+    t = mem != NULL ? XffTlsfCreate(mem, poolSize) : NULL;
+    if (t == NULL)
+    {
+        fprintf(stderr, "xfftlsfbench: can't create a pool of %u bytes\n", poolSize);
+        return 1;
+    }
+
+    ReplayTrace(ops, opNrE, idNrE, t, &rp[0], &end);
+    ReplayTrace(ops, opNrE, idNrE, NULL, &rp[1], NULL);
+    XffTlsfStats(t, &st);
+
+    printf("%u requests, TLSF pool %u bytes\n", opNrE, poolSize);
+    printf("                 mean ns   p99 ns   worst ns   failed\n");
+    printf("  tlsf         %9.1f %8.0f %10.0f %8u\n", rp[0].ns / opNrE, Percentile(&rp[0], opNrE, 0.99), rp[0].maxNs, rp[0].failed);
+    printf("  host malloc  %9.1f %8.0f %10.0f %8u\n", rp[1].ns / opNrE, Percentile(&rp[1], opNrE, 0.99), rp[1].maxNs, rp[1].failed);
+    printf("tlsf at the end: %u bytes used in %u blocks (peak %u), %u free in %u blocks, largest %u (%.1f%% fragmented)\n", end.used,
+           end.usedBlocks, end.peak, end.free, end.freeBlocks, end.largestFree,
+           end.free ? (end.free - end.largestFree) * 100.0 / end.free : 0.0);
+
+    if (XffTlsfCheck(t) != XFF_OK || st.used != 0 || st.freeBlocks != 1 || rp[0].corrupt != 0 || rp[1].corrupt != 0)
+    {
+        fprintf(stderr, "xfftlsfbench: heap inconsistent after the replay (%u/%u corrupt blocks)\n", rp[0].corrupt, rp[1].corrupt);
+        ret = 1;
+    }
+
+    free(mem);
+    free(ops);
+    return ret;
+}
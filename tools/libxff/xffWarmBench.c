@@ -0,0 +1,213 @@
+/*
+xffwarmbench: reset-to-entry latency, cold reload against warm snapshot restore.
+
+Usage: xffwarmbench [-n resets] [-c corruptEvery] [-s reserve] STARTUP.XFF [file.xff...]
+
+The files are a boot sequence, STARTUP.XFF first. A cold reset does what loaderLoop()
+does after a soft reset: reset the heap, read every file again and relocate it. A warm
+reset restores the snapshot taken after the first cold load and falls back to a cold
+load (taking a new snapshot) when the snapshot doesn't check out. Between resets the
+program "runs": it writes over random words of its data and of the free heap. Every
+'corruptEvery'-th warm reset (default 8, 0 = never) a byte of the reserved block is
+flipped first to exercise the fallback. After every reset the heap must equal the one
+of the first load and the entry point must be the same.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libxff.h"
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static u32 Next(u32 *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+static u32 EntryPoint(const struct XffLoader *ldr)
+{
+    const struct XffModule *mod;
+
+    for (mod = ldr->modules; mod != NULL && mod->next != NULL; mod = mod->next)
+        ;
+    return mod != NULL ? mod->xffEp->entryPnt : 0;
+}
+
+static s32 ColdBoot(struct XffLoader *ldr, char **paths, s32 pathNrE, u32 *entryOut)
+{
+    s32 i;
+
+    XffLoaderReset(ldr);
+    for (i = 0; i < pathNrE; i++)
+    {
+        if (XffLoadFile(ldr, paths[i], NULL) != XFF_OK)
+        {
+            fprintf(stderr, "xffwarmbench: %s: load failed\n", paths[i]);
+            return XFF_ERR_IO;
+        }
+    }
+    *entryOut = EntryPoint(ldr);
+    return XFF_OK;
+}
+
+// Returns 1 for a warm reset, 0 for a cold one
+static s32 WarmBoot(struct XffLoader *ldr, struct XffSnapshot *snap, char **paths, s32 pathNrE, u32 *entryOut)
+{
+    if (XffSnapshotRestore(ldr, snap, entryOut) == XFF_OK)
+        return 1;
+
+    if (ColdBoot(ldr, paths, pathNrE, entryOut) != XFF_OK)
+        exit(1);
+    if (XffSnapshotTake(ldr, snap) != XFF_OK)
+        fprintf(stderr, "xffwarmbench: snapshot doesn't fit the reserved block\n");
+    return 0;
+}
+
+// The program runs: data, bss and the free heap get written
+static void Run(struct XffLoader *ldr, u32 *seed)
+{
+    u32 span = ldr->arena.heapPt - ldr->arena.base + 0x10000;
+    u32 i;
+
+    if (span > ldr->arena.size)
+        span = ldr->arena.size;
+    for (i = 0; i < 256; i++)
+        ((u32 *)ldr->arena.host)[Next(seed) % (span / 4)] = Next(seed);
+    if (ldr->arena.heapPt + 0x10000 > ldr->arena.zeroPt)
+        ldr->arena.zeroPt = ldr->arena.heapPt + 0x10000;
+}
+
+int main(int argc, char **argv)
+{
+    struct XffLoader ldr;
+    struct XffSnapshot snap;
+    char **paths;
+    u8 *pristine;
+    u32 pristineSize;
+    u32 reserve = 0x01000000;
+    u32 corruptEvery = 8;
+    u32 resetNrE = 50;
+    u32 seed = 1;
+    u32 entry0;
+    u32 entry;
+    u32 bad = 0;
+    u32 warm = 0;
+    u32 fallbacks = 0;
+    u32 i;
+    s32 pathNrE;
+    s32 opt;
+    double coldSum = 0;
+    double coldMin = 1e9;
+    double warmSum = 0;
+    double warmMin = 1e9;
+    double t;
+
+    while ((opt = getopt(argc, argv, "n:c:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            resetNrE = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            corruptEvery = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            reserve = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+
+    if (optind >= argc || resetNrE == 0)
+    {
+        fprintf(stderr, "usage: %s [-n resets] [-c corruptEvery] [-s reserve] STARTUP.XFF [file.xff...]\n", argv[0]);
+        return 1;
+    }
+    paths = argv + optind;
+    pathNrE = argc - optind;
+
+    if (XffLoaderInit(&ldr, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK || XffSnapshotInit(&snap, reserve) != XFF_OK)
+    {
+        fprintf(stderr, "xffwarmbench: out of memory\n");
+        return 1;
+    }
+
+    // First boot, the reference heap
+    if (ColdBoot(&ldr, paths, pathNrE, &entry0) != XFF_OK)
+        return 1;
+    pristineSize = ldr.arena.heapPt - ldr.arena.base;
+    pristine = malloc(pristineSize);
+    memcpy(pristine, ldr.arena.host, pristineSize);
+    if (XffSnapshotTake(&ldr, &snap) != XFF_OK)
+    {
+        fprintf(stderr, "xffwarmbench: heap of %u bytes doesn't fit a %u byte reserve\n", pristineSize, reserve);
+        return 1;
+    }
+
+    for (i = 0; i < resetNrE; i++)
+    {
+        Run(&ldr, &seed);
+        t = NowSec();
+        if (ColdBoot(&ldr, paths, pathNrE, &entry) != XFF_OK)
+            return 1;
+        t = NowSec() - t;
+        coldSum += t;
+        coldMin = t < coldMin ? t : coldMin;
+        bad += entry != entry0 || ldr.arena.heapPt - ldr.arena.base != pristineSize || memcmp(ldr.arena.host, pristine, pristineSize) != 0;
+    }
+
+    for (i = 0; i < resetNrE; i++)
+    {
+        Run(&ldr, &seed);
+        if (corruptEvery != 0 && i % corruptEvery == corruptEvery - 1)
+            ((u8 *)snap.data)[Next(&seed) % snap.used] ^= 0x40;
+
+        t = NowSec();
+        if (WarmBoot(&ldr, &snap, paths, pathNrE, &entry))
+        {
+            t = NowSec() - t;
+            warm++;
+            warmSum += t;
+            warmMin = t < warmMin ? t : warmMin;
+        }
+        else
+        {
+            fallbacks++;
+        }
+        bad += entry != entry0 || ldr.arena.heapPt - ldr.arena.base != pristineSize || memcmp(ldr.arena.host, pristine, pristineSize) != 0;
+    }
+
+    printf("boot sequence   : %d files, heap %u bytes, entry 0x%08X\n", pathNrE, pristineSize, entry0);
+    printf("cold reset      : %8.3f ms mean %8.3f ms min (%u resets)\n", coldSum * 1e3 / resetNrE, coldMin * 1e3, resetNrE);
+    if (warm != 0)
+    {
+        printf("warm reset      : %8.3f ms mean %8.3f ms min (%u resets, %.1fx)\n", warmSum * 1e3 / warm, warmMin * 1e3, warm,
+               (coldSum / resetNrE) / (warmSum / warm));
+    }
+    printf("fallbacks       : %u checksum mismatches, loaded cold\n", fallbacks);
+
+    XffSnapshotTerm(&snap);
+    XffLoaderTerm(&ldr);
+    free(pristine);
+
+    if (bad != 0)
+    {
+        fprintf(stderr, "xffwarmbench: %u resets didn't give the first boot's heap\n", bad);
+        return 1;
+    }
+    return 0;
+}
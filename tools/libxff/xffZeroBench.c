@@ -0,0 +1,166 @@
+/*
+xffzerobench: cost of clearing nobits sections.
+
+Usage: xffzerobench [-n iterations] file.xff...
+
+First XffBulkZero() is timed against memset() over a range of block sizes. Then the
+files are loaded in order into a fresh arena (cold boot) and again after a reset (warm
+reboot), once clearing every nobits section and once with XffLoader.lazyZero, and the
+bytes each way had to clear are reported. Lazy and eager loads must give the same heap.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libxff.h"
+
+struct BenchFile
+{
+    const char *path;
+    void *data;
+    u32 size;
+};
+
+static double NowSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double TimeClear(u8 *buf, u32 size, s32 iterations, s32 bulk)
+{
+    double t0 = NowSec();
+    s32 i;
+
+    for (i = 0; i < iterations; i++)
+    {
+        buf[i & 0xF] = (u8)i; // keep the stores from being folded away
+        if (bulk)
+            XffBulkZero(buf, size);
+        else
+            memset(buf, 0, size);
+        __asm__ volatile("" : : "r"(buf) : "memory");
+    }
+    return NowSec() - t0;
+}
+
+static s32 LoadAll(struct XffLoader *ldr, struct BenchFile *files, s32 fileNrE)
+{
+    s32 i;
+
+    for (i = 0; i < fileNrE; i++)
+    {
+        if (XffLoadImage(ldr, files[i].path, files[i].data, files[i].size, NULL) != XFF_OK)
+        {
+            fprintf(stderr, "xffzerobench: %s: load failed\n", files[i].path);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    static const u32 sizes[] = {0x100, 0x1000, 0x10000, 0x100000};
+    struct XffLoader eager;
+    struct XffLoader lazy;
+    struct BenchFile *files;
+    s32 iterations = 20;
+    s32 fileNrE;
+    s32 opt;
+    s32 boot;
+    s32 reps;
+    s32 i;
+    u8 *buf;
+    u64 eagerZeroed;
+    u64 lazyZeroed;
+    double memsetSec;
+    double bulkSec;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            iterations = strtol(optarg, NULL, 0);
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+
+    fileNrE = argc - optind;
+    if (fileNrE <= 0 || iterations <= 0)
+    {
+        fprintf(stderr, "usage: %s [-n iterations] file.xff...\n", argv[0]);
+        return 1;
+    }
+
+    buf = aligned_alloc(0x40, sizes[sizeof(sizes) / sizeof(sizes[0]) - 1] + 0x40);
+    printf("block      memset        XffBulkZero\n");
+    for (i = 0; i < (s32)(sizeof(sizes) / sizeof(sizes[0])); i++)
+    {
+        reps = iterations * (0x4000000 / sizes[i]);
+        memsetSec = TimeClear(buf, sizes[i], reps, 0);
+        bulkSec = TimeClear(buf, sizes[i], reps, 1);
+        printf("%8x   %7.2f GB/s   %7.2f GB/s\n", sizes[i], (double)sizes[i] * reps / memsetSec * 1e-9,
+               (double)sizes[i] * reps / bulkSec * 1e-9);
+    }
+    free(buf);
+
+    files = calloc(fileNrE, sizeof(*files));
+    for (i = 0; i < fileNrE; i++)
+    {
+        files[i].path = argv[optind + i];
+        files[i].data = XffMapFile(files[i].path, &files[i].size);
+        if (files[i].data == NULL)
+        {
+            fprintf(stderr, "xffzerobench: can't map %s\n", files[i].path);
+            return 1;
+        }
+    }
+
+    if (XffLoaderInit(&eager, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK ||
+        XffLoaderInit(&lazy, XFF_ARENA_DEFAULT_BASE, XFF_ARENA_DEFAULT_SIZE) != XFF_OK)
+    {
+        fprintf(stderr, "xffzerobench: can't create arena\n");
+        return 1;
+    }
+    lazy.lazyZero = 1;
+
+    printf("                 eager       lazy   (bytes zeroed)\n");
+    for (boot = 0; boot < 2; boot++)
+    {
+        XffLoaderReset(&eager);
+        XffLoaderReset(&lazy);
+        eagerZeroed = eager.stats.bytesZeroed;
+        lazyZeroed = lazy.stats.bytesZeroed;
+        if (!LoadAll(&eager, files, fileNrE) || !LoadAll(&lazy, files, fileNrE))
+            return 1;
+
+        printf("%-12s %10llu %10llu\n", boot == 0 ? "cold boot" : "warm reboot", (unsigned long long)(eager.stats.bytesZeroed - eagerZeroed),
+               (unsigned long long)(lazy.stats.bytesZeroed - lazyZeroed));
+
+        if (eager.arena.heapPt != lazy.arena.heapPt ||
+            memcmp(eager.arena.host, lazy.arena.host, eager.arena.heapPt - eager.arena.base) != 0)
+        {
+            fprintf(stderr, "xffzerobench: lazy and eager heaps differ\n");
+            return 1;
+        }
+    }
+
+    XffLoaderTerm(&eager);
+    XffLoaderTerm(&lazy);
+    for (i = 0; i < fileNrE; i++)
+    {
+        XffUnmapFile(files[i].data, files[i].size);
+    }
+    free(files);
+    return 0;
+}